@@ -1,3 +1,4 @@
 CALL buildoniguruma.bat
 CALL buildzlib.bat
+CALL buildzstd.bat
 CALL buildopenssl.bat
@@ -0,0 +1,16 @@
+cd zstd\lib
+
+if exist zstdd.lib goto build_release
+del *.obj
+cl /nologo /c /MTd /Od /Z7 /DZSTD_DISABLE_ASM /DXXH_NAMESPACE=ZSTD_ common\*.c compress\*.c decompress\*.c
+lib /nologo /out:zstdd.lib *.obj
+
+:build_release
+if exist zstd.lib goto end
+del *.obj
+cl /nologo /c /MT /O2 /DZSTD_DISABLE_ASM /DXXH_NAMESPACE=ZSTD_ common\*.c compress\*.c decompress\*.c
+lib /nologo /out:zstd.lib *.obj
+
+:end
+del *.obj
+cd ..\..
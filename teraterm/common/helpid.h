@@ -307,6 +307,7 @@
 #define HlpMacroCommandSetsync          92084
 #define HlpMacroCommandSettime          92085
 #define HlpMacroCommandSettitle         92086
+#define HlpMacroCommandSftpcmd          92215
 #define HlpMacroCommandShow             92087
 #define HlpMacroCommandShowtt           92088
 #define HlpMacroCommandSprintf          92117
@@ -345,6 +346,7 @@
 #define HlpMacroCommandWhile            92104
 #define HlpMacroCommandXmodemrecv       92105
 #define HlpMacroCommandXmodemsend       92106
+#define HlpMacroCommandXferqueue        92216
 #define HlpMacroCommandYesnobox         92107
 #define HlpMacroCommandYmodemrecv       92176
 #define HlpMacroCommandYmodemsend       92177
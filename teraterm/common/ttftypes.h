@@ -86,6 +86,7 @@ typedef struct {
   BOOL FileOpen;
   int FileHandle;
   LONG FileSize, ByteCount;
+  LONG PktNum; // packet number shown in the protocol dialog
   BOOL OverWrite;
 
   BOOL LogFlag;
@@ -115,6 +116,36 @@ typedef struct {
   DWORD LogThreadId;
 
   DWORD FileMtime;
+
+  // batch send: the next file is opened and pre-read on a worker thread
+  HANDLE PrefetchThread;
+  char PrefetchName[MAX_PATH];
+  int PrefetchHandle;
+  LONG PrefetchSize;
+  DWORD PrefetchMtime;
+  int PrefetchListPtr;
+  PCHAR PrefetchList;   // the worker's own copy of the rest of the file list
+  LONG PrefetchListSize;
+
+  // batch send: aggregated progress
+  LONG BatchTotalSize;
+  LONG BatchDoneSize;
+  int BatchPercent;
+
+  // transfer statistics, written to the protocol log at the end
+  DWORD StatStartTime;
+  LONGLONG StatBytes, StatResentBytes;
+  LONG StatLastCount, StatFileMax;
+  DWORD StatFileStart;
+  int StatTimeOuts;
+  LONGLONG StatEngineTime;
+
+  // receive: file preallocated to the announced size
+  LONG PreallocSize;
+  LONGLONG PreallocTime, WriteTime;
+  LONGLONG WriteBytes, HoleBytes;
+  int Sparse;                 // 0: not tried, 1: sparse, -1: not supported
+  LONG HoleStart, HoleLen;    // zero range not yet released
 } TFileVar;
 typedef TFileVar far *PFileVar;
 
@@ -16,6 +16,11 @@
 #define IdPrnProcTimer       9
 #define IdCancelConnectTimer 10  // add (2007.1.10 yutaka)
 #define IdPasteDelayTimer    11
+#define IdProtoDlgTimer      12
+#define IdFileSendTimer      13
+
+  /* Interval (ms) at which the protocol dialog polls the transfer progress */
+#define ProtoDlgRefreshInterval 250
 
   /* Window Id */
 #define IdVT  1
@@ -148,6 +153,7 @@ typedef TCharAttr *PCharAttr;
 #define WM_USER_KEYCODE      WM_USER+12
 #define WM_USER_GETSERIALNO  WM_USER+13
 #define WM_USER_CHANGETITLE  WM_USER+14
+#define WM_USER_XFERQUEUE    WM_USER+15
 
 #define WM_USER_DDEREADY     WM_USER+21
 #define WM_USER_DDECMNDEND   WM_USER+22
@@ -585,6 +591,8 @@ struct tttset {
 	WORD AcceleratorNewConnection;
 	WORD AcceleratorCygwinConnection;
 	int SendBreakTime;
+	int FileSendBytesPerSec;
+	int FileSendLinesPerSec;
 };
 
 typedef struct tttset TTTSet, *PTTSet;
@@ -1048,6 +1056,10 @@ typedef TMap far *PMap;
  * Increment the number of this macro value
  * when you change TMap or member of TMap.
  *
+ * - At version 4.86, ttset_memfilemap was replaced with ttset_memfilemap_26.
+ *   added tttset.FileSendBytesPerSec
+ *   added tttset.FileSendLinesPerSec
+ *
  * - At version 4.85, ttset_memfilemap was replaced with ttset_memfilemap_25.
  *   added tttset.AcceleratorNewConnection
  *   added tttset.AcceleratorCygwinConnection
@@ -1195,4 +1207,4 @@ typedef TMap far *PMap;
  *   added tttset.VTCompatTab.
  */
 
-#define TT_FILEMAPNAME "ttset_memfilemap_25"
+#define TT_FILEMAPNAME "ttset_memfilemap_26"
@@ -41,11 +41,16 @@ static BYTE LogLast = 0;
 BOOL FileLog = FALSE;
 BOOL BinLog = FALSE;
 BOOL DDELog = FALSE;
-static BOOL FileRetrySend, FileRetryEcho, FileCRSend, FileReadEOF, BinaryMode;
-static BYTE FileByte;
+static BOOL FileCRSend, FileReadEOF, BinaryMode;
+
+#define FileSendBufSize 8192
+#define FileSendPaceTick 50
+static BYTE FileSendBuf[FileSendBufSize];
+static int FileSendBufLen, FileSendBufPtr, FileEchoPtr;
+static DWORD FilePaceTime;
+static LONG FilePaceBytes, FilePaceLines;
 
 static int FileBracketMode = FS_BRACKET_NONE;
-static int FileBracketPtr = 0;
 static char BracketStartStr[] = "\033[200~";
 static char BracketEndStr[] = "\033[201~";
 
@@ -96,6 +101,18 @@ enum enumLineEnd eLineEnd = Line_LineHead;
 #define WM_DPC_LOGTHREAD_SEND (WM_APP + 1)
 
 static void CloseFileSync(PFileVar ptr);
+static void ClosePrefetch(PFileVar ptr);
+
+// ]L[ (}N xferqueue o^ꂽ ZMODEM/YMODEM M)
+#define XFER_QUEUE_MAX 64
+typedef struct {
+	int Mode;                 // IdZSend or IdYSend
+	char FileName[MAX_PATH];
+	int Binary;
+} TXferJob;
+static TXferJob XferQueue[XFER_QUEUE_MAX];
+static int XferQueueLen = 0;
+static BOOL XferQueueJob = FALSE;  // s̓]̓L[N̂
 
 
 BOOL LoadTTFILE()
@@ -305,6 +322,7 @@ void FreeFileVar(PFileVar *fv)
 	if ((*fv)!=NULL)
 	{
 		CloseFileSync(*fv);
+		ClosePrefetch(*fv);
 		//if ((*fv)->FileOpen) _lclose((*fv)->FileHandle);
 		if ((*fv)->FnStrMemHandle>0)
 		{
@@ -378,6 +396,23 @@ void FixLogOption()
 }
 
 
+// ob`M̐ǂ݃Xbh̏I҂ƁAǂ݂t@C̃N[Y
+// Xbh TTPFILE.DLL œ߁ADLL ̉OɌĂԂƁB
+static void ClosePrefetch(PFileVar ptr)
+{
+	if (ptr->PrefetchThread != NULL) {
+		WaitForSingleObject(ptr->PrefetchThread, INFINITE);
+		CloseHandle(ptr->PrefetchThread);
+		ptr->PrefetchThread = NULL;
+	}
+	free(ptr->PrefetchList);
+	ptr->PrefetchList = NULL;
+	if (ptr->PrefetchHandle > 0) {
+		_lclose(ptr->PrefetchHandle);
+		ptr->PrefetchHandle = 0;
+	}
+}
+
 // Xbh̏Iƃt@C̃N[Y
 static void CloseFileSync(PFileVar ptr)
 {
@@ -391,6 +426,12 @@ static void CloseFileSync(PFileVar ptr)
 		CloseHandle(ptr->LogThread);
 		ptr->LogThread = (HANDLE)-1;
 	}
+	// M̒fɁAOmۂ̈悪cȂ悤ɂ
+	// (ʏ TTPFILE  FTFinishRecvFile() ŏς݁B͎肱ڂpŁA
+	//  TTPFILE ͉ς݂̂ߌ̉͂łȂ)
+	if (ptr->PreallocSize > 0) {
+		SetEndOfFile((HANDLE)ptr->FileHandle);
+	}
 #ifdef FileVarWin16
 	_lclose(ptr->FileHandle);
 #else
@@ -1124,14 +1165,17 @@ void FileSendStart()
 	SendVar->FileSize = GetFSize(SendVar->FullName);
 
 	TalkStatus = IdTalkFile;
-	FileRetrySend = FALSE;
-	FileRetryEcho = FALSE;
 	FileCRSend = FALSE;
 	FileReadEOF = FALSE;
+	FileSendBufLen = 0;
+	FileSendBufPtr = 0;
+	FileEchoPtr = 0;
+	FilePaceTime = GetTickCount();
+	FilePaceBytes = 0;
+	FilePaceLines = 0;
 
 	if (BracketedPasteMode()) {
 		FileBracketMode = FS_BRACKET_START;
-		FileBracketPtr = 0;
 		BinaryMode = TRUE;
 	}
 	else {
@@ -1181,129 +1225,193 @@ void FileTransEnd(WORD OpId)
 	EndDdeCmnd(0);
 }
 
-int FSOut1(BYTE b)
+static int FSOut(PCHAR B, int C)
 {
 	if (BinaryMode)
-		return CommBinaryOut(&cv,(PCHAR)&b,1);
-	else if ((b>=0x20) || (b==0x09) || (b==0x0A) || (b==0x0D))
-		return CommTextOut(&cv,(PCHAR)&b,1);
+		return CommBinaryOut(&cv,B,C);
 	else
-		return 1;
+		return CommTextOut(&cv,B,C);
 }
 
-int FSEcho1(BYTE b)
+static int FSEcho(PCHAR B, int C)
 {
 	if (BinaryMode)
-		return CommBinaryEcho(&cv,(PCHAR)&b,1);
+		return CommBinaryEcho(&cv,B,C);
 	else
-		return CommTextEcho(&cv,(PCHAR)&b,1);
+		return CommTextEcho(&cv,B,C);
 }
 
-extern "C" {
-void FileSend()
+/* Refill FileSendBuf with the next block to be sent: the bracketed paste
+   start/end sequence or a chunk of the file. In text mode, control
+   characters other than TAB/LF/CR and LF following CR are dropped here.
+   Returns FALSE when there is nothing left to send. */
+static BOOL FileSendFill()
 {
-	WORD c, fc;
-	LONG BCOld;
 	DWORD read_bytes;
+	int i, j;
+	BYTE b;
 
-	if ((SendDlg==NULL) ||
-	    ((cv.FilePause & OpSendFile) !=0))
-		return;
-
-	BCOld = SendVar->ByteCount;
+	FileSendBufLen = 0;
+	FileSendBufPtr = 0;
+	FileEchoPtr = 0;
 
-	if (FileRetrySend)
-	{
-		FileRetryEcho = (ts.LocalEcho>0);
-		c = FSOut1(FileByte);
-		FileRetrySend = (c==0);
-		if (FileRetrySend)
-			return;
-	}
-
-	if (FileRetryEcho)
-	{
-		c = FSEcho1(FileByte);
-		FileRetryEcho = (c==0);
-		if (FileRetryEcho)
-			return;
+	if (FileBracketMode == FS_BRACKET_START) {
+		FileSendBufLen = sizeof(BracketStartStr) - 1;
+		memcpy(FileSendBuf, BracketStartStr, FileSendBufLen);
+		BinaryMode = TRUE;
+		FileBracketMode = FS_BRACKET_END;
+		return TRUE;
 	}
 
-	do {
-		if (FileBracketMode == FS_BRACKET_START) {
-			FileByte = BracketStartStr[FileBracketPtr++];
-			fc = 1;
-
-			if (FileBracketPtr >= sizeof(BracketStartStr) - 1) {
-				FileBracketMode = FS_BRACKET_END;
-				FileBracketPtr = 0;
-				BinaryMode = ts.TransBin;
-			}
-		}
-		else if (! FileReadEOF) {
+	while (! FileReadEOF) {
 #ifdef FileVarWin16
-			fc = _lread(SendVar->FileHandle,&FileByte,1);
+		read_bytes = _lread(SendVar->FileHandle,FileSendBuf,FileSendBufSize);
+		if (read_bytes == HFILE_ERROR)
+			read_bytes = 0;
 #else
-			ReadFile((HANDLE)SendVar->FileHandle, &FileByte, 1, &read_bytes, NULL);
-			fc = LOWORD(read_bytes);
+		if (! ReadFile((HANDLE)SendVar->FileHandle, FileSendBuf, FileSendBufSize, &read_bytes, NULL))
+			read_bytes = 0;
 #endif
-			SendVar->ByteCount = SendVar->ByteCount + fc;
+		if (read_bytes == 0) {
+			FileReadEOF = TRUE;
+			break;
+		}
+		SendVar->ByteCount = SendVar->ByteCount + read_bytes;
+		BinaryMode = ts.TransBin;
 
-			if (FileCRSend && (fc==1) && (FileByte==0x0A)) {
-#ifdef FileVarWin16
-				fc = _lread(SendVar->FileHandle,&FileByte,1);
-#else
-				ReadFile((HANDLE)SendVar->FileHandle, &FileByte, 1, &read_bytes, NULL);
-				fc = LOWORD(read_bytes);
-#endif
-				SendVar->ByteCount = SendVar->ByteCount + fc;
-			}
+		if (BinaryMode) {
+			FileSendBufLen = read_bytes;
 		}
 		else {
-			fc = 0;
+			for (i = 0, j = 0; i < (int)read_bytes; i++) {
+				b = FileSendBuf[i];
+				if (FileCRSend && (b==0x0A)) {
+					FileCRSend = FALSE;
+					continue;
+				}
+				FileCRSend = (b==0x0D);
+				if ((b>=0x20) || (b==0x09) || (b==0x0A) || (b==0x0D))
+					FileSendBuf[j++] = b;
+			}
+			FileSendBufLen = j;
 		}
+		if (FileSendBufLen > 0)
+			return TRUE;
+	}
 
-		if (fc == 0 && FileBracketMode == FS_BRACKET_END) {
-			FileReadEOF = TRUE;
-			FileByte = BracketEndStr[FileBracketPtr++];
-			fc = 1;
-			BinaryMode = TRUE;
+	if (FileBracketMode == FS_BRACKET_END) {
+		FileSendBufLen = sizeof(BracketEndStr) - 1;
+		memcpy(FileSendBuf, BracketEndStr, FileSendBufLen);
+		BinaryMode = TRUE;
+		FileBracketMode = FS_BRACKET_NONE;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static BOOL FileIsEOL(BYTE b)
+{
+	/* in text mode LF after CR has already been dropped */
+	return (b==0x0A) || (! BinaryMode && (b==0x0D));
+}
+
+/* Number of the C bytes at B that may go out now without exceeding
+   FileSendBytesPerSec / FileSendLinesPerSec. If nothing may be sent,
+   IdFileSendTimer is set so that FileSend is called again. */
+static int FileSendPace(PCHAR B, int C)
+{
+	DWORD now, elapsed;
+	LONG allow;
+	int i;
+
+	if ((ts.FileSendBytesPerSec <= 0) && (ts.FileSendLinesPerSec <= 0))
+		return C;
+
+	now = GetTickCount();
+	elapsed = now - FilePaceTime;
+	if (elapsed >= 1000) {
+		FilePaceTime = now;
+		FilePaceBytes = 0;
+		FilePaceLines = 0;
+		elapsed = 0;
+	}
+	elapsed += FileSendPaceTick;
 
-			if (FileBracketPtr >= sizeof(BracketEndStr) - 1) {
-				FileBracketMode = FS_BRACKET_NONE;
-				FileBracketPtr = 0;
+	if (ts.FileSendBytesPerSec > 0) {
+		allow = MulDiv(ts.FileSendBytesPerSec, elapsed, 1000) - FilePaceBytes;
+		if (allow < C)
+			C = max(allow, 0);
+	}
+
+	if ((ts.FileSendLinesPerSec > 0) && (C > 0)) {
+		allow = MulDiv(ts.FileSendLinesPerSec, elapsed, 1000) - FilePaceLines;
+		if (allow <= 0) {
+			C = 0;
+		}
+		else {
+			for (i = 0; i < C; i++) {
+				if (FileIsEOL(B[i]) && (--allow == 0)) {
+					C = i + 1;
+					break;
+				}
 			}
 		}
+	}
 
+	if (C == 0)
+		SetTimer(HVTWin, IdFileSendTimer, FileSendPaceTick, NULL);
 
-		if (fc!=0)
-		{
-			c = FSOut1(FileByte);
-			FileCRSend = (ts.TransBin==0) && (FileByte==0x0D);
-			FileRetrySend = (c==0);
-			if (FileRetrySend)
-			{
-				if (SendVar->ByteCount != BCOld)
-					SendDlg->RefreshNum();
+	return C;
+}
+
+extern "C" {
+void FileSend()
+{
+	int c, len, i;
+
+	if ((SendDlg==NULL) ||
+	    ((cv.FilePause & OpSendFile) !=0))
+		return;
+
+	for (;;) {
+		if (FileEchoPtr < FileSendBufPtr) {
+			c = FSEcho((PCHAR)&FileSendBuf[FileEchoPtr], FileSendBufPtr - FileEchoPtr);
+			FileEchoPtr += c;
+			if (FileEchoPtr < FileSendBufPtr)
+				break;
+		}
+
+		if (FileSendBufPtr >= FileSendBufLen) {
+			if (! FileSendFill()) {
+				SendDlg->RefreshNum();
+				FileTransEnd(OpSendFile);
 				return;
 			}
-			if (ts.LocalEcho>0)
-			{
-				c = FSEcho1(FileByte);
-				FileRetryEcho = (c==0);
-				if (FileRetryEcho)
-					return;
-			}
 		}
-		if ((fc==0) || ((SendVar->ByteCount % 100 == 0) && (FileBracketPtr == 0))) {
-			SendDlg->RefreshNum();
-			BCOld = SendVar->ByteCount;
-			if (fc!=0)
-				return;
+
+		len = FileSendBufLen - FileSendBufPtr;
+		len = FileSendPace((PCHAR)&FileSendBuf[FileSendBufPtr], len);
+		if (len == 0)
+			break;
+
+		c = FSOut((PCHAR)&FileSendBuf[FileSendBufPtr], len);
+		FilePaceBytes += c;
+		if (ts.FileSendLinesPerSec > 0) {
+			for (i = FileSendBufPtr; i < FileSendBufPtr + c; i++) {
+				if (FileIsEOL(FileSendBuf[i]))
+					FilePaceLines++;
+			}
 		}
-	} while (fc!=0);
+		FileSendBufPtr += c;
+		if (ts.LocalEcho == 0)
+			FileEchoPtr = FileSendBufPtr;
 
-	FileTransEnd(OpSendFile);
+		if (c < len)
+			break;
+	}
+
+	SendDlg->RefreshNum();
 }
 }
 
@@ -1476,13 +1584,21 @@ void ProtoEnd()
 
 	CloseProtoDlg();
 
-	if ((FileVar!=NULL) && FileVar->Success)
+	// L[N]̓}N҂ĂȂ̂ŁAʒmȂB
+	if (XferQueueJob)
+		XferQueueJob = FALSE;
+	else if ((FileVar!=NULL) && FileVar->Success)
 		EndDdeCmnd(1);
 	else
 		EndDdeCmnd(0);
 
+	if (FileVar!=NULL)
+		ClosePrefetch(FileVar);
 	FreeTTFILE();
 	FreeFileVar(&FileVar);
+
+	if (XferQueueLen > 0)
+		PostMessage(HVTWin, WM_USER_XFERQUEUE, 0, 0);
 }
 
 extern "C" {
@@ -1672,17 +1788,14 @@ void YMODEMStart(int mode)
 }
 }
 
-extern "C" {
-void ZMODEMStart(int mode)
+// Opt ͑M̃oCiIvVBL[̃Wu̓WuƂ̒lnB
+static void ZMODEMStartOpt(int mode, WORD Opt)
 {
-	WORD Opt;
-
 	if (! ProtoStart())
 		return;
 
 	if (mode==IdZSend)
 	{
-		Opt = ts.XmodemBin;
 		FileVar->OpId = OpZSend;
 		if (strlen(&(FileVar->FullName[FileVar->DirLen]))==0)
 		{
@@ -1708,6 +1821,155 @@ void ZMODEMStart(int mode)
 	if (! OpenProtoDlg(FileVar,PROTO_ZM,mode,Opt,0))
 		ProtoEnd();
 }
+
+extern "C" {
+void ZMODEMStart(int mode)
+{
+	ZMODEMStartOpt(mode, ts.XmodemBin);
+}
+}
+
+// L[̐擪̃WuJnB]Ȃ牽Ȃ (ProtoEnd ēxĂ΂)B
+extern "C" {
+void XferQueueNext()
+{
+	TXferJob job;
+
+	while ((XferQueueLen > 0) && ! cv.ProtoFlag && (FileVar==NULL) && ! FSend)
+	{
+		job = XferQueue[0];
+		XferQueueLen--;
+		memmove(&XferQueue[0], &XferQueue[1], sizeof(TXferJob) * XferQueueLen);
+
+		if (! NewFileVar(&FileVar))
+			return;
+		FileVar->DirLen = 0;
+		strncpy_s(FileVar->FullName, sizeof(FileVar->FullName), job.FileName, _TRUNCATE);
+		FileVar->NumFname = 1;
+		FileVar->NoMsg = TRUE;
+		XferQueueJob = TRUE;
+		if (job.Mode==IdZSend) {
+			ZMODEMStartOpt(IdZSend, job.Binary);
+		}
+		else {
+			YMODEMStart(IdYSend);
+		}
+		if (cv.ProtoFlag)
+			return;
+
+		// JnłȂꍇ͎̃Wu
+		XferQueueJob = FALSE;
+		FreeFileVar(&FileVar);
+	}
+}
+}
+
+// 󔒋؂̃g[NoB"..." ň͂߂΋󔒂܂߂B
+static PCHAR XferQueueToken(PCHAR *p, PCHAR buf, int buflen)
+{
+	PCHAR s = *p;
+	int i = 0;
+	char quote = 0;
+
+	while ((*s==' ') || (*s=='\t'))
+		s++;
+	if (*s=='\0')
+		return NULL;
+	if (*s=='"')
+		quote = *s++;
+	while ((*s!='\0') &&
+	       (quote ? (*s!=quote) : ((*s!=' ') && (*s!='\t')))) {
+		if (i < buflen - 1)
+			buf[i++] = *s;
+		s++;
+	}
+	if (quote && (*s==quote))
+		s++;
+	buf[i] = '\0';
+	*p = s;
+	return buf;
+}
+
+// }N xferqueue ̃R}hB]̊͑҂ȂB
+//   zmodem <file> [<binary>]  L[̖ ZMODEM Mǉ
+//   ymodem <file>             L[̖ YMODEM Mǉ
+//   move <from> <to>          ҋ@̃WȕԂς (1 琔)
+//   cancel <n> | cancel all   ҋ@̃Wu
+//   cancel current            L[Ns̓]𒆎~
+//   count                     ҋ@̃WuԂ
+// count ȊO͐ 1As 0 ԂB
+extern "C" {
+int XferQueueCommand(PCHAR Cmd)
+{
+	char op[16], arg1[MAX_PATH], arg2[16];
+	PCHAR p = Cmd;
+	TXferJob job;
+	int from, to;
+
+	if (XferQueueToken(&p, op, sizeof(op))==NULL)
+		return 0;
+
+	if ((_stricmp(op, "zmodem")==0) || (_stricmp(op, "ymodem")==0)) {
+		if (XferQueueToken(&p, arg1, sizeof(arg1))==NULL)
+			return 0;
+		if (XferQueueLen >= XFER_QUEUE_MAX)
+			return 0;
+		memset(&job, 0, sizeof(job));
+		job.Mode = (_stricmp(op, "zmodem")==0) ? IdZSend : IdYSend;
+		if (XferQueueToken(&p, arg2, sizeof(arg2))!=NULL)
+			job.Binary = (atoi(arg2)!=0);
+		else
+			job.Binary = ts.XmodemBin;
+		// o^_̃JgfBNgŉĂ
+		if ((_fullpath(job.FileName, arg1, sizeof(job.FileName))==NULL) ||
+		    (_access(job.FileName, 0)!=0))
+			return 0;
+		XferQueue[XferQueueLen++] = job;
+		PostMessage(HVTWin, WM_USER_XFERQUEUE, 0, 0);
+		return 1;
+	}
+	else if (_stricmp(op, "move")==0) {
+		if ((XferQueueToken(&p, arg1, sizeof(arg1))==NULL) ||
+		    (XferQueueToken(&p, arg2, sizeof(arg2))==NULL))
+			return 0;
+		from = atoi(arg1) - 1;
+		to = atoi(arg2) - 1;
+		if ((from < 0) || (from >= XferQueueLen) ||
+		    (to < 0) || (to >= XferQueueLen))
+			return 0;
+		job = XferQueue[from];
+		if (from < to)
+			memmove(&XferQueue[from], &XferQueue[from+1], sizeof(TXferJob) * (to - from));
+		else
+			memmove(&XferQueue[to+1], &XferQueue[to], sizeof(TXferJob) * (from - to));
+		XferQueue[to] = job;
+		return 1;
+	}
+	else if (_stricmp(op, "cancel")==0) {
+		if (XferQueueToken(&p, arg1, sizeof(arg1))==NULL)
+			return 0;
+		if (_stricmp(arg1, "all")==0) {
+			XferQueueLen = 0;
+			return 1;
+		}
+		if (_stricmp(arg1, "current")==0) {
+			if (! XferQueueJob || ! cv.ProtoFlag)
+				return 0;
+			PostMessage(HVTWin, WM_USER_PROTOCANCEL, 0, 0);
+			return 1;
+		}
+		from = atoi(arg1) - 1;
+		if ((from < 0) || (from >= XferQueueLen))
+			return 0;
+		XferQueueLen--;
+		memmove(&XferQueue[from], &XferQueue[from+1], sizeof(TXferJob) * (XferQueueLen - from));
+		return 1;
+	}
+	else if (_stricmp(op, "count")==0) {
+		return XferQueueLen;
+	}
+	return 0;
+}
 }
 
 extern "C" {
@@ -65,6 +65,8 @@ void KermitStart(int mode);
 void XMODEMStart(int mode);
 void YMODEMStart(int mode);
 void ZMODEMStart(int mode);
+void XferQueueNext();
+int XferQueueCommand(PCHAR Cmd);
 void BPStart(int mode);
 void QVStart(int mode);
 
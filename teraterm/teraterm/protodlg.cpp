@@ -9,6 +9,7 @@
 #include "tttypes.h"
 #include "ttftypes.h"
 #include "ttlib.h"
+#include "dlglib.h"
 #include "protodlg.h"
 
 #ifdef _DEBUG
@@ -22,6 +23,7 @@ static char THIS_FILE[] = __FILE__;
 
 BEGIN_MESSAGE_MAP(CProtoDlg, CDialog)
 	//{{AFX_MSG_MAP(CProtoDlg)
+	ON_WM_TIMER()
 	//}}AFX_MSG_MAP
 END_MESSAGE_MAP()
 
@@ -53,9 +55,30 @@ BOOL CProtoDlg::Create(PFileVar pfv, PTTSet pts)
 		SendDlgItemMessage(IDCANCEL, WM_SETFONT, (WPARAM)DlgFont, MAKELPARAM(TRUE,0));
 	}
 
+	// vgR̓pPbgƂ fv ̃JE^XV邾ɂāA
+	// _CAO̕\͈ԊuōsB
+	// vgR̂̂ VT EBhẼXbhœ܂܂ɂĂB
+	// Mobt@(cv) VT EBhẼXbh CommReceive() ƋLĂA
+	// evgR̓^C}[CEBhEɓo^AbZ[W{bNX
+	// t@CI_CAOo߁AʃXbhֈڂɂ͂炷ׂĂ
+	// 蒼KvB
+	SetTimer(IdProtoDlgTimer, ProtoDlgRefreshInterval, NULL);
+
 	return Ok;
 }
 
+void CProtoDlg::RefreshNum()
+{
+	if (fv->PktNum > 0)
+		SetDlgNum(GetSafeHwnd(), IDC_PROTOPKTNUM, fv->PktNum);
+	SetDlgNum(GetSafeHwnd(), IDC_PROTOBYTECOUNT, fv->ByteCount);
+	if (fv->FileSize > 0 && fv->ProgStat != -1)
+		SetDlgPercent(GetSafeHwnd(), IDC_PROTOPERCENT, IDC_PROTOPROGRESS,
+		              fv->ByteCount, fv->FileSize, &fv->ProgStat);
+	if (fv->StartTime != 0)
+		SetDlgTime(GetSafeHwnd(), IDC_PROTOELAPSEDTIME, fv->StartTime, fv->ByteCount);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // CProtoDlg message handler
 
@@ -75,6 +98,15 @@ BOOL CProtoDlg::OnCommand(WPARAM wParam, LPARAM lParam)
 	}
 }
 
+void CProtoDlg::OnTimer(UINT nIDEvent)
+{
+	if (nIDEvent == IdProtoDlgTimer) {
+		RefreshNum();
+		return;
+	}
+	CDialog::OnTimer(nIDEvent);
+}
+
 void CProtoDlg::PostNcDestroy()
 {
 	delete this;
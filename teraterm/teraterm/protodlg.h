@@ -19,6 +19,7 @@ public:
 #else
 	BOOL Create(PFileVar pfv);
 #endif
+	void RefreshNum();
 
 	//{{AFX_DATA(CProtoDlg)
 	enum { IDD = IDD_PROTDLG };
@@ -34,6 +35,7 @@ public:
 protected:
 
 	//{{AFX_MSG(CProtoDlg)
+	afx_msg void OnTimer(UINT nIDEvent);
 	//}}AFX_MSG
 	DECLARE_MESSAGE_MAP()
 };
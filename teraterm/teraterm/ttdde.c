@@ -372,6 +372,14 @@ WORD HexStr2Word(PCHAR Str)
 #define CmdLogRotate    'W'
 #define CmdLogAutoClose 'X'
 #define CmdGetModemStatus 'Y'
+#define CmdSftpCmd      'Z'
+#define CmdXferQueue    '['
+
+// sftpcmd ̃R}hIƂ TTSSH Ă΂
+static void CALLBACK SftpCmdEnd(int result)
+{
+	EndDdeCmnd(result);
+}
 
 HDDEDATA AcceptExecute(HSZ TopicHSz, HDDEDATA Data)
 {
@@ -878,6 +886,45 @@ scp_rcv_error:
 		}
 		break;
 
+	case CmdXferQueue:
+		// WuL[ɐςނŁA]̊͑҂ȂB
+		i = XferQueueCommand(ParamFileName);
+		DdeCmnd = TRUE;
+		EndDdeCmnd(i);
+		break;
+
+	case CmdSftpCmd:
+		{
+		typedef int (CALLBACK *PSSH_sftp_command)(char *, void (CALLBACK *)(int));
+		static PSSH_sftp_command func = NULL;
+		static HMODULE h = NULL;
+		char msg[128];
+
+		if (func == NULL) {
+			if ( ((h = GetModuleHandle("ttxssh.dll")) == NULL) ) {
+				_snprintf_s(msg, sizeof(msg), _TRUNCATE, "GetModuleHandle(\"ttxssh.dll\")) %d", GetLastError());
+				goto sftp_cmd_error;
+			}
+			func = (PSSH_sftp_command)GetProcAddress(h, "TTXSftpCommand");
+			if (func == NULL) {
+				_snprintf_s(msg, sizeof(msg), _TRUNCATE, "GetProcAddress(\"TTXSftpCommand\")) %d", GetLastError());
+				goto sftp_cmd_error;
+			}
+		}
+
+		if (func != NULL) {
+			// }NSFTPR}hI܂ő҂Aʂ result Ɏ󂯎B
+			DdeCmnd = TRUE;
+			func(ParamFileName, SftpCmdEnd);
+			break;
+		}
+
+sftp_cmd_error:
+		MessageBox(NULL, msg, "Tera Term: sftpcmd command error", MB_OK | MB_ICONERROR);
+		return DDE_FNOTPROCESSED;
+		}
+		break;
+
 	case CmdSetBaud:  // add 'setbaud' (2008.2.13 steven patch)
 		{
 		int val;
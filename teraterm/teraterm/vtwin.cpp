@@ -145,6 +145,7 @@ BEGIN_MESSAGE_MAP(CVTWindow, CFrameWnd)
 	ON_MESSAGE(WM_USER_GETSERIALNO,OnGetSerialNo)
 	ON_MESSAGE(WM_USER_KEYCODE,OnKeyCode)
 	ON_MESSAGE(WM_USER_PROTOCANCEL,OnProtoEnd)
+	ON_MESSAGE(WM_USER_XFERQUEUE,OnXferQueue)
 	ON_MESSAGE(WM_USER_CHANGETITLE,OnChangeTitle)
 	ON_MESSAGE(WM_COPYDATA,OnReceiveIpcMessage)
 	ON_MESSAGE(WM_USER_NONCONFIRM_CLOSE, OnNonConfirmClose)
@@ -3558,6 +3559,12 @@ LONG CVTWindow::OnProtoEnd(UINT wParam, LONG lParam)
 	return 0;
 }
 
+LONG CVTWindow::OnXferQueue(UINT wParam, LONG lParam)
+{
+	XferQueueNext();
+	return 0;
+}
+
 LONG CVTWindow::OnChangeTitle(UINT wParam, LONG lParam)
 {
 	ChangeTitle();
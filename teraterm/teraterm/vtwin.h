@@ -113,6 +113,7 @@ protected:
 	afx_msg LONG OnGetSerialNo(UINT wParam, LONG lParam);
 	afx_msg LONG OnKeyCode(UINT wParam, LONG lParam);
 	afx_msg LONG OnProtoEnd(UINT wParam, LONG lParam);
+	afx_msg LONG OnXferQueue(UINT wParam, LONG lParam);
 	afx_msg LONG OnChangeTitle(UINT wParam, LONG lParam);
 	afx_msg LONG OnReceiveIpcMessage(UINT wParam, LONG lParam);
 	afx_msg LONG OnNonConfirmClose(UINT wParam, LONG lParam);
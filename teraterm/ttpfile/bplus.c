@@ -438,12 +438,6 @@ void BPSendNPacket(PFileVar fv, PBPVar bv)
   }
   i = i - 4;
   BPMakePacket(bv,'N',i);
-
-  SetDlgNum(fv->HWin, IDC_PROTOBYTECOUNT, fv->ByteCount);
-  if (fv->FileSize>0)
-    SetDlgPercent(fv->HWin, IDC_PROTOPERCENT, IDC_PROTOPROGRESS,
-      fv->ByteCount, fv->FileSize, &fv->ProgStat);
-  SetDlgTime(fv->HWin, IDC_PROTOELAPSEDTIME, fv->StartTime, fv->ByteCount);
 }
 
 void BPCheckPacket(PFileVar fv, PBPVar bv, PComVar cv)
@@ -467,8 +461,7 @@ void BPCheckPacket(PFileVar fv, PBPVar bv, PComVar cv)
     bv->PktNum = 0;
     bv->PktNumOffset = bv->PktNumOffset + 10;
   }
-  SetDlgNum(fv->HWin, IDC_PROTOPKTNUM,
-	    bv->PktNum + bv->PktNumOffset);
+  fv->PktNum = bv->PktNum + bv->PktNumOffset;
 
   if (bv->PktIn[1] != '+')
     BPSendACK(fv,bv,cv); /* Send ack */
@@ -637,11 +630,6 @@ void BPParsePacket(PFileVar fv, PBPVar bv)
       _lwrite(fv->FileHandle,&(bv->PktIn[2]),bv->PktInCount-2);
       fv->ByteCount = fv->ByteCount +
 		      bv->PktInCount - 2;
-      SetDlgNum(fv->HWin, IDC_PROTOBYTECOUNT, fv->ByteCount);
-      if (fv->FileSize>0)
-	SetDlgPercent(fv->HWin, IDC_PROTOPERCENT, IDC_PROTOPROGRESS,
-	  fv->ByteCount, fv->FileSize, &fv->ProgStat);
-      SetDlgTime(fv->HWin, IDC_PROTOELAPSEDTIME, fv->StartTime, fv->ByteCount);
       break;
     case 'T':
       BPParseTPacket(fv,bv); /* File transfer */
@@ -705,7 +693,7 @@ void BPParseAck(PFileVar fv, PBPVar bv, BYTE b)
       break;
     case BP_Failure: bv->BPState = BP_Close; break;
   }
-  SetDlgNum(fv->HWin, IDC_PROTOPKTNUM, bv->PktNum + bv->PktNumOffset);
+  fv->PktNum = bv->PktNum + bv->PktNumOffset;
 }
 
   void BPDequote(LPBYTE b)
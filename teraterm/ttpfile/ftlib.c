@@ -9,7 +9,10 @@
 #include "ttftypes.h"
 #include "ttlib.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <process.h>
+#include <winioctl.h>
 
 #include "tt_res.h"
 
@@ -47,6 +50,389 @@ BOOL GetNextFname(PFileVar fv)
   return TRUE;
 }
 
+/* Batch send: the file following the current one is opened, stat'ed and
+   pre-read on a worker thread while the current one is being transferred,
+   so that switching files does not stall the protocol on the UI thread. */
+#define FT_PREFETCH_READ 65536
+
+static unsigned __stdcall FTPrefetchThread(void *arg)
+{
+  PFileVar fv = (PFileVar)arg;
+  char Temp[MAX_PATH];
+  char *buf;
+  int i, n;
+
+  fv->PrefetchSize = GetFSize(fv->PrefetchName);
+  fv->PrefetchMtime = GetFMtime(fv->PrefetchName);
+  fv->PrefetchHandle = _lopen(fv->PrefetchName,OF_READ);
+  if (fv->PrefetchHandle > 0)
+  {
+    // warm up the file cache for the first data packets
+    buf = malloc(FT_PREFETCH_READ);
+    if (buf != NULL)
+    {
+      _lread(fv->PrefetchHandle, buf, FT_PREFETCH_READ);
+      free(buf);
+    }
+    _llseek(fv->PrefetchHandle, 0, 0);
+  }
+
+  // size of the rest of the batch (only once, for the aggregated progress)
+  if (fv->PrefetchList != NULL)
+  {
+    fv->PrefetchListSize = 0;
+    i = 0;
+    for (n = 1 ; n < fv->NumFname ; n++)
+    {
+      strncpy_s(Temp, sizeof(Temp), fv->PrefetchName, fv->DirLen);
+      strncat_s(Temp, sizeof(Temp), &fv->PrefetchList[i], _TRUNCATE);
+      fv->PrefetchListSize += GetFSize(Temp);
+      i = i + strlen(&fv->PrefetchList[i]) + 1;
+    }
+    free(fv->PrefetchList);
+    fv->PrefetchList = NULL;
+  }
+
+  return 0;
+}
+
+static void FTPrefetchWait(PFileVar fv)
+{
+  if (fv->PrefetchThread == NULL)
+    return;
+  WaitForSingleObject(fv->PrefetchThread, INFINITE);
+  CloseHandle(fv->PrefetchThread);
+  fv->PrefetchThread = NULL;
+}
+
+static void FTPrefetchNext(PFileVar fv)
+{
+  unsigned tid;
+  int i, n;
+
+  if ((fv->NumFname <= 1) || (fv->FNCount >= fv->NumFname))
+    return;
+
+  GlobalLock(fv->FnStrMemHandle);
+  strncpy_s(fv->PrefetchName, sizeof(fv->PrefetchName), fv->FullName, fv->DirLen);
+  strncat_s(fv->PrefetchName, sizeof(fv->PrefetchName),
+    &fv->FnStrMem[fv->FnPtr], _TRUNCATE);
+
+  // the worker must not touch FnStrMem, so it gets a copy of the rest of the list
+  fv->PrefetchList = NULL;
+  fv->PrefetchListPtr = -1;
+  if (fv->FNCount == 1)
+  {
+    i = fv->FnPtr;
+    for (n = 1 ; n < fv->NumFname ; n++)
+      i = i + strlen(&fv->FnStrMem[i]) + 1;
+    fv->PrefetchList = malloc(i - fv->FnPtr);
+    if (fv->PrefetchList != NULL)
+    {
+      memcpy(fv->PrefetchList, &fv->FnStrMem[fv->FnPtr], i - fv->FnPtr);
+      fv->PrefetchListPtr = fv->FnPtr;
+    }
+  }
+  GlobalUnlock(fv->FnStrMemHandle);
+
+  fv->PrefetchHandle = 0;
+  fv->PrefetchThread = (HANDLE)_beginthreadex(NULL, 0, FTPrefetchThread, fv, 0, &tid);
+  if (fv->PrefetchThread == NULL)
+  {
+    free(fv->PrefetchList);
+    fv->PrefetchList = NULL;
+    fv->PrefetchListPtr = -1;
+  }
+}
+
+BOOL FTOpenSendFile(PFileVar fv)
+{
+  FTPrefetchWait(fv);
+
+  if (fv->FNCount > 1)
+    fv->BatchDoneSize += fv->FileSize;
+  else
+  {
+    fv->BatchDoneSize = 0;
+    fv->BatchTotalSize = 0;
+  }
+
+  if ((fv->PrefetchHandle > 0) &&
+      (_stricmp(fv->PrefetchName, fv->FullName) == 0))
+  {
+    fv->FileHandle = fv->PrefetchHandle;
+    fv->FileSize = fv->PrefetchSize;
+    fv->FileMtime = fv->PrefetchMtime;
+    if (fv->PrefetchListPtr >= 0)
+      fv->BatchTotalSize += fv->PrefetchListSize;
+  }
+  else
+  {
+    if (fv->PrefetchHandle > 0)
+      _lclose(fv->PrefetchHandle);
+    fv->FileHandle = _lopen(fv->FullName,OF_READ);
+    fv->FileSize = GetFSize(fv->FullName);
+    fv->FileMtime = GetFMtime(fv->FullName);
+  }
+  fv->PrefetchHandle = 0;
+  fv->FileOpen = fv->FileHandle>0;
+
+  if (fv->FNCount <= 1)
+    fv->BatchTotalSize = fv->FileSize;
+  fv->BatchPercent = -1;
+
+  FTPrefetchNext(fv);
+
+  return fv->FileOpen;
+}
+
+void FTSetBatchProgress(PFileVar fv)
+{
+  char Temp[sizeof(fv->DlgCaption) + 32];
+  int percent;
+
+  if ((fv->NumFname <= 1) || (fv->BatchTotalSize <= 0))
+    return;
+
+  percent = (int)((double)(fv->BatchDoneSize + fv->ByteCount) * 100 / fv->BatchTotalSize);
+  if (percent > 100)
+    percent = 100;
+  if (percent == fv->BatchPercent)
+    return;
+  fv->BatchPercent = percent;
+
+  _snprintf_s(Temp, sizeof(Temp), _TRUNCATE, "%s - %d/%d (%d%%)",
+    fv->DlgCaption, fv->FNCount, fv->NumFname, percent);
+  SetWindowText(fv->HWin, Temp);
+}
+
+/* Transfer statistics.
+   ProtoParse() calls FTStatUpdate() after each run of a protocol engine.
+   Payload bytes are taken from the growth of fv->ByteCount, bytes below
+   the highest position reached in the current file count as resent. */
+void FTStatInit(PFileVar fv)
+{
+  fv->StatStartTime = GetTickCount();
+  fv->StatBytes = 0;
+  fv->StatResentBytes = 0;
+  fv->StatLastCount = 0;
+  fv->StatFileMax = 0;
+  fv->StatFileStart = fv->StartTime;
+  fv->StatTimeOuts = 0;
+  fv->StatEngineTime = 0;
+}
+
+void FTStatUpdate(PFileVar fv, LONGLONG EngineTime)
+{
+  LONG Count = fv->ByteCount;
+
+  fv->StatEngineTime += EngineTime;
+
+  if ((fv->StartTime != fv->StatFileStart) ||
+      ((Count == 0) && (fv->StatLastCount != 0)))
+  { // next file
+    fv->StatFileStart = fv->StartTime;
+    fv->StatFileMax = 0;
+    fv->StatLastCount = 0;
+  }
+
+  if (Count > fv->StatLastCount)
+  {
+    if (Count > fv->StatFileMax)
+    {
+      if (fv->StatLastCount < fv->StatFileMax)
+        fv->StatResentBytes += fv->StatFileMax - fv->StatLastCount;
+      fv->StatBytes += Count - fv->StatFileMax;
+      fv->StatFileMax = Count;
+    }
+    else
+      fv->StatResentBytes += Count - fv->StatLastCount;
+  }
+  fv->StatLastCount = Count;
+}
+
+void FTStatLog(PFileVar fv, PCHAR ProtoName)
+{
+  char Temp[256];
+  LARGE_INTEGER Freq;
+  DWORD Elapsed;
+  double EngineMs, Rate, MsPerMB;
+
+  if (! fv->LogFlag || (fv->StatStartTime == 0))
+    return;
+
+  Elapsed = GetTickCount() - fv->StatStartTime;
+  if (! QueryPerformanceFrequency(&Freq) || (Freq.QuadPart == 0))
+    Freq.QuadPart = 1000;
+  EngineMs = (double)fv->StatEngineTime * 1000.0 / (double)Freq.QuadPart;
+  Rate = (Elapsed > 0) ? (double)fv->StatBytes * 1000.0 / Elapsed : 0.0;
+  MsPerMB = (fv->StatBytes > 0) ? EngineMs * 1048576.0 / (double)fv->StatBytes : 0.0;
+
+  if (fv->LogCount > 0)
+  {
+    fv->FlushLogLineBuf = 1;
+    FTLog1Byte(fv, 0);
+    fv->FlushLogLineBuf = 0;
+  }
+
+  _snprintf_s(Temp, sizeof(Temp), _TRUNCATE,
+    "%s statistics: %I64d bytes in %lu ms (%.0f bytes/s), "
+    "engine %.1f ms (%.2f ms/MB), resent %I64d bytes, %d timeouts\015\012",
+    ProtoName, fv->StatBytes, Elapsed, Rate,
+    EngineMs, MsPerMB, fv->StatResentBytes, fv->StatTimeOuts);
+  _lwrite(fv->LogFile, Temp, strlen(Temp));
+
+  fv->StatStartTime = 0;
+}
+
+/* Receive: the file is extended to the size announced by the sender
+   (ZMODEM ZFILE header, YMODEM block 0) before any data arrives, so that
+   the file system can allocate it in one piece instead of growing it a
+   block at a time.  Blocks consisting only of zeros inside the
+   preallocated area are skipped instead of written.  The file is marked
+   sparse first and the skipped ranges are released with
+   FSCTL_SET_ZERO_DATA.  If the file system has no sparse files (FAT,
+   Windows 9x), the zeros are written as usual. */
+#define FT_HOLE_MIN 512
+
+#ifndef FSCTL_SET_SPARSE
+#define FSCTL_SET_SPARSE    CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 49, METHOD_BUFFERED, FILE_SPECIAL_ACCESS)
+#endif
+#ifndef FSCTL_SET_ZERO_DATA
+#define FSCTL_SET_ZERO_DATA CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 50, METHOD_BUFFERED, FILE_WRITE_DATA)
+#endif
+
+static BOOL FTSetSparse(PFileVar fv)
+{
+  DWORD n;
+
+  if (fv->Sparse == 0)
+    fv->Sparse = DeviceIoControl((HANDLE)fv->FileHandle, FSCTL_SET_SPARSE,
+                                 NULL, 0, NULL, 0, &n, NULL) ? 1 : -1;
+  return (fv->Sparse > 0);
+}
+
+// release the clusters of the skipped range
+static void FTFlushHole(PFileVar fv)
+{
+  struct {
+    LARGE_INTEGER FileOffset;
+    LARGE_INTEGER BeyondFinalZero;
+  } z;  // FILE_ZERO_DATA_INFORMATION
+  DWORD n;
+
+  if (fv->HoleLen <= 0)
+    return;
+  z.FileOffset.QuadPart = fv->HoleStart;
+  z.BeyondFinalZero.QuadPart = (LONGLONG)fv->HoleStart + fv->HoleLen;
+  DeviceIoControl((HANDLE)fv->FileHandle, FSCTL_SET_ZERO_DATA,
+                  &z, sizeof(z), NULL, 0, &n, NULL);
+  fv->HoleLen = 0;
+}
+
+void FTPreallocate(PFileVar fv, LONG Size)
+{
+  HANDLE h;
+  LARGE_INTEGER t1, t2;
+
+  fv->PreallocSize = 0;
+  fv->PreallocTime = 0;
+  fv->WriteTime = 0;
+  fv->WriteBytes = 0;
+  fv->HoleBytes = 0;
+  fv->Sparse = 0;
+  fv->HoleLen = 0;
+
+  if (! fv->FileOpen || (Size <= 0))
+    return;
+
+  h = (HANDLE)fv->FileHandle;
+  QueryPerformanceCounter(&t1);
+  if ((SetFilePointer(h, Size, NULL, FILE_BEGIN) != INVALID_SET_FILE_POINTER) &&
+      SetEndOfFile(h))
+    fv->PreallocSize = Size;
+  SetFilePointer(h, 0, NULL, FILE_BEGIN);
+  QueryPerformanceCounter(&t2);
+  fv->PreallocTime = t2.QuadPart - t1.QuadPart;
+}
+
+void FTWriteFile(PFileVar fv, PCHAR Buf, int Len)
+{
+  LARGE_INTEGER t1, t2;
+  LONG Pos;
+  int i;
+
+  QueryPerformanceCounter(&t1);
+
+  i = 0;
+  if ((fv->PreallocSize > 0) && (Len >= FT_HOLE_MIN))
+  {
+    while ((i < Len) && (Buf[i] == 0))
+      i++;
+  }
+  Pos = (i == Len) ? _llseek(fv->FileHandle, 0, 1) : -1;
+  if ((Pos >= 0) && (Pos + Len <= fv->PreallocSize) && FTSetSparse(fv))
+  {
+    if ((fv->HoleLen > 0) && (fv->HoleStart + fv->HoleLen == Pos))
+      fv->HoleLen += Len;
+    else
+    {
+      FTFlushHole(fv);
+      fv->HoleStart = Pos;
+      fv->HoleLen = Len;
+    }
+    _llseek(fv->FileHandle, Len, 1);
+    fv->HoleBytes += Len;
+  }
+  else
+  {
+    // a rewrite may overlap the pending range, release it first
+    FTFlushHole(fv);
+    _lwrite(fv->FileHandle, Buf, Len);
+    fv->WriteBytes += Len;
+  }
+
+  QueryPerformanceCounter(&t2);
+  fv->WriteTime += t2.QuadPart - t1.QuadPart;
+}
+
+void FTFinishRecvFile(PFileVar fv)
+{
+  char Temp[256];
+  LARGE_INTEGER Freq;
+  double PreallocMs, WriteMs, Rate;
+
+  if (! fv->FileOpen || (fv->PreallocSize <= 0))
+    return;
+
+  FTFlushHole(fv);
+  // a short or cancelled transfer must not leave the preallocated tail
+  SetEndOfFile((HANDLE)fv->FileHandle);
+  fv->PreallocSize = 0;
+
+  if (! fv->LogFlag)
+    return;
+
+  if (! QueryPerformanceFrequency(&Freq) || (Freq.QuadPart == 0))
+    Freq.QuadPart = 1000;
+  PreallocMs = (double)fv->PreallocTime * 1000.0 / (double)Freq.QuadPart;
+  WriteMs = (double)fv->WriteTime * 1000.0 / (double)Freq.QuadPart;
+  Rate = (WriteMs > 0) ? (double)fv->WriteBytes * 1000.0 / WriteMs : 0.0;
+
+  if (fv->LogCount > 0)
+  {
+    fv->FlushLogLineBuf = 1;
+    FTLog1Byte(fv, 0);
+    fv->FlushLogLineBuf = 0;
+  }
+
+  _snprintf_s(Temp, sizeof(Temp), _TRUNCATE,
+    "%s: preallocated in %.1f ms, wrote %I64d bytes in %.1f ms (%.0f bytes/s), "
+    "skipped %I64d zero bytes\015\012",
+    &(fv->FullName[fv->DirLen]), PreallocMs,
+    fv->WriteBytes, WriteMs, Rate, fv->HoleBytes);
+  _lwrite(fv->LogFile, Temp, strlen(Temp));
+}
 
 WORD UpdateCRC(BYTE b, WORD CRC)
 {
@@ -186,6 +572,10 @@ BOOL FTCreateFile(PFileVar fv)
   SetDlgItemText(fv->HWin, IDC_PROTOFNAME,&(fv->FullName[fv->DirLen]));
   fv->ByteCount = 0;
   fv->FileSize = 0;
+  fv->PreallocSize = 0;
+  fv->WriteTime = 0;
+  fv->WriteBytes = 0;
+  fv->HoleBytes = 0;
 
   if (fv->ProgStat != -1) {
     fv->ProgStat = 0;
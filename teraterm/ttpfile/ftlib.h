@@ -9,6 +9,14 @@ extern char UILanguageFile[MAX_PATH];
 void GetLongFName(PCHAR FullName, PCHAR LongName, int destlen);
 void FTConvFName(PCHAR FName);
 BOOL GetNextFname(PFileVar fv);
+BOOL FTOpenSendFile(PFileVar fv);
+void FTSetBatchProgress(PFileVar fv);
+void FTStatInit(PFileVar fv);
+void FTStatUpdate(PFileVar fv, LONGLONG EngineTime);
+void FTStatLog(PFileVar fv, PCHAR ProtoName);
+void FTPreallocate(PFileVar fv, LONG Size);
+void FTWriteFile(PFileVar fv, PCHAR Buf, int Len);
+void FTFinishRecvFile(PFileVar fv);
 WORD UpdateCRC(BYTE b, WORD CRC);
 LONG UpdateCRC32(BYTE b, LONG CRC);
 void FTLog1Byte(PFileVar fv, BYTE b);
@@ -641,10 +641,7 @@ void KmtDecode(PFileVar fv, PKmtVar kv, PCHAR Buff, int *BuffLen)
 		}
 	}
 
-	if (Buff==NULL)
-		SetDlgNum(fv->HWin, IDC_PROTOBYTECOUNT, fv->ByteCount);
 	*BuffLen = BuffPtr;
-	SetDlgTime(fv->HWin, IDC_PROTOELAPSEDTIME, fv->StartTime, fv->ByteCount);
 }
 
 static void KmtRecvFileAttr(PFileVar fv, PKmtVar kv, PCHAR Buff, int *BuffLen)
@@ -900,10 +897,6 @@ void KmtSendNextData(PFileVar fv, PKmtVar kv, PComVar cv)
 	int DataLen, DataLenNew, maxlen;
 	BOOL NextFlag;
 
-	SetDlgNum(fv->HWin, IDC_PROTOBYTECOUNT, fv->ByteCount);
-	SetDlgPercent(fv->HWin, IDC_PROTOPERCENT, IDC_PROTOPROGRESS,
-		fv->ByteCount, fv->FileSize, &fv->ProgStat);
-	SetDlgTime(fv->HWin, IDC_PROTOELAPSEDTIME, fv->StartTime, fv->ByteCount);
 	DataLen = 0;
 	DataLenNew = 0;
 
@@ -936,10 +929,6 @@ void KmtSendNextData(PFileVar fv, PKmtVar kv, PComVar cv)
 
 	if (DataLen==0)
 	{
-		SetDlgNum(fv->HWin, IDC_PROTOBYTECOUNT, fv->ByteCount);
-		SetDlgPercent(fv->HWin, IDC_PROTOPERCENT, IDC_PROTOPROGRESS,
-			fv->ByteCount, fv->FileSize, &fv->ProgStat);
-		SetDlgTime(fv->HWin, IDC_PROTOELAPSEDTIME, fv->StartTime, fv->ByteCount);
 		KmtSendEOFPacket(fv,kv,cv);
 	}
 	else {
@@ -1531,7 +1520,7 @@ read_end:
 			kv->PktNumOffset = kv->PktNumOffset + 64;
 	}
 
-	SetDlgNum(fv->HWin, IDC_PROTOPKTNUM, kv->PktNum);
+	fv->PktNum = kv->PktNum;
 
 	return TRUE;
 }
@@ -473,13 +473,7 @@ void QVWriteToFile(PFileVar fv, PQVVar qv)
     C = 128;
   _lwrite(fv->FileHandle,&(qv->PktIn[3]),C);
   fv->ByteCount = fv->ByteCount + C;
-
-  SetDlgNum(fv->HWin, IDC_PROTOPKTNUM, qv->SeqNum);
-  SetDlgNum(fv->HWin, IDC_PROTOBYTECOUNT, fv->ByteCount);
-  if (fv->FileSize>0)
-    SetDlgPercent(fv->HWin, IDC_PROTOPERCENT, IDC_PROTOPROGRESS,
-      fv->ByteCount, fv->FileSize, &fv->ProgStat);
-  SetDlgTime(fv->HWin, IDC_PROTOELAPSEDTIME, fv->StartTime, fv->ByteCount);
+  fv->PktNum = qv->SeqNum;
 }
 
 BOOL QVCheckWindow8(PQVVar qv, WORD w0, WORD w1, BYTE b, LPWORD  w)
@@ -852,11 +846,7 @@ void QVSendVDATA(PFileVar fv, PQVVar qv)
     _llseek(fv->FileHandle,Pos,0);
     _lread(fv->FileHandle,&(qv->PktOut[3]),C);
     fv->ByteCount = Pos + (LONG)C;
-    SetDlgNum(fv->HWin, IDC_PROTOPKTNUM, qv->SeqSent);
-    SetDlgNum(fv->HWin, IDC_PROTOBYTECOUNT, fv->ByteCount);
-    SetDlgPercent(fv->HWin, IDC_PROTOPERCENT, IDC_PROTOPROGRESS,
-		  fv->ByteCount, fv->FileSize, &fv->ProgStat);
-    SetDlgTime(fv->HWin, IDC_PROTOELAPSEDTIME, fv->StartTime, fv->ByteCount);
+    fv->PktNum = qv->SeqSent;
     for (i = C ; i <= 127 ; i++)
       qv->PktOut[3+i] = 0;
     /* send VDAT */
@@ -1037,6 +1037,19 @@ BOOL FAR PASCAL GetXFname
 	return Ok;
 }
 
+static PCHAR ProtoName(int Proto)
+{
+	switch (Proto) {
+		case PROTO_KMT: return "Kermit";
+		case PROTO_XM: return "XMODEM";
+		case PROTO_YM: return "YMODEM";
+		case PROTO_ZM: return "ZMODEM";
+		case PROTO_BP: return "B-Plus";
+		case PROTO_QV: return "Quick-VAN";
+	}
+	return "";
+}
+
 void FAR PASCAL ProtoInit(int Proto, PFileVar fv, PCHAR pv, PComVar cv, PTTSet ts)
 {
 	switch (Proto) {
@@ -1059,12 +1072,16 @@ void FAR PASCAL ProtoInit(int Proto, PFileVar fv, PCHAR pv, PComVar cv, PTTSet t
 			QVInit(fv,(PQVVar)pv,cv,ts);
 			break;
 	}
+	FTStatInit(fv);
 }
 
 BOOL FAR PASCAL ProtoParse
   (int Proto, PFileVar fv, PCHAR pv, PComVar cv)
 {
 	BOOL Ok;
+	LARGE_INTEGER t1, t2;
+
+	QueryPerformanceCounter(&t1);
 
 	Ok = FALSE;
 	switch (Proto) {
@@ -1108,12 +1125,23 @@ BOOL FAR PASCAL ProtoParse
 				}
 			break;
 	}
+
+	QueryPerformanceCounter(&t2);
+	FTStatUpdate(fv, t2.QuadPart - t1.QuadPart);
+	if (! Ok) {
+		// fǍĂ玖Omۂ؂l߂
+		FTFinishRecvFile(fv);
+		FTStatLog(fv, ProtoName(Proto));
+	}
+
 	return Ok;
 }
 
 void FAR PASCAL ProtoTimeOutProc
   (int Proto, PFileVar fv, PCHAR pv, PComVar cv)
 {
+	fv->StatTimeOuts++;
+
 	switch (Proto) {
 		case PROTO_KMT:
 			KmtTimeOutProc(fv,(PKmtVar)pv,cv);
@@ -1163,6 +1191,8 @@ BOOL FAR PASCAL ProtoCancel
 			QVCancel(fv,(PQVVar)pv,cv);
 			break;
 		}
+	FTFinishRecvFile(fv);
+	FTStatLog(fv, ProtoName(Proto));
 	return TRUE;
 }
 
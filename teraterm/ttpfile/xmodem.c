@@ -371,9 +371,7 @@ BOOL XReadPacket(PFileVar fv, PXVar xv, PComVar cv)
 
 	fv->ByteCount = fv->ByteCount + c;
 
-	SetDlgNum(fv->HWin, IDC_PROTOPKTNUM, xv->PktNumOffset + xv->PktNum);
-	SetDlgNum(fv->HWin, IDC_PROTOBYTECOUNT, fv->ByteCount);
-	SetDlgTime(fv->HWin, IDC_PROTOELAPSEDTIME, fv->StartTime, fv->ByteCount);
+	fv->PktNum = xv->PktNumOffset + xv->PktNum;
 
 	FTSetTimeOut(fv, xv->TOutLong);
 
@@ -500,15 +498,11 @@ BOOL XSendPacket(PFileVar fv, PXVar xv, PComVar cv)
 
 	if (xv->PktBufCount == 0) {
 		if (xv->PktNumSent == 0) {
-			SetDlgNum(fv->HWin, IDC_PROTOPKTNUM, xv->PktNumOffset + 256);
+			fv->PktNum = xv->PktNumOffset + 256;
 		}
 		else {
-			SetDlgNum(fv->HWin, IDC_PROTOPKTNUM, xv->PktNumOffset + xv->PktNumSent);
+			fv->PktNum = xv->PktNumOffset + xv->PktNumSent;
 		}
-		SetDlgNum(fv->HWin, IDC_PROTOBYTECOUNT, fv->ByteCount);
-		SetDlgPercent(fv->HWin, IDC_PROTOPERCENT, IDC_PROTOPROGRESS,
-		              fv->ByteCount, fv->FileSize, &fv->ProgStat);
-		SetDlgTime(fv->HWin, IDC_PROTOELAPSEDTIME, fv->StartTime, fv->ByteCount);
 	}
 
 	return TRUE;
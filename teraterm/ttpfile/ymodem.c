@@ -239,8 +239,7 @@ static void initialize_file_info(PFileVar fv, PYVar yv)
 				SetFMtime(fv->FullName, fv->FileMtime);
 			}
 		}
-		fv->FileHandle = _lopen(fv->FullName,OF_READ);
-		fv->FileSize = GetFSize(fv->FullName);
+		FTOpenSendFile(fv);
 	} else {
 		fv->FileHandle = -1;
 		fv->FileSize = 0;
@@ -417,6 +416,7 @@ BOOL YReadPacket(PFileVar fv, PYVar yv, PComVar cv)
 			{
 				// EOTA1̃t@CMƂB
 				if (fv->FileOpen) {
+					FTFinishRecvFile(fv);
 					fv->FileOpen = 0;
 					_lclose(fv->FileHandle);
 					fv->FileHandle = -1;
@@ -571,6 +571,11 @@ BOOL YReadPacket(PFileVar fv, PYVar yv, PComVar cv)
 			}
 		}
 
+		// t@CŜ̗̈ɊmۂĂ
+		if (yv->RecvFilesize) {
+			FTPreallocate(fv, fv->FileSize);
+		}
+
 		SetDlgItemText(fv->HWin, IDC_PROTOFNAME, name);
 
 		yv->SendFileInfo = 1;
@@ -607,13 +612,11 @@ BOOL YReadPacket(PFileVar fv, PYVar yv, PComVar cv)
 			_lwrite(fv->FileHandle,&b,1);
 		}
 	else
-		_lwrite(fv->FileHandle, &(yv->PktIn[3]), c);
+		FTWriteFile(fv, &(yv->PktIn[3]), c);
 
 	fv->ByteCount = fv->ByteCount + c;
 
-	SetDlgNum(fv->HWin, IDC_PROTOPKTNUM, yv->PktNumOffset+yv->PktNum);
-	SetDlgNum(fv->HWin, IDC_PROTOBYTECOUNT, fv->ByteCount);
-	SetDlgTime(fv->HWin, IDC_PROTOELAPSEDTIME, fv->StartTime, fv->ByteCount);
+	fv->PktNum = yv->PktNumOffset+yv->PktNum;
 
 	FTSetTimeOut(fv,yv->TOutLong);
 
@@ -841,9 +844,6 @@ BOOL YSendPacket(PFileVar fv, PYVar yv, PComVar cv)
 				yv->__DataLen = current_packet_size;
 				yv->PktOut[0] = SOH;
 
-				// Timestamp.
-				fv->FileMtime = GetFMtime(fv->FullName);
-
 				ret = _snprintf_s(buf, sizeof(buf), _TRUNCATE, "%s",
 				                  &(fv->FullName[fv->DirLen]));
 				// NULL-terminated string.
@@ -993,22 +993,19 @@ BOOL YSendPacket(PFileVar fv, PYVar yv, PComVar cv)
 			break;
 	}
 
-	// Update dialog window.
+	// Publish the progress. The dialog polls it at a fixed interval.
 	if (0 == yv->PktBufCount)
 	{
 		if (0 == yv->PktNumSent)
 		{
-			SetDlgNum(fv->HWin, IDC_PROTOPKTNUM, yv->PktNumOffset + 256);
+			fv->PktNum = yv->PktNumOffset + 256;
 		}
 		else
 		{
-			SetDlgNum(fv->HWin, IDC_PROTOPKTNUM, yv->PktNumOffset + yv->PktNumSent);
+			fv->PktNum = yv->PktNumOffset + yv->PktNumSent;
 		}
 
-		SetDlgNum(fv->HWin, IDC_PROTOBYTECOUNT, fv->ByteCount);
-		SetDlgPercent(fv->HWin, IDC_PROTOPERCENT, IDC_PROTOPROGRESS,
-		              fv->ByteCount, fv->FileSize, &fv->ProgStat);
-		SetDlgTime(fv->HWin, IDC_PROTOELAPSEDTIME, fv->StartTime, fv->ByteCount);
+		FTSetBatchProgress(fv);
 	}
 
 	return TRUE;
@@ -497,11 +497,7 @@ void ZSendFileDat(PFileVar fv, PZVar zv)
 		zv->CRC = UpdateCRC(zv->PktOut[i], zv->CRC);
 	ZPutBin(zv, &(zv->PktOutCount), 0);
 	zv->CRC = UpdateCRC(0, zv->CRC);
-	/* file size */
-	fv->FileSize = GetFSize(fv->FullName);
-
-	/* timestamp */
-	fv->FileMtime = GetFMtime(fv->FullName);
+	/* file size and timestamp were taken by FTOpenSendFile() */
 
 	// t@C̃^CX^vƃp[~bV悤ɂB(2007.12.20 maya, yutaka)
 	_snprintf_s(&(zv->PktOut[zv->PktOutCount]),
@@ -577,10 +573,7 @@ void ZSendDataDat(PFileVar fv, PZVar zv)
 		}
 	} while ((c != 0) && (zv->PktOutCount <= zv->MaxDataLen - 2));
 
-	SetDlgNum(fv->HWin, IDC_PROTOBYTECOUNT, fv->ByteCount);
-	SetDlgPercent(fv->HWin, IDC_PROTOPERCENT, IDC_PROTOPROGRESS,
-				  fv->ByteCount, fv->FileSize, &fv->ProgStat);
-	SetDlgTime(fv->HWin, IDC_PROTOELAPSEDTIME, fv->StartTime, fv->ByteCount);
+	FTSetBatchProgress(fv);
 	zv->Pos = fv->ByteCount;
 
 	zv->PktOut[zv->PktOutCount] = ZDLE;
@@ -788,9 +781,8 @@ void ZParseRInit(PFileVar fv, PZVar zv)
 		return;
 	}
 
-	/* file open */
-	fv->FileHandle = _lopen(fv->FullName, OF_READ);
-	fv->FileOpen = fv->FileHandle > 0;
+	/* file open (size and timestamp are fetched too) */
+	FTOpenSendFile(fv);
 
 	if (zv->CtlEsc) {
 		if ((zv->RxHdr[ZF0] & ESCCTL) == 0) {
@@ -937,6 +929,7 @@ void ZParseHdr(PFileVar fv, PZVar zv, PComVar cv)
 					zv->CRRecv = FALSE;
 					_lwrite(fv->FileHandle, "\012", 1);
 				}
+				FTFinishRecvFile(fv);
 				_lclose(fv->FileHandle);
 				fv->FileOpen = FALSE;
 
@@ -1000,6 +993,9 @@ BOOL ZParseFile(PFileVar fv, PZVar zv)
 		}
 	}
 
+	/* allocate the whole file in advance */
+	FTPreallocate(fv, fv->FileSize);
+
 	zv->Pos = 0;
 	fv->ByteCount = 0;
 	ZStoHdr(zv, 0);
@@ -1027,7 +1023,7 @@ BOOL ZWriteData(PFileVar fv, PZVar zv)
 	FTSetTimeOut(fv, 0);
 
 	if (zv->BinFlag)
-		_lwrite(fv->FileHandle, zv->PktIn, zv->PktInPtr);
+		FTWriteFile(fv, zv->PktIn, zv->PktInPtr);
 	else
 		for (i = 0; i <= zv->PktInPtr - 1; i++) {
 			b = zv->PktIn[i];
@@ -1042,11 +1038,6 @@ BOOL ZWriteData(PFileVar fv, PZVar zv)
 	fv->ByteCount = fv->ByteCount + zv->PktInPtr;
 	zv->Pos = zv->Pos + zv->PktInPtr;
 	ZStoHdr(zv, zv->Pos);
-	SetDlgNum(fv->HWin, IDC_PROTOBYTECOUNT, fv->ByteCount);
-	if (fv->FileSize > 0)
-		SetDlgPercent(fv->HWin, IDC_PROTOPERCENT, IDC_PROTOPROGRESS,
-					  fv->ByteCount, fv->FileSize, &fv->ProgStat);
-	SetDlgTime(fv->HWin, IDC_PROTOELAPSEDTIME, fv->StartTime, fv->ByteCount);
 
 	/* set timeout for data */
 	FTSetTimeOut(fv, zv->TimeOut);
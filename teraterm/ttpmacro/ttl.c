@@ -5791,6 +5791,47 @@ WORD TTLScpRecv()
 	return SendCmnd(CmdScpRcv,IdTTLWaitCmndEnd);
 }
 
+// SYNOPSIS: 
+//   sftpcmd "get foo.txt"
+//   sftpcmd "put c:\foo.txt"
+WORD TTLSftpCmd()
+{
+	TStrVal Str;
+	WORD Err;
+
+	Err = 0;
+	GetStrVal(Str,&Err);
+
+	if ((Err==0) &&
+	    ((strlen(Str)==0) || (GetFirstChar()!=0)))
+		Err = ErrSyntax;
+	if (Err!=0) return Err;
+
+	SetFile(Str);
+	return SendCmnd(CmdSftpCmd,IdTTLWaitCmndResult);
+}
+
+// SYNOPSIS: 
+//   xferqueue 'zmodem "c:\usr\sample.bin" 1'
+//   xferqueue 'move 3 1'
+//   xferqueue 'cancel 2'
+WORD TTLXferQueue()
+{
+	TStrVal Str;
+	WORD Err;
+
+	Err = 0;
+	GetStrVal(Str,&Err);
+
+	if ((Err==0) &&
+	    ((strlen(Str)==0) || (GetFirstChar()!=0)))
+		Err = ErrSyntax;
+	if (Err!=0) return Err;
+
+	SetFile(Str);
+	return SendCmnd(CmdXferQueue,IdTTLWaitCmndResult);
+}
+
 int ExecCmnd()
 {
 	WORD WId, Err;
@@ -6190,6 +6231,8 @@ int ExecCmnd()
 			Err = TTLSetTime(); break;
 		case RsvSetTitle:
 			Err = TTLCommCmdFile(CmdSetTitle,0); break;
+		case RsvSftpCmd:
+			Err = TTLSftpCmd(); break;
 		case RsvShow:
 			Err = TTLShow(); break;
 		case RsvShowTT:
@@ -6264,6 +6307,8 @@ int ExecCmnd()
 			Err = TTLXmodemRecv(); break;
 		case RsvXmodemSend:
 			Err = TTLXmodemSend(); break;
+		case RsvXferQueue:
+			Err = TTLXferQueue(); break;
 		case RsvYesNoBox:
 			Err = TTLYesNoBox(); break;
 		case RsvZmodemRecv:
@@ -63,6 +63,8 @@
 #define CmdLogRotate    'W'
 #define CmdLogAutoClose 'X'
 #define CmdGetModemStatus 'Y'
+#define CmdSftpCmd      'Z'
+#define CmdXferQueue    '['
 
 #ifdef __cplusplus
 extern "C" {
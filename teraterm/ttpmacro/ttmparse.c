@@ -353,6 +353,7 @@ BOOL CheckReservedWord(PCHAR Str, LPWORD WordId)
 		else if (_stricmp(Str,"setsync")==0) *WordId = RsvSetSync;
 		else if (_stricmp(Str,"settime")==0) *WordId = RsvSetTime;
 		else if (_stricmp(Str,"settitle")==0) *WordId = RsvSetTitle;
+		else if (_stricmp(Str,"sftpcmd")==0) *WordId = RsvSftpCmd;
 		else if (_stricmp(Str,"show")==0) *WordId = RsvShow;
 		else if (_stricmp(Str,"showtt")==0) *WordId = RsvShowTT;
 		else if (_stricmp(Str,"sprintf")==0) *WordId = RsvSprintf;  // add 'sprintf' (2007.5.1 yutaka)
@@ -402,6 +403,7 @@ BOOL CheckReservedWord(PCHAR Str, LPWORD WordId)
 	case 'x':
 		if (_stricmp(Str,"xmodemrecv")==0) *WordId = RsvXmodemRecv;
 		else if (_stricmp(Str,"xmodemsend")==0) *WordId = RsvXmodemSend;
+		else if (_stricmp(Str,"xferqueue")==0) *WordId = RsvXferQueue;
 		else if (_stricmp(Str,"xor")==0) *WordId = RsvBXor;
 		break;
 	case 'y':
@@ -244,6 +244,8 @@
 #define RsvUptime		212
 #define RsvGetModemStatus	213
 #define RsvDirnameBox   214
+#define RsvSftpCmd      215
+#define RsvXferQueue    216
 
 #define RsvOperator     1000
 #define RsvBNot         1001
@@ -821,6 +821,12 @@ void FAR PASCAL ReadIniFile(PCHAR FName, PTTSet ts)
 	                        ts->FileSendFilter, sizeof(ts->FileSendFilter),
 	                        FName);
 
+	/* Pacing of file send (0 = unlimited) */
+	ts->FileSendBytesPerSec =
+		max(0, (int)GetPrivateProfileInt(Section, "FileSendBytesPerSec", 0, FName));
+	ts->FileSendLinesPerSec =
+		max(0, (int)GetPrivateProfileInt(Section, "FileSendLinesPerSec", 0, FName));
+
 	/* SCPMpX (2012.4.6 yutaka) */
 	GetPrivateProfileString(Section, "ScpSendDir", "~/",
 	                        ts->ScpSendDir, sizeof(ts->ScpSendDir), FName);
@@ -2204,6 +2210,10 @@ void FAR PASCAL WriteIniFile(PCHAR FName, PTTSet ts)
 	WritePrivateProfileString(Section, "FileSendFilter",
 	                          ts->FileSendFilter, FName);
 
+	/* Pacing of file send */
+	WriteInt(Section, "FileSendBytesPerSec", FName, ts->FileSendBytesPerSec);
+	WriteInt(Section, "FileSendLinesPerSec", FName, ts->FileSendLinesPerSec);
+
 	WritePrivateProfileString(Section, "ScpSendDir", ts->ScpSendDir, FName);
 
 /*------------------------------------------------------------------*/
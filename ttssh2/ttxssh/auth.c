@@ -485,44 +485,13 @@ static BOOL end_auth_dlg(PTInstVar pvar, HWND dlg)
 
 			memset(errmsg, 0, sizeof(errmsg));
 
-			keyfile_type = get_ssh2_keytype(keyfile, &fp, errmsg, sizeof(errmsg));
-			switch (keyfile_type) {
-				case SSH2_KEYFILE_TYPE_OPENSSH:
-				{
-					key_pair = read_SSH2_private_key(pvar, fp, password,
-					                                 &invalid_passphrase,
-					                                 FALSE,
-					                                 errmsg,
-					                                 sizeof(errmsg)
-					                                );
-					break;
-				}
-				case SSH2_KEYFILE_TYPE_PUTTY:
-				{
-					key_pair = read_SSH2_PuTTY_private_key(pvar, fp, password,
-					                                       &invalid_passphrase,
-					                                       FALSE,
-					                                       errmsg,
-					                                       sizeof(errmsg)
-					                                      );
-					break;
-				}
-				case SSH2_KEYFILE_TYPE_SECSH:
-				{
-					key_pair = read_SSH2_SECSH_private_key(pvar, fp, password,
-					                                       &invalid_passphrase,
-					                                       FALSE,
-					                                       errmsg,
-					                                       sizeof(errmsg)
-					                                      );
-					break;
-				}
-				default:
-				{
-					char buf[1024];
-
-					// t@CJꍇ̓t@C`słǂݍł݂
-					if (fp != NULL) {
+			// pXt[Yœǂݍ񂾂Ƃ̂錮ȂAt@CǂݒȂ
+			key_pair = KEYFILES_get_cached_key(pvar, keyfile, password);
+			if (key_pair == NULL) {
+				keyfile_type = get_ssh2_keytype(keyfile, &fp, errmsg, sizeof(errmsg));
+				switch (keyfile_type) {
+					case SSH2_KEYFILE_TYPE_OPENSSH:
+					{
 						key_pair = read_SSH2_private_key(pvar, fp, password,
 						                                 &invalid_passphrase,
 						                                 FALSE,
@@ -531,16 +500,55 @@ static BOOL end_auth_dlg(PTInstVar pvar, HWND dlg)
 						                                );
 						break;
 					}
+					case SSH2_KEYFILE_TYPE_PUTTY:
+					{
+						key_pair = read_SSH2_PuTTY_private_key(pvar, fp, password,
+						                                       &invalid_passphrase,
+						                                       FALSE,
+						                                       errmsg,
+						                                       sizeof(errmsg)
+						                                      );
+						break;
+					}
+					case SSH2_KEYFILE_TYPE_SECSH:
+					{
+						key_pair = read_SSH2_SECSH_private_key(pvar, fp, password,
+						                                       &invalid_passphrase,
+						                                       FALSE,
+						                                       errmsg,
+						                                       sizeof(errmsg)
+						                                      );
+						break;
+					}
+					default:
+					{
+						char buf[1024];
+
+						// t@CJꍇ̓t@C`słǂݍł݂
+						if (fp != NULL) {
+							key_pair = read_SSH2_private_key(pvar, fp, password,
+							                                 &invalid_passphrase,
+							                                 FALSE,
+							                                 errmsg,
+							                                 sizeof(errmsg)
+							                                );
+							break;
+						}
+
+						UTIL_get_lang_msg("MSG_READKEY_ERROR", pvar,
+						                  "read error SSH2 private key file\r\n%s");
+						_snprintf_s(buf, sizeof(buf), _TRUNCATE, pvar->ts->UIMsg, errmsg);
+						notify_nonfatal_error(pvar, buf);
+						// ɗƂƂ SSH2 閧t@CJȂ̂
+						// t@C̑I{^ɃtH[JXڂ
+						SetFocus(GetDlgItem(dlg, IDC_CHOOSERSAFILE));
+						destroy_malloced_string(&password);
+						return FALSE;
+					}
+				}
 
-					UTIL_get_lang_msg("MSG_READKEY_ERROR", pvar,
-					                  "read error SSH2 private key file\r\n%s");
-					_snprintf_s(buf, sizeof(buf), _TRUNCATE, pvar->ts->UIMsg, errmsg);
-					notify_nonfatal_error(pvar, buf);
-					// ɗƂƂ SSH2 閧t@CJȂ̂
-					// t@C̑I{^ɃtH[JXڂ
-					SetFocus(GetDlgItem(dlg, IDC_CHOOSERSAFILE));
-					destroy_malloced_string(&password);
-					return FALSE;
+				if (key_pair != NULL) {
+					KEYFILES_cache_key(pvar, keyfile, password, key_pair);
 				}
 			}
 
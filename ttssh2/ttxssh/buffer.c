@@ -193,6 +193,17 @@ int buffer_get_int(buffer_t *msg)
 	return (ret);
 }
 
+unsigned long long buffer_get_int64(buffer_t *msg)
+{
+	unsigned char buf[8];
+
+	if (buffer_get_ret(msg, (char *) buf, 8) == -1) {
+		OutputDebugPrintf("buffer_get_int64: buffer error");
+		return 0;
+	}
+	return ((unsigned long long)get_uint32(buf) << 32) | get_uint32(buf + 4);
+}
+
 int buffer_get_char_ret(char *ret, buffer_t *msg)
 {
 	if (buffer_get_ret(msg, ret, 1) == -1)
@@ -315,6 +326,15 @@ void buffer_put_int(buffer_t *msg, int value)
 	buffer_append(msg, buf, sizeof(buf));
 }
 
+void buffer_put_int64(buffer_t *msg, unsigned long long value)
+{
+	char buf[8];
+
+	set_uint32_MSBfirst(buf, (unsigned int)(value >> 32));
+	set_uint32_MSBfirst(buf + 4, (unsigned int)value);
+	buffer_append(msg, buf, sizeof(buf));
+}
+
 int buffer_len(buffer_t *msg)
 {
 	return (msg->len);
@@ -610,3 +630,126 @@ int buffer_decompress(z_stream *zstream, char *payload, int len, buffer_t *compb
 
 	return 0; // success
 }
+
+// kx̕ύX
+// deflate ̏ςꍇ́A܂ł̓͂ubNE܂ŃtbV̂ŁA
+// ̏o͂ compbuf ɒǉB buffer_compress() ĂԂƁB
+int buffer_compress_level(z_stream *zstream, int level, buffer_t *compbuf)
+{
+	unsigned char buf[4096];
+
+	// input buffer
+	zstream->next_in = NULL;
+	zstream->avail_in = 0;
+
+	// output buffer
+	zstream->next_out = buf;
+	zstream->avail_out = sizeof(buf);
+
+	if (deflateParams(zstream, level, Z_DEFAULT_STRATEGY) != Z_OK) {
+		return -1; // error
+	}
+	buffer_append(compbuf, buf, sizeof(buf) - zstream->avail_out);
+
+	return 0; // success
+}
+
+// pPbg̈k (zstd@ttssh2.osdn.jp)
+// pPbgƂ ZSTD_e_flush ŃtbV̂ŁAM̓pPbgPʂœWJłB
+int buffer_compress_zstd(ZSTD_CStream *zstream, char *payload, int len, buffer_t *compbuf)
+{
+	unsigned char buf[4096];
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer out;
+	size_t remain;
+
+	// input buffer
+	in.src = payload;
+	in.size = len;
+	in.pos = 0;
+
+	do {
+		// output buffer
+		out.dst = buf;
+		out.size = sizeof(buf);
+		out.pos = 0;
+
+		// ߂l͂܂tbVĂȂoCgB0 ɂȂΓׂ͂ďo͂IB
+		remain = ZSTD_compressStream2(zstream, &out, &in, ZSTD_e_flush);
+		if (ZSTD_isError(remain)) {
+			return -1; // error
+		}
+		buffer_append(compbuf, buf, out.pos);
+	} while (remain != 0);
+
+	return 0; // success
+}
+
+// zstd ̈kx̕ύX
+// PXbḧkł̓t[̓rŃxςȂ̂ŁÃt[
+// ̏o͂ compbuf ɒǉÃt[VxgB
+// M͑ē͂t[̂܂ܓWJłB buffer_compress_zstd() ĂԂƁB
+int buffer_compress_zstd_level(ZSTD_CStream *zstream, int level, buffer_t *compbuf)
+{
+	unsigned char buf[4096];
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer out;
+	size_t remain;
+
+	in.src = NULL;
+	in.size = 0;
+	in.pos = 0;
+
+	do {
+		out.dst = buf;
+		out.size = sizeof(buf);
+		out.pos = 0;
+
+		remain = ZSTD_compressStream2(zstream, &out, &in, ZSTD_e_end);
+		if (ZSTD_isError(remain)) {
+			return -1; // error
+		}
+		buffer_append(compbuf, buf, out.pos);
+	} while (remain != 0);
+
+	ZSTD_CCtx_reset(zstream, ZSTD_reset_session_only);
+	if (ZSTD_isError(ZSTD_CCtx_setParameter(zstream, ZSTD_c_compressionLevel, level))) {
+		return -1; // error
+	}
+
+	return 0; // success
+}
+
+// pPbg̓WJ (zstd@ttssh2.osdn.jp)
+// WJ̒ maxlen 𒴂pPbg̓G[ɂB
+int buffer_decompress_zstd(ZSTD_DStream *zstream, char *payload, int len, int maxlen, buffer_t *compbuf)
+{
+	unsigned char buf[4096];
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer out;
+	size_t ret;
+
+	// input buffer
+	in.src = payload;
+	in.size = len;
+	in.pos = 0;
+
+	do {
+		// output buffer
+		out.dst = buf;
+		out.size = sizeof(buf);
+		out.pos = 0;
+
+		ret = ZSTD_decompressStream(zstream, &out, &in);
+		if (ZSTD_isError(ret)) {
+			return -1; // error
+		}
+		if (buffer_len(compbuf) + (int)out.pos > maxlen) {
+			return -1; // too large
+		}
+		buffer_append(compbuf, buf, out.pos);
+		// o̓obt@tɂȂꍇ́A܂WJς݃f[^cĂB
+	} while (in.pos < in.size || out.pos == out.size);
+
+	return 0; // success
+}
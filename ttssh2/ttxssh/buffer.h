@@ -4,6 +4,7 @@
 #include <openssl/bn.h>
 #include <openssl/ec.h>
 #include <zlib.h>
+#include <zstd.h>
 
 typedef struct buffer {
 	char *buf;      /* obt@̐擪|C^Brealloc()ɂϓB*/
@@ -25,6 +26,7 @@ void buffer_put_cstring(buffer_t *msg, char *ptr);
 void buffer_put_char(buffer_t *msg, int value);
 void buffer_put_padding(buffer_t *msg, int size);
 void buffer_put_int(buffer_t *msg, int value);
+void buffer_put_int64(buffer_t *msg, unsigned long long value);
 int buffer_len(buffer_t *msg);
 char *buffer_ptr(buffer_t *msg);
 void buffer_put_bignum(buffer_t *buffer, BIGNUM *value);
@@ -41,9 +43,14 @@ void buffer_consume(buffer_t *buf, int shift_byte);
 void buffer_consume_end(buffer_t *buf, int shift_byte);
 int buffer_compress(z_stream *zstream, char *payload, int len, buffer_t *compbuf);
 int buffer_decompress(z_stream *zstream, char *payload, int len, buffer_t *compbuf);
+int buffer_compress_level(z_stream *zstream, int level, buffer_t *compbuf);
+int buffer_compress_zstd(ZSTD_CStream *zstream, char *payload, int len, buffer_t *compbuf);
+int buffer_compress_zstd_level(ZSTD_CStream *zstream, int level, buffer_t *compbuf);
+int buffer_decompress_zstd(ZSTD_DStream *zstream, char *payload, int len, int maxlen, buffer_t *compbuf);
 int buffer_get_ret(buffer_t *msg, void *buf, int len);
 int buffer_get_int_ret(int *ret, buffer_t *msg);
 int buffer_get_int(buffer_t *msg);
+unsigned long long buffer_get_int64(buffer_t *msg);
 int buffer_get_char_ret(char *ret, buffer_t *msg);
 int buffer_get_char(buffer_t *msg);
 void buffer_rewind(buffer_t *buf);
@@ -24,44 +24,58 @@
 #include "config.h"
 
 #include <openssl/evp.h>
-#include <openssl/aes.h>
 #include <openssl/des.h>
 #include <openssl/blowfish.h>
 #include <openssl/cast.h>
 #include <openssl/camellia.h>
 
-extern const EVP_CIPHER *evp_aes_128_ctr(void);
 extern const EVP_CIPHER *evp_camellia_128_ctr(void);
 
-struct ssh_aes_ctr_ctx
+/*
+ * AES-CTR uses OpenSSL's native EVP_aes_*_ctr() (AES-NI capable).
+ * The remaining CTR modes generate keystream for many blocks at once
+ * into a per-context buffer and XOR it with the data a word at a time.
+ * Unused keystream is kept for the next call, so callers need not pass
+ * block-aligned lengths.
+ */
+#define SSH_CTR_KEYSTREAM_SIZE	512
+
+struct ssh_ctr_keystream
 {
-	AES_KEY		aes_ctx;
-	unsigned char	aes_counter[AES_BLOCK_SIZE];
+	unsigned char	buf[SSH_CTR_KEYSTREAM_SIZE];
+	unsigned int	pos;
+	unsigned int	len;
 };
 
+typedef void (*ssh_ctr_block_f)(const void *key, const unsigned char *in, unsigned char *out);
+
 #define DES_BLOCK_SIZE sizeof(DES_cblock)
 struct ssh_des3_ctr_ctx
 {
 	DES_key_schedule des3_ctx[3];
 	unsigned char	des3_counter[DES_BLOCK_SIZE];
+	struct ssh_ctr_keystream ks;
 };
 
 struct ssh_blowfish_ctr_ctx
 {
 	BF_KEY		blowfish_ctx;
 	unsigned char	blowfish_counter[BF_BLOCK];
+	struct ssh_ctr_keystream ks;
 };
 
 struct ssh_cast5_ctr_ctx
 {
 	CAST_KEY	cast5_ctx;
 	unsigned char	cast5_counter[CAST_BLOCK];
+	struct ssh_ctr_keystream ks;
 };
 
 struct ssh_camellia_ctr_ctx
 {
 	CAMELLIA_KEY	camellia_ctx;
 	unsigned char	camellia_counter[CAMELLIA_BLOCK_SIZE];
+	struct ssh_ctr_keystream ks;
 };
 
 static void
@@ -74,104 +88,84 @@ ssh_ctr_inc(unsigned char *ctr, unsigned int len)
 			return;
 }
 
-//============================================================================
-// AES
-//============================================================================
-static int
-ssh_aes_ctr(EVP_CIPHER_CTX *ctx, unsigned char *dest, const unsigned char *src, unsigned int len)
-{
-	struct ssh_aes_ctr_ctx *c;
-	unsigned int n = 0;
-	unsigned char buf[AES_BLOCK_SIZE];
-
-	if (len == 0)
-		return (1);
-	if ((c = EVP_CIPHER_CTX_get_app_data(ctx)) == NULL)
-		return (0);
-
-	while ((len--) > 0) {
-		if (n == 0) {
-			AES_encrypt(c->aes_counter, buf, &c->aes_ctx);
-			ssh_ctr_inc(c->aes_counter, AES_BLOCK_SIZE);
-		}
-		*(dest++) = *(src++) ^ buf[n];
-		n = (n + 1) % AES_BLOCK_SIZE;
-	}
-	return (1);
-}
-
-static int
-ssh_aes_ctr_init(EVP_CIPHER_CTX *ctx, const unsigned char *key, const unsigned char *iv, int enc)
+static void
+ssh_ctr_xor(unsigned char *dest, const unsigned char *src, const unsigned char *ks, unsigned int len)
 {
-	struct ssh_aes_ctr_ctx *c;
-
-	if ((c = EVP_CIPHER_CTX_get_app_data(ctx)) == NULL) {
-		c = malloc(sizeof(*c));
-		EVP_CIPHER_CTX_set_app_data(ctx, c);
+	size_t a, b;
+
+	for (; len >= sizeof(size_t); len -= sizeof(size_t)) {
+		memcpy(&a, src, sizeof(a));
+		memcpy(&b, ks, sizeof(b));
+		a ^= b;
+		memcpy(dest, &a, sizeof(a));
+		dest += sizeof(size_t);
+		src += sizeof(size_t);
+		ks += sizeof(size_t);
 	}
-	if (key != NULL)
-		AES_set_encrypt_key(key, EVP_CIPHER_CTX_key_length(ctx) * 8, &c->aes_ctx);
-	if (iv != NULL)
-		memcpy(c->aes_counter, iv, AES_BLOCK_SIZE);
-	return (1);
+	while (len-- > 0)
+		*(dest++) = *(src++) ^ *(ks++);
 }
 
-static int
-ssh_aes_ctr_cleanup(EVP_CIPHER_CTX *ctx)
+static void
+ssh_ctr_crypt(struct ssh_ctr_keystream *ks, ssh_ctr_block_f block, const void *key,
+              unsigned char *counter, unsigned int block_size,
+              unsigned char *dest, const unsigned char *src, unsigned int len)
 {
-	struct ssh_aes_ctr_ctx *c;
-
-	if((c = EVP_CIPHER_CTX_get_app_data(ctx)) != NULL) {
-		memset(c, 0, sizeof(*c));
-		free(c);
-		EVP_CIPHER_CTX_set_app_data(ctx, NULL);
+	unsigned char *p;
+	unsigned int n;
+
+	while (len > 0) {
+		if (ks->pos >= ks->len) {
+			ks->len = (sizeof(ks->buf) / block_size) * block_size;
+			for (p = ks->buf; p < ks->buf + ks->len; p += block_size) {
+				block(key, counter, p);
+				ssh_ctr_inc(counter, block_size);
+			}
+			ks->pos = 0;
+		}
+		n = ks->len - ks->pos;
+		if (n > len)
+			n = len;
+		ssh_ctr_xor(dest, src, ks->buf + ks->pos, n);
+		ks->pos += n;
+		dest += n;
+		src += n;
+		len -= n;
 	}
-	return (1);
 }
 
-const EVP_CIPHER *
-evp_aes_128_ctr(void)
+static void
+ssh_ctr_reset(struct ssh_ctr_keystream *ks)
 {
-	static EVP_CIPHER aes_ctr;
-
-	memset(&aes_ctr, 0, sizeof(EVP_CIPHER));
-	aes_ctr.nid = NID_undef;
-	aes_ctr.block_size = AES_BLOCK_SIZE;
-	aes_ctr.iv_len = AES_BLOCK_SIZE;
-	aes_ctr.key_len = 16;
-	aes_ctr.init = ssh_aes_ctr_init;
-	aes_ctr.cleanup = ssh_aes_ctr_cleanup;
-	aes_ctr.do_cipher = ssh_aes_ctr;
-#ifndef SSH_OLD_EVP
-	aes_ctr.flags = EVP_CIPH_CBC_MODE | EVP_CIPH_VARIABLE_LENGTH | EVP_CIPH_ALWAYS_CALL_INIT | EVP_CIPH_CUSTOM_IV;
-#endif
-	return (&aes_ctr);
+	ks->pos = ks->len = 0;
 }
 
 //============================================================================
 // Triple-DES
 //============================================================================
+static void
+ssh_des3_ctr_block(const void *key, const unsigned char *in, unsigned char *out)
+{
+	const struct ssh_des3_ctr_ctx *c = key;
+	DES_LONG tmp[2];
+
+	memcpy(tmp, in, DES_BLOCK_SIZE);
+	DES_encrypt3(tmp, (DES_key_schedule *)&c->des3_ctx[0],
+	             (DES_key_schedule *)&c->des3_ctx[1], (DES_key_schedule *)&c->des3_ctx[2]);
+	memcpy(out, tmp, DES_BLOCK_SIZE);
+}
+
 static int
 ssh_des3_ctr(EVP_CIPHER_CTX *ctx, unsigned char *dest, const unsigned char *src, unsigned int len)
 {
 	struct ssh_des3_ctr_ctx *c;
-	unsigned int n = 0;
-	unsigned char buf[DES_BLOCK_SIZE];
 
 	if (len == 0)
 		return (1);
 	if ((c = EVP_CIPHER_CTX_get_app_data(ctx)) == NULL)
 		return (0);
 
-	while ((len--) > 0) {
-		if (n == 0) {
-			memcpy(buf, (unsigned char *)(c->des3_counter), DES_BLOCK_SIZE);
-			DES_encrypt3((DES_LONG *)buf, &c->des3_ctx[0], &c->des3_ctx[1], &c->des3_ctx[2]);
-			ssh_ctr_inc(c->des3_counter, DES_BLOCK_SIZE);
-		}
-		*(dest++) = *(src++) ^ buf[n];
-		n = (n + 1) % DES_BLOCK_SIZE;
-	}
+	ssh_ctr_crypt(&c->ks, ssh_des3_ctr_block, c, c->des3_counter, DES_BLOCK_SIZE, dest, src, len);
 	return (1);
 }
 
@@ -192,6 +186,8 @@ ssh_des3_ctr_init(EVP_CIPHER_CTX *ctx, const unsigned char *key, const unsigned
 
 	if (iv != NULL)
 		memcpy(c->des3_counter, iv, DES_BLOCK_SIZE);
+	if (key != NULL || iv != NULL)
+		ssh_ctr_reset(&c->ks);
 	return (1);
 }
 
@@ -230,44 +226,41 @@ evp_des3_ctr(void)
 //============================================================================
 // Blowfish
 //============================================================================
+static void
+ssh_bf_ctr_block(const void *key, const unsigned char *in, unsigned char *out)
+{
+	const struct ssh_blowfish_ctr_ctx *c = key;
+	int i, j;
+	BF_LONG tmp[(BF_BLOCK + 3) / 4];
+
+	for (i = j = 0; i < BF_BLOCK; i += 4, j++) {
+		tmp[j]  = ((BF_LONG)*in++) << 24;
+		tmp[j] |= ((BF_LONG)*in++) << 16;
+		tmp[j] |= ((BF_LONG)*in++) << 8;
+		tmp[j] |= ((BF_LONG)*in++);
+	}
+
+	BF_encrypt(tmp, &c->blowfish_ctx);
+
+	for (i = j = 0; i < BF_BLOCK; i += 4, j++) {
+		*out++ = (unsigned char)(tmp[j] >> 24);
+		*out++ = (unsigned char)(tmp[j] >> 16);
+		*out++ = (unsigned char)(tmp[j] >> 8);
+		*out++ = (unsigned char)tmp[j];
+	}
+}
+
 static int
 ssh_bf_ctr(EVP_CIPHER_CTX *ctx, unsigned char *dest, const unsigned char *src, unsigned int len)
 {
 	struct ssh_blowfish_ctr_ctx *c;
-	unsigned int n = 0;
-	unsigned char buf[BF_BLOCK];
-	int i, j;
-	BF_LONG tmp[(BF_BLOCK + 3) / 4];
-	unsigned char *p;
 
 	if (len == 0)
 		return (1);
 	if ((c = EVP_CIPHER_CTX_get_app_data(ctx)) == NULL)
 		return (0);
 
-	while ((len--) > 0) {
-		if (n == 0) {
-			for (i = j = 0, p = c->blowfish_counter; i < BF_BLOCK; i += 4, j++) {
-				tmp[j]  = ((BF_LONG)*p++) << 24;
-				tmp[j] |= ((BF_LONG)*p++) << 16;
-				tmp[j] |= ((BF_LONG)*p++) << 8;
-				tmp[j] |= ((BF_LONG)*p++);
-			}
-
-			BF_encrypt(tmp, &c->blowfish_ctx);
-
-			for (i = j = 0, p = buf; i < BF_BLOCK; i += 4, j++) {
-				*p++ = (unsigned char)(tmp[j] >> 24);
-				*p++ = (unsigned char)(tmp[j] >> 16);
-				*p++ = (unsigned char)(tmp[j] >> 8);
-				*p++ = (unsigned char)tmp[j];
-			}
-
-			ssh_ctr_inc(c->blowfish_counter, BF_BLOCK);
-		}
-		*(dest++) = *(src++) ^ buf[n];
-		n = (n + 1) % BF_BLOCK;
-	}
+	ssh_ctr_crypt(&c->ks, ssh_bf_ctr_block, c, c->blowfish_counter, BF_BLOCK, dest, src, len);
 	return (1);
 }
 
@@ -286,6 +279,8 @@ ssh_bf_ctr_init(EVP_CIPHER_CTX *ctx, const unsigned char *key, const unsigned ch
 
 	if (iv != NULL)
 		memcpy(c->blowfish_counter, iv, BF_BLOCK);
+	if (key != NULL || iv != NULL)
+		ssh_ctr_reset(&c->ks);
 	return (1);
 }
 
@@ -324,44 +319,41 @@ evp_bf_ctr(void)
 //============================================================================
 // CAST-128
 //============================================================================
+static void
+ssh_cast5_ctr_block(const void *key, const unsigned char *in, unsigned char *out)
+{
+	const struct ssh_cast5_ctr_ctx *c = key;
+	int i, j;
+	CAST_LONG tmp[(CAST_BLOCK + 3) / 4];
+
+	for (i = j = 0; i < CAST_BLOCK; i += 4, j++) {
+		tmp[j]  = ((CAST_LONG)*in++) << 24;
+		tmp[j] |= ((CAST_LONG)*in++) << 16;
+		tmp[j] |= ((CAST_LONG)*in++) << 8;
+		tmp[j] |= ((CAST_LONG)*in++);
+	}
+
+	CAST_encrypt(tmp, &c->cast5_ctx);
+
+	for (i = j = 0; i < CAST_BLOCK; i += 4, j++) {
+		*out++ = (unsigned char)(tmp[j] >> 24);
+		*out++ = (unsigned char)(tmp[j] >> 16);
+		*out++ = (unsigned char)(tmp[j] >> 8);
+		*out++ = (unsigned char)tmp[j];
+	}
+}
+
 static int
 ssh_cast5_ctr(EVP_CIPHER_CTX *ctx, unsigned char *dest, const unsigned char *src, unsigned int len)
 {
 	struct ssh_cast5_ctr_ctx *c;
-	unsigned int n = 0;
-	unsigned char buf[CAST_BLOCK];
-	int i, j;
-	CAST_LONG tmp[(CAST_BLOCK + 3) / 4];
-	unsigned char *p;
 
 	if (len == 0)
 		return (1);
 	if ((c = EVP_CIPHER_CTX_get_app_data(ctx)) == NULL)
 		return (0);
 
-	while ((len--) > 0) {
-		if (n == 0) {
-			for (i = j = 0, p = c->cast5_counter; i < CAST_BLOCK; i += 4, j++) {
-				tmp[j]  = ((CAST_LONG)*p++) << 24;
-				tmp[j] |= ((CAST_LONG)*p++) << 16;
-				tmp[j] |= ((CAST_LONG)*p++) << 8;
-				tmp[j] |= ((CAST_LONG)*p++);
-			}
-
-			CAST_encrypt(tmp, &c->cast5_ctx);
-
-			for (i = j = 0, p = buf; i < CAST_BLOCK; i += 4, j++) {
-				*p++ = (unsigned char)(tmp[j] >> 24);
-				*p++ = (unsigned char)(tmp[j] >> 16);
-				*p++ = (unsigned char)(tmp[j] >> 8);
-				*p++ = (unsigned char)tmp[j];
-			}
-
-			ssh_ctr_inc(c->cast5_counter, CAST_BLOCK);
-		}
-		*(dest++) = *(src++) ^ buf[n];
-		n = (n + 1) % CAST_BLOCK;
-	}
+	ssh_ctr_crypt(&c->ks, ssh_cast5_ctr_block, c, c->cast5_counter, CAST_BLOCK, dest, src, len);
 	return (1);
 }
 
@@ -380,6 +372,8 @@ ssh_cast5_ctr_init(EVP_CIPHER_CTX *ctx, const unsigned char *key, const unsigned
 
 	if (iv != NULL)
 		memcpy(c->cast5_counter, iv, CAST_BLOCK);
+	if (key != NULL || iv != NULL)
+		ssh_ctr_reset(&c->ks);
 	return (1);
 }
 
@@ -418,26 +412,25 @@ evp_cast5_ctr(void)
 //============================================================================
 // Camellia
 //============================================================================
+static void
+ssh_camellia_ctr_block(const void *key, const unsigned char *in, unsigned char *out)
+{
+	const struct ssh_camellia_ctr_ctx *c = key;
+
+	Camellia_encrypt(in, out, &c->camellia_ctx);
+}
+
 static int
 ssh_camellia_ctr(EVP_CIPHER_CTX *ctx, unsigned char *dest, const unsigned char *src, unsigned int len)
 {
 	struct ssh_camellia_ctr_ctx *c;
-	unsigned int n = 0;
-	unsigned char buf[CAMELLIA_BLOCK_SIZE];
 
 	if (len == 0)
 		return (1);
 	if ((c = EVP_CIPHER_CTX_get_app_data(ctx)) == NULL)
 		return (0);
 
-	while ((len--) > 0) {
-		if (n == 0) {
-			Camellia_encrypt(c->camellia_counter, buf, &c->camellia_ctx);
-			ssh_ctr_inc(c->camellia_counter, CAMELLIA_BLOCK_SIZE);
-		}
-		*(dest++) = *(src++) ^ buf[n];
-		n = (n + 1) % CAMELLIA_BLOCK_SIZE;
-	}
+	ssh_ctr_crypt(&c->ks, ssh_camellia_ctr_block, c, c->camellia_counter, CAMELLIA_BLOCK_SIZE, dest, src, len);
 	return (1);
 }
 
@@ -454,6 +447,8 @@ ssh_camellia_ctr_init(EVP_CIPHER_CTX *ctx, const unsigned char *key, const unsig
 		Camellia_set_key(key, EVP_CIPHER_CTX_key_length(ctx) * 8, &c->camellia_ctx);
 	if (iv != NULL)
 		memcpy(c->camellia_counter, iv, CAMELLIA_BLOCK_SIZE);
+	if (key != NULL || iv != NULL)
+		ssh_ctr_reset(&c->ks);
 	return (1);
 }
 
@@ -476,8 +471,10 @@ ssh_camellia_ctr_iv(EVP_CIPHER_CTX *evp, int doset, unsigned char * iv, unsigned
 	struct ssh_camellia_ctr_ctx *c;
 
 	if ((c = EVP_CIPHER_CTX_get_app_data(evp)) != NULL)
-		if(doset)
+		if(doset) {
 			memcpy(c->camellia_counter, iv, len);
+			ssh_ctr_reset(&c->ks);
+		}
 		else
 			memcpy(iv, c->camellia_counter, len);
 }
@@ -212,6 +212,8 @@ static void no_encrypt(PTInstVar pvar, unsigned char FAR * buf, int bytes)
 {
 }
 
+static char FAR *get_cipher_name(int cipher);
+
 
 // for SSH2(yutaka)
 // Oɐݒ肷錮ႤȂ̂ŁAAES192, AES256 ł
@@ -968,6 +970,9 @@ BOOL CRYPT_set_supported_ciphers(PTInstVar pvar, int sender_ciphers,
 		            | (1 << SSH2_CIPHER_CAMELLIA128_CTR)
 		            | (1 << SSH2_CIPHER_CAMELLIA192_CTR)
 		            | (1 << SSH2_CIPHER_CAMELLIA256_CTR)
+		            | (1 << SSH2_CIPHER_AES128_GCM)
+		            | (1 << SSH2_CIPHER_AES256_GCM)
+		            | (1 << SSH2_CIPHER_CHACHAPOLY)
 		);
 	}
 
@@ -1017,6 +1022,41 @@ int CRYPT_get_encryption_block_size(PTInstVar pvar)
 	}
 }
 
+// VMAC HMAC  ipad/opad vZĂB
+// pPbgƂɂ͂̏ԂRs[ĎĝŁÃnbVvZ͌1񂾂ōςށB
+// ssh2_keys[mode] ɐVݒ肳ꂽƂɌĂԂƁB
+void CRYPT_set_MAC_key(PTInstVar pvar, int mode)
+{
+	struct Mac *mac = &pvar->ssh2_keys[mode].mac;
+
+	pvar->crypt_state.hmac_ready[mode] = FALSE;
+
+	// AEADÍłMACgȂ
+	if (mac->key == NULL || mac->md == NULL)
+		return;
+
+	if (HMAC_Init_ex(&pvar->crypt_state.hmac[mode], mac->key, mac->key_len, mac->md, NULL)) {
+		pvar->crypt_state.hmac_ready[mode] = TRUE;
+	}
+}
+
+// ݒς݂ HMAC ReLXg MAC vZB
+// HMAC_Init_ex() ɌnȂƁAvZς݂ ipad ԂRs[邾ɂȂB
+static BOOL calc_MAC(HMAC_CTX *c, uint32 sequence_number,
+                     char FAR * data, int len, unsigned char *m)
+{
+	unsigned char b[4];
+
+	set_uint32_MSBfirst(b, sequence_number);
+	if (!HMAC_Init_ex(c, NULL, 0, NULL, NULL) ||
+	    !HMAC_Update(c, b, sizeof(b)) ||
+	    !HMAC_Update(c, data, len) ||
+	    !HMAC_Final(c, m, NULL)) {
+		return FALSE;
+	}
+	return TRUE;
+}
+
 int CRYPT_get_receiver_MAC_size(PTInstVar pvar)
 {
 	struct Mac *mac;
@@ -1040,9 +1080,7 @@ int CRYPT_get_receiver_MAC_size(PTInstVar pvar)
 BOOL CRYPT_verify_receiver_MAC(PTInstVar pvar, uint32 sequence_number,
                                char FAR * data, int len, char FAR * MAC)
 {
-	HMAC_CTX c;
 	unsigned char m[EVP_MAX_MD_SIZE];
-	unsigned char b[4];
 	struct Mac *mac;
 
 	mac = &pvar->ssh2_keys[MODE_IN].mac;
@@ -1051,18 +1089,14 @@ BOOL CRYPT_verify_receiver_MAC(PTInstVar pvar, uint32 sequence_number,
 	if (mac == NULL || mac->enabled == 0) 
 		return TRUE;
 
-	if (mac->key == NULL)
+	if (!pvar->crypt_state.hmac_ready[MODE_IN])
 		goto error;
 
 	if ((u_int)mac->mac_len > sizeof(m))
 		goto error;
 
-	HMAC_Init(&c, mac->key, mac->key_len, mac->md);
-	set_uint32_MSBfirst(b, sequence_number);
-	HMAC_Update(&c, b, sizeof(b));
-	HMAC_Update(&c, data, len);
-	HMAC_Final(&c, m, NULL);
-	HMAC_cleanup(&c);
+	if (!calc_MAC(&pvar->crypt_state.hmac[MODE_IN], sequence_number, data, len, m))
+		goto error;
 
 	if (memcmp(m, MAC, mac->mac_len)) {
 		goto error;
@@ -1093,9 +1127,7 @@ int CRYPT_get_sender_MAC_size(PTInstVar pvar)
 BOOL CRYPT_build_sender_MAC(PTInstVar pvar, uint32 sequence_number,
                             char FAR * data, int len, char FAR * MAC)
 {
-	HMAC_CTX c;
 	static u_char m[EVP_MAX_MD_SIZE];
-	u_char b[4];
 	struct Mac *mac;
 
 	if (SSHv2(pvar)) { // for SSH2(yutaka)
@@ -1103,12 +1135,12 @@ BOOL CRYPT_build_sender_MAC(PTInstVar pvar, uint32 sequence_number,
 		if (mac == NULL || mac->enabled == 0) 
 			return FALSE;
 
-		HMAC_Init(&c, mac->key, mac->key_len, mac->md);
-		set_uint32_MSBfirst(b, sequence_number);
-		HMAC_Update(&c, b, sizeof(b));
-		HMAC_Update(&c, data, len);
-		HMAC_Final(&c, m, NULL);
-		HMAC_cleanup(&c);
+		// AEADÍłMACgȂ
+		if (!pvar->crypt_state.hmac_ready[MODE_OUT])
+			return FALSE;
+
+		if (!calc_MAC(&pvar->crypt_state.hmac[MODE_OUT], sequence_number, data, len, m))
+			return FALSE;
 
 		// 20oCgRs[
 		memcpy(MAC, m, pvar->ssh2_keys[MODE_OUT].mac.mac_len);
@@ -1121,6 +1153,102 @@ BOOL CRYPT_build_sender_MAC(PTInstVar pvar, uint32 sequence_number,
 
 }
 
+// AES-GCMɂ1pPbg̈Í/
+// data: packet-length(4) + ÍΏ(len) + F؃^O(authlen)
+// packet-length ͈Í AAD ƂĔF؂sB
+static BOOL cAESGCM_crypt(EVP_CIPHER_CTX *evp, unsigned char FAR * data,
+                          unsigned int len, unsigned int authlen, int do_encrypt)
+{
+	unsigned char lastiv[1];
+	unsigned char *tag = data + 4 + len;
+
+	if (EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_GCM_IV_GEN, 1, lastiv) == 0)
+		return FALSE;
+	if (!do_encrypt &&
+	    EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_GCM_SET_TAG, authlen, tag) == 0)
+		return FALSE;
+
+	if (EVP_Cipher(evp, NULL, data, 4) < 0)
+		return FALSE;
+	if (EVP_Cipher(evp, data + 4, data + 4, len) < 0)
+		return FALSE;
+	// ͂ŔF؃^O؂B
+	if (EVP_Cipher(evp, NULL, NULL, 0) < 0)
+		return FALSE;
+
+	if (do_encrypt &&
+	    EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_GCM_GET_TAG, authlen, tag) == 0)
+		return FALSE;
+
+	return TRUE;
+}
+
+// AEADÍ(AES-GCM, ChaCha20-Poly1305)ɂpPbg̈ÍƔF؃^O̐
+// data  packet-length(4) ɑ len oCgÍAɔF؃^OށB
+// {֐ SSH2 ł̂ݎgpB
+BOOL CRYPT_encrypt_aead(PTInstVar pvar, uint32 sequence_number,
+                        unsigned char FAR * data, unsigned int len)
+{
+	struct Enc *enc = &pvar->ssh2_keys[MODE_OUT].enc;
+	BOOL ret = FALSE;
+	char tmp[80];
+
+	switch (pvar->crypt_state.sender_cipher) {
+	case SSH2_CIPHER_AES128_GCM:
+	case SSH2_CIPHER_AES256_GCM:
+		ret = cAESGCM_crypt(&pvar->evpcip[MODE_OUT], data, len, enc->auth_len, 1);
+		break;
+
+	case SSH2_CIPHER_CHACHAPOLY:
+		ret = chachapoly_crypt(&pvar->crypt_state.enc.cChachaPoly, sequence_number,
+		                       data, data, len, 4, enc->auth_len, 1) == 0;
+		break;
+	}
+
+	if (!ret) {
+		UTIL_get_lang_msg("MSG_ENCRYPT_ERROR2", pvar, "%s encrypt error(2)");
+		_snprintf_s(tmp, sizeof(tmp), _TRUNCATE, pvar->ts->UIMsg,
+		            get_cipher_name(pvar->crypt_state.sender_cipher));
+		notify_fatal_error(pvar, tmp, TRUE);
+	}
+	return ret;
+}
+
+// AEADÍɂpPbg̔F؃^Ǒ؂ƕ
+// F؃^O data + 4 + len ɂB؂Ɏsꍇ FALSE ԂB
+BOOL CRYPT_decrypt_aead(PTInstVar pvar, uint32 sequence_number,
+                        unsigned char FAR * data, unsigned int len)
+{
+	struct Enc *enc = &pvar->ssh2_keys[MODE_IN].enc;
+
+	switch (pvar->crypt_state.receiver_cipher) {
+	case SSH2_CIPHER_AES128_GCM:
+	case SSH2_CIPHER_AES256_GCM:
+		return cAESGCM_crypt(&pvar->evpcip[MODE_IN], data, len, enc->auth_len, 0);
+
+	case SSH2_CIPHER_CHACHAPOLY:
+		return chachapoly_crypt(&pvar->crypt_state.dec.cChachaPoly, sequence_number,
+		                        data, data, len, 4, enc->auth_len, 0) == 0;
+	}
+	return FALSE;
+}
+
+// AEADÍŎMpPbg packet-length oB
+// ChaCha20-Poly1305 ł packet-length ÍĂ̂ŁAdata ɕB
+uint32 CRYPT_get_aead_packet_length(PTInstVar pvar, uint32 sequence_number,
+                                    unsigned char FAR * data)
+{
+	unsigned int len;
+
+	if (pvar->crypt_state.receiver_cipher == SSH2_CIPHER_CHACHAPOLY) {
+		if (chachapoly_get_length(&pvar->crypt_state.dec.cChachaPoly, &len,
+		                          sequence_number, data, 4) != 0)
+			return 0;
+		return len;
+	}
+	return get_uint32_MSBfirst(data);
+}
+
 static int choose_cipher(PTInstVar pvar, int supported)
 {
 	int i;
@@ -1385,6 +1513,17 @@ void cipher_init_SSH2(EVP_CIPHER_CTX *evp,
 		return;
 	}
 
+	// AES-GCMłIV̐擪4oCgŒ蕔Ac8oCgpPbgƂ
+	// 1 invocation counter ɂȂB(RFC5647)
+	if (EVP_CIPHER_mode(type) == EVP_CIPH_GCM_MODE &&
+	    EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_GCM_SET_IV_FIXED, -1, (u_char *)iv) == 0) {
+		UTIL_get_lang_msg("MSG_CIPHER_INIT_ERROR", pvar,
+		                  "Cipher initialize error(%d)");
+		_snprintf_s(tmp, sizeof(tmp), _TRUNCATE, pvar->ts->UIMsg, 4);
+		notify_fatal_error(pvar, tmp, TRUE);
+		return;
+	}
+
 	klen = EVP_CIPHER_CTX_key_length(evp);
 	if (klen > 0 && keylen != klen) {
 		if (EVP_CIPHER_CTX_set_key_length(evp, keylen) == 0) {
@@ -1438,6 +1577,7 @@ BOOL CRYPT_start_encryption(PTInstVar pvar, int sender_flag, int receiver_flag)
 	BOOL isOK = TRUE;
 
 	if (sender_flag) {
+		pvar->crypt_state.sender_aead = FALSE;
 		switch (pvar->crypt_state.sender_cipher) {
 			// for SSH2(yutaka)
 		case SSH2_CIPHER_3DES_CBC:
@@ -1579,6 +1719,43 @@ BOOL CRYPT_start_encryption(PTInstVar pvar, int sender_flag, int receiver_flag)
 				pvar->crypt_state.encrypt = c3DES_encrypt;
 				break;
 			}
+			// AEADÍ CRYPT_encrypt_aead() ňÍƔF؃^O̐𓯎ɍŝŁA
+			// CRYPT_encrypt() ł͉ȂB
+		case SSH2_CIPHER_AES128_GCM:
+		case SSH2_CIPHER_AES256_GCM:
+			{
+				struct Enc *enc;
+
+				enc = &pvar->ssh2_keys[MODE_OUT].enc;
+				cipher_init_SSH2(&pvar->evpcip[MODE_OUT],
+				                 enc->key, get_cipher_key_len(pvar->crypt_state.sender_cipher),
+				                 enc->iv, get_cipher_block_size(pvar->crypt_state.sender_cipher),
+				                 CIPHER_ENCRYPT,
+				                 get_cipher_EVP_CIPHER(pvar->crypt_state.sender_cipher),
+				                 get_cipher_discard_len(pvar->crypt_state.sender_cipher),
+				                 pvar);
+
+				pvar->crypt_state.encrypt = no_encrypt;
+				pvar->crypt_state.sender_aead = TRUE;
+				break;
+			}
+
+		case SSH2_CIPHER_CHACHAPOLY:
+			{
+				struct Enc *enc;
+
+				enc = &pvar->ssh2_keys[MODE_OUT].enc;
+				if (chachapoly_init(&pvar->crypt_state.enc.cChachaPoly,
+				                    enc->key, get_cipher_key_len(pvar->crypt_state.sender_cipher)) != 0) {
+					isOK = FALSE;
+					break;
+				}
+
+				pvar->crypt_state.encrypt = no_encrypt;
+				pvar->crypt_state.sender_aead = TRUE;
+				break;
+			}
+
 		case SSH_CIPHER_IDEA:{
 				cIDEA_init(encryption_key, &pvar->crypt_state.enc.cIDEA);
 				pvar->crypt_state.encrypt = cIDEA_encrypt;
@@ -1608,6 +1785,7 @@ BOOL CRYPT_start_encryption(PTInstVar pvar, int sender_flag, int receiver_flag)
 
 
 	if (receiver_flag) {
+		pvar->crypt_state.receiver_aead = FALSE;
 		switch (pvar->crypt_state.receiver_cipher) {
 			// for SSH2(yutaka)
 		case SSH2_CIPHER_3DES_CBC:
@@ -1751,6 +1929,41 @@ BOOL CRYPT_start_encryption(PTInstVar pvar, int sender_flag, int receiver_flag)
 				pvar->crypt_state.decrypt = c3DES_decrypt;
 				break;
 			}
+		case SSH2_CIPHER_AES128_GCM:
+		case SSH2_CIPHER_AES256_GCM:
+			{
+				struct Enc *enc;
+
+				enc = &pvar->ssh2_keys[MODE_IN].enc;
+				cipher_init_SSH2(&pvar->evpcip[MODE_IN],
+				                 enc->key, get_cipher_key_len(pvar->crypt_state.receiver_cipher),
+				                 enc->iv, get_cipher_block_size(pvar->crypt_state.receiver_cipher),
+				                 CIPHER_DECRYPT,
+				                 get_cipher_EVP_CIPHER(pvar->crypt_state.receiver_cipher),
+				                 get_cipher_discard_len(pvar->crypt_state.receiver_cipher),
+				                 pvar);
+
+				pvar->crypt_state.decrypt = no_encrypt;
+				pvar->crypt_state.receiver_aead = TRUE;
+				break;
+			}
+
+		case SSH2_CIPHER_CHACHAPOLY:
+			{
+				struct Enc *enc;
+
+				enc = &pvar->ssh2_keys[MODE_IN].enc;
+				if (chachapoly_init(&pvar->crypt_state.dec.cChachaPoly,
+				                    enc->key, get_cipher_key_len(pvar->crypt_state.receiver_cipher)) != 0) {
+					isOK = FALSE;
+					break;
+				}
+
+				pvar->crypt_state.decrypt = no_encrypt;
+				pvar->crypt_state.receiver_aead = TRUE;
+				break;
+			}
+
 		case SSH_CIPHER_IDEA:{
 				cIDEA_init(decryption_key, &pvar->crypt_state.dec.cIDEA);
 				pvar->crypt_state.decrypt = cIDEA_decrypt;
@@ -1796,6 +2009,12 @@ void CRYPT_init(PTInstVar pvar)
 	pvar->crypt_state.decrypt = no_encrypt;
 	pvar->crypt_state.sender_cipher = SSH_CIPHER_NONE;
 	pvar->crypt_state.receiver_cipher = SSH_CIPHER_NONE;
+	pvar->crypt_state.sender_aead = FALSE;
+	pvar->crypt_state.receiver_aead = FALSE;
+	HMAC_CTX_init(&pvar->crypt_state.hmac[MODE_IN]);
+	HMAC_CTX_init(&pvar->crypt_state.hmac[MODE_OUT]);
+	pvar->crypt_state.hmac_ready[MODE_IN] = FALSE;
+	pvar->crypt_state.hmac_ready[MODE_OUT] = FALSE;
 	pvar->crypt_state.server_key.RSA_key = NULL;
 	pvar->crypt_state.host_key.RSA_key = NULL;
 
@@ -1863,6 +2082,12 @@ static char FAR *get_cipher_name(int cipher)
 		return "Camellia192-CTR";
 	case SSH2_CIPHER_CAMELLIA256_CTR:
 		return "Camellia256-CTR";
+	case SSH2_CIPHER_AES128_GCM:
+		return "AES128-GCM";
+	case SSH2_CIPHER_AES256_GCM:
+		return "AES256-GCM";
+	case SSH2_CIPHER_CHACHAPOLY:
+		return "ChaCha20-Poly1305";
 
 	default:
 		return "Unknown";
@@ -1936,6 +2161,10 @@ void CRYPT_end(PTInstVar pvar)
 	       sizeof(pvar->crypt_state.client_cookie));
 	memset(&pvar->crypt_state.enc, 0, sizeof(pvar->crypt_state.enc));
 	memset(&pvar->crypt_state.dec, 0, sizeof(pvar->crypt_state.dec));
+	HMAC_CTX_cleanup(&pvar->crypt_state.hmac[MODE_IN]);
+	HMAC_CTX_cleanup(&pvar->crypt_state.hmac[MODE_OUT]);
+	pvar->crypt_state.hmac_ready[MODE_IN] = FALSE;
+	pvar->crypt_state.hmac_ready[MODE_OUT] = FALSE;
 }
 
 int CRYPT_passphrase_decrypt(int cipher, char FAR * passphrase,
@@ -39,6 +39,8 @@ See LICENSE.TXT for the license.
 #include <openssl/idea.h>
 #include <openssl/rc4.h>
 #include <openssl/blowfish.h>
+#include <openssl/hmac.h>
+#include "cipher-chachapoly.h"
 
 #define SSH_SESSION_KEY_LENGTH    32
 #define SSH_RSA_CHALLENGE_LENGTH  32
@@ -91,6 +93,7 @@ typedef union {
   CipherDESState cDES;
   CipherRC4State cRC4;
   CipherBlowfishState cBlowfish;
+  struct chachapoly_ctx cChachaPoly;
 } CRYPTCipherState;
 
 typedef void (* CRYPTCryptFun)(PTInstVar pvar, unsigned char FAR * buf, int bytes);
@@ -114,6 +117,10 @@ typedef struct {
   CRYPTCryptFun decrypt;
   CRYPTCipherState enc;
   CRYPTCipherState dec;
+  BOOL sender_aead;
+  BOOL receiver_aead;
+  HMAC_CTX hmac[MODE_MAX];
+  BOOL hmac_ready[MODE_MAX];
 } CRYPTState;
 
 void CRYPT_init(PTInstVar pvar);
@@ -143,6 +150,7 @@ BOOL CRYPT_start_encryption(PTInstVar pvar, int sender_flag, int receiver_flag);
 int CRYPT_generate_RSA_challenge_response(PTInstVar pvar, unsigned char FAR * challenge,
                                            int challenge_len, unsigned char FAR * response);
 
+void CRYPT_set_MAC_key(PTInstVar pvar, int mode);
 int CRYPT_get_receiver_MAC_size(PTInstVar pvar);
 BOOL CRYPT_verify_receiver_MAC(PTInstVar pvar, uint32 sequence_number,
   char FAR * data, int len, char FAR * MAC);
@@ -151,6 +159,19 @@ int CRYPT_get_sender_MAC_size(PTInstVar pvar);
 BOOL CRYPT_build_sender_MAC(PTInstVar pvar, uint32 sequence_number,
   char FAR * data, int len, char FAR * MAC);
 
+BOOL CRYPT_encrypt_aead(PTInstVar pvar, uint32 sequence_number,
+  unsigned char FAR * data, unsigned int len);
+BOOL CRYPT_decrypt_aead(PTInstVar pvar, uint32 sequence_number,
+  unsigned char FAR * data, unsigned int len);
+uint32 CRYPT_get_aead_packet_length(PTInstVar pvar, uint32 sequence_number,
+  unsigned char FAR * data);
+#define CRYPT_is_sender_aead(pvar) ((pvar)->crypt_state.sender_aead)
+#define CRYPT_is_receiver_aead(pvar) ((pvar)->crypt_state.receiver_aead)
+#define CRYPT_is_sender_etm(pvar) \
+    ((pvar)->ssh2_keys[MODE_OUT].mac.enabled && (pvar)->ssh2_keys[MODE_OUT].mac.etm)
+#define CRYPT_is_receiver_etm(pvar) \
+    ((pvar)->ssh2_keys[MODE_IN].mac.enabled && (pvar)->ssh2_keys[MODE_IN].mac.etm)
+
 BOOL CRYPT_set_supported_ciphers(PTInstVar pvar, int sender_ciphers, int receiver_ciphers);
 BOOL CRYPT_choose_ciphers(PTInstVar pvar);
 #define CRYPT_get_sender_cipher(pvar) ((pvar)->crypt_state.sender_cipher)
@@ -46,10 +46,10 @@
 
 #if 0
 #include <stdio.h>		/* used for debugging */
-#include <string.h>
 #endif
 
 #include <sys/types.h>
+#include <string.h>
 #include "ed25519_blf.h"
 
 #undef inline
@@ -68,6 +68,32 @@
 
 #define BLFRND(s,p,i,j,n) (i ^= F(s,j) ^ (p)[n])
 
+/*
+ * Unrolled encipher used by the (Eks)Blowfish key schedule, which calls it
+ * 521 times per state expansion.  The four S-boxes are addressed through
+ * separate pointers and the subkeys through a local copy, so the compiler
+ * can keep them in registers instead of reloading them from the context
+ * after every store into the S-boxes.
+ */
+#define F4(x) ((((s0)[(x) >> 24] + (s1)[((x) >> 16) & 0xFF]) \
+		 ^ (s2)[((x) >> 8) & 0xFF]) + (s3)[(x) & 0xFF])
+
+#define BLF_ENCIPHER(p, xl, xr) do {					\
+	u_int32_t t_;							\
+	xl ^= (p)[0];							\
+	xr ^= F4(xl) ^ (p)[1];  xl ^= F4(xr) ^ (p)[2];			\
+	xr ^= F4(xl) ^ (p)[3];  xl ^= F4(xr) ^ (p)[4];			\
+	xr ^= F4(xl) ^ (p)[5];  xl ^= F4(xr) ^ (p)[6];			\
+	xr ^= F4(xl) ^ (p)[7];  xl ^= F4(xr) ^ (p)[8];			\
+	xr ^= F4(xl) ^ (p)[9];  xl ^= F4(xr) ^ (p)[10];			\
+	xr ^= F4(xl) ^ (p)[11]; xl ^= F4(xr) ^ (p)[12];			\
+	xr ^= F4(xl) ^ (p)[13]; xl ^= F4(xr) ^ (p)[14];			\
+	xr ^= F4(xl) ^ (p)[15]; xl ^= F4(xr) ^ (p)[16];			\
+	t_ = xl;							\
+	xl = xr ^ (p)[17];						\
+	xr = t_;							\
+} while (0)
+
 void
 Blowfish_encipher(blf_ctx *c, u_int32_t *xl, u_int32_t *xr)
 {
@@ -427,32 +453,41 @@ Blowfish_expand0state(blf_ctx *c, const u_int8_t *key, u_int16_t keybytes)
 	u_int32_t temp;
 	u_int32_t datal;
 	u_int32_t datar;
+	u_int32_t p[BLF_N + 2];
+	u_int32_t *s0 = c->S[0];
+	u_int32_t *s1 = c->S[1];
+	u_int32_t *s2 = c->S[2];
+	u_int32_t *s3 = c->S[3];
+	u_int32_t *s;
 
 	j = 0;
 	for (i = 0; i < BLF_N + 2; i++) {
 		/* Extract 4 int8 to 1 int32 from keystream */
 		temp = Blowfish_stream2word(key, keybytes, &j);
-		c->P[i] = c->P[i] ^ temp;
+		p[i] = c->P[i] ^ temp;
 	}
 
-	j = 0;
 	datal = 0x00000000;
 	datar = 0x00000000;
 	for (i = 0; i < BLF_N + 2; i += 2) {
-		Blowfish_encipher(c, &datal, &datar);
+		BLF_ENCIPHER(p, datal, datar);
 
-		c->P[i] = datal;
-		c->P[i + 1] = datar;
+		p[i] = datal;
+		p[i + 1] = datar;
 	}
+	memcpy(c->P, p, sizeof(p));
 
 	for (i = 0; i < 4; i++) {
+		s = c->S[i];
 		for (k = 0; k < 256; k += 2) {
-			Blowfish_encipher(c, &datal, &datar);
+			BLF_ENCIPHER(p, datal, datar);
 
-			c->S[i][k] = datal;
-			c->S[i][k + 1] = datar;
+			s[k] = datal;
+			s[k + 1] = datar;
 		}
 	}
+
+	memset(p, 0, sizeof(p));
 }
 
 
@@ -466,12 +501,18 @@ Blowfish_expandstate(blf_ctx *c, const u_int8_t *data, u_int16_t databytes,
 	u_int32_t temp;
 	u_int32_t datal;
 	u_int32_t datar;
+	u_int32_t p[BLF_N + 2];
+	u_int32_t *s0 = c->S[0];
+	u_int32_t *s1 = c->S[1];
+	u_int32_t *s2 = c->S[2];
+	u_int32_t *s3 = c->S[3];
+	u_int32_t *s;
 
 	j = 0;
 	for (i = 0; i < BLF_N + 2; i++) {
 		/* Extract 4 int8 to 1 int32 from keystream */
 		temp = Blowfish_stream2word(key, keybytes, &j);
-		c->P[i] = c->P[i] ^ temp;
+		p[i] = c->P[i] ^ temp;
 	}
 
 	j = 0;
@@ -480,23 +521,26 @@ Blowfish_expandstate(blf_ctx *c, const u_int8_t *data, u_int16_t databytes,
 	for (i = 0; i < BLF_N + 2; i += 2) {
 		datal ^= Blowfish_stream2word(data, databytes, &j);
 		datar ^= Blowfish_stream2word(data, databytes, &j);
-		Blowfish_encipher(c, &datal, &datar);
+		BLF_ENCIPHER(p, datal, datar);
 
-		c->P[i] = datal;
-		c->P[i + 1] = datar;
+		p[i] = datal;
+		p[i + 1] = datar;
 	}
+	memcpy(c->P, p, sizeof(p));
 
 	for (i = 0; i < 4; i++) {
+		s = c->S[i];
 		for (k = 0; k < 256; k += 2) {
 			datal ^= Blowfish_stream2word(data, databytes, &j);
 			datar ^= Blowfish_stream2word(data, databytes, &j);
-			Blowfish_encipher(c, &datal, &datar);
+			BLF_ENCIPHER(p, datal, datar);
 
-			c->S[i][k] = datal;
-			c->S[i][k + 1] = datar;
+			s[k] = datal;
+			s[k + 1] = datar;
 		}
 	}
 
+	memset(p, 0, sizeof(p));
 }
 
 void
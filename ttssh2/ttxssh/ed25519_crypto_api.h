@@ -43,6 +43,7 @@ typedef u_int64_t uint64_t;
 
 typedef int crypto_int32;
 typedef unsigned int crypto_uint32;
+typedef long long int crypto_int64;
 
 #define randombytes(buf, buf_len) arc4random_buf((buf), (buf_len))
 
@@ -69,6 +70,11 @@ int	crypto_sign_ed25519_open(unsigned char *, unsigned long long *,
     const unsigned char *, unsigned long long, const unsigned char *);
 int	crypto_sign_ed25519_keypair(unsigned char *, unsigned char *);
 
+#define crypto_scalarmult_curve25519_BYTES 32U
+
+int	crypto_scalarmult_curve25519(unsigned char *a,
+    const unsigned char *b, const unsigned char *c);
+
 int	bcrypt_pbkdf(const char *, size_t, const u_int8_t *, size_t,
     u_int8_t *, size_t, unsigned int);
 
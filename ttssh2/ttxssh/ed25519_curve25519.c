@@ -0,0 +1,77 @@
+/*
+ * Public Domain.
+ * X25519 (RFC 7748) built on the field arithmetic of ed25519_fe25519.c,
+ * used by the curve25519-sha256 key exchange.
+ */
+
+#include "ed25519_fe25519.h"
+
+/* (486662 - 2) / 4 */
+static const fe25519 a24 = {{121665, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
+
+/* Constant-time version of: if(b) swap p and q */
+static void cswap(fe25519 *p, fe25519 *q, unsigned char b)
+{
+  fe25519 t = *p;
+  fe25519_cmov(p, q, b);
+  fe25519_cmov(q, &t, b);
+}
+
+/* Montgomery ladder, RFC 7748 section 5 */
+int crypto_scalarmult_curve25519(unsigned char *q, const unsigned char *n, const unsigned char *p)
+{
+  unsigned char s[32];
+  fe25519 x1, x2, z2, x3, z3;
+  fe25519 a, aa, b, bb, e, c, d, da, cb;
+  unsigned char swap = 0, bit;
+  int i;
+
+  for(i=0;i<32;i++) s[i] = n[i];
+  s[0] &= 248;
+  s[31] &= 127;
+  s[31] |= 64;
+
+  fe25519_unpack(&x1, p);
+  fe25519_setone(&x2);
+  fe25519_setzero(&z2);
+  x3 = x1;
+  fe25519_setone(&z3);
+
+  for(i=254;i>=0;i--)
+  {
+    bit = (s[i >> 3] >> (i & 7)) & 1;
+    swap ^= bit;
+    cswap(&x2, &x3, swap);
+    cswap(&z2, &z3, swap);
+    swap = bit;
+
+    fe25519_add(&a, &x2, &z2);
+    fe25519_square(&aa, &a);
+    fe25519_sub(&b, &x2, &z2);
+    fe25519_square(&bb, &b);
+    fe25519_sub(&e, &aa, &bb);
+    fe25519_add(&c, &x3, &z3);
+    fe25519_sub(&d, &x3, &z3);
+    fe25519_mul(&da, &d, &a);
+    fe25519_mul(&cb, &c, &b);
+
+    fe25519_add(&x3, &da, &cb);
+    fe25519_square(&x3, &x3);
+    fe25519_sub(&z3, &da, &cb);
+    fe25519_square(&z3, &z3);
+    fe25519_mul(&z3, &z3, &x1);
+    fe25519_mul(&x2, &aa, &bb);
+    fe25519_mul(&z2, &a24, &e);
+    fe25519_add(&z2, &z2, &aa);
+    fe25519_mul(&z2, &z2, &e);
+  }
+  cswap(&x2, &x3, swap);
+  cswap(&z2, &z3, swap);
+
+  fe25519_invert(&z2, &z2);
+  fe25519_mul(&x2, &x2, &z2);
+  fe25519_pack(q, &x2);
+
+  for(i=0;i<32;i++) s[i] = 0;
+  return 0;
+}
@@ -4,141 +4,190 @@
  * Public Domain, Authors: Daniel J. Bernstein, Niels Duif, Tanja Lange,
  * Peter Schwabe, Bo-Yin Yang.
  * Copied from supercop-20130419/crypto_sign/ed25519/ref/fe25519.c
+ *
+ * The field arithmetic was replaced with the radix 2^25.5 representation
+ * of supercop's crypto_sign/ed25519/ref10 (same authors, public domain).
+ * fe25519_invert() and fe25519_pow2523() are unchanged.
  */
 
 //#include "includes.h"
 
-#define WINDOWSIZE 1 /* Should be 1,2, or 4 */
-#define WINDOWMASK ((1<<WINDOWSIZE)-1)
-
 #include "ed25519_fe25519.h"
 
 #pragma warning(disable : 4146)
 
-static crypto_uint32 equal(crypto_uint32 a,crypto_uint32 b) /* 16-bit inputs */
-{
-  crypto_uint32 x = a ^ b; /* 0: yes; 1..65535: no */
-  x -= 1; /* 4294967295: yes; 0..65534: no */
-  x >>= 31; /* 1: yes; 0: no */
-  return x;
-}
+/*
+ * An element is h[0]+2^26 h[1]+2^51 h[2]+2^77 h[3]+2^102 h[4]+...+2^230 h[9].
+ * Every function leaves the limbs carried, i.e. |h[i]| is a little over
+ * 2^25 for even i and 2^24 for odd i, so results can be fed to any other
+ * function without further reduction and the products in fe25519_mul()
+ * fit in 64 bits.
+ */
 
-static crypto_uint32 ge(crypto_uint32 a,crypto_uint32 b) /* 16-bit inputs */
+static crypto_int64 load_3(const unsigned char *in)
 {
-  unsigned int x = a;
-  x -= (unsigned int) b; /* 0..65535: yes; 4294901761..4294967295: no */
-  x >>= 31; /* 0: yes; 1: no */
-  x ^= 1; /* 1: yes; 0: no */
-  return x;
+  crypto_int64 result;
+  result = (crypto_int64) in[0];
+  result |= ((crypto_int64) in[1]) << 8;
+  result |= ((crypto_int64) in[2]) << 16;
+  return result;
 }
 
-static crypto_uint32 times19(crypto_uint32 a)
+static crypto_int64 load_4(const unsigned char *in)
 {
-  return (a << 4) + (a << 1) + a;
+  crypto_int64 result;
+  result = (crypto_int64) in[0];
+  result |= ((crypto_int64) in[1]) << 8;
+  result |= ((crypto_int64) in[2]) << 16;
+  result |= ((crypto_int64) in[3]) << 24;
+  return result;
 }
 
-static crypto_uint32 times38(crypto_uint32 a)
-{
-  return (a << 5) + (a << 2) + (a << 1);
-}
+#define CARRY(i, j, bits) \
+  c = (h##i + ((crypto_int64) 1 << ((bits) - 1))) >> (bits); \
+  h##j += c; \
+  h##i -= c * ((crypto_int64) 1 << (bits));
 
-static void reduce_add_sub(fe25519 *r)
+static void carry(fe25519 *r,
+                  crypto_int64 h0, crypto_int64 h1, crypto_int64 h2, crypto_int64 h3, crypto_int64 h4,
+                  crypto_int64 h5, crypto_int64 h6, crypto_int64 h7, crypto_int64 h8, crypto_int64 h9)
 {
-  crypto_uint32 t;
-  int i,rep;
-
-  for(rep=0;rep<4;rep++)
-  {
-    t = r->v[31] >> 7;
-    r->v[31] &= 127;
-    t = times19(t);
-    r->v[0] += t;
-    for(i=0;i<31;i++)
-    {
-      t = r->v[i] >> 8;
-      r->v[i+1] += t;
-      r->v[i] &= 255;
-    }
-  }
+  crypto_int64 c;
+
+  CARRY(0, 1, 26); CARRY(4, 5, 26);
+  CARRY(1, 2, 25); CARRY(5, 6, 25);
+  CARRY(2, 3, 26); CARRY(6, 7, 26);
+  CARRY(3, 4, 25); CARRY(7, 8, 25);
+  CARRY(4, 5, 26); CARRY(8, 9, 26);
+  c = (h9 + ((crypto_int64) 1 << 24)) >> 25;
+  h0 += c * 19;
+  h9 -= c * ((crypto_int64) 1 << 25);
+  CARRY(0, 1, 26);
+
+  r->v[0] = (crypto_int32) h0;
+  r->v[1] = (crypto_int32) h1;
+  r->v[2] = (crypto_int32) h2;
+  r->v[3] = (crypto_int32) h3;
+  r->v[4] = (crypto_int32) h4;
+  r->v[5] = (crypto_int32) h5;
+  r->v[6] = (crypto_int32) h6;
+  r->v[7] = (crypto_int32) h7;
+  r->v[8] = (crypto_int32) h8;
+  r->v[9] = (crypto_int32) h9;
 }
 
-static void reduce_mul(fe25519 *r)
-{
-  crypto_uint32 t;
-  int i,rep;
-
-  for(rep=0;rep<2;rep++)
-  {
-    t = r->v[31] >> 7;
-    r->v[31] &= 127;
-    t = times19(t);
-    r->v[0] += t;
-    for(i=0;i<31;i++)
-    {
-      t = r->v[i] >> 8;
-      r->v[i+1] += t;
-      r->v[i] &= 255;
-    }
-  }
-}
+#undef CARRY
 
 /* reduction modulo 2^255-19 */
-void fe25519_freeze(fe25519 *r) 
+void fe25519_freeze(fe25519 *r)
 {
-  int i;
-  crypto_uint32 m = equal(r->v[31],127);
-  for(i=30;i>0;i--)
-    m &= equal(r->v[i],255);
-  m &= ge(r->v[0],237);
-
-  // warning C4146: t̒lϐ́At^ɃLXgȂ΂Ȃ܂B
-  // FIXME: gccVC++ł͓삪قȂH
-  m = -m;
-
-  r->v[31] -= m&127;
-  for(i=30;i>0;i--)
-    r->v[i] -= m&255;
-  r->v[0] -= m&237;
+  unsigned char s[32];
+  fe25519_pack(s, r);
+  fe25519_unpack(r, s);
 }
 
 void fe25519_unpack(fe25519 *r, const unsigned char x[32])
 {
-  int i;
-  for(i=0;i<32;i++) r->v[i] = x[i];
-  r->v[31] &= 127;
+  carry(r,
+        load_4(x),
+        load_3(x + 4) << 6,
+        load_3(x + 7) << 5,
+        load_3(x + 10) << 3,
+        load_3(x + 13) << 2,
+        load_4(x + 16),
+        load_3(x + 20) << 7,
+        load_3(x + 23) << 5,
+        load_3(x + 26) << 4,
+        (load_3(x + 29) & 8388607) << 2);
 }
 
-/* Assumes input x being reduced below 2^255 */
+/* Produces the unique representative below 2^255-19 */
 void fe25519_pack(unsigned char r[32], const fe25519 *x)
 {
-  int i;
-  fe25519 y = *x;
-  fe25519_freeze(&y);
-  for(i=0;i<32;i++) 
-    r[i] = y.v[i];
+  crypto_int32 h0 = x->v[0], h1 = x->v[1], h2 = x->v[2], h3 = x->v[3], h4 = x->v[4];
+  crypto_int32 h5 = x->v[5], h6 = x->v[6], h7 = x->v[7], h8 = x->v[8], h9 = x->v[9];
+  crypto_int32 q;
+
+  /* q = floor(x / p), 0 or 1 for carried input */
+  q = (19 * h9 + (((crypto_int32) 1) << 24)) >> 25;
+  q = (h0 + q) >> 26;
+  q = (h1 + q) >> 25;
+  q = (h2 + q) >> 26;
+  q = (h3 + q) >> 25;
+  q = (h4 + q) >> 26;
+  q = (h5 + q) >> 25;
+  q = (h6 + q) >> 26;
+  q = (h7 + q) >> 25;
+  q = (h8 + q) >> 26;
+  q = (h9 + q) >> 25;
+
+  /* x - q*p = x + 19*q - q*2^255 */
+  h0 += 19 * q;
+
+  h1 += h0 >> 26; h0 &= 0x3ffffff;
+  h2 += h1 >> 25; h1 &= 0x1ffffff;
+  h3 += h2 >> 26; h2 &= 0x3ffffff;
+  h4 += h3 >> 25; h3 &= 0x1ffffff;
+  h5 += h4 >> 26; h4 &= 0x3ffffff;
+  h6 += h5 >> 25; h5 &= 0x1ffffff;
+  h7 += h6 >> 26; h6 &= 0x3ffffff;
+  h8 += h7 >> 25; h7 &= 0x1ffffff;
+  h9 += h8 >> 26; h8 &= 0x3ffffff;
+  h9 &= 0x1ffffff;
+
+  r[0] = (unsigned char) h0;
+  r[1] = (unsigned char) (h0 >> 8);
+  r[2] = (unsigned char) (h0 >> 16);
+  r[3] = (unsigned char) ((h0 >> 24) | ((crypto_uint32) h1 << 2));
+  r[4] = (unsigned char) (h1 >> 6);
+  r[5] = (unsigned char) (h1 >> 14);
+  r[6] = (unsigned char) ((h1 >> 22) | ((crypto_uint32) h2 << 3));
+  r[7] = (unsigned char) (h2 >> 5);
+  r[8] = (unsigned char) (h2 >> 13);
+  r[9] = (unsigned char) ((h2 >> 21) | ((crypto_uint32) h3 << 5));
+  r[10] = (unsigned char) (h3 >> 3);
+  r[11] = (unsigned char) (h3 >> 11);
+  r[12] = (unsigned char) ((h3 >> 19) | ((crypto_uint32) h4 << 6));
+  r[13] = (unsigned char) (h4 >> 2);
+  r[14] = (unsigned char) (h4 >> 10);
+  r[15] = (unsigned char) (h4 >> 18);
+  r[16] = (unsigned char) h5;
+  r[17] = (unsigned char) (h5 >> 8);
+  r[18] = (unsigned char) (h5 >> 16);
+  r[19] = (unsigned char) ((h5 >> 24) | ((crypto_uint32) h6 << 1));
+  r[20] = (unsigned char) (h6 >> 7);
+  r[21] = (unsigned char) (h6 >> 15);
+  r[22] = (unsigned char) ((h6 >> 23) | ((crypto_uint32) h7 << 3));
+  r[23] = (unsigned char) (h7 >> 5);
+  r[24] = (unsigned char) (h7 >> 13);
+  r[25] = (unsigned char) ((h7 >> 21) | ((crypto_uint32) h8 << 4));
+  r[26] = (unsigned char) (h8 >> 4);
+  r[27] = (unsigned char) (h8 >> 12);
+  r[28] = (unsigned char) ((h8 >> 20) | ((crypto_uint32) h9 << 6));
+  r[29] = (unsigned char) (h9 >> 2);
+  r[30] = (unsigned char) (h9 >> 10);
+  r[31] = (unsigned char) (h9 >> 18);
 }
 
 int fe25519_iszero(const fe25519 *x)
 {
   int i;
-  int r;
-  fe25519 t = *x;
-  fe25519_freeze(&t);
-  r = equal(t.v[0],0);
-  for(i=1;i<32;i++) 
-    r &= equal(t.v[i],0);
-  return r;
+  unsigned char s[32];
+  crypto_uint32 r = 0;
+  fe25519_pack(s, x);
+  for(i=0;i<32;i++)
+    r |= s[i];
+  return (int) ((r - 1) >> 31);
 }
 
 int fe25519_iseq_vartime(const fe25519 *x, const fe25519 *y)
 {
   int i;
-  fe25519 t1 = *x;
-  fe25519 t2 = *y;
-  fe25519_freeze(&t1);
-  fe25519_freeze(&t2);
+  unsigned char s1[32], s2[32];
+  fe25519_pack(s1, x);
+  fe25519_pack(s2, y);
   for(i=0;i<32;i++)
-    if(t1.v[i] != t2.v[i]) return 0;
+    if(s1[i] != s2[i]) return 0;
   return 1;
 }
 
@@ -149,76 +198,148 @@ void fe25519_cmov(fe25519 *r, const fe25519 *x, unsigned char b)
   // warning C4146: t̒lϐ́At^ɃLXgȂ΂Ȃ܂B
   // FIXME: gccVC++ł͓삪قȂH
   mask = -mask;
-  for(i=0;i<32;i++) r->v[i] ^= mask & (x->v[i] ^ r->v[i]);
+  for(i=0;i<10;i++) r->v[i] ^= mask & (x->v[i] ^ r->v[i]);
 }
 
 unsigned char fe25519_getparity(const fe25519 *x)
 {
-  fe25519 t = *x;
-  fe25519_freeze(&t);
-  return t.v[0] & 1;
+  unsigned char s[32];
+  fe25519_pack(s, x);
+  return s[0] & 1;
 }
 
 void fe25519_setone(fe25519 *r)
 {
   int i;
   r->v[0] = 1;
-  for(i=1;i<32;i++) r->v[i]=0;
+  for(i=1;i<10;i++) r->v[i]=0;
 }
 
 void fe25519_setzero(fe25519 *r)
 {
   int i;
-  for(i=0;i<32;i++) r->v[i]=0;
+  for(i=0;i<10;i++) r->v[i]=0;
 }
 
 void fe25519_neg(fe25519 *r, const fe25519 *x)
 {
-  fe25519 t;
   int i;
-  for(i=0;i<32;i++) t.v[i]=x->v[i];
-  fe25519_setzero(r);
-  fe25519_sub(r, r, &t);
+  for(i=0;i<10;i++) r->v[i] = -x->v[i];
 }
 
 void fe25519_add(fe25519 *r, const fe25519 *x, const fe25519 *y)
 {
-  int i;
-  for(i=0;i<32;i++) r->v[i] = x->v[i] + y->v[i];
-  reduce_add_sub(r);
+  carry(r,
+        (crypto_int64) x->v[0] + y->v[0], (crypto_int64) x->v[1] + y->v[1],
+        (crypto_int64) x->v[2] + y->v[2], (crypto_int64) x->v[3] + y->v[3],
+        (crypto_int64) x->v[4] + y->v[4], (crypto_int64) x->v[5] + y->v[5],
+        (crypto_int64) x->v[6] + y->v[6], (crypto_int64) x->v[7] + y->v[7],
+        (crypto_int64) x->v[8] + y->v[8], (crypto_int64) x->v[9] + y->v[9]);
 }
 
 void fe25519_sub(fe25519 *r, const fe25519 *x, const fe25519 *y)
 {
-  int i;
-  crypto_uint32 t[32];
-  t[0] = x->v[0] + 0x1da;
-  t[31] = x->v[31] + 0xfe;
-  for(i=1;i<31;i++) t[i] = x->v[i] + 0x1fe;
-  for(i=0;i<32;i++) r->v[i] = t[i] - y->v[i];
-  reduce_add_sub(r);
+  carry(r,
+        (crypto_int64) x->v[0] - y->v[0], (crypto_int64) x->v[1] - y->v[1],
+        (crypto_int64) x->v[2] - y->v[2], (crypto_int64) x->v[3] - y->v[3],
+        (crypto_int64) x->v[4] - y->v[4], (crypto_int64) x->v[5] - y->v[5],
+        (crypto_int64) x->v[6] - y->v[6], (crypto_int64) x->v[7] - y->v[7],
+        (crypto_int64) x->v[8] - y->v[8], (crypto_int64) x->v[9] - y->v[9]);
 }
 
+/*
+ * Schoolbook multiplication with the wrap-around folded in: a limb
+ * product whose weight exceeds 2^255 is multiplied by 19, and the
+ * product of two odd limbs is doubled because 2^25.5 is not an integer
+ * power of two.
+ */
 void fe25519_mul(fe25519 *r, const fe25519 *x, const fe25519 *y)
 {
-  int i,j;
-  crypto_uint32 t[63];
-  for(i=0;i<63;i++)t[i] = 0;
-
-  for(i=0;i<32;i++)
-    for(j=0;j<32;j++)
-      t[i+j] += x->v[i] * y->v[j];
-
-  for(i=32;i<63;i++)
-    r->v[i-32] = t[i-32] + times38(t[i]); 
-  r->v[31] = t[31]; /* result now in r[0]...r[31] */
-
-  reduce_mul(r);
+  crypto_int32 f0 = x->v[0], f1 = x->v[1], f2 = x->v[2], f3 = x->v[3], f4 = x->v[4];
+  crypto_int32 f5 = x->v[5], f6 = x->v[6], f7 = x->v[7], f8 = x->v[8], f9 = x->v[9];
+  crypto_int32 g0 = y->v[0], g1 = y->v[1], g2 = y->v[2], g3 = y->v[3], g4 = y->v[4];
+  crypto_int32 g5 = y->v[5], g6 = y->v[6], g7 = y->v[7], g8 = y->v[8], g9 = y->v[9];
+  crypto_int32 g1_19 = 19 * g1, g2_19 = 19 * g2, g3_19 = 19 * g3, g4_19 = 19 * g4, g5_19 = 19 * g5;
+  crypto_int32 g6_19 = 19 * g6, g7_19 = 19 * g7, g8_19 = 19 * g8, g9_19 = 19 * g9;
+  crypto_int32 f1_2 = 2 * f1, f3_2 = 2 * f3, f5_2 = 2 * f5, f7_2 = 2 * f7, f9_2 = 2 * f9;
+  crypto_int64 h0, h1, h2, h3, h4, h5, h6, h7, h8, h9;
+
+  h0 = f0 * (crypto_int64) g0 + f1_2 * (crypto_int64) g9_19 + f2 * (crypto_int64) g8_19
+       + f3_2 * (crypto_int64) g7_19 + f4 * (crypto_int64) g6_19 + f5_2 * (crypto_int64) g5_19
+       + f6 * (crypto_int64) g4_19 + f7_2 * (crypto_int64) g3_19 + f8 * (crypto_int64) g2_19
+       + f9_2 * (crypto_int64) g1_19;
+  h1 = f0 * (crypto_int64) g1 + f1 * (crypto_int64) g0 + f2 * (crypto_int64) g9_19
+       + f3 * (crypto_int64) g8_19 + f4 * (crypto_int64) g7_19 + f5 * (crypto_int64) g6_19
+       + f6 * (crypto_int64) g5_19 + f7 * (crypto_int64) g4_19 + f8 * (crypto_int64) g3_19
+       + f9 * (crypto_int64) g2_19;
+  h2 = f0 * (crypto_int64) g2 + f1_2 * (crypto_int64) g1 + f2 * (crypto_int64) g0
+       + f3_2 * (crypto_int64) g9_19 + f4 * (crypto_int64) g8_19 + f5_2 * (crypto_int64) g7_19
+       + f6 * (crypto_int64) g6_19 + f7_2 * (crypto_int64) g5_19 + f8 * (crypto_int64) g4_19
+       + f9_2 * (crypto_int64) g3_19;
+  h3 = f0 * (crypto_int64) g3 + f1 * (crypto_int64) g2 + f2 * (crypto_int64) g1
+       + f3 * (crypto_int64) g0 + f4 * (crypto_int64) g9_19 + f5 * (crypto_int64) g8_19
+       + f6 * (crypto_int64) g7_19 + f7 * (crypto_int64) g6_19 + f8 * (crypto_int64) g5_19
+       + f9 * (crypto_int64) g4_19;
+  h4 = f0 * (crypto_int64) g4 + f1_2 * (crypto_int64) g3 + f2 * (crypto_int64) g2
+       + f3_2 * (crypto_int64) g1 + f4 * (crypto_int64) g0 + f5_2 * (crypto_int64) g9_19
+       + f6 * (crypto_int64) g8_19 + f7_2 * (crypto_int64) g7_19 + f8 * (crypto_int64) g6_19
+       + f9_2 * (crypto_int64) g5_19;
+  h5 = f0 * (crypto_int64) g5 + f1 * (crypto_int64) g4 + f2 * (crypto_int64) g3
+       + f3 * (crypto_int64) g2 + f4 * (crypto_int64) g1 + f5 * (crypto_int64) g0
+       + f6 * (crypto_int64) g9_19 + f7 * (crypto_int64) g8_19 + f8 * (crypto_int64) g7_19
+       + f9 * (crypto_int64) g6_19;
+  h6 = f0 * (crypto_int64) g6 + f1_2 * (crypto_int64) g5 + f2 * (crypto_int64) g4
+       + f3_2 * (crypto_int64) g3 + f4 * (crypto_int64) g2 + f5_2 * (crypto_int64) g1
+       + f6 * (crypto_int64) g0 + f7_2 * (crypto_int64) g9_19 + f8 * (crypto_int64) g8_19
+       + f9_2 * (crypto_int64) g7_19;
+  h7 = f0 * (crypto_int64) g7 + f1 * (crypto_int64) g6 + f2 * (crypto_int64) g5
+       + f3 * (crypto_int64) g4 + f4 * (crypto_int64) g3 + f5 * (crypto_int64) g2
+       + f6 * (crypto_int64) g1 + f7 * (crypto_int64) g0 + f8 * (crypto_int64) g9_19
+       + f9 * (crypto_int64) g8_19;
+  h8 = f0 * (crypto_int64) g8 + f1_2 * (crypto_int64) g7 + f2 * (crypto_int64) g6
+       + f3_2 * (crypto_int64) g5 + f4 * (crypto_int64) g4 + f5_2 * (crypto_int64) g3
+       + f6 * (crypto_int64) g2 + f7_2 * (crypto_int64) g1 + f8 * (crypto_int64) g0
+       + f9_2 * (crypto_int64) g9_19;
+  h9 = f0 * (crypto_int64) g9 + f1 * (crypto_int64) g8 + f2 * (crypto_int64) g7
+       + f3 * (crypto_int64) g6 + f4 * (crypto_int64) g5 + f5 * (crypto_int64) g4
+       + f6 * (crypto_int64) g3 + f7 * (crypto_int64) g2 + f8 * (crypto_int64) g1
+       + f9 * (crypto_int64) g0;
+
+  carry(r, h0, h1, h2, h3, h4, h5, h6, h7, h8, h9);
 }
 
 void fe25519_square(fe25519 *r, const fe25519 *x)
 {
-  fe25519_mul(r, x, x);
+  crypto_int32 f0 = x->v[0], f1 = x->v[1], f2 = x->v[2], f3 = x->v[3], f4 = x->v[4];
+  crypto_int32 f5 = x->v[5], f6 = x->v[6], f7 = x->v[7], f8 = x->v[8], f9 = x->v[9];
+  crypto_int32 f0_2 = 2 * f0, f1_2 = 2 * f1, f2_2 = 2 * f2, f3_2 = 2 * f3, f4_2 = 2 * f4;
+  crypto_int32 f5_2 = 2 * f5, f6_2 = 2 * f6, f7_2 = 2 * f7, f8_2 = 2 * f8;
+  crypto_int32 f5_38 = 38 * f5, f6_19 = 19 * f6, f7_19 = 19 * f7, f7_38 = 38 * f7;
+  crypto_int32 f8_19 = 19 * f8, f9_19 = 19 * f9, f9_38 = 38 * f9;
+  crypto_int64 h0, h1, h2, h3, h4, h5, h6, h7, h8, h9;
+
+  h0 = f0 * (crypto_int64) f0 + f1_2 * (crypto_int64) f9_38 + f2_2 * (crypto_int64) f8_19
+       + f3_2 * (crypto_int64) f7_38 + f4_2 * (crypto_int64) f6_19 + f5 * (crypto_int64) f5_38;
+  h1 = f0_2 * (crypto_int64) f1 + f2_2 * (crypto_int64) f9_19 + f3_2 * (crypto_int64) f8_19
+       + f4_2 * (crypto_int64) f7_19 + f5_2 * (crypto_int64) f6_19;
+  h2 = f0_2 * (crypto_int64) f2 + f1 * (crypto_int64) f1_2 + f3_2 * (crypto_int64) f9_38
+       + f4_2 * (crypto_int64) f8_19 + f5_2 * (crypto_int64) f7_38 + f6 * (crypto_int64) f6_19;
+  h3 = f0_2 * (crypto_int64) f3 + f1_2 * (crypto_int64) f2 + f4_2 * (crypto_int64) f9_19
+       + f5_2 * (crypto_int64) f8_19 + f6_2 * (crypto_int64) f7_19;
+  h4 = f0_2 * (crypto_int64) f4 + f1_2 * (crypto_int64) f3_2 + f2 * (crypto_int64) f2
+       + f5_2 * (crypto_int64) f9_38 + f6_2 * (crypto_int64) f8_19 + f7 * (crypto_int64) f7_38;
+  h5 = f0_2 * (crypto_int64) f5 + f1_2 * (crypto_int64) f4 + f2_2 * (crypto_int64) f3
+       + f6_2 * (crypto_int64) f9_19 + f7_2 * (crypto_int64) f8_19;
+  h6 = f0_2 * (crypto_int64) f6 + f1_2 * (crypto_int64) f5_2 + f2_2 * (crypto_int64) f4
+       + f3 * (crypto_int64) f3_2 + f7_2 * (crypto_int64) f9_38 + f8 * (crypto_int64) f8_19;
+  h7 = f0_2 * (crypto_int64) f7 + f1_2 * (crypto_int64) f6 + f2_2 * (crypto_int64) f5
+       + f3_2 * (crypto_int64) f4 + f8_2 * (crypto_int64) f9_19;
+  h8 = f0_2 * (crypto_int64) f8 + f1_2 * (crypto_int64) f7_2 + f2_2 * (crypto_int64) f6
+       + f3_2 * (crypto_int64) f5_2 + f4 * (crypto_int64) f4 + f9 * (crypto_int64) f9_38;
+  h9 = f0_2 * (crypto_int64) f9 + f1_2 * (crypto_int64) f8 + f2_2 * (crypto_int64) f7
+       + f3_2 * (crypto_int64) f6 + f4_2 * (crypto_int64) f5;
+
+  carry(r, h0, h1, h2, h3, h4, h5, h6, h7, h8, h9);
 }
 
 void fe25519_invert(fe25519 *r, const fe25519 *x)
@@ -299,6 +299,11 @@ void FWD_free_channel(PTInstVar pvar, uint32 local_channel_num)
 {
 	FWDChannel FAR *channel = &pvar->fwd_state.channels[local_channel_num];
 
+	// ɉς݂̃Xbgdɋ󂫃X^bN֐ς܂Ȃ
+	if (channel->status != 0) {
+		pvar->fwd_state.free_channels[pvar->fwd_state.num_free_channels++] = local_channel_num;
+	}
+
 	if (channel->type == TYPE_AGENT) { // TYPE_AGENT łɗ̂ SSH1 ̂
 		buffer_free(channel->agent_msg);
 		// channel_close  TTSSH I2Ă΂̂ŁAd free h~̂
@@ -469,45 +474,72 @@ static void channel_opening_error(PTInstVar pvar, int channel_num, int err)
 	FWD_free_channel(pvar, channel_num);
 }
 
-static int alloc_channel(PTInstVar pvar, int new_status,
-                         int new_request_num)
+// 󂫃Xbg1oB󂫂Δz{XŊgA
+// 󂫃Xbg̃X^bN֐ςށB
+static int alloc_channel_slot(PTInstVar pvar)
 {
 	int i;
 	int new_num_channels;
-	int new_channel = -1;
+	FWDChannel FAR *channels;
+	int FAR *free_channels;
 	FWDChannel FAR *channel;
 
-	for (i = 0; i < pvar->fwd_state.num_channels && new_channel < 0; i++) {
-		if (pvar->fwd_state.channels[i].status == 0) {
-			new_channel = i;
+	if (pvar->fwd_state.num_free_channels == 0) {
+		// ̓ڑł realloc pȂ悤A{XŊgB
+		new_num_channels = max(pvar->fwd_state.num_channels * 2, 8);
+		channels = (FWDChannel FAR *) realloc(pvar->fwd_state.channels,
+		                                      sizeof(FWDChannel) * new_num_channels);
+		if (channels == NULL) {
+			return -1;
 		}
-	}
-
-	if (new_channel < 0) {
-		new_num_channels = pvar->fwd_state.num_channels + 1;
-		pvar->fwd_state.channels =
-			(FWDChannel FAR *) realloc(pvar->fwd_state.channels,
-			                           sizeof(FWDChannel) *
-			                           new_num_channels);
+		pvar->fwd_state.channels = channels;
+		free_channels = (int FAR *) realloc(pvar->fwd_state.free_channels,
+		                                    sizeof(int) * new_num_channels);
+		if (free_channels == NULL) {
+			return -1;
+		}
+		pvar->fwd_state.free_channels = free_channels;
 
-		for (; i < new_num_channels; i++) {
+		// ԍ̏Xbgg悤AtɐςށB
+		for (i = new_num_channels - 1; i >= pvar->fwd_state.num_channels; i--) {
 			channel = pvar->fwd_state.channels + i;
 
 			channel->status = 0;
+			channel->type = TYPE_PORTFWD;
 			channel->local_socket = INVALID_SOCKET;
 			channel->request_num = -1;
 			channel->filter = NULL;
 			channel->filter_closure = NULL;
+			channel->agent_msg = NULL;
 			UTIL_init_sock_write_buf(&channel->writebuf);
-		}
 
-		new_channel = pvar->fwd_state.num_channels;
+			free_channels[pvar->fwd_state.num_free_channels++] = i;
+		}
 		pvar->fwd_state.num_channels = new_num_channels;
 	}
 
+	return pvar->fwd_state.free_channels[--pvar->fwd_state.num_free_channels];
+}
+
+static int alloc_channel(PTInstVar pvar, int new_status,
+                         int new_request_num)
+{
+	int new_channel;
+	FWDChannel FAR *channel;
+
+	new_channel = alloc_channel_slot(pvar);
+	if (new_channel < 0) {
+		return -1;
+	}
+
 	channel = pvar->fwd_state.channels + new_channel;
 
+	// G[WFg]ŎgĂXbgȂ̂ŁAʂݒ肵B
 	channel->status = new_status;
+	channel->type = TYPE_PORTFWD;
+	channel->local_socket = INVALID_SOCKET;
+	channel->filter = NULL;
+	channel->filter_closure = NULL;
 	channel->request_num = new_request_num;
 	pvar->fwd_state.requests[new_request_num].num_channels++;
 	UTIL_init_sock_write_buf(&channel->writebuf);
@@ -517,26 +549,12 @@ static int alloc_channel(PTInstVar pvar, int new_status,
 
 static int alloc_agent_channel(PTInstVar pvar, int remote_channel_num)
 {
-	int i;
-	int new_num_channels;
-	int new_channel = -1;
+	int new_channel;
 	FWDChannel FAR *channel;
 
-	for (i = 0; i < pvar->fwd_state.num_channels && new_channel < 0; i++) {
-		if (pvar->fwd_state.channels[i].status == 0) {
-			new_channel = i;
-		}
-	}
-
+	new_channel = alloc_channel_slot(pvar);
 	if (new_channel < 0) {
-		new_num_channels = pvar->fwd_state.num_channels + 1;
-		pvar->fwd_state.channels =
-			(FWDChannel FAR *) realloc(pvar->fwd_state.channels,
-			                           sizeof(FWDChannel) *
-			                           new_num_channels);
-
-		new_channel = pvar->fwd_state.num_channels;
-		pvar->fwd_state.num_channels = new_num_channels;
+		return -1;
 	}
 
 	channel = pvar->fwd_state.channels + new_channel;
@@ -712,6 +730,10 @@ static void accept_local_connection(PTInstVar pvar, int request_num)
 #endif
 
 	channel_num = alloc_channel(pvar, FWD_LOCAL_CONNECTED, request_num);
+	if (channel_num < 0) {
+		closesocket(s);
+		return;
+	}
 	channel = pvar->fwd_state.channels + channel_num;
 
 	channel->local_socket = s;
@@ -747,9 +769,17 @@ static void read_local_connection(PTInstVar pvar, int channel_num)
 
 	while (channel->local_socket != INVALID_SOCKET) {
 		char buf[CHANNEL_READ_BUF_SIZE];
-		int amount = recv(channel->local_socket, buf, sizeof(buf), 0);
+		int amount;
 		int err;
 
+		// SSH̑ML[l܂ĂԂ͓ǂݍ݂~߂B
+		// L[󂢂 FWD_resume_local_read() ōĊJB
+		if (SSH_channel_is_congested(pvar, channel_num)) {
+			return;
+		}
+
+		amount = recv(channel->local_socket, buf, sizeof(buf), 0);
+
 		// XT[õf[^M΁AmubLO[hŃ\PbgMsA
 		// SSHT[oXAvP[V֑MB
 		//OutputDebugPrintf("%s: recv %d\n", __FUNCTION__, amount);
@@ -792,6 +822,16 @@ static void read_local_connection(PTInstVar pvar, int channel_num)
 	}
 }
 
+void FWD_resume_local_read(PTInstVar pvar, uint32 local_channel_num)
+{
+	// `lɕĂ邱Ƃ̂ŁAG[\͂ȂB
+	if (local_channel_num >= (uint32)pvar->fwd_state.num_channels
+	 || pvar->fwd_state.channels[local_channel_num].status == 0)
+		return;
+
+	read_local_connection(pvar, local_channel_num);
+}
+
 static void failed_to_host_addr(PTInstVar pvar, int request_num, int err)
 {
 	int i;
@@ -1601,6 +1641,10 @@ static void create_local_channel(PTInstVar pvar, uint32 remote_channel_num,
 	}
 
 	channel_num = alloc_channel(pvar, FWD_REMOTE_CONNECTED, request_num);
+	if (channel_num < 0) {
+		SSH_fail_channel_open(pvar, remote_channel_num);
+		return;
+	}
 	channel = pvar->fwd_state.channels + channel_num;
 
 	channel->remote_num = remote_channel_num;
@@ -1871,6 +1915,8 @@ void FWD_init(PTInstVar pvar)
 	pvar->fwd_state.server_listening_specs = NULL;
 	pvar->fwd_state.num_channels = 0;
 	pvar->fwd_state.channels = NULL;
+	pvar->fwd_state.num_free_channels = 0;
+	pvar->fwd_state.free_channels = NULL;
 	pvar->fwd_state.local_host_IP_numbers = NULL;
 	pvar->fwd_state.X11_auth_data = NULL;
 	pvar->fwd_state.accept_wnd = NULL;
@@ -1887,6 +1933,7 @@ void FWD_end(PTInstVar pvar)
 		}
 		free(pvar->fwd_state.channels);
 	}
+	free(pvar->fwd_state.free_channels);
 #ifndef NO_INET6
 	if (pvar->fwd_state.requests != NULL) {
 		for (i = 0; i < pvar->fwd_state.num_requests; i++) {
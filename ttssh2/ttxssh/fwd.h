@@ -130,6 +130,9 @@ typedef struct {
   FWDRequest FAR * requests;
   int num_channels;
   FWDChannel FAR * channels;
+  /* stack of unused indexes into channels */
+  int num_free_channels;
+  int FAR * free_channels;
 #ifndef NO_INET6
   struct sockaddr_storage FAR * local_host_IP_numbers;
 #else
@@ -164,6 +167,7 @@ void FWD_failed_open(PTInstVar pvar, uint32 local_channel_num);
 void FWD_received_data(PTInstVar pvar, uint32 local_channel_num,
   unsigned char FAR * data, int length);
 void FWD_channel_input_eof(PTInstVar pvar, uint32 local_channel_num);
+void FWD_resume_local_read(PTInstVar pvar, uint32 local_channel_num);
 void FWD_channel_output_eof(PTInstVar pvar, uint32 local_channel_num);
 void FWD_end(PTInstVar pvar);
 void FWD_free_channel(PTInstVar pvar, uint32 local_channel_num);
@@ -37,12 +37,15 @@ See LICENSE.TXT for the license.
 #include "ssh.h"
 #include "key.h"
 #include "hosts.h"
+#include "hostsidx.h"
 #include "dns.h"
 
 #include <openssl/bn.h>
 #include <openssl/evp.h>
 #include <openssl/rsa.h>
 #include <openssl/dsa.h>
+#include <openssl/hmac.h>
+#include <openssl/sha.h>
 
 #include <fcntl.h>
 #include <io.h>
@@ -213,6 +216,28 @@ static int begin_read_file(PTInstVar pvar, char FAR * name,
 	}
 }
 
+//
+// known_hostst@ĈAzXgɍvsgēǂݍށB
+// gȂ΁Abegin_read_file() Ɠt@CŜǂݍށB
+//
+static int begin_read_file_indexed(PTInstVar pvar, char FAR * name,
+                                   char FAR * hostname, unsigned short tcpport,
+                                   int suppress_errors)
+{
+	char buf[2048];
+	hostsidx_lines_t lines;
+
+	get_teraterm_dir_relative_name(buf, sizeof(buf), name);
+	if (HOSTSIDX_lookup(pvar, buf, hostname, tcpport, &lines)) {
+		pvar->hosts_state.file_data = lines.data;
+		lines.data = NULL;
+		HOSTSIDX_free_lines(&lines);
+		return 1;
+	}
+
+	return begin_read_file(pvar, name, suppress_errors);
+}
+
 static int end_read_file(PTInstVar pvar, int suppress_errors)
 {
 	free(pvar->hosts_state.file_data);
@@ -415,6 +440,125 @@ int uudecode(unsigned char *src, int srclen, unsigned char *target, int targsize
 	return (tarindex);
 }
 
+//
+// nbVꂽzXg (|1|salt|hash) ƐڑׂB(OpenSSH HashKnownHosts)
+// |[gԍ22łȂ "[host]:port" nbV̂ƔׂB
+//
+int HOSTS_match_hashed_host(char FAR * pattern, int len,
+                            char FAR * hostname, unsigned short tcpport)
+{
+	char buf[256];
+	char name[1024];
+	unsigned char salt[64], hash[64], mac[EVP_MAX_MD_SIZE];
+	unsigned int maclen = 0;
+	char FAR *sep;
+	int saltlen, hashlen;
+
+	if (len < 3 || len >= (int)sizeof(buf) || strncmp(pattern, "|1|", 3) != 0) {
+		return 0;
+	}
+	memcpy(buf, pattern + 3, len - 3);
+	buf[len - 3] = '\0';
+	sep = strchr(buf, '|');
+	if (sep == NULL) {
+		return 0;
+	}
+	*sep = '\0';
+	saltlen = uudecode(buf, strlen(buf), salt, sizeof(salt));
+	hashlen = uudecode(sep + 1, strlen(sep + 1), hash, sizeof(hash));
+	if (saltlen != SHA_DIGEST_LENGTH || hashlen != SHA_DIGEST_LENGTH) {
+		return 0;
+	}
+
+	if (tcpport == 22) {
+		_snprintf_s(name, sizeof(name), _TRUNCATE, "%s", hostname);
+	} else {
+		_snprintf_s(name, sizeof(name), _TRUNCATE, "[%s]:%d", hostname, tcpport);
+	}
+	HMAC(EVP_sha1(), salt, saltlen, name, strlen(name), mac, &maclen);
+
+	return maclen == SHA_DIGEST_LENGTH && memcmp(mac, hash, maclen) == 0;
+}
+
+//
+// zXg̃p^[1(data  len oCg)ƁAڑ̃zXgƃ|[gԍׂB
+//   host          |[g22
+//   [host]:port
+//   |1|salt|hash  nbVꂽzXg
+//
+static int match_host_pattern(char FAR * data, int len,
+                              char FAR * hostname, unsigned short tcpport)
+{
+	char buf[1024];
+	char FAR *end_bracket = NULL;
+	unsigned short keyfile_port;
+	int i;
+
+	if (len >= 3 && strncmp(data, "|1|", 3) == 0) {
+		return HOSTS_match_hashed_host(data, len, hostname, tcpport);
+	}
+
+	// "]:" ͂̃p^[̒ŒT
+	if (data[0] == '[') {
+		for (i = 1; i + 1 < len; i++) {
+			if (data[i] == ']' && data[i + 1] == ':') {
+				end_bracket = data + i;
+				break;
+			}
+		}
+	}
+	if (end_bracket == NULL) {
+		return tcpport == 22 && match_pattern(data, hostname);
+	}
+
+	if (end_bracket - data - 1 >= (int)sizeof(buf)) {
+		return 0;
+	}
+	memcpy(buf, data + 1, end_bracket - data - 1);
+	buf[end_bracket - data - 1] = '\0';
+	keyfile_port = atoi(end_bracket + 2);
+
+	return keyfile_port == tcpport && match_pattern(buf, hostname);
+}
+
+//
+// s̃zXg̃Xg(J}؂)ڑƔׂB
+// *len ɂ̓Xg̒ԂB
+//
+// return:
+//    1  v
+//    0  vȂ
+//   -1  ے̃p^[(!)ɍv
+//
+static int match_host_list(char FAR * data, char FAR * hostname,
+                           unsigned short tcpport, int *len)
+{
+	int index = -1;
+	int matched = 0;
+	int negated;
+	int n;
+
+	do {
+		index++;
+		negated = data[index] == '!';
+		if (negated) {
+			index++;
+		}
+		n = eat_to_end_of_pattern(data + index);
+		if (n > 0 && match_host_pattern(data + index, n, hostname, tcpport)) {
+			if (negated) {
+				matched = -1;
+			} else if (matched == 0) {
+				matched = 1;
+			}
+		}
+		index += n;
+	} while (data[index] == ',');
+
+	*len = index;
+	return matched;
+}
+
 
 // SSH2 BASE64 `Ŋi[Ă
 static Key *parse_uudecode(char *data)
@@ -508,6 +652,7 @@ static int check_host_key(PTInstVar pvar, char FAR * hostname,
 	int index = eat_spaces(data);
 	int matched = 0;
 	int keybits = 0;
+	int len;
 
 	if (data[index] == '#') {
 		return index + eat_to_end_of_line(data + index);
@@ -515,58 +660,10 @@ static int check_host_key(PTInstVar pvar, char FAR * hostname,
 
 	/* if we find an empty line, then it won't have any patterns matching the hostname
 	   and so we skip it */
-	index--;
-	do {
-		int negated;
-		int bracketed;
-		char *end_bracket;
-		int host_matched = 0;
-		unsigned short keyfile_port = 22;
+	matched = match_host_list(data + index, hostname, tcpport, &len);
+	index += len;
 
-		index++;
-		negated = data[index] == '!';
-
-		if (negated) {
-			index++;
-			bracketed = data[index] == '[';
-			if (bracketed) {
-				end_bracket = strstr(data + index + 1, "]:");
-				if (end_bracket != NULL) {
-					*end_bracket = ' ';
-					index++;
-				}
-			}
-			host_matched = match_pattern(data + index, hostname);
-			if (bracketed && end_bracket != NULL) {
-				*end_bracket = ']';
-				keyfile_port = atoi(end_bracket + 2);
-			}
-			if (host_matched && keyfile_port == tcpport) {
-				return index + eat_to_end_of_line(data + index);
-			}
-		} else {
-			bracketed = data[index] == '[';
-			if (bracketed) {
-				end_bracket = strstr(data + index + 1, "]:");
-				if (end_bracket != NULL) {
-					*end_bracket = ' ';
-					index++;
-				}
-			}
-			host_matched = match_pattern(data + index, hostname);
-			if (bracketed && end_bracket != NULL) {
-				*end_bracket = ']';
-				keyfile_port = atoi(end_bracket + 2);
-			}
-			if (host_matched && keyfile_port == tcpport) {
-				matched = 1;
-			}
-		}
-
-		index += eat_to_end_of_pattern(data + index);
-	} while (data[index] == ',');
-
-	if (!matched) {
+	if (matched <= 0) {
 		return index + eat_to_end_of_line(data + index);
 	} else {
 		// ̎ނɂtH[}bgقȂ
@@ -714,7 +811,8 @@ static int read_host_key(PTInstVar pvar,
 					pvar->hosts_state.file_num++;
 
 					if (filename[0] != 0) {
-						if (begin_read_file(pvar, filename, suppress_errors)) {
+						if (begin_read_file_indexed(pvar, filename, hostname, tcpport,
+						                            suppress_errors)) {
 							pvar->hosts_state.file_data_index = 0;
 							keep_going = 0;
 						}
@@ -747,9 +845,169 @@ static void finish_read_host_files(PTInstVar pvar, int suppress_errors)
 	}
 }
 
+//
+// known_hostsŊmFς݂̃zXgJ̃LbV
+//
+// vZXœzXg֍Đڑ邽т known_hosts t@Cǂݒ̂
+// 傫ȃt@Cł͎Ԃ|邽߁AmFłJ(SSH2̂)莞ԊoĂB
+// known_hosts t@C̍XVTCYςAoĂׂ͂Ď̂ĂB
+//
+#define HOSTKEY_CACHE_MAX 16
+
+typedef struct {
+	char FAR *hostname;
+	unsigned short tcpport;
+	char *blob;       // J (key_to_blob()̌`)
+	int bloblen;
+	DWORD tick;       // known_hostsŊmF
+} hostkey_cache_t;
+
+static hostkey_cache_t hostkey_cache[HOSTKEY_CACHE_MAX];
+static unsigned long hostkey_cache_stamp;
+
+static void hostkey_cache_clear(void)
+{
+	int i;
+
+	for (i = 0; i < HOSTKEY_CACHE_MAX; i++) {
+		free(hostkey_cache[i].hostname);
+		free(hostkey_cache[i].blob);
+		memset(&hostkey_cache[i], 0, sizeof(hostkey_cache[i]));
+	}
+}
+
+// known_hostst@C̍XVƃTCYAt@CςƂo邽߂̒l
+static unsigned long get_host_files_stamp(PTInstVar pvar)
+{
+	unsigned long stamp = 0;
+	char buf[2048];
+	struct _stat st;
+	int i;
+
+	if (pvar->hosts_state.file_names == NULL) {
+		return 0;
+	}
+
+	for (i = 0; pvar->hosts_state.file_names[i] != NULL; i++) {
+		if (pvar->hosts_state.file_names[i][0] == 0) {
+			continue;
+		}
+		get_teraterm_dir_relative_name(buf, sizeof(buf), pvar->hosts_state.file_names[i]);
+		if (_stat(buf, &st) == 0) {
+			stamp = stamp * 31 + (unsigned long)st.st_mtime;
+			stamp = stamp * 31 + (unsigned long)st.st_size;
+		}
+		stamp = stamp * 31 + 1;
+	}
+
+	return stamp;
+}
+
+// oĂJTBkey  NULL ȂAzXgƃ|[gŒTB
+static hostkey_cache_t *hostkey_cache_find(PTInstVar pvar, char FAR * hostname,
+                                           unsigned short tcpport, Key *key)
+{
+	DWORD lifetime = pvar->session_settings.HostKeyCacheLifetime * 1000;
+	DWORD now = GetTickCount();
+	char *blob = NULL;
+	int bloblen = 0;
+	hostkey_cache_t *found = NULL;
+	int i;
+
+	if (lifetime == 0 || hostname == NULL) {
+		return NULL;
+	}
+
+	if (hostkey_cache_stamp != get_host_files_stamp(pvar)) {
+		hostkey_cache_clear();
+		return NULL;
+	}
+
+	if (key != NULL && key_to_blob(key, &blob, &bloblen) == 0) {
+		return NULL;
+	}
+
+	for (i = 0; i < HOSTKEY_CACHE_MAX; i++) {
+		hostkey_cache_t *p = &hostkey_cache[i];
+
+		if (p->hostname == NULL || now - p->tick >= lifetime) {
+			continue;
+		}
+		if (p->tcpport != tcpport || _stricmp(p->hostname, hostname) != 0) {
+			continue;
+		}
+		if (blob != NULL &&
+		    (p->bloblen != bloblen || memcmp(p->blob, blob, bloblen) != 0)) {
+			continue;
+		}
+		found = p;
+		break;
+	}
+
+	free(blob);
+	return found;
+}
+
+// known_hostsŊmFłJoĂ
+static void hostkey_cache_add(PTInstVar pvar, char FAR * hostname,
+                              unsigned short tcpport, Key *key)
+{
+	DWORD now = GetTickCount();
+	unsigned long stamp;
+	hostkey_cache_t *p;
+	char *blob;
+	int bloblen;
+	int i;
+
+	if (pvar->session_settings.HostKeyCacheLifetime == 0 || key->type == KEY_RSA1) {
+		return;
+	}
+
+	stamp = get_host_files_stamp(pvar);
+	if (hostkey_cache_stamp != stamp) {
+		hostkey_cache_clear();
+		hostkey_cache_stamp = stamp;
+	}
+
+	p = hostkey_cache_find(pvar, hostname, tcpport, key);
+	if (p != NULL) {
+		p->tick = now;
+		return;
+	}
+
+	if (key_to_blob(key, &blob, &bloblen) == 0) {
+		return;
+	}
+
+	// 󂫂Ȃ΁A΂Â̂Ɠւ
+	p = &hostkey_cache[0];
+	for (i = 0; i < HOSTKEY_CACHE_MAX; i++) {
+		if (hostkey_cache[i].hostname == NULL) {
+			p = &hostkey_cache[i];
+			break;
+		}
+		if (now - hostkey_cache[i].tick > now - p->tick) {
+			p = &hostkey_cache[i];
+		}
+	}
+	free(p->hostname);
+	free(p->blob);
+
+	p->hostname = _strdup(hostname);
+	p->tcpport = tcpport;
+	p->blob = blob;
+	p->bloblen = bloblen;
+	p->tick = now;
+}
+
 // T[o֐ڑOɁAknown_hostst@CzXgJǂ݂ĂB
 void HOSTS_prefetch_host_key(PTInstVar pvar, char FAR * hostname, unsigned short tcpport)
 {
+	// mFς݂̌JoĂ΁At@C͓ǂ܂ɃT[ǒƒڔׂ
+	if (SSHv2(pvar) && hostkey_cache_find(pvar, hostname, tcpport, NULL) != NULL) {
+		return;
+	}
+
 	if (!begin_read_host_files(pvar, 1)) {
 		return;
 	}
@@ -776,6 +1034,7 @@ static int parse_hostkey_file(PTInstVar pvar, char FAR * hostname,
 	int index = eat_spaces(data);
 	int matched = 0;
 	int keybits = 0;
+	int len;
 	ssh_keytype ktype;
 	Key *key;
 
@@ -787,59 +1046,10 @@ static int parse_hostkey_file(PTInstVar pvar, char FAR * hostname,
 
 	/* if we find an empty line, then it won't have any patterns matching the hostname
 	and so we skip it */
-	index--;
-	do {
-		int negated;
-		int bracketed;
-		char *end_bracket;
-		int host_matched = 0;
-		unsigned short keyfile_port = 22;
-
-		index++;
-		negated = data[index] == '!';
+	matched = match_host_list(data + index, hostname, tcpport, &len);
+	index += len;
 
-		if (negated) {
-			index++;
-			bracketed = data[index] == '[';
-			if (bracketed) {
-				end_bracket = strstr(data + index + 1, "]:");
-				if (end_bracket != NULL) {
-					*end_bracket = ' ';
-					index++;
-				}
-			}
-			host_matched = match_pattern(data + index, hostname);
-			if (bracketed && end_bracket != NULL) {
-				*end_bracket = ']';
-				keyfile_port = atoi(end_bracket + 2);
-			}
-			if (host_matched && keyfile_port == tcpport) {
-				return index + eat_to_end_of_line(data + index);
-			}
-		}
-		else {
-			bracketed = data[index] == '[';
-			if (bracketed) {
-				end_bracket = strstr(data + index + 1, "]:");
-				if (end_bracket != NULL) {
-					*end_bracket = ' ';
-					index++;
-				}
-			}
-			host_matched = match_pattern(data + index, hostname);
-			if (bracketed && end_bracket != NULL) {
-				*end_bracket = ']';
-				keyfile_port = atoi(end_bracket + 2);
-			}
-			if (host_matched && keyfile_port == tcpport) {
-				matched = 1;
-			}
-		}
-
-		index += eat_to_end_of_pattern(data + index);
-	} while (data[index] == ',');
-
-	if (!matched) {
+	if (matched <= 0) {
 		return index + eat_to_end_of_line(data + index);
 	}
 	else {
@@ -940,21 +1150,21 @@ int HOSTS_hostkey_foreach(PTInstVar pvar, hostkeys_foreach_fn *callback, void *c
 	filename = pvar->hosts_state.file_names[pvar->hosts_state.file_num];
 	pvar->hosts_state.file_num++;
 
+	// ΏۂƂȂzXgƃ|[gԍB
+	hostname = pvar->ssh_state.hostname;
+	tcpport = pvar->ssh_state.tcpport;
+
 	pvar->hosts_state.file_data_index = -1;
 	if (filename[0] != 0) {
-		if (begin_read_file(pvar, filename, suppress_errors)) {
+		if (begin_read_file_indexed(pvar, filename, hostname, tcpport, suppress_errors)) {
 			pvar->hosts_state.file_data_index = 0;
 		}
 	}
 	if (pvar->hosts_state.file_data_index == -1)
 		goto error;
 
-	// ΏۂƂȂzXgƃ|[gԍB
-	hostname = pvar->ssh_state.hostname;
-	tcpport = pvar->ssh_state.tcpport;
-
-	// known_hostst@C̓eׂ pvar->hosts_state.file_data ɓǂݍ܂ĂB
-	//  \0 B
+	// known_hostst@ĈAzXgɍvs pvar->hosts_state.file_data 
+	// ǂݍ܂ĂB \0 B
 	while (pvar->hosts_state.file_data[pvar->hosts_state.file_data_index] != 0) {
 		key = NULL;
 
@@ -1332,6 +1542,8 @@ static void add_host_key(PTInstVar pvar)
 {
 	char FAR *name = NULL;
 
+	hostkey_cache_clear();
+
 	if ( pvar->hosts_state.file_names != NULL)
 		name = pvar->hosts_state.file_names[0];
 
@@ -1347,8 +1559,10 @@ static void add_host_key(PTInstVar pvar)
 		int amount_written;
 		int close_result;
 		char buf[FILENAME_MAX];
+		hostsidx_stamp_t stamp;
 
 		get_teraterm_dir_relative_name(buf, sizeof(buf), name);
+		HOSTSIDX_get_stamp(buf, &stamp);
 		fd = _open(buf,
 		          _O_APPEND | _O_CREAT | _O_WRONLY | _O_SEQUENTIAL | _O_BINARY,
 		          _S_IREAD | _S_IWRITE);
@@ -1368,7 +1582,6 @@ static void add_host_key(PTInstVar pvar)
 		}
 
 		amount_written = _write(fd, keydata, length);
-		free(keydata);
 		close_result = _close(fd);
 
 		if (amount_written != length || close_result == -1) {
@@ -1376,7 +1589,10 @@ static void add_host_key(PTInstVar pvar)
 			                  "An error occurred while trying to write the host key.\n"
 			                  "The host key could not be written.");
 			notify_nonfatal_error(pvar, pvar->ts->UIMsg);
+		} else {
+			HOSTSIDX_notify_appended(pvar, buf, &stamp, keydata, length);
 		}
+		free(keydata);
 	}
 }
 
@@ -1390,6 +1606,8 @@ void HOSTS_add_host_key(PTInstVar pvar, Key *key)
 	hostname = pvar->ssh_state.hostname;
 	tcpport = pvar->ssh_state.tcpport;
 
+	hostkey_cache_clear();
+
 	if (pvar->hosts_state.file_names != NULL)
 		name = pvar->hosts_state.file_names[0];
 
@@ -1406,8 +1624,10 @@ void HOSTS_add_host_key(PTInstVar pvar, Key *key)
 		int amount_written;
 		int close_result;
 		char buf[FILENAME_MAX];
+		hostsidx_stamp_t stamp;
 
 		get_teraterm_dir_relative_name(buf, sizeof(buf), name);
+		HOSTSIDX_get_stamp(buf, &stamp);
 		fd = _open(buf,
 			_O_APPEND | _O_CREAT | _O_WRONLY | _O_SEQUENTIAL | _O_BINARY,
 			_S_IREAD | _S_IWRITE);
@@ -1428,7 +1648,6 @@ void HOSTS_add_host_key(PTInstVar pvar, Key *key)
 		}
 
 		amount_written = _write(fd, keydata, length);
-		free(keydata);
 		close_result = _close(fd);
 
 		if (amount_written != length || close_result == -1) {
@@ -1437,6 +1656,10 @@ void HOSTS_add_host_key(PTInstVar pvar, Key *key)
 				"The host key could not be written.");
 			notify_nonfatal_error(pvar, pvar->ts->UIMsg);
 		}
+		else {
+			HOSTSIDX_notify_appended(pvar, buf, &stamp, keydata, length);
+		}
+		free(keydata);
 	}
 }
 
@@ -1453,12 +1676,21 @@ static char FAR *copy_mp_int(char FAR * num)
 }
 
 //
-// zXgœëقȂL[폜
-// add_host_key ̂ƂɌĂԂ
+// 1߂ known_hosts t@CAڑ̃zXg̍sB
+//   all  TRUE ȂzXgvsׂāA
+//   FALSE Ȃ献̌`œëقȂsB
+// t@CŜ͏AŌYs󔒂œhԂB
 //
-static void delete_different_key(PTInstVar pvar)
+static void delete_host_keys(PTInstVar pvar, BOOL all)
 {
 	char FAR *name = pvar->hosts_state.file_names[0];
+	char *hostname;
+	unsigned short tcpport;
+
+	hostname = pvar->ssh_state.hostname;
+	tcpport = pvar->ssh_state.tcpport;
+
+	hostkey_cache_clear();
 
 	if (name == NULL || name[0] == 0) {
 		UTIL_get_lang_msg("MSG_HOSTS_FILE_UNSPECIFY_ERROR", pvar,
@@ -1467,425 +1699,69 @@ static void delete_different_key(PTInstVar pvar)
 		notify_nonfatal_error(pvar, pvar->ts->UIMsg);
 	}
 	else {
-		Key key; // ڑ̃zXg̃L[
-		Key *key_freed;
-		int length;
-		char filename[MAX_PATH];
-		char tmp[L_tmpnam];
-		int fd;
-		int amount_written = 0;
-		int close_result;
-		int data_index = 0;
+		hostsidx_lines_t lines;
+		BOOL *erase;
+		int num_erased = 0;
+		int i, len;
 		char buf[FILENAME_MAX];
 
-		// ݈ꎞt@CJ
-		_getcwd(filename, sizeof(filename));
-		tmpnam_s(tmp,sizeof(tmp));
-		strcat_s(filename, sizeof(filename), tmp);
-		fd = _open(filename,
-		          _O_CREAT | _O_WRONLY | _O_SEQUENTIAL | _O_BINARY | _O_TRUNC,
-		          _S_IREAD | _S_IWRITE);
-
-		if (fd == -1) {
-			if (errno == EACCES) {
-				UTIL_get_lang_msg("MSG_HOSTS_WRITE_EACCES_ERROR", pvar,
-				                  "An error occurred while trying to write the host key.\n"
-				                  "You do not have permission to write to the known-hosts file.");
-				notify_nonfatal_error(pvar, pvar->ts->UIMsg);
-			} else {
-				UTIL_get_lang_msg("MSG_HOSTS_WRITE_ERROR", pvar,
-				                  "An error occurred while trying to write the host key.\n"
-				                  "The host key could not be written.");
-				notify_nonfatal_error(pvar, pvar->ts->UIMsg);
-			}
+		// t@CȂ΁ÂȂ
+		get_teraterm_dir_relative_name(buf, sizeof(buf), name);
+		if (!HOSTSIDX_lookup(pvar, buf, hostname, tcpport, &lines)) {
 			return;
 		}
 
-		// ڑ̃T[õL[ǂݍ
-		memset(&key, 0, sizeof(key));
-		switch (pvar->hosts_state.hostkey.type) {
-		case KEY_RSA1: // SSH1
-			key.type = KEY_RSA1;
-			key.bits = pvar->hosts_state.hostkey.bits;
-			key.exp = copy_mp_int(pvar->hosts_state.hostkey.exp);
-			key.mod = copy_mp_int(pvar->hosts_state.hostkey.mod);
-			break;
-		case KEY_RSA: // SSH2 RSA
-			key.type = KEY_RSA;
-			key.rsa = duplicate_RSA(pvar->hosts_state.hostkey.rsa);
-			break;
-		case KEY_DSA: // SSH2 DSA
-			key.type = KEY_DSA;
-			key.dsa = duplicate_DSA(pvar->hosts_state.hostkey.dsa);
-			break;
-		case KEY_ECDSA256:
-		case KEY_ECDSA384:
-		case KEY_ECDSA521:
-			key.type = pvar->hosts_state.hostkey.type;
-			key.ecdsa = EC_KEY_dup(pvar->hosts_state.hostkey.ecdsa);
-			break;
-		case KEY_ED25519:
-			key.type = pvar->hosts_state.hostkey.type;
-			key.ed25519_pk = duplicate_ED25519_PK(pvar->hosts_state.hostkey.ed25519_pk);
-			break;
+		erase = calloc(lines.num + 1, sizeof(BOOL));
+		if (erase == NULL) {
+			HOSTSIDX_free_lines(&lines);
+			return;
 		}
 
-		// t@Cǂݍ
-		begin_read_host_files(pvar, 0);
-		do {
-			int host_index = 0;
-			int matched = 0;
-			int keybits = 0;
-			char FAR *data;
-			int do_write = 0;
-			length = amount_written = 0;
-
-			if (!read_host_key(pvar, pvar->ssh_state.hostname, pvar->ssh_state.tcpport, 0, 1)) {
-				break;
-			}
+		for (i = 0; i < lines.num; i++) {
+			char FAR *data = lines.data + lines.starts[i];
+			Key *key = NULL;
 
-			if (data_index == pvar->hosts_state.file_data_index) {
-				// index i܂Ȃ == Ō܂œǂ
-				break;
-			}
-
-			data = pvar->hosts_state.file_data + data_index;
-			host_index = eat_spaces(data);
-
-			if (data[host_index] == '#') {
-				do_write = 1;
+			if (all) {
+				// ̌`ɂ炸
+				erase[i] = match_host_list(data + eat_spaces(data), hostname, tcpport, &len) > 0;
 			}
 			else {
-				// zXg̏ƍ
-				host_index--;
-				do {
-					int negated;
-					int bracketed;
-					char *end_bracket;
-					int host_matched = 0;
-					unsigned short keyfile_port = 22;
-
-					host_index++;
-					negated = data[host_index] == '!';
-
-					if (negated) {
-						host_index++;
-						bracketed = data[host_index] == '[';
-						if (bracketed) {
-							end_bracket = strstr(data + host_index + 1, "]:");
-							if (end_bracket != NULL) {
-								*end_bracket = ' ';
-								host_index++;
-							}
-						}
-						host_matched = match_pattern(data + host_index, pvar->ssh_state.hostname);
-						if (bracketed && end_bracket != NULL) {
-							*end_bracket = ']';
-							keyfile_port = atoi(end_bracket + 2);
-						}
-						if (host_matched && keyfile_port == pvar->ssh_state.tcpport) {
-							matched = 0;
-							// ڑo[W`FbN̂߂ host_index i߂Ă甲
-							host_index--;
-							do {
-								host_index++;
-								host_index += eat_to_end_of_pattern(data + host_index);
-							} while (data[host_index] == ',');
-							break;
-						}
-					}
-					else {
-						bracketed = data[host_index] == '[';
-						if (bracketed) {
-							end_bracket = strstr(data + host_index + 1, "]:");
-							if (end_bracket != NULL) {
-								*end_bracket = ' ';
-								host_index++;
-							}
-						}
-						host_matched = match_pattern(data + host_index, pvar->ssh_state.hostname);
-						if (bracketed && end_bracket != NULL) {
-							*end_bracket = ']';
-							keyfile_port = atoi(end_bracket + 2);
-						}
-						if (host_matched && keyfile_port == pvar->ssh_state.tcpport) {
-							matched = 1;
-						}
-					}
-					host_index += eat_to_end_of_pattern(data + host_index);
-				} while (data[host_index] == ',');
-
-				// zXgȂ
-				if (!matched) {
-					do_write = 1;
-				}
-				// zXg
-				else {
-					// ̌`Ⴄ or vL[
-					if (match_key(pvar, &key) != 0) {
-						do_write = 1;
-					}
-					// ̌`ōvȂL[̓XLbv
+				// ڑ̃T[õL[ƌ̌`ŁAvȂL[
+				parse_hostkey_file(pvar, hostname, tcpport, data, &key);
+				if (key != NULL) {
+					erase[i] = match_key(pvar, key) == 0;
+					key_free(key);
 				}
 			}
-
-			// ݏ
-			if (do_write) {
-				length = pvar->hosts_state.file_data_index - data_index;
-				amount_written =
-					_write(fd, pvar->hosts_state.file_data + data_index,
-					       length);
-
-				if (amount_written != length) {
-					goto error1;
-				}
+			if (erase[i]) {
+				num_erased++;
 			}
-			data_index = pvar->hosts_state.file_data_index;
-		} while (1); // Ō܂œǂ
+		}
 
-error1:
-		close_result = _close(fd);
-		if (amount_written != length || close_result == -1) {
+		if (num_erased > 0 && !HOSTSIDX_blank_lines(pvar, buf, &lines, erase)) {
 			UTIL_get_lang_msg("MSG_HOSTS_WRITE_ERROR", pvar,
 			                  "An error occurred while trying to write the host key.\n"
 			                  "The host key could not be written.");
 			notify_nonfatal_error(pvar, pvar->ts->UIMsg);
-			goto error2;
 		}
 
-		// ݈ꎞt@C烊l[
-		get_teraterm_dir_relative_name(buf, sizeof(buf), name);
-		_unlink(buf);
-		rename(filename, buf);
-
-error2:
-		_unlink(filename);
-
-		finish_read_host_files(pvar, 0);
-
-		// ŌɃĂB
-		key_freed = key_new(KEY_UNSPEC);
-		memcpy(key_freed, &key, sizeof(Key));
-		key_free(key_freed);
+		free(erase);
+		HOSTSIDX_free_lines(&lines);
 	}
 }
 
+//
+// zXgœëقȂL[폜
+// add_host_key ̂ƂɌĂԂ
+//
+static void delete_different_key(PTInstVar pvar)
+{
+	delete_host_keys(pvar, FALSE);
+}
 
 void HOSTS_delete_all_hostkeys(PTInstVar pvar)
 {
-	char FAR *name = pvar->hosts_state.file_names[0];
-	char *hostname;
-	unsigned short tcpport;
-
-	hostname = pvar->ssh_state.hostname;
-	tcpport = pvar->ssh_state.tcpport;
-
-	if (name == NULL || name[0] == 0) {
-		UTIL_get_lang_msg("MSG_HOSTS_FILE_UNSPECIFY_ERROR", pvar,
-			"The host and its key cannot be added, because no known-hosts file has been specified.\n"
-			"Restart Tera Term and specify a read/write known-hosts file in the TTSSH Setup dialog box.");
-		notify_nonfatal_error(pvar, pvar->ts->UIMsg);
-	}
-	else {
-		Key key; // ڑ̃zXg̃L[
-		Key *key_freed;
-		int length;
-		char filename[MAX_PATH];
-		char tmp[L_tmpnam];
-		int fd;
-		int amount_written = 0;
-		int close_result;
-		int data_index = 0;
-		char buf[FILENAME_MAX];
-
-		// ݈ꎞt@CJ
-		_getcwd(filename, sizeof(filename));
-		tmpnam_s(tmp, sizeof(tmp));
-		strcat_s(filename, sizeof(filename), tmp);
-		fd = _open(filename,
-			_O_CREAT | _O_WRONLY | _O_SEQUENTIAL | _O_BINARY | _O_TRUNC,
-			_S_IREAD | _S_IWRITE);
-
-		if (fd == -1) {
-			if (errno == EACCES) {
-				UTIL_get_lang_msg("MSG_HOSTS_WRITE_EACCES_ERROR", pvar,
-					"An error occurred while trying to write the host key.\n"
-					"You do not have permission to write to the known-hosts file.");
-				notify_nonfatal_error(pvar, pvar->ts->UIMsg);
-			}
-			else {
-				UTIL_get_lang_msg("MSG_HOSTS_WRITE_ERROR", pvar,
-					"An error occurred while trying to write the host key.\n"
-					"The host key could not be written.");
-				notify_nonfatal_error(pvar, pvar->ts->UIMsg);
-			}
-			return;
-		}
-
-		// ڑ̃T[õL[ǂݍ
-		memset(&key, 0, sizeof(key));
-		switch (pvar->hosts_state.hostkey.type) {
-		case KEY_RSA1: // SSH1
-			key.type = KEY_RSA1;
-			key.bits = pvar->hosts_state.hostkey.bits;
-			key.exp = copy_mp_int(pvar->hosts_state.hostkey.exp);
-			key.mod = copy_mp_int(pvar->hosts_state.hostkey.mod);
-			break;
-		case KEY_RSA: // SSH2 RSA
-			key.type = KEY_RSA;
-			key.rsa = duplicate_RSA(pvar->hosts_state.hostkey.rsa);
-			break;
-		case KEY_DSA: // SSH2 DSA
-			key.type = KEY_DSA;
-			key.dsa = duplicate_DSA(pvar->hosts_state.hostkey.dsa);
-			break;
-		case KEY_ECDSA256:
-		case KEY_ECDSA384:
-		case KEY_ECDSA521:
-			key.type = pvar->hosts_state.hostkey.type;
-			key.ecdsa = EC_KEY_dup(pvar->hosts_state.hostkey.ecdsa);
-			break;
-		case KEY_ED25519:
-			key.type = pvar->hosts_state.hostkey.type;
-			key.ed25519_pk = duplicate_ED25519_PK(pvar->hosts_state.hostkey.ed25519_pk);
-			break;
-		}
-
-		// t@Cǂݍ
-		begin_read_host_files(pvar, 0);
-		do {
-			int host_index = 0;
-			int matched = 0;
-			int keybits = 0;
-			char FAR *data;
-			int do_write = 0;
-			length = amount_written = 0;
-
-			if (!read_host_key(pvar, pvar->ssh_state.hostname, pvar->ssh_state.tcpport, 0, 1)) {
-				break;
-			}
-
-			if (data_index == pvar->hosts_state.file_data_index) {
-				// index i܂Ȃ == Ō܂œǂ
-				break;
-			}
-
-			data = pvar->hosts_state.file_data + data_index;
-			host_index = eat_spaces(data);
-
-			if (data[host_index] == '#') {
-				do_write = 1;
-			}
-			else {
-				// zXg̏ƍ
-				host_index--;
-				do {
-					int negated;
-					int bracketed;
-					char *end_bracket;
-					int host_matched = 0;
-					unsigned short keyfile_port = 22;
-
-					host_index++;
-					negated = data[host_index] == '!';
-
-					if (negated) {
-						host_index++;
-						bracketed = data[host_index] == '[';
-						if (bracketed) {
-							end_bracket = strstr(data + host_index + 1, "]:");
-							if (end_bracket != NULL) {
-								*end_bracket = ' ';
-								host_index++;
-							}
-						}
-						host_matched = match_pattern(data + host_index, pvar->ssh_state.hostname);
-						if (bracketed && end_bracket != NULL) {
-							*end_bracket = ']';
-							keyfile_port = atoi(end_bracket + 2);
-						}
-						if (host_matched && keyfile_port == pvar->ssh_state.tcpport) {
-							matched = 0;
-							// ڑo[W`FbN̂߂ host_index i߂Ă甲
-							host_index--;
-							do {
-								host_index++;
-								host_index += eat_to_end_of_pattern(data + host_index);
-							} while (data[host_index] == ',');
-							break;
-						}
-					}
-					else {
-						bracketed = data[host_index] == '[';
-						if (bracketed) {
-							end_bracket = strstr(data + host_index + 1, "]:");
-							if (end_bracket != NULL) {
-								*end_bracket = ' ';
-								host_index++;
-							}
-						}
-						host_matched = match_pattern(data + host_index, pvar->ssh_state.hostname);
-						if (bracketed && end_bracket != NULL) {
-							*end_bracket = ']';
-							keyfile_port = atoi(end_bracket + 2);
-						}
-						if (host_matched && keyfile_port == pvar->ssh_state.tcpport) {
-							matched = 1;
-						}
-					}
-					host_index += eat_to_end_of_pattern(data + host_index);
-				} while (data[host_index] == ',');
-
-				// zXgȂ
-				if (!matched) {
-					do_write = 1;
-				}
-				// zXg
-				else {
-					// ؏݂ȂB
-
-				}
-			}
-
-			// ݏ
-			if (do_write) {
-				length = pvar->hosts_state.file_data_index - data_index;
-				amount_written =
-					_write(fd, pvar->hosts_state.file_data + data_index,
-					length);
-
-				if (amount_written != length) {
-					goto error1;
-				}
-			}
-			data_index = pvar->hosts_state.file_data_index;
-		} while (1); // Ō܂œǂ
-
-	error1:
-		close_result = _close(fd);
-		if (amount_written != length || close_result == -1) {
-			UTIL_get_lang_msg("MSG_HOSTS_WRITE_ERROR", pvar,
-				"An error occurred while trying to write the host key.\n"
-				"The host key could not be written.");
-			notify_nonfatal_error(pvar, pvar->ts->UIMsg);
-			goto error2;
-		}
-
-		// ݈ꎞt@C烊l[
-		get_teraterm_dir_relative_name(buf, sizeof(buf), name);
-		_unlink(buf);
-		rename(filename, buf);
-
-	error2:
-		_unlink(filename);
-
-		finish_read_host_files(pvar, 0);
-
-		// ŌɃĂB
-		key_freed = key_new(KEY_UNSPEC);
-		memcpy(key_freed, &key, sizeof(Key));
-		key_free(key_freed);
-	}
+	delete_host_keys(pvar, TRUE);
 }
 
 
@@ -2379,6 +2255,33 @@ void HOSTS_do_different_type_key_dialog(HWND wnd, PTInstVar pvar)
 	}
 }
 
+// T[õzXgJ pvar->hosts_state.hostkey փRs[
+static void copy_host_key(PTInstVar pvar, Key *key)
+{
+	pvar->hosts_state.hostkey.type = key->type;
+	switch (key->type) {
+	case KEY_RSA1: // SSH1
+		pvar->hosts_state.hostkey.bits = key->bits;
+		pvar->hosts_state.hostkey.exp = copy_mp_int(key->exp);
+		pvar->hosts_state.hostkey.mod = copy_mp_int(key->mod);
+		break;
+	case KEY_RSA: // SSH2 RSA
+		pvar->hosts_state.hostkey.rsa = duplicate_RSA(key->rsa);
+		break;
+	case KEY_DSA: // SSH2 DSA
+		pvar->hosts_state.hostkey.dsa = duplicate_DSA(key->dsa);
+		break;
+	case KEY_ECDSA256: // SSH2 ECDSA
+	case KEY_ECDSA384:
+	case KEY_ECDSA521:
+		pvar->hosts_state.hostkey.ecdsa = EC_KEY_dup(key->ecdsa);
+		break;
+	case KEY_ED25519:
+		pvar->hosts_state.hostkey.ed25519_pk = duplicate_ED25519_PK(key->ed25519_pk);
+		break;
+	}
+}
+
 //
 // T[o瑗ĂzXgJ̑Ó`FbN
 //
@@ -2390,11 +2293,26 @@ BOOL HOSTS_check_host_key(PTInstVar pvar, char FAR * hostname, unsigned short tc
 
 	pvar->dns_key_check = DNS_VERIFY_NONE;
 
+	// O known_hosts ŊmFƓȂAt@Cǂݒɍς܂B
+	if (hostkey_cache_find(pvar, hostname, tcpport, key) != NULL) {
+		init_hostkey(&pvar->hosts_state.hostkey);
+		copy_host_key(pvar, key);
+		free(pvar->hosts_state.prefetched_hostname);
+		pvar->hosts_state.prefetched_hostname = _strdup(hostname);
+
+		notify_verbose_message(pvar, "Host key was found in the cache of known_hosts.", LOG_LEVEL_VERBOSE);
+
+		// LbVSSH2̌Ȃ̂ŁAƂ SSH_notify_host_OK() ĂԁB
+		return TRUE;
+	}
+
 	// ł known_hosts t@CzXgJǂݍłȂAƔrB
 	if (pvar->hosts_state.prefetched_hostname != NULL
 	 && _stricmp(pvar->hosts_state.prefetched_hostname, hostname) == 0
 	 && match_key(pvar, key) == 1) {
 
+		hostkey_cache_add(pvar, hostname, tcpport, key);
+
 		if (SSHv1(pvar)) {
 			SSH_notify_host_OK(pvar);
 		} else {
@@ -2414,6 +2332,7 @@ BOOL HOSTS_check_host_key(PTInstVar pvar, char FAR * hostname, unsigned short tc
 				int match = match_key(pvar, key);
 				if (match == 1) {
 					finish_read_host_files(pvar, 0);
+					hostkey_cache_add(pvar, hostname, tcpport, key);
 					// ׂẴGgQƂāAvL[߂B
 					// SSH2̏ꍇ͂ł͉ȂB(2006.3.29 yutaka)
 					if (SSHv1(pvar)) {
@@ -2438,28 +2357,7 @@ BOOL HOSTS_check_host_key(PTInstVar pvar, char FAR * hostname, unsigned short tc
 	}
 
 	// known_hosts ɑ݂ȂL[͂ƂŃt@C֏ނ߂ɁAŕۑĂB
-	pvar->hosts_state.hostkey.type = key->type;
-	switch (key->type) {
-	case KEY_RSA1: // SSH1
-		pvar->hosts_state.hostkey.bits = key->bits;
-		pvar->hosts_state.hostkey.exp = copy_mp_int(key->exp);
-		pvar->hosts_state.hostkey.mod = copy_mp_int(key->mod);
-		break;
-	case KEY_RSA: // SSH2 RSA
-		pvar->hosts_state.hostkey.rsa = duplicate_RSA(key->rsa);
-		break;
-	case KEY_DSA: // SSH2 DSA
-		pvar->hosts_state.hostkey.dsa = duplicate_DSA(key->dsa);
-		break;
-	case KEY_ECDSA256: // SSH2 ECDSA
-	case KEY_ECDSA384:
-	case KEY_ECDSA521:
-		pvar->hosts_state.hostkey.ecdsa = EC_KEY_dup(key->ecdsa);
-		break;
-	case KEY_ED25519:
-		pvar->hosts_state.hostkey.ed25519_pk = duplicate_ED25519_PK(key->ed25519_pk);
-		break;
-	}
+	copy_host_key(pvar, key);
 	free(pvar->hosts_state.prefetched_hostname);
 	pvar->hosts_state.prefetched_hostname = _strdup(hostname);
 
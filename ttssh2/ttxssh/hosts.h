@@ -72,6 +72,8 @@ void HOSTS_notify_disconnecting(PTInstVar pvar);
 void HOSTS_end(PTInstVar pvar);
 
 int uudecode(unsigned char *src, int srclen, unsigned char *target, int targsize);
+int HOSTS_match_hashed_host(char FAR * pattern, int len,
+                            char FAR * hostname, unsigned short tcpport);
 
 int HOSTS_compare_public_key(Key *src, Key *key);
 int HOSTS_hostkey_foreach(PTInstVar pvar, hostkeys_foreach_fn *callback, void *ctx);
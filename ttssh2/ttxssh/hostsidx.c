@@ -0,0 +1,1003 @@
+/*
+Copyright (c) TeraTerm Project.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+  3. The name of the author may not be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+OF SUCH DAMAGE.
+*/
+
+//
+// known_hosts t@C̍
+//
+#include "ttxssh.h"
+#include "matcher.h"
+#include "hosts.h"
+#include "hostsidx.h"
+
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+
+#define HOSTSIDX_MAGIC       "TTKHIDX2"
+#define HOSTSIDX_SUFFIX      ".idx"
+#define HOSTSIDX_MIN_BUCKETS 256
+#define HOSTSIDX_MAX_BUCKETS 0x100000
+#define HOSTSIDX_MAX_FILE    0x80000000   // ȏ傫ȃt@C͍Ȃ
+#define HOSTSIDX_MEM_MAX     4
+#define HOSTSIDX_RESOLVED_MAX 16
+
+// GgȂ`FC
+#define HOSTSIDX_CHAIN_HOST    0  // zXgƃ|[gԍ̃nbV\
+#define HOSTSIDX_CHAIN_PATTERN 1  // ChJ[hے܂ލs (ɌƂ)
+#define HOSTSIDX_CHAIN_HASHED  2  // nbVꂽzXg܂ލs
+
+/*
+ * t@Č`
+ *   hostsidx_header_t
+ *   DWORD buckets[header.buckets]        `FC̐擪 (Ggԍ + 1, 0 ͋)
+ *   hostsidx_entry_t entries[header.entries]
+ * Gg͖ɒǉĂŁAȂB
+ */
+typedef struct {
+	char magic[8];
+	DWORD buckets;         // nbV\̑傫 (2ׂ̂)
+	DWORD entries;         // Gg̐
+	DWORD pattern_head;
+	DWORD hashed_head;
+	hostsidx_stamp_t stamp;  // ΉĂ known_hosts ̏
+} hostsidx_header_t;
+
+typedef struct {
+	DWORD hash_lo;
+	DWORD hash_hi;
+	DWORD next;            // `FC̎̃Ggԍ + 1
+	DWORD offset;          // known_hosts t@C̍s̐擪ʒu
+} hostsidx_entry_t;
+
+typedef struct {
+	hostsidx_header_t *hdr;
+	DWORD *buckets;
+	hostsidx_entry_t *entries;
+} hostsidx_image_t;
+
+// JĂ
+typedef struct {
+	HANDLE file;
+	HANDLE map;
+	BYTE *view;
+	BYTE *mem;             // 蒼 (Kv)
+	BOOL on_disk;          // t@Cǂ񂾂At@Cɏ
+	hostsidx_image_t img;
+} hostsidx_index_t;
+
+// ɒǉGg
+typedef struct {
+	DWORD hash_lo;
+	DWORD hash_hi;
+	DWORD offset;
+	int chain;
+} hostsidx_item_t;
+
+typedef struct {
+	hostsidx_item_t *items;
+	int num;
+	int max;
+} hostsidx_items_t;
+
+typedef struct {
+	DWORD *v;
+	int num;
+	int max;
+} hostsidx_offsets_t;
+
+// t@CȂƂ(ǂݎp̃tH_)́AvZXōoĂ
+typedef struct {
+	char *idxname;
+	hostsidx_stamp_t stamp;
+	BYTE *image;
+	DWORD size;
+} hostsidx_mem_t;
+
+static hostsidx_mem_t mem_index[HOSTSIDX_MEM_MAX];
+static int mem_index_next;
+
+// nbVꂽsƍʁB
+// t@CɏƁAnbVĉBzXg番Ă܂̂ŁA
+// vȂƂ܂߂ăvZXŊoĂB
+typedef struct {
+	char *idxname;
+	hostsidx_stamp_t stamp;
+	DWORD hash_lo;
+	DWORD hash_hi;
+	hostsidx_offsets_t offsets;  // vs̈ʒu
+} hostsidx_resolved_t;
+
+static hostsidx_resolved_t resolved_cache[HOSTSIDX_RESOLVED_MAX];
+static int resolved_next;
+
+
+BOOL HOSTSIDX_get_stamp(char *filename, hostsidx_stamp_t *stamp)
+{
+	WIN32_FILE_ATTRIBUTE_DATA fad;
+
+	memset(stamp, 0, sizeof(*stamp));
+	if (!GetFileAttributesEx(filename, GetFileExInfoStandard, &fad)) {
+		return FALSE;
+	}
+	stamp->mtime = fad.ftLastWriteTime;
+	stamp->size_low = fad.nFileSizeLow;
+	stamp->size_high = fad.nFileSizeHigh;
+	return TRUE;
+}
+
+static void get_index_name(char *filename, char *idxname, int idxname_len)
+{
+	_snprintf_s(idxname, idxname_len, _TRUNCATE, "%s%s", filename, HOSTSIDX_SUFFIX);
+}
+
+// zXgƃ|[gԍ̃nbVl (FNV-1a 64bit)
+static void hash_host(char *host, int len, unsigned short port, DWORD *lo, DWORD *hi)
+{
+	unsigned __int64 h = 14695981039346656037ui64;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)host[i];
+		h *= 1099511628211ui64;
+	}
+	h ^= port & 0xff;
+	h *= 1099511628211ui64;
+	h ^= port >> 8;
+	h *= 1099511628211ui64;
+
+	*lo = (DWORD)h;
+	*hi = (DWORD)(h >> 32);
+}
+
+// known_hosts ̃zXg ("host" ܂ "[host]:port") ̃nbVl
+static void hash_name(char *name, int len, DWORD *lo, DWORD *hi)
+{
+	unsigned short port = 22;
+	char buf[16];
+	int i, n;
+
+	if (name[0] == '[') {
+		for (i = 1; i + 1 < len; i++) {
+			if (name[i] == ']' && name[i + 1] == ':') {
+				n = min(len - (i + 2), (int)sizeof(buf) - 1);
+				memcpy(buf, name + i + 2, n);
+				buf[n] = '\0';
+				port = atoi(buf);
+				hash_host(name + 1, i - 1, port, lo, hi);
+				return;
+			}
+		}
+	}
+	hash_host(name, len, port, lo, hi);
+}
+
+static BOOL items_add(hostsidx_items_t *a, DWORD lo, DWORD hi, DWORD offset, int chain)
+{
+	if (a->num >= a->max) {
+		int max = a->max ? a->max * 2 : 256;
+		hostsidx_item_t *p = realloc(a->items, max * sizeof(hostsidx_item_t));
+		if (p == NULL) {
+			return FALSE;
+		}
+		a->items = p;
+		a->max = max;
+	}
+	a->items[a->num].hash_lo = lo;
+	a->items[a->num].hash_hi = hi;
+	a->items[a->num].offset = offset;
+	a->items[a->num].chain = chain;
+	a->num++;
+	return TRUE;
+}
+
+static BOOL offsets_add(hostsidx_offsets_t *a, DWORD offset)
+{
+	if (a->num >= a->max) {
+		int max = a->max ? a->max * 2 : 16;
+		DWORD *p = realloc(a->v, max * sizeof(DWORD));
+		if (p == NULL) {
+			return FALSE;
+		}
+		a->v = p;
+		a->max = max;
+	}
+	a->v[a->num++] = offset;
+	return TRUE;
+}
+
+static BOOL offsets_contain(hostsidx_offsets_t *a, DWORD offset)
+{
+	int i;
+
+	for (i = 0; i < a->num; i++) {
+		if (a->v[i] == offset) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static int compare_offset(const void *a, const void *b)
+{
+	DWORD x = *(const DWORD *)a;
+	DWORD y = *(const DWORD *)b;
+
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+//
+// 1s(line  end ̎O܂)𕪗ނāAɓGgǉB
+//   zXg          nbV\
+//   *, ?, ! ܂    p^[̃`FC (1sɂ1Gg)
+//   |1|...            nbVꂽs̃`FC (s̕ʂ̃zXg̓nbV\ւ)
+// RgAsA@Ŏn܂s͓ȂB
+//
+static BOOL index_line(hostsidx_items_t *a, char *line, char *end, DWORD offset)
+{
+	char *p = line;
+	char *start;
+	int first = a->num;
+	int pattern = 0;
+	int hashed = 0;
+	DWORD lo, hi;
+
+	while (p < end && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+	if (p >= end || *p == '#' || *p == '@' || *p == '\r') {
+		return TRUE;
+	}
+
+	for (;;) {
+		start = p;
+		while (p < end && is_pattern_char(*p)) {
+			p++;
+		}
+		if (p > start) {
+			if (*start == '!' || memchr(start, '*', p - start) != NULL ||
+			    memchr(start, '?', p - start) != NULL) {
+				pattern = 1;
+			}
+			else if (p - start >= 3 && strncmp(start, "|1|", 3) == 0) {
+				hashed = 1;
+			}
+			else {
+				hash_name(start, (int)(p - start), &lo, &hi);
+				if (!items_add(a, lo, hi, offset, HOSTSIDX_CHAIN_HOST)) {
+					return FALSE;
+				}
+			}
+		}
+		if (p < end && *p == ',') {
+			p++;
+			continue;
+		}
+		break;
+	}
+
+	if (pattern) {
+		a->num = first;
+		return items_add(a, 0, 0, offset, HOSTSIDX_CHAIN_PATTERN);
+	}
+	if (hashed) {
+		return items_add(a, 0, 0, offset, HOSTSIDX_CHAIN_HASHED);
+	}
+	return TRUE;
+}
+
+static BOOL index_lines(hostsidx_items_t *a, char *data, DWORD len, DWORD base)
+{
+	DWORD off = 0;
+
+	while (off < len) {
+		char *eol = memchr(data + off, '\n', len - off);
+		char *end = (eol != NULL) ? eol : data + len;
+
+		if (!index_line(a, data + off, end, base + off)) {
+			return FALSE;
+		}
+		off = (DWORD)(end - data) + 1;
+	}
+	return TRUE;
+}
+
+static void link_entry(hostsidx_image_t *img, hostsidx_item_t *item)
+{
+	hostsidx_header_t *hdr = img->hdr;
+	hostsidx_entry_t *e = &img->entries[hdr->entries];
+	DWORD no = hdr->entries + 1;
+	DWORD *head;
+
+	switch (item->chain) {
+	case HOSTSIDX_CHAIN_HOST:
+		head = &img->buckets[item->hash_lo & (hdr->buckets - 1)];
+		break;
+	case HOSTSIDX_CHAIN_PATTERN:
+		head = &hdr->pattern_head;
+		break;
+	default:
+		head = &hdr->hashed_head;
+		break;
+	}
+	e->hash_lo = item->hash_lo;
+	e->hash_hi = item->hash_hi;
+	e->offset = item->offset;
+	e->next = *head;
+	*head = no;
+	hdr->entries++;
+}
+
+static BOOL image_attach(hostsidx_image_t *img, BYTE *base, DWORD size)
+{
+	hostsidx_header_t *hdr = (hostsidx_header_t *)base;
+	DWORD rest;
+
+	if (size < sizeof(hostsidx_header_t) ||
+	    memcmp(hdr->magic, HOSTSIDX_MAGIC, sizeof(hdr->magic)) != 0) {
+		return FALSE;
+	}
+	rest = size - sizeof(hostsidx_header_t);
+	if (hdr->buckets == 0 || (hdr->buckets & (hdr->buckets - 1)) != 0 ||
+	    hdr->buckets > rest / sizeof(DWORD)) {
+		return FALSE;
+	}
+	rest -= hdr->buckets * sizeof(DWORD);
+	if (hdr->entries > rest / sizeof(hostsidx_entry_t) ||
+	    hdr->pattern_head > hdr->entries || hdr->hashed_head > hdr->entries) {
+		return FALSE;
+	}
+
+	img->hdr = hdr;
+	img->buckets = (DWORD *)(base + sizeof(hostsidx_header_t));
+	img->entries = (hostsidx_entry_t *)(img->buckets + hdr->buckets);
+	return TRUE;
+}
+
+// known_hosts ̓e
+static BYTE *build_index(char *data, DWORD size, hostsidx_stamp_t *stamp, DWORD *image_size)
+{
+	hostsidx_items_t a;
+	hostsidx_image_t img;
+	DWORD buckets = HOSTSIDX_MIN_BUCKETS;
+	DWORD total;
+	BYTE *image = NULL;
+	int i;
+
+	memset(&a, 0, sizeof(a));
+	if (!index_lines(&a, data, size, 0)) {
+		goto error;
+	}
+
+	while (buckets < (DWORD)a.num * 2 && buckets < HOSTSIDX_MAX_BUCKETS) {
+		buckets <<= 1;
+	}
+	total = sizeof(hostsidx_header_t) + buckets * sizeof(DWORD) +
+	        a.num * sizeof(hostsidx_entry_t);
+	image = calloc(1, total);
+	if (image == NULL) {
+		goto error;
+	}
+
+	img.hdr = (hostsidx_header_t *)image;
+	memcpy(img.hdr->magic, HOSTSIDX_MAGIC, sizeof(img.hdr->magic));
+	img.hdr->buckets = buckets;
+	img.hdr->stamp = *stamp;
+	img.buckets = (DWORD *)(image + sizeof(hostsidx_header_t));
+	img.entries = (hostsidx_entry_t *)(img.buckets + buckets);
+	for (i = 0; i < a.num; i++) {
+		link_entry(&img, &a.items[i]);
+	}
+	*image_size = total;
+
+error:
+	free(a.items);
+	return image;
+}
+
+//
+// ꎞt@CɏĂuB
+// ̃vZXɏĂA̍t@CǂނƂ͂ȂB
+//
+static BOOL write_index_file(char *idxname, BYTE *image, DWORD size)
+{
+	char tmpname[FILENAME_MAX + 32];
+	int fd;
+	int amount_written;
+	int close_result;
+
+	_snprintf_s(tmpname, sizeof(tmpname), _TRUNCATE, "%s.%lu.tmp",
+	            idxname, GetCurrentProcessId());
+	fd = _open(tmpname, _O_CREAT | _O_TRUNC | _O_WRONLY | _O_BINARY,
+	           _S_IREAD | _S_IWRITE);
+	if (fd == -1) {
+		return FALSE;
+	}
+	amount_written = _write(fd, image, size);
+	close_result = _close(fd);
+	if (amount_written != (int)size || close_result == -1 ||
+	    !MoveFileEx(tmpname, idxname, MOVEFILE_REPLACE_EXISTING)) {
+		_unlink(tmpname);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+//
+// ɃGgǉă`FCɂȂAt@CB
+//  expect ̏Ԃ known_hosts ɑΉĂȂΉȂB
+// new_stamp  NULL łȂ΁AΉ known_hosts ̏ԂB
+// ȂƂ́A known_hosts ƐHႤ̂ŁAɈƂɍ蒼B
+//
+static BOOL append_index_entries(char *idxname, hostsidx_stamp_t *expect, hostsidx_stamp_t *new_stamp,
+                                 hostsidx_item_t *items, int num)
+{
+	hostsidx_image_t img;
+	BYTE *image = NULL;
+	long len;
+	DWORD size;
+	int fd;
+	int i;
+	BOOL ret = FALSE;
+
+	fd = _open(idxname, _O_RDONLY | _O_BINARY);
+	if (fd == -1) {
+		return FALSE;
+	}
+	len = _filelength(fd);
+	if (len >= (long)sizeof(hostsidx_header_t) && (DWORD)len < HOSTSIDX_MAX_FILE) {
+		image = malloc(len + num * sizeof(hostsidx_entry_t));
+		if (image != NULL && _read(fd, image, len) != len) {
+			free(image);
+			image = NULL;
+		}
+	}
+	_close(fd);
+
+	if (image == NULL || !image_attach(&img, image, len) ||
+	    memcmp(&img.hdr->stamp, expect, sizeof(img.hdr->stamp)) != 0) {
+		goto end;
+	}
+
+	for (i = 0; i < num; i++) {
+		link_entry(&img, &items[i]);
+	}
+	if (new_stamp != NULL) {
+		img.hdr->stamp = *new_stamp;
+	}
+
+	// ̃Ggɗ]ȃf[^ĂA͏Ȃ
+	size = sizeof(hostsidx_header_t) + img.hdr->buckets * sizeof(DWORD) +
+	       img.hdr->entries * sizeof(hostsidx_entry_t);
+	ret = write_index_file(idxname, image, size);
+
+end:
+	free(image);
+	return ret;
+}
+
+static BOOL mem_index_find(char *idxname, hostsidx_stamp_t *stamp, hostsidx_index_t *idx)
+{
+	int i;
+
+	for (i = 0; i < HOSTSIDX_MEM_MAX; i++) {
+		hostsidx_mem_t *m = &mem_index[i];
+
+		if (m->idxname != NULL && strcmp(m->idxname, idxname) == 0 &&
+		    memcmp(&m->stamp, stamp, sizeof(*stamp)) == 0) {
+			return image_attach(&idx->img, m->image, m->size);
+		}
+	}
+	return FALSE;
+}
+
+static void mem_index_store(char *idxname, hostsidx_stamp_t *stamp, BYTE *image, DWORD size)
+{
+	hostsidx_mem_t *m = NULL;
+	int i;
+
+	for (i = 0; i < HOSTSIDX_MEM_MAX; i++) {
+		if (mem_index[i].idxname != NULL && strcmp(mem_index[i].idxname, idxname) == 0) {
+			m = &mem_index[i];
+			break;
+		}
+	}
+	if (m == NULL) {
+		m = &mem_index[mem_index_next];
+		mem_index_next = (mem_index_next + 1) % HOSTSIDX_MEM_MAX;
+	}
+
+	free(m->idxname);
+	free(m->image);
+	m->idxname = _strdup(idxname);
+	m->stamp = *stamp;
+	m->image = image;
+	m->size = size;
+}
+
+static hostsidx_resolved_t *resolved_find(char *idxname, hostsidx_stamp_t *stamp,
+                                          DWORD lo, DWORD hi)
+{
+	int i;
+
+	for (i = 0; i < HOSTSIDX_RESOLVED_MAX; i++) {
+		hostsidx_resolved_t *r = &resolved_cache[i];
+
+		if (r->idxname != NULL && strcmp(r->idxname, idxname) == 0 &&
+		    memcmp(&r->stamp, stamp, sizeof(*stamp)) == 0 &&
+		    r->hash_lo == lo && r->hash_hi == hi) {
+			return r;
+		}
+	}
+	return NULL;
+}
+
+// matched ̔z resolved_cache Ɉ
+static void resolved_store(char *idxname, hostsidx_stamp_t *stamp, DWORD lo, DWORD hi,
+                           hostsidx_offsets_t *matched)
+{
+	hostsidx_resolved_t *r = &resolved_cache[resolved_next];
+
+	resolved_next = (resolved_next + 1) % HOSTSIDX_RESOLVED_MAX;
+
+	free(r->idxname);
+	free(r->offsets.v);
+	r->idxname = _strdup(idxname);
+	r->stamp = *stamp;
+	r->hash_lo = lo;
+	r->hash_hi = hi;
+	r->offsets = *matched;
+	memset(matched, 0, sizeof(*matched));
+}
+
+static void close_index(hostsidx_index_t *idx)
+{
+	if (idx->view != NULL) {
+		UnmapViewOfFile(idx->view);
+	}
+	if (idx->map != NULL) {
+		CloseHandle(idx->map);
+	}
+	if (idx->file != INVALID_HANDLE_VALUE) {
+		CloseHandle(idx->file);
+	}
+	free(idx->mem);
+
+	memset(idx, 0, sizeof(*idx));
+	idx->file = INVALID_HANDLE_VALUE;
+}
+
+//
+// known_hosts (data, size) ɑΉJB
+// t@CÂĂ(rebuild  TRUE ̂Ƃ)蒼B
+//
+static BOOL open_index(PTInstVar pvar, char *idxname, hostsidx_stamp_t *stamp,
+                       char *data, DWORD size, BOOL rebuild, hostsidx_index_t *idx)
+{
+	char buf[FILENAME_MAX + 64];
+	BYTE *image;
+	DWORD image_size;
+	DWORD tick;
+
+	memset(idx, 0, sizeof(*idx));
+	idx->file = INVALID_HANDLE_VALUE;
+
+	if (!rebuild) {
+		idx->file = CreateFile(idxname, GENERIC_READ,
+		                       FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		                       NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (idx->file != INVALID_HANDLE_VALUE) {
+			image_size = GetFileSize(idx->file, NULL);
+			if (image_size != INVALID_FILE_SIZE && image_size >= sizeof(hostsidx_header_t)) {
+				idx->map = CreateFileMapping(idx->file, NULL, PAGE_READONLY, 0, 0, NULL);
+				if (idx->map != NULL) {
+					idx->view = MapViewOfFile(idx->map, FILE_MAP_READ, 0, 0, 0);
+				}
+			}
+			if (idx->view != NULL && image_attach(&idx->img, idx->view, image_size) &&
+			    memcmp(&idx->img.hdr->stamp, stamp, sizeof(*stamp)) == 0) {
+				idx->on_disk = TRUE;
+				return TRUE;
+			}
+			close_index(idx);
+		}
+
+		if (mem_index_find(idxname, stamp, idx)) {
+			return TRUE;
+		}
+	}
+
+	tick = GetTickCount();
+	image = build_index(data, size, stamp, &image_size);
+	if (image == NULL) {
+		return FALSE;
+	}
+	image_attach(&idx->img, image, image_size);
+
+	if (write_index_file(idxname, image, image_size)) {
+		idx->mem = image;
+		idx->on_disk = TRUE;
+	}
+	else {
+		mem_index_store(idxname, stamp, image, image_size);
+	}
+
+	_snprintf_s(buf, sizeof(buf), _TRUNCATE,
+	            "known_hosts index was rebuilt: %s (%u entries, %lu ms)%s",
+	            idxname, idx->img.hdr->entries, GetTickCount() - tick,
+	            idx->on_disk ? "" : " (kept in memory)");
+	notify_verbose_message(pvar, buf, LOG_LEVEL_VERBOSE);
+	return TRUE;
+}
+
+//
+// `FCǂčs̈ʒuW߂B
+// match_hash  TRUE ȂnbVl̓GgW߂B
+// NĂ FALSE ԂB
+//
+static BOOL walk_chain(hostsidx_image_t *img, DWORD head, BOOL match_hash, DWORD lo, DWORD hi,
+                       hostsidx_offsets_t *out)
+{
+	DWORD no = head;
+	DWORD steps = 0;
+
+	while (no != 0) {
+		hostsidx_entry_t *e;
+
+		if (no > img->hdr->entries || steps++ > img->hdr->entries) {
+			return FALSE;
+		}
+		e = &img->entries[no - 1];
+		if ((!match_hash || (e->hash_lo == lo && e->hash_hi == hi)) &&
+		    !offsets_add(out, e->offset)) {
+			return FALSE;
+		}
+		no = e->next;
+	}
+	return TRUE;
+}
+
+// offset s̐擪wĂ΁As̒(s)Ԃ
+static BOOL get_line(char *data, DWORD size, DWORD offset, DWORD *len)
+{
+	char *eol;
+
+	if (offset >= size || (offset > 0 && data[offset - 1] != '\n')) {
+		return FALSE;
+	}
+	eol = memchr(data + offset, '\n', size - offset);
+	*len = (eol != NULL ? (DWORD)(eol - data) : size) - offset;
+	if (*len > 0 && data[offset + *len - 1] == '\r') {
+		(*len)--;
+	}
+	return TRUE;
+}
+
+// s̃nbVꂽzXĝǂꂩAڑɍv邩
+static BOOL match_hashed_line(char *data, DWORD size, DWORD offset,
+                              char *hostname, unsigned short tcpport)
+{
+	char *p, *end, *start;
+	DWORD len;
+
+	if (!get_line(data, size, offset, &len)) {
+		return FALSE;
+	}
+	p = data + offset;
+	end = p + len;
+	while (p < end && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+	for (;;) {
+		start = p;
+		while (p < end && is_pattern_char(*p)) {
+			p++;
+		}
+		if (HOSTS_match_hashed_host(start, (int)(p - start), hostname, tcpport)) {
+			return TRUE;
+		}
+		if (p < end && *p == ',') {
+			p++;
+			continue;
+		}
+		return FALSE;
+	}
+}
+
+// W߂ʒu̍so
+static BOOL make_lines(char *data, DWORD size, hostsidx_offsets_t *found, hostsidx_lines_t *lines)
+{
+	DWORD total = 1;
+	DWORD len;
+	int i, n;
+
+	qsort(found->v, found->num, sizeof(DWORD), compare_offset);
+
+	for (i = 0; i < found->num; i++) {
+		if ((i == 0 || found->v[i] != found->v[i - 1]) &&
+		    get_line(data, size, found->v[i], &len)) {
+			total += len + 1;
+		}
+	}
+
+	lines->data = malloc(total);
+	lines->offsets = malloc((found->num + 1) * sizeof(DWORD));
+	lines->starts = malloc((found->num + 1) * sizeof(int));
+	if (lines->data == NULL || lines->offsets == NULL || lines->starts == NULL) {
+		HOSTSIDX_free_lines(lines);
+		return FALSE;
+	}
+
+	total = 0;
+	n = 0;
+	for (i = 0; i < found->num; i++) {
+		if ((i == 0 || found->v[i] != found->v[i - 1]) &&
+		    get_line(data, size, found->v[i], &len)) {
+			memcpy(lines->data + total, data + found->v[i], len);
+			lines->offsets[n] = found->v[i];
+			lines->starts[n] = total;
+			total += len;
+			lines->data[total++] = '\n';
+			n++;
+		}
+	}
+	lines->data[total] = '\0';
+	lines->num = n;
+	return TRUE;
+}
+
+//
+// gāAzXgɍvs known_hosts t@CoB
+// gȂ FALSE Ԃ̂ŁAĂяo̓t@CŜǂނƁB
+//
+BOOL HOSTSIDX_lookup(PTInstVar pvar, char *filename,
+                     char *hostname, unsigned short tcpport,
+                     hostsidx_lines_t *lines)
+{
+	char idxname[FILENAME_MAX + 8];
+	hostsidx_stamp_t stamp;
+	hostsidx_index_t idx;
+	hostsidx_offsets_t found, hashed, matched;
+	hostsidx_resolved_t *resolved;
+	HANDLE file, map = NULL;
+	char *data = NULL;
+	DWORD size, lo, hi;
+	BOOL ret = FALSE;
+	int attempt, i;
+
+	memset(lines, 0, sizeof(*lines));
+	memset(&idx, 0, sizeof(idx));
+	idx.file = INVALID_HANDLE_VALUE;
+	memset(&found, 0, sizeof(found));
+	memset(&hashed, 0, sizeof(hashed));
+	memset(&matched, 0, sizeof(matched));
+
+	if (!HOSTSIDX_get_stamp(filename, &stamp) ||
+	    stamp.size_high != 0 || stamp.size_low >= HOSTSIDX_MAX_FILE) {
+		return FALSE;
+	}
+	size = stamp.size_low;
+	if (size == 0) {
+		lines->data = calloc(1, 1);
+		return lines->data != NULL;
+	}
+	get_index_name(filename, idxname, sizeof(idxname));
+
+	file = CreateFile(filename, GENERIC_READ,
+	                  FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+	                  NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return FALSE;
+	}
+	if (GetFileSize(file, NULL) != size) {
+		goto end;
+	}
+	map = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (map == NULL) {
+		goto end;
+	}
+	data = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL) {
+		goto end;
+	}
+
+	hash_host(hostname, (int)strlen(hostname), tcpport, &lo, &hi);
+	resolved = resolved_find(idxname, &stamp, lo, hi);
+
+	// ĂAx蒼Ĉ
+	for (attempt = 0; attempt < 2; attempt++) {
+		found.num = hashed.num = 0;
+		if (!open_index(pvar, idxname, &stamp, data, size, attempt > 0, &idx)) {
+			goto end;
+		}
+		if (walk_chain(&idx.img, idx.img.buckets[lo & (idx.img.hdr->buckets - 1)],
+		               TRUE, lo, hi, &found) &&
+		    walk_chain(&idx.img, idx.img.hdr->pattern_head, FALSE, 0, 0, &found) &&
+		    (resolved != NULL ||
+		     walk_chain(&idx.img, idx.img.hdr->hashed_head, FALSE, 0, 0, &hashed))) {
+			break;
+		}
+		close_index(&idx);
+	}
+	if (attempt == 2) {
+		goto end;
+	}
+
+	// nbVꂽśAzXgƂɈxSƍAʂvZXŊoĂB
+	if (resolved != NULL) {
+		for (i = 0; i < resolved->offsets.num; i++) {
+			if (!offsets_add(&found, resolved->offsets.v[i])) {
+				goto end;
+			}
+		}
+	}
+	else if (hashed.num > 0) {
+		for (i = 0; i < hashed.num; i++) {
+			if (!offsets_contain(&found, hashed.v[i]) &&
+			    match_hashed_line(data, size, hashed.v[i], hostname, tcpport)) {
+				if (!offsets_add(&found, hashed.v[i]) ||
+				    !offsets_add(&matched, hashed.v[i])) {
+					goto end;
+				}
+			}
+		}
+		resolved_store(idxname, &stamp, lo, hi, &matched);
+	}
+
+	ret = make_lines(data, size, &found, lines);
+
+end:
+	close_index(&idx);
+	if (data != NULL) {
+		UnmapViewOfFile(data);
+	}
+	if (map != NULL) {
+		CloseHandle(map);
+	}
+	CloseHandle(file);
+	free(found.v);
+	free(hashed.v);
+	free(matched.v);
+	return ret;
+}
+
+void HOSTSIDX_free_lines(hostsidx_lines_t *lines)
+{
+	free(lines->data);
+	free(lines->offsets);
+	free(lines->starts);
+	memset(lines, 0, sizeof(*lines));
+}
+
+// known_hosts t@C offset ̒O̕s
+static BOOL is_line_head(char *filename, DWORD offset)
+{
+	int fd;
+	char ch = 0;
+
+	if (offset == 0) {
+		return TRUE;
+	}
+	fd = _open(filename, _O_RDONLY | _O_BINARY);
+	if (fd == -1) {
+		return FALSE;
+	}
+	if (_lseek(fd, offset - 1, SEEK_SET) != (long)offset - 1 || _read(fd, &ch, 1) != 1) {
+		ch = 0;
+	}
+	_close(fd);
+	return ch == '\n';
+}
+
+//
+// known_hosts t@C̖ data ǋLƂɌĂԁB
+// ǋLÕt@CɑΉĂ΁AǋLs̃Gg𑫂B
+// ȊȌꍇ͉AɈƂɍ蒼B
+//
+void HOSTSIDX_notify_appended(PTInstVar pvar, char *filename,
+                              hostsidx_stamp_t *before, char *data, int len)
+{
+	char idxname[FILENAME_MAX + 8];
+	hostsidx_stamp_t after;
+	hostsidx_items_t a;
+
+	if (!HOSTSIDX_get_stamp(filename, &after)) {
+		return;
+	}
+	// ̃vZXłAŌ̍sɉsȂꍇ͍蒼
+	if (before->size_high != 0 || after.size_high != 0 ||
+	    after.size_low >= HOSTSIDX_MAX_FILE ||
+	    after.size_low != before->size_low + len ||
+	    !is_line_head(filename, before->size_low)) {
+		return;
+	}
+	get_index_name(filename, idxname, sizeof(idxname));
+
+	memset(&a, 0, sizeof(a));
+	if (index_lines(&a, data, len, before->size_low) &&
+	    append_index_entries(idxname, before, &after, a.items, a.num)) {
+		notify_verbose_message(pvar, "known_hosts index was updated.", LOG_LEVEL_VERBOSE);
+	}
+	free(a.items);
+}
+
+//
+// HOSTSIDX_lookup() ŎoŝAerase  TRUE ̍s󔒂œhԂB
+// t@C̑傫Ƒ̍s̈ʒu͕ςȂ̂ŁA͂̂܂܎gB
+//
+BOOL HOSTSIDX_blank_lines(PTInstVar pvar, char *filename,
+                          hostsidx_lines_t *lines, BOOL *erase)
+{
+	char idxname[FILENAME_MAX + 8];
+	hostsidx_stamp_t before, after;
+	char *buf;
+	int fd;
+	int i;
+	BOOL ret = TRUE;
+
+	if (!HOSTSIDX_get_stamp(filename, &before)) {
+		return FALSE;
+	}
+	fd = _open(filename, _O_RDWR | _O_BINARY);
+	if (fd == -1) {
+		return FALSE;
+	}
+
+	for (i = 0; i < lines->num && ret; i++) {
+		char *line = lines->data + lines->starts[i];
+		long pos = lines->offsets[i];
+		int len = (int)(strchr(line, '\n') - line);
+
+		if (!erase[i] || len == 0) {
+			continue;
+		}
+		buf = malloc(len);
+		if (buf == NULL) {
+			ret = FALSE;
+			break;
+		}
+		// ǂݍ񂾂Ƃɏꂽs͐GȂ
+		if (_lseek(fd, pos, SEEK_SET) == pos && _read(fd, buf, len) == len &&
+		    memcmp(buf, line, len) == 0) {
+			memset(buf, ' ', len);
+			if (_lseek(fd, pos, SEEK_SET) != pos || _write(fd, buf, len) != len) {
+				ret = FALSE;
+			}
+		}
+		free(buf);
+	}
+
+	if (_close(fd) == -1) {
+		ret = FALSE;
+	}
+
+	if (ret && HOSTSIDX_get_stamp(filename, &after)) {
+		get_index_name(filename, idxname, sizeof(idxname));
+		if (append_index_entries(idxname, &before, &after, NULL, 0)) {
+			notify_verbose_message(pvar, "known_hosts index was updated.", LOG_LEVEL_VERBOSE);
+		}
+	}
+	return ret;
+}
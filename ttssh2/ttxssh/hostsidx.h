@@ -0,0 +1,64 @@
+/*
+Copyright (c) TeraTerm Project.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+  3. The name of the author may not be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+OF SUCH DAMAGE.
+*/
+
+#ifndef __TTSSH_HOSTSIDX_H
+#define __TTSSH_HOSTSIDX_H
+
+/*
+ * known_hosts t@C̍
+ *
+ * known_hosts t@CƓꏊ "<t@C>.idx" AzXgƃ|[gԍ
+ * nbVlÃzXgĂs̈ʒu悤ɂĂB
+ * ڑ̂тɃt@CŜǂőSsƍɁA̍sǂށB
+ * ɂ͍쐬 known_hosts ̍XVƃTCYL^AH蒼B
+ */
+
+// known_hosts t@C̏ (XVƃTCY)
+typedef struct {
+	FILETIME mtime;
+	DWORD size_low;
+	DWORD size_high;
+} hostsidx_stamp_t;
+
+// o̍s
+typedef struct {
+	char *data;       // ̍s '\n' ؂łȂ́B \0B
+	int num;          // s̐
+	DWORD *offsets;   // es known_hosts t@Cł̈ʒu
+	int *starts;      // es data ł̈ʒu
+} hostsidx_lines_t;
+
+BOOL HOSTSIDX_get_stamp(char *filename, hostsidx_stamp_t *stamp);
+BOOL HOSTSIDX_lookup(PTInstVar pvar, char *filename,
+                     char *hostname, unsigned short tcpport,
+                     hostsidx_lines_t *lines);
+void HOSTSIDX_free_lines(hostsidx_lines_t *lines);
+void HOSTSIDX_notify_appended(PTInstVar pvar, char *filename,
+                              hostsidx_stamp_t *before, char *data, int len);
+BOOL HOSTSIDX_blank_lines(PTInstVar pvar, char *filename,
+                          hostsidx_lines_t *lines, BOOL *erase);
+
+#endif
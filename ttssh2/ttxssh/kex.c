@@ -303,6 +303,51 @@ unsigned char *kex_ecdh_hash(const EVP_MD *evp_md,
 }
 
 
+unsigned char *kex_c25519_hash(const EVP_MD *evp_md,
+                               char *client_version_string,
+                               char *server_version_string,
+                               char *ckexinit, int ckexinitlen,
+                               char *skexinit, int skexinitlen,
+                               u_char *serverhostkeyblob, int sbloblen,
+                               u_char *client_dh_pub,
+                               u_char *server_dh_pub,
+                               BIGNUM *shared_secret,
+                               unsigned int *hashlen)
+{
+	buffer_t *b;
+	static unsigned char digest[EVP_MAX_MD_SIZE];
+	EVP_MD_CTX md;
+
+	b = buffer_init();
+	buffer_put_string(b, client_version_string, strlen(client_version_string));
+	buffer_put_string(b, server_version_string, strlen(server_version_string));
+
+	/* kexinit messages: fake header: len+SSH2_MSG_KEXINIT */
+	buffer_put_int(b, ckexinitlen+1);
+	buffer_put_char(b, SSH2_MSG_KEXINIT);
+	buffer_append(b, ckexinit, ckexinitlen);
+	buffer_put_int(b, skexinitlen+1);
+	buffer_put_char(b, SSH2_MSG_KEXINIT);
+	buffer_append(b, skexinit, skexinitlen);
+
+	buffer_put_string(b, serverhostkeyblob, sbloblen);
+
+	// J 32 oCg̕ƂāAL閧 mpint ƂănbVɊ܂߂ (RFC8731)
+	buffer_put_string(b, client_dh_pub, CURVE25519_SIZE);
+	buffer_put_string(b, server_dh_pub, CURVE25519_SIZE);
+	buffer_put_bignum2(b, shared_secret);
+
+	EVP_DigestInit(&md, evp_md);
+	EVP_DigestUpdate(&md, buffer_ptr(b), buffer_len(b));
+	EVP_DigestFinal(&md, digest, NULL);
+
+	buffer_free(b);
+
+	*hashlen = EVP_MD_size(evp_md);
+
+	return digest;
+}
+
 int dh_pub_is_valid(DH *dh, BIGNUM *dh_pub)
 {
 	int i;
@@ -71,6 +71,16 @@ unsigned char *kex_ecdh_hash(const EVP_MD *evp_md,
                              const EC_POINT *server_dh_pub,
                              BIGNUM *shared_secret,
                                unsigned int *hashlen);
+unsigned char *kex_c25519_hash(const EVP_MD *evp_md,
+                               char *client_version_string,
+                               char *server_version_string,
+                               char *ckexinit, int ckexinitlen,
+                               char *skexinit, int skexinitlen,
+                               u_char *serverhostkeyblob, int sbloblen,
+                               u_char *client_dh_pub,
+                               u_char *server_dh_pub,
+                               BIGNUM *shared_secret,
+                               unsigned int *hashlen);
 
 int dh_pub_is_valid(DH *dh, BIGNUM *dh_pub);
 int key_ec_validate_public(const EC_GROUP *group, const EC_POINT *public);
@@ -40,12 +40,16 @@ See LICENSE.TXT for the license.
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <sys/stat.h>
 #include <openssl/rsa.h>
 #include <openssl/dsa.h>
 #include <openssl/evp.h>
 #include <openssl/pem.h>
 #include <openssl/md5.h>
 #include <openssl/err.h>
+#include <openssl/sha.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
 
 #include "cipher.h"
 
@@ -373,6 +377,8 @@ static Key *read_SSH2_private2_key(PTInstVar pvar,
 	SSHCipher ciphernameval;
 	size_t authlen;
 	EVP_CIPHER_CTX cipher_ctx;
+	DWORD tick;
+	char msg[128];
 
 	blob = buffer_init();
 	b = buffer_init();
@@ -530,11 +536,16 @@ static Key *read_SSH2_private2_key(PTInstVar pvar,
 		}
 		rounds = buffer_get_int(kdf);
 		// TODO: error check
+		tick = GetTickCount();
 		if (bcrypt_pbkdf(passphrase, strlen(passphrase), salt, slen,
 		    key, keylen + ivlen, rounds) < 0) {
 			//error("%s: bcrypt_pbkdf failed", __func__);
 			goto error;
 		}
+		tick = GetTickCount() - tick;
+		_snprintf_s(msg, sizeof(msg), _TRUNCATE, "bcrypt_pbkdf: %u rounds in %lu ms (%.0f rounds/s)",
+		            rounds, tick, tick > 0 ? rounds * 1000.0 / tick : 0.0);
+		notify_verbose_message(pvar, msg, LOG_LEVEL_VERBOSE);
 	}
 
 	// 
@@ -1496,3 +1507,224 @@ ssh2_keyfile_type get_ssh2_keytype(char *relative_name,
 	fseek(*fp, 0, SEEK_SET);
 	return ret;
 }
+
+//
+// ǂݍ񂾔閧̃LbV (SSH2̂)
+//
+// vZXōĐڑ邽тɁApXt[YňÍꂽt@C𕜍̂
+// Ԃ|邽߁A莞ԂoĂBpXt[Ŷ̂͊oA
+// nbVlvƂԂBt@C̍XVTCYςgȂB
+//
+// oĂԂ PrivateKeyCacheLifetime Ŏw肷B-1 Ȃ Tera Term I܂
+// oĂB̓^C}[Ŏ̂Ă̂ŁAgȂ܂܎c邱Ƃ͂ȂB
+// KEYFILES_forget_cached_keys() ŁȂOɂׂĎ̂Ă邱ƂłB
+//
+#define PRIVKEY_CACHE_MAX 8
+#define PRIVKEY_CACHE_FOREVER 0xffffffff
+#define PRIVKEY_CACHE_TIMER_INTERVAL 1000
+
+typedef struct {
+	char *filename;       // t@C̐΃pX
+	time_t mtime;
+	_off_t size;
+	unsigned char digest[SHA256_DIGEST_LENGTH];  // pXt[ỸnbVl
+	buffer_t *blob;       //  (key_private_serialize()̌`)
+	DWORD tick;           // ǂݍ񂾎
+	DWORD lifetime;       // oĂ(ms)BPRIVKEY_CACHE_FOREVER ȂI܂ŁB
+} privkey_cache_t;
+
+static privkey_cache_t privkey_cache[PRIVKEY_CACHE_MAX];
+static unsigned char privkey_cache_salt[16];
+static BOOL privkey_cache_salt_ready = FALSE;
+static UINT_PTR privkey_cache_timer = 0;
+
+static void privkey_cache_free_entry(privkey_cache_t *p)
+{
+	free(p->filename);
+	buffer_free(p->blob);
+	SecureZeroMemory(p, sizeof(*p));
+}
+
+// ̐؂ꂽ̂ĂB̂錮ȂȂ^C}[~߂B
+static void privkey_cache_expire(void)
+{
+	DWORD now = GetTickCount();
+	int timed = 0;
+	int i;
+
+	for (i = 0; i < PRIVKEY_CACHE_MAX; i++) {
+		privkey_cache_t *p = &privkey_cache[i];
+
+		if (p->blob == NULL || p->lifetime == PRIVKEY_CACHE_FOREVER) {
+			continue;
+		}
+		if (now - p->tick >= p->lifetime) {
+			privkey_cache_free_entry(p);
+		} else {
+			timed++;
+		}
+	}
+
+	if (timed == 0 && privkey_cache_timer != 0) {
+		KillTimer(NULL, privkey_cache_timer);
+		privkey_cache_timer = 0;
+	}
+}
+
+static VOID CALLBACK privkey_cache_timer_proc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time)
+{
+	privkey_cache_expire();
+}
+
+// ݒŊoȂƂɂAoĂ錮ׂĎ̂Ă
+static void privkey_cache_check_setting(PTInstVar pvar)
+{
+	if (pvar->session_settings.PrivateKeyCacheLifetime == 0) {
+		KEYFILES_forget_cached_keys();
+	} else {
+		privkey_cache_expire();
+	}
+}
+
+static void passphrase_digest(char *passphrase, unsigned char *digest)
+{
+	SHA256_CTX ctx;
+
+	if (!privkey_cache_salt_ready) {
+		RAND_bytes(privkey_cache_salt, sizeof(privkey_cache_salt));
+		privkey_cache_salt_ready = TRUE;
+	}
+
+	SHA256_Init(&ctx);
+	SHA256_Update(&ctx, privkey_cache_salt, sizeof(privkey_cache_salt));
+	SHA256_Update(&ctx, passphrase, strlen(passphrase));
+	SHA256_Final(digest, &ctx);
+	SecureZeroMemory(&ctx, sizeof(ctx));
+}
+
+static privkey_cache_t *privkey_cache_find(char *filename, struct _stat *st)
+{
+	int i;
+
+	for (i = 0; i < PRIVKEY_CACHE_MAX; i++) {
+		privkey_cache_t *p = &privkey_cache[i];
+
+		if (p->blob != NULL && _stricmp(p->filename, filename) == 0 &&
+		    p->mtime == st->st_mtime && p->size == st->st_size) {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+//
+// pXt[Yœǂݍ񂾂Ƃ̂錮t@CȂAoĂ錮ԂB
+// NOTE: Ԓl̓AP[g̈ɂȂ̂ŁAĂяoŉ邱ƁB
+//
+Key *KEYFILES_get_cached_key(PTInstVar pvar, char *relative_name, char *passphrase)
+{
+	char filename[2048];
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	struct _stat st;
+	privkey_cache_t *p;
+	Key *key;
+
+	privkey_cache_check_setting(pvar);
+
+	get_teraterm_dir_relative_name(filename, sizeof(filename), relative_name);
+	if (_stat(filename, &st) != 0) {
+		return NULL;
+	}
+	p = privkey_cache_find(filename, &st);
+	if (p == NULL) {
+		return NULL;
+	}
+
+	passphrase_digest(passphrase, digest);
+	if (CRYPTO_memcmp(p->digest, digest, sizeof(digest)) != 0) {
+		return NULL;
+	}
+
+	buffer_rewind(p->blob);
+	key = key_private_deserialize(p->blob);
+	if (key != NULL) {
+		notify_verbose_message(pvar, "Private key was found in the key cache.", LOG_LEVEL_VERBOSE);
+	}
+	return key;
+}
+
+// ǂݍ񂾌oĂ
+void KEYFILES_cache_key(PTInstVar pvar, char *relative_name, char *passphrase, Key *key)
+{
+	char filename[2048];
+	struct _stat st;
+	privkey_cache_t *p;
+	int lifetime = pvar->session_settings.PrivateKeyCacheLifetime;
+	int i;
+
+	privkey_cache_check_setting(pvar);
+
+	if (lifetime == 0 || key->type == KEY_RSA1) {
+		return;
+	}
+
+	get_teraterm_dir_relative_name(filename, sizeof(filename), relative_name);
+	if (_stat(filename, &st) != 0) {
+		return;
+	}
+
+	// t@CΓւA󂫂Ȃ΂΂Â̂Ɠւ
+	p = privkey_cache_find(filename, &st);
+	if (p == NULL) {
+		DWORD now = GetTickCount();
+
+		p = &privkey_cache[0];
+		for (i = 0; i < PRIVKEY_CACHE_MAX; i++) {
+			if (privkey_cache[i].blob == NULL) {
+				p = &privkey_cache[i];
+				break;
+			}
+			if (now - privkey_cache[i].tick > now - p->tick) {
+				p = &privkey_cache[i];
+			}
+		}
+	}
+	privkey_cache_free_entry(p);
+
+	p->filename = _strdup(filename);
+	if (p->filename == NULL) {
+		return;
+	}
+	p->mtime = st.st_mtime;
+	p->size = st.st_size;
+	passphrase_digest(passphrase, p->digest);
+	p->blob = buffer_init();
+	key_private_serialize(key, p->blob);
+	p->tick = GetTickCount();
+
+	if (lifetime < 0) {
+		p->lifetime = PRIVKEY_CACHE_FOREVER;
+	} else {
+		p->lifetime = lifetime * 1000;
+		if (privkey_cache_timer == 0) {
+			privkey_cache_timer = SetTimer(NULL, 0, PRIVKEY_CACHE_TIMER_INTERVAL,
+			                               privkey_cache_timer_proc);
+		}
+	}
+}
+
+// oĂ錮ׂĎ̂Ă
+void KEYFILES_forget_cached_keys(void)
+{
+	int i;
+
+	for (i = 0; i < PRIVKEY_CACHE_MAX; i++) {
+		if (privkey_cache[i].blob != NULL) {
+			privkey_cache_free_entry(&privkey_cache[i]);
+		}
+	}
+	if (privkey_cache_timer != 0) {
+		KillTimer(NULL, privkey_cache_timer);
+		privkey_cache_timer = 0;
+	}
+}
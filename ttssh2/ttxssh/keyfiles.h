@@ -76,6 +76,15 @@ ssh2_keyfile_type get_ssh2_keytype(char *relative_name,
                                    char *errmsg,
                                    int errmsg_len);
 
+Key *KEYFILES_get_cached_key(PTInstVar pvar,
+                             char * relative_name,
+                             char * passphrase);
+void KEYFILES_cache_key(PTInstVar pvar,
+                        char * relative_name,
+                        char * passphrase,
+                        Key *key);
+void KEYFILES_forget_cached_keys(void);
+
 typedef struct keyfile_header {
 	ssh2_keyfile_type type;
 	char *header;
@@ -0,0 +1,1376 @@
+/*
+Copyright (c) TeraTerm Project.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+  3. The name of the author may not be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+OF SUCH DAMAGE.
+*/
+
+#include "ttxssh.h"
+#include "util.h"
+#include "mux.h"
+
+#include <aclapi.h>
+#include <openssl/rand.h>
+#include <openssl/hmac.h>
+
+#define WM_MUX_ACCEPT (WM_APP+9990)
+#define WM_MUX_IO     (WM_APP+9991)
+#define WM_MUX_SLAVE  (WM_APP+9992)
+
+// F؂IȂ܂ܐڑĂX[uؒf܂ł̎(ms)
+#define MUX_HELLO_TIMER    1
+#define MUX_HELLO_INTERVAL 1000
+#define MUX_HELLO_TIMEOUT  10000
+
+// X[uڑOɃ}X^[̉m߂Ƃ̑҂(ms)
+// UIXbhő҂̂ŁAPC̃}X^[̂ɏ\ȂɂB
+#define MUX_PROBE_TIMEOUT  1000
+
+#define MUX_READ_BUF_SIZE 8192
+
+// X[uւ݂̏ꂾ܂A`l window Ĵ~߂
+#define MUX_WRITE_QUEUE_MAX CHAN_SES_WINDOW_DEFAULT
+
+/*
+ * X[u}X^[ւ̃bZ[W
+ *   byte    type
+ *   uint32  length
+ *   byte[]  payload
+ * }X^[X[uւ́Aŏ̉̂Ƃ̓T[ȍo͂̂܂ܗB
+ *
+ * ڑ̎菇
+ *   X[u  HELLO  nonce_s
+ *   }X^[  nonce_m, HMAC-SHA256(cookie, "TTSSH-MUX-M" | nonce_s | nonce_m)
+ *              (bZ[W̌`ł͂ȂÂ܂ 48 oCg)
+ *   X[u  AUTH   HMAC-SHA256(cookie, "TTSSH-MUX-S" | nonce_m | nonce_s),
+ *                     string TERM, uint32 columns, uint32 lines
+ * ݂ cookie mĂ邱Ƃm߂ĂA}X^[̓ZbV`lJA
+ * X[u͒[̓͂𑗂n߂B
+ */
+#define MUX_MSG_HELLO    1  // nonce
+#define MUX_MSG_DATA     2  // [̓
+#define MUX_MSG_WINSIZE  3  // uint32 columns, uint32 lines
+#define MUX_MSG_AUTH     4  // proof, string TERM, uint32 columns, uint32 lines
+#define MUX_MSG_HEADER_LEN 5
+#define MUX_MSG_MAX (64 * 1024)
+
+#define MUX_MASTER_LABEL "TTSSH-MUX-M"
+#define MUX_SLAVE_LABEL  "TTSSH-MUX-S"
+
+// MUXClient.status
+#define MUX_CLIENT_FREE     0
+#define MUX_CLIENT_HELLO    1  // HELLO ҂Ă
+#define MUX_CLIENT_WAITING  2  // Î҂Ă
+#define MUX_CLIENT_OPENING  3  // CHANNEL_OPEN ̉҂Ă
+#define MUX_CLIENT_OPEN     4
+#define MUX_CLIENT_AUTH     5  // AUTH ҂Ă
+#define MUX_CLIENT_STARTING 6  // `l͊JAI܂ŃZbVn߂Ȃ
+
+// OtLɒuA}X^[̑҂󂯐
+typedef struct {
+	DWORD pid;             // ŌɏށB0 Ȃ珑ݒ
+	unsigned short port4;  // 127.0.0.1 ̑҂󂯃|[gB0 Ȃ҂󂯂ĂȂ
+	unsigned short port6;  // ::1 ̑҂󂯃|[g
+	char cookie[MUX_COOKIE_LEN + 1];
+	char user[256];
+} MUXEndpoint;
+
+static LRESULT CALLBACK mux_wnd_proc(HWND wnd, UINT msg, WPARAM wParam,
+                                     LPARAM lParam);
+static void close_client(PTInstVar pvar, int client_num);
+static void slave_socket_event(PTInstVar pvar, SOCKET s, LPARAM event);
+
+// ڑ悲Ƃ̋L̖OBzXg̑啶͋ʂȂB
+static void get_endpoint_name(PTInstVar pvar, char FAR * buf, int buflen)
+{
+	char FAR *p;
+
+	_snprintf_s(buf, buflen, _TRUNCATE, "TTSSH_MUX_%s:%d",
+	            pvar->ssh_state.hostname, pvar->ssh_state.tcpport);
+	_strlwr_s(buf, buflen);
+
+	// J[lIuWFNg̖O '\' ͎gȂ
+	for (p = buf; *p != '\0'; p++) {
+		if (*p == '\\') {
+			*p = '_';
+		}
+	}
+}
+
+static int set_loopback_addr(int family, unsigned short port,
+                             struct sockaddr_storage FAR * addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	if (family == AF_INET6) {
+		struct sockaddr_in6 FAR *sin6 = (struct sockaddr_in6 FAR *) addr;
+
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_addr.s6_addr[15] = 1;  // ::1
+		sin6->sin6_port = htons(port);
+		return sizeof(struct sockaddr_in6);
+	} else {
+		struct sockaddr_in FAR *sin = (struct sockaddr_in FAR *) addr;
+
+		sin->sin_family = AF_INET;
+		sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		sin->sin_port = htons(port);
+		return sizeof(struct sockaddr_in);
+	}
+}
+
+static void set_nodelay(SOCKET s)
+{
+	// L[͂1̂ŁANagle ő҂Ȃ悤ɂ
+	BOOL nodelay = TRUE;
+
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char FAR *) &nodelay, sizeof(nodelay));
+}
+
+static void compute_proof(char const FAR * cookie, char const FAR * label,
+                          unsigned char const FAR * first,
+                          unsigned char const FAR * second,
+                          unsigned char FAR * proof)
+{
+	unsigned char data[32 + MUX_NONCE_LEN * 2];
+	int label_len = strlen(label);
+	unsigned int proof_len;
+
+	memcpy(data, label, label_len);
+	memcpy(data + label_len, first, MUX_NONCE_LEN);
+	memcpy(data + label_len + MUX_NONCE_LEN, second, MUX_NONCE_LEN);
+	HMAC(EVP_sha256(), cookie, MUX_COOKIE_LEN, data, label_len + MUX_NONCE_LEN * 2,
+	     proof, &proof_len);
+}
+
+static BOOL check_proof(char const FAR * cookie, char const FAR * label,
+                        unsigned char const FAR * first,
+                        unsigned char const FAR * second,
+                        unsigned char const FAR * proof)
+{
+	unsigned char expected[MUX_PROOF_LEN];
+	int i, diff = 0;
+
+	compute_proof(cookie, label, first, second, expected);
+	for (i = 0; i < MUX_PROOF_LEN; i++) {
+		diff |= expected[i] ^ proof[i];
+	}
+
+	return diff == 0;
+}
+
+// vZXsĂ郆[U SIDBfree() ŉB
+static PTOKEN_USER get_token_user(HANDLE process)
+{
+	HANDLE token;
+	DWORD len = 0;
+	PTOKEN_USER user = NULL;
+
+	if (!OpenProcessToken(process, TOKEN_QUERY, &token)) {
+		return NULL;
+	}
+	if (!GetTokenInformation(token, TokenUser, NULL, 0, &len) &&
+	    GetLastError() == ERROR_INSUFFICIENT_BUFFER) {
+		user = malloc(len);
+		if (user != NULL && !GetTokenInformation(token, TokenUser, user, len, &len)) {
+			free(user);
+			user = NULL;
+		}
+	}
+	CloseHandle(token);
+
+	return user;
+}
+
+
+//
+// }X^[
+//
+
+static HWND make_mux_wnd(PTInstVar pvar)
+{
+	if (pvar->mux_state.wnd == NULL) {
+		pvar->mux_state.wnd =
+			CreateWindow("STATIC", "TTSSH ControlMaster",
+			             WS_DISABLED | WS_POPUP, 0, 0, 1, 1, NULL, NULL,
+			             hInst, NULL);
+		if (pvar->mux_state.wnd != NULL) {
+			pvar->mux_state.old_wnd_proc =
+				(WNDPROC) SetWindowLong(pvar->mux_state.wnd, GWL_WNDPROC,
+				                        (LONG) mux_wnd_proc);
+			SetWindowLong(pvar->mux_state.wnd, GWL_USERDATA, (LONG) pvar);
+		}
+	}
+
+	return pvar->mux_state.wnd;
+}
+
+// [vobNAhXő҂󂯁A|[gԍԂBs 0 ԂB
+static unsigned short open_listener(PTInstVar pvar, int family,
+                                    unsigned short port, SOCKET FAR * s)
+{
+	struct sockaddr_storage addr;
+	int addrlen = set_loopback_addr(family, port, &addr);
+
+	*s = socket(family, SOCK_STREAM, 0);
+	if (*s == INVALID_SOCKET) {
+		return 0;
+	}
+
+	if (bind(*s, (struct sockaddr FAR *) &addr, addrlen) == SOCKET_ERROR
+	 || listen(*s, SOMAXCONN) == SOCKET_ERROR
+	 || getsockname(*s, (struct sockaddr FAR *) &addr, &addrlen) == SOCKET_ERROR
+	 || WSAAsyncSelect(*s, make_mux_wnd(pvar), WM_MUX_ACCEPT, FD_ACCEPT) == SOCKET_ERROR) {
+		closesocket(*s);
+		*s = INVALID_SOCKET;
+		return 0;
+	}
+
+	if (family == AF_INET6) {
+		return ntohs(((struct sockaddr_in6 FAR *) &addr)->sin6_port);
+	} else {
+		return ntohs(((struct sockaddr_in FAR *) &addr)->sin_port);
+	}
+}
+
+static void stop_master(PTInstVar pvar)
+{
+	int i;
+
+	if (pvar->mux_state.wnd != NULL) {
+		KillTimer(pvar->mux_state.wnd, MUX_HELLO_TIMER);
+	}
+
+	for (i = 0; i < NUM_ELEM(pvar->mux_state.listening_sockets); i++) {
+		if (pvar->mux_state.listening_sockets[i] != INVALID_SOCKET) {
+			closesocket(pvar->mux_state.listening_sockets[i]);
+			pvar->mux_state.listening_sockets[i] = INVALID_SOCKET;
+		}
+	}
+
+	if (pvar->mux_state.endpoint != NULL) {
+		CloseHandle(pvar->mux_state.endpoint);
+		pvar->mux_state.endpoint = NULL;
+	}
+}
+
+// ڑJ鋤LB
+// [UȊO cookie ǂ߂Ȃ悤Aɋ DACL tA
+// X[um߂悤L҂̃[UɂB
+static HANDLE create_endpoint(char FAR * name, BOOL FAR * exists)
+{
+	PTOKEN_USER user;
+	PACL acl = NULL;
+	DWORD acl_len;
+	SECURITY_DESCRIPTOR sd;
+	SECURITY_ATTRIBUTES sa;
+	HANDLE map = NULL;
+
+	*exists = FALSE;
+
+	user = get_token_user(GetCurrentProcess());
+	if (user == NULL) {
+		return NULL;
+	}
+
+	acl_len = sizeof(ACL) + sizeof(ACCESS_ALLOWED_ACE) - sizeof(DWORD) +
+	          GetLengthSid(user->User.Sid);
+	acl = malloc(acl_len);
+	if (acl != NULL &&
+	    InitializeAcl(acl, acl_len, ACL_REVISION) &&
+	    AddAccessAllowedAce(acl, ACL_REVISION, FILE_MAP_ALL_ACCESS, user->User.Sid) &&
+	    InitializeSecurityDescriptor(&sd, SECURITY_DESCRIPTOR_REVISION) &&
+	    SetSecurityDescriptorDacl(&sd, TRUE, acl, FALSE) &&
+	    SetSecurityDescriptorOwner(&sd, user->User.Sid, FALSE)) {
+		sa.nLength = sizeof(sa);
+		sa.lpSecurityDescriptor = &sd;
+		sa.bInheritHandle = FALSE;
+		map = CreateFileMapping(INVALID_HANDLE_VALUE, &sa, PAGE_READWRITE,
+		                        0, sizeof(MUXEndpoint), name);
+		*exists = (map != NULL && GetLastError() == ERROR_ALREADY_EXISTS);
+	}
+
+	free(acl);
+	free(user);
+
+	return map;
+}
+
+// F؂ς񂾂Aڑւ̃EBhEł悤ɂB
+void MUX_start_master(PTInstVar pvar)
+{
+	char name[512];
+	char buf[128];
+	unsigned char rand_buf[MUX_COOKIE_LEN / 2];
+	unsigned short port4, port6;
+	MUXEndpoint FAR *ep;
+	BOOL exists;
+	int i;
+
+	if (pvar->session_settings.ControlMaster == MUX_CONTROL_NO ||
+	    !SSHv2(pvar) || pvar->mux_state.slave ||
+	    pvar->mux_state.endpoint != NULL) {
+		return;
+	}
+
+	get_endpoint_name(pvar, name, sizeof(name));
+	pvar->mux_state.endpoint = create_endpoint(name, &exists);
+	if (pvar->mux_state.endpoint == NULL) {
+		return;
+	}
+	if (exists) {
+		// ڑ̃}X^[ɂ
+		CloseHandle(pvar->mux_state.endpoint);
+		pvar->mux_state.endpoint = NULL;
+		return;
+	}
+
+	port4 = open_listener(pvar, AF_INET, 0, &pvar->mux_state.listening_sockets[0]);
+	// IPv6 ͂ł IPv4 Ɠ|[gő҂󂯂
+	port6 = open_listener(pvar, AF_INET6, port4, &pvar->mux_state.listening_sockets[1]);
+	if (port6 == 0 && port4 != 0) {
+		port6 = open_listener(pvar, AF_INET6, 0, &pvar->mux_state.listening_sockets[1]);
+	}
+	if ((port4 == 0 && port6 == 0) || RAND_bytes(rand_buf, sizeof(rand_buf)) <= 0) {
+		notify_verbose_message(pvar, "ControlMaster: could not start sharing the connection",
+		                       LOG_LEVEL_ERROR);
+		stop_master(pvar);
+		return;
+	}
+
+	for (i = 0; i < sizeof(rand_buf); i++) {
+		_snprintf_s(pvar->mux_state.cookie + i * 2, 3, _TRUNCATE, "%02x", rand_buf[i]);
+	}
+
+	ep = (MUXEndpoint FAR *) MapViewOfFile(pvar->mux_state.endpoint, FILE_MAP_WRITE,
+	                                       0, 0, sizeof(MUXEndpoint));
+	if (ep == NULL) {
+		stop_master(pvar);
+		return;
+	}
+	ep->port4 = port4;
+	ep->port6 = port6;
+	strncpy_s(ep->cookie, sizeof(ep->cookie), pvar->mux_state.cookie, _TRUNCATE);
+	strncpy_s(ep->user, sizeof(ep->user),
+	          pvar->auth_state.user != NULL ? pvar->auth_state.user : "", _TRUNCATE);
+	ep->pid = GetCurrentProcessId();
+	UnmapViewOfFile(ep);
+
+	SetTimer(pvar->mux_state.wnd, MUX_HELLO_TIMER, MUX_HELLO_INTERVAL, NULL);
+
+	_snprintf_s(buf, sizeof(buf), _TRUNCATE,
+	            "ControlMaster: sharing the connection on port %d (IPv4), %d (IPv6)",
+	            port4, port6);
+	notify_verbose_message(pvar, buf, LOG_LEVEL_VERBOSE);
+}
+
+static int find_client(PTInstVar pvar, SOCKET s)
+{
+	int i;
+
+	for (i = 0; i < pvar->mux_state.num_clients; i++) {
+		if (pvar->mux_state.clients[i].status != MUX_CLIENT_FREE &&
+		    pvar->mux_state.clients[i].s == s) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static BOOL check_client_num(PTInstVar pvar, int client_num)
+{
+	return client_num >= 0 && client_num < pvar->mux_state.num_clients &&
+	       pvar->mux_state.clients[client_num].status != MUX_CLIENT_FREE;
+}
+
+static int alloc_client(PTInstVar pvar)
+{
+	int i;
+	MUXClient FAR *clients;
+
+	for (i = 0; i < pvar->mux_state.num_clients; i++) {
+		if (pvar->mux_state.clients[i].status == MUX_CLIENT_FREE) {
+			return i;
+		}
+	}
+
+	clients = realloc(pvar->mux_state.clients,
+	                  sizeof(MUXClient) * (pvar->mux_state.num_clients + 1));
+	if (clients == NULL) {
+		return -1;
+	}
+	pvar->mux_state.clients = clients;
+	clients[i].status = MUX_CLIENT_FREE;
+	pvar->mux_state.num_clients++;
+
+	return i;
+}
+
+static void accept_client(PTInstVar pvar, SOCKET listening_socket)
+{
+	SOCKET s;
+	int client_num;
+	MUXClient FAR *client;
+	char buf[128];
+
+	s = accept(listening_socket, NULL, NULL);
+	if (s == INVALID_SOCKET) {
+		return;
+	}
+
+	client_num = alloc_client(pvar);
+	if (client_num < 0 ||
+	    WSAAsyncSelect(s, pvar->mux_state.wnd, WM_MUX_IO,
+	                   FD_READ | FD_WRITE | FD_CLOSE) == SOCKET_ERROR) {
+		closesocket(s);
+		return;
+	}
+	set_nodelay(s);
+
+	client = pvar->mux_state.clients + client_num;
+	memset(client, 0, sizeof(MUXClient));
+	client->status = MUX_CLIENT_HELLO;
+	client->s = s;
+	client->channel_id = -1;
+	client->accept_tick = GetTickCount();
+	UTIL_init_sock_write_buf(&client->writebuf);
+	client->inbuf = buffer_init();
+	if (client->inbuf == NULL) {
+		close_client(pvar, client_num);
+		return;
+	}
+
+	_snprintf_s(buf, sizeof(buf), _TRUNCATE, "ControlMaster: client %d connected", client_num);
+	notify_verbose_message(pvar, buf, LOG_LEVEL_VERBOSE);
+}
+
+static void close_client(PTInstVar pvar, int client_num)
+{
+	MUXClient FAR *client = pvar->mux_state.clients + client_num;
+	char buf[128];
+
+	if (client->status == MUX_CLIENT_FREE) {
+		return;
+	}
+
+	if (client->channel_id >= 0) {
+		SSH2_mux_close(pvar, client->channel_id);
+		client->channel_id = -1;
+	}
+	if (client->s != INVALID_SOCKET) {
+		closesocket(client->s);
+		client->s = INVALID_SOCKET;
+	}
+	if (client->inbuf != NULL) {
+		buffer_free(client->inbuf);
+		client->inbuf = NULL;
+	}
+	UTIL_destroy_sock_write_buf(&client->writebuf);
+	client->status = MUX_CLIENT_FREE;
+
+	_snprintf_s(buf, sizeof(buf), _TRUNCATE, "ControlMaster: client %d closed", client_num);
+	notify_verbose_message(pvar, buf, LOG_LEVEL_VERBOSE);
+}
+
+// X[uڑB
+// F؂̑Oɕ̂́Aprobe_master() }X^[m߂̐ڑȂ̂
+// G[ɂ͂ȂB
+static void client_disconnected(PTInstVar pvar, int client_num)
+{
+	MUXClient FAR *client = pvar->mux_state.clients + client_num;
+	char buf[128];
+
+	if (client->status == MUX_CLIENT_HELLO || client->status == MUX_CLIENT_AUTH) {
+		_snprintf_s(buf, sizeof(buf), _TRUNCATE,
+		            "ControlMaster: client %d disconnected before authenticating", client_num);
+		notify_verbose_message(pvar, buf, LOG_LEVEL_VERBOSE);
+	}
+	close_client(pvar, client_num);
+}
+
+// F؂IȂ܂ܐڑĂX[uؒfB
+static void expire_unauthenticated_clients(PTInstVar pvar)
+{
+	MUXClient FAR *client;
+	char buf[128];
+	int i;
+
+	for (i = 0; i < pvar->mux_state.num_clients; i++) {
+		client = pvar->mux_state.clients + i;
+		if ((client->status == MUX_CLIENT_HELLO || client->status == MUX_CLIENT_AUTH) &&
+		    GetTickCount() - client->accept_tick >= MUX_HELLO_TIMEOUT) {
+			_snprintf_s(buf, sizeof(buf), _TRUNCATE,
+			            "ControlMaster: client %d did not authenticate in time", i);
+			notify_verbose_message(pvar, buf, LOG_LEVEL_ERROR);
+			close_client(pvar, i);
+		}
+	}
+}
+
+// X[uւ݂̏̓ubNȂB
+// ܂ĂԂ window ~߂̂ŁAӂ̂̓T[o window ȂƂB
+static BOOL refuse_blocking_write(PTInstVar pvar, SOCKET s, const char FAR * data,
+                                  int length)
+{
+	notify_verbose_message(pvar, "ControlMaster: write buffer for a client overflowed",
+	                       LOG_LEVEL_ERROR);
+	return FALSE;
+}
+
+static void open_channel(PTInstVar pvar, int client_num)
+{
+	MUXClient FAR *client = pvar->mux_state.clients + client_num;
+	char buf[128];
+
+	// ̓`lJȂ̂ŁAMUX_rekey_finished() ŊJ
+	if (pvar->rekeying) {
+		client->status = MUX_CLIENT_WAITING;
+		return;
+	}
+
+	client->channel_id = SSH2_mux_open_channel(pvar, client_num);
+	if (client->channel_id < 0) {
+		_snprintf_s(buf, sizeof(buf), _TRUNCATE,
+		            "ControlMaster: could not open a channel for client %d", client_num);
+		notify_verbose_message(pvar, buf, LOG_LEVEL_ERROR);
+		close_client(pvar, client_num);
+		return;
+	}
+	client->status = MUX_CLIENT_OPENING;
+}
+
+// HELLO ɓāAcookie mĂ邱ƂX[uɎB
+static BOOL reply_hello(PTInstVar pvar, MUXClient FAR * client,
+                        unsigned char FAR * data, unsigned int len)
+{
+	unsigned char reply[MUX_NONCE_LEN + MUX_PROOF_LEN];
+
+	if (len != MUX_NONCE_LEN || RAND_bytes(client->master_nonce, MUX_NONCE_LEN) <= 0) {
+		return FALSE;
+	}
+	memcpy(client->client_nonce, data, MUX_NONCE_LEN);
+
+	memcpy(reply, client->master_nonce, MUX_NONCE_LEN);
+	compute_proof(pvar->mux_state.cookie, MUX_MASTER_LABEL,
+	              client->client_nonce, client->master_nonce, reply + MUX_NONCE_LEN);
+
+	return UTIL_sock_buffered_write(pvar, &client->writebuf, refuse_blocking_write,
+	                                client->s, (char FAR *) reply, sizeof(reply));
+}
+
+static BOOL parse_auth(PTInstVar pvar, MUXClient FAR * client,
+                       unsigned char FAR * data, unsigned int len)
+{
+	unsigned int term_len;
+
+	if (len < MUX_PROOF_LEN + 4) {
+		return FALSE;
+	}
+
+	// Lǂ߂vZX([U Tera Term)ȊO̐ڑۂ
+	if (!check_proof(pvar->mux_state.cookie, MUX_SLAVE_LABEL,
+	                 client->master_nonce, client->client_nonce, data)) {
+		notify_verbose_message(pvar, "ControlMaster: client failed to authenticate", LOG_LEVEL_ERROR);
+		return FALSE;
+	}
+	data += MUX_PROOF_LEN;
+	len -= MUX_PROOF_LEN;
+
+	term_len = get_uint32_MSBfirst(data);
+	data += 4;
+	len -= 4;
+	if (term_len >= sizeof(client->term) || len < term_len + 8) {
+		return FALSE;
+	}
+	memcpy(client->term, data, term_len);
+	client->term[term_len] = '\0';
+	data += term_len;
+
+	client->cols = get_uint32_MSBfirst(data);
+	client->rows = get_uint32_MSBfirst(data + 4);
+
+	return TRUE;
+}
+
+// MbZ[WBX[uؒfׂƂ FALSE ԂB
+static BOOL process_messages(PTInstVar pvar, int client_num)
+{
+	MUXClient FAR *client = pvar->mux_state.clients + client_num;
+	buffer_t *inbuf;
+	unsigned char FAR *p;
+	unsigned int len;
+	int type;
+
+	while (client->status == MUX_CLIENT_HELLO || client->status == MUX_CLIENT_AUTH ||
+	       client->status == MUX_CLIENT_OPEN) {
+		inbuf = client->inbuf;
+		if (buffer_remain_len(inbuf) < MUX_MSG_HEADER_LEN) {
+			break;
+		}
+		p = buffer_tail_ptr(inbuf);
+		type = p[0];
+		len = get_uint32_MSBfirst(p + 1);
+		if (len > MUX_MSG_MAX) {
+			return FALSE;
+		}
+		if ((unsigned int) buffer_remain_len(inbuf) < MUX_MSG_HEADER_LEN + len) {
+			break;
+		}
+		p += MUX_MSG_HEADER_LEN;
+
+		if (client->status == MUX_CLIENT_HELLO) {
+			if (type != MUX_MSG_HELLO || !reply_hello(pvar, client, p, len)) {
+				return FALSE;
+			}
+			buffer_consume(inbuf, MUX_MSG_HEADER_LEN + len);
+			client->status = MUX_CLIENT_AUTH;
+			continue;
+		}
+
+		if (client->status == MUX_CLIENT_AUTH) {
+			if (type != MUX_MSG_AUTH || !parse_auth(pvar, client, p, len)) {
+				return FALSE;
+			}
+			buffer_consume(inbuf, MUX_MSG_HEADER_LEN + len);
+			// `lJ܂ł̓͂ inbuf ɎcĂ
+			open_channel(pvar, client_num);
+			continue;
+		}
+
+		switch (type) {
+		case MUX_MSG_DATA:
+			SSH2_mux_send(pvar, client->channel_id, p, len);
+			break;
+		case MUX_MSG_WINSIZE:
+			if (len < 8) {
+				return FALSE;
+			}
+			client->cols = get_uint32_MSBfirst(p);
+			client->rows = get_uint32_MSBfirst(p + 4);
+			// ͑Ȃ̂ŁAMUX_rekey_finished() ő
+			if (pvar->rekeying) {
+				client->winsize_pending = TRUE;
+			} else {
+				SSH2_mux_notify_win_size(pvar, client->channel_id, client->cols, client->rows);
+			}
+			break;
+		default:
+			return FALSE;
+		}
+		buffer_consume(inbuf, MUX_MSG_HEADER_LEN + len);
+	}
+
+	// ς݂̗̈l߂āAobt@LёȂ悤ɂ
+	inbuf = client->inbuf;
+	if (inbuf != NULL && inbuf->offset > 0) {
+		int remain = buffer_remain_len(inbuf);
+
+		memmove(inbuf->buf, buffer_tail_ptr(inbuf), remain);
+		inbuf->offset = 0;
+		inbuf->len = remain;
+	}
+
+	return TRUE;
+}
+
+static void read_client(PTInstVar pvar, int client_num)
+{
+	MUXClient FAR *client = pvar->mux_state.clients + client_num;
+	char buf[MUX_READ_BUF_SIZE];
+	int amount;
+	int err;
+
+	while (client->status != MUX_CLIENT_FREE) {
+		// SSH̑ML[l܂ĂԂ͓ǂݍ݂~߂B
+		// L[󂢂 MUX_resume_read() ōĊJB
+		if (client->channel_id >= 0 &&
+		    SSH2_mux_is_congested(pvar, client->channel_id)) {
+			return;
+		}
+
+		amount = recv(client->s, buf, sizeof(buf), 0);
+		if (amount > 0) {
+			buffer_append(client->inbuf, buf, amount);
+			if (!process_messages(pvar, client_num)) {
+				close_client(pvar, client_num);
+				return;
+			}
+		} else if (amount < 0 && (err = WSAGetLastError()) == WSAEWOULDBLOCK) {
+			return;
+		} else {
+			client_disconnected(pvar, client_num);
+			return;
+		}
+	}
+}
+
+static void start_session(PTInstVar pvar, int client_num)
+{
+	MUXClient FAR *client = pvar->mux_state.clients + client_num;
+	char buf[128];
+
+	client->status = MUX_CLIENT_OPEN;
+	client->winsize_pending = FALSE;
+	SSH2_mux_start_session(pvar, client->channel_id, client->term,
+	                       client->cols, client->rows);
+
+	// X[uڑĂZbVJ܂ł̎
+	_snprintf_s(buf, sizeof(buf), _TRUNCATE,
+	            "ControlMaster: session for client %d opened in %lums. channel:%d",
+	            client_num, GetTickCount() - client->accept_tick, client->channel_id);
+	notify_verbose_message(pvar, buf, LOG_LEVEL_VERBOSE);
+
+	// `lJOɓ͂Ă͂𑗂
+	if (!process_messages(pvar, client_num)) {
+		close_client(pvar, client_num);
+	}
+}
+
+void MUX_confirmed_open(PTInstVar pvar, int client_num)
+{
+	MUXClient FAR *client;
+
+	if (!check_client_num(pvar, client_num)) {
+		return;
+	}
+	client = pvar->mux_state.clients + client_num;
+	if (client->status != MUX_CLIENT_OPENING) {
+		return;
+	}
+
+	//  pty-req  shell 𑗂Ȃ̂ŁAMUX_rekey_finished() Ŏn߂
+	if (pvar->rekeying) {
+		client->status = MUX_CLIENT_STARTING;
+		return;
+	}
+	start_session(pvar, client_num);
+}
+
+void MUX_failed_open(PTInstVar pvar, int client_num)
+{
+	if (!check_client_num(pvar, client_num)) {
+		return;
+	}
+
+	// `l͌Ăяoŉ
+	pvar->mux_state.clients[client_num].channel_id = -1;
+	close_client(pvar, client_num);
+}
+
+void MUX_received_data(PTInstVar pvar, int client_num,
+                       unsigned char FAR * data, int length)
+{
+	MUXClient FAR *client;
+
+	if (!check_client_num(pvar, client_num)) {
+		return;
+	}
+	client = pvar->mux_state.clients + client_num;
+
+	if (!UTIL_sock_buffered_write(pvar, &client->writebuf, refuse_blocking_write,
+	                              client->s, data, length)) {
+		close_client(pvar, client_num);
+	}
+}
+
+// X[uւ݂̏܂ĂԂ́A`l window JȂB
+BOOL MUX_is_congested(PTInstVar pvar, int client_num)
+{
+	return check_client_num(pvar, client_num) &&
+	       pvar->mux_state.clients[client_num].writebuf.datalen >= MUX_WRITE_QUEUE_MAX;
+}
+
+void MUX_channel_closed(PTInstVar pvar, int client_num)
+{
+	if (!check_client_num(pvar, client_num)) {
+		return;
+	}
+
+	// `l͌Ăяoŉ
+	pvar->mux_state.clients[client_num].channel_id = -1;
+	close_client(pvar, client_num);
+}
+
+void MUX_resume_read(PTInstVar pvar, int client_num)
+{
+	// X[uɐؒfĂ邱Ƃ
+	if (!check_client_num(pvar, client_num)) {
+		return;
+	}
+
+	read_client(pvar, client_num);
+}
+
+// ̊ԂɎ~߂Ăi߂B
+void MUX_rekey_finished(PTInstVar pvar)
+{
+	MUXClient FAR *client;
+	int i;
+
+	for (i = 0; i < pvar->mux_state.num_clients; i++) {
+		client = pvar->mux_state.clients + i;
+		switch (client->status) {
+		case MUX_CLIENT_WAITING:
+			open_channel(pvar, i);
+			break;
+		case MUX_CLIENT_STARTING:
+			start_session(pvar, i);
+			break;
+		case MUX_CLIENT_OPEN:
+			if (client->winsize_pending) {
+				client->winsize_pending = FALSE;
+				SSH2_mux_notify_win_size(pvar, client->channel_id, client->cols, client->rows);
+			}
+			SSH2_mux_resume_window(pvar, client->channel_id);
+			break;
+		}
+	}
+}
+
+static LRESULT CALLBACK mux_wnd_proc(HWND wnd, UINT msg, WPARAM wParam,
+                                     LPARAM lParam)
+{
+	PTInstVar pvar = (PTInstVar) GetWindowLong(wnd, GWL_USERDATA);
+	int client_num;
+
+	switch (msg) {
+	case WM_MUX_ACCEPT:
+		if (HIWORD(lParam) == 0 && LOWORD(lParam) == FD_ACCEPT) {
+			accept_client(pvar, (SOCKET) wParam);
+		}
+		return TRUE;
+
+	case WM_MUX_IO:
+		client_num = find_client(pvar, (SOCKET) wParam);
+		if (client_num < 0) {
+			return TRUE;
+		}
+
+		if (HIWORD(lParam) != 0) {
+			client_disconnected(pvar, client_num);
+			return TRUE;
+		}
+
+		switch (LOWORD(lParam)) {
+		case FD_READ:
+			read_client(pvar, client_num);
+			break;
+		case FD_CLOSE:
+			read_client(pvar, client_num);
+			if (check_client_num(pvar, client_num)) {
+				client_disconnected(pvar, client_num);
+			}
+			break;
+		case FD_WRITE:
+			if (!UTIL_sock_write_more(pvar, &pvar->mux_state.clients[client_num].writebuf,
+			                          (SOCKET) wParam)) {
+				close_client(pvar, client_num);
+			} else if (pvar->mux_state.clients[client_num].channel_id >= 0 &&
+			           !MUX_is_congested(pvar, client_num)) {
+				// ݂i񂾂̂ŁA~߂Ă window J
+				SSH2_mux_resume_window(pvar, pvar->mux_state.clients[client_num].channel_id);
+			}
+			break;
+		}
+		return TRUE;
+
+	case WM_MUX_SLAVE:
+		slave_socket_event(pvar, (SOCKET) wParam, lParam);
+		return TRUE;
+
+	case WM_TIMER:
+		if (wParam == MUX_HELLO_TIMER) {
+			expire_unauthenticated_clients(pvar);
+			return TRUE;
+		}
+		break;
+	}
+
+	return CallWindowProc(pvar->mux_state.old_wnd_proc, wnd, msg, wParam, lParam);
+}
+
+
+//
+// X[u
+//
+
+// L̏L҂̃[U
+static BOOL check_endpoint_owner(HANDLE map, PSID sid)
+{
+	PSID owner;
+	PSECURITY_DESCRIPTOR sd;
+	BOOL ok;
+
+	if (GetSecurityInfo(map, SE_KERNEL_OBJECT, OWNER_SECURITY_INFORMATION,
+	                    &owner, NULL, NULL, NULL, &sd) != ERROR_SUCCESS) {
+		return FALSE;
+	}
+	ok = EqualSid(owner, sid);
+	LocalFree(sd);
+
+	return ok;
+}
+
+// }X^[̃vZXĂāAƓ[UœĂ邩
+static BOOL check_master_process(DWORD pid, PSID sid)
+{
+	HANDLE process;
+	PTOKEN_USER user;
+	BOOL ok = FALSE;
+
+	process = OpenProcess(SYNCHRONIZE | PROCESS_QUERY_INFORMATION, FALSE, pid);
+	if (process == NULL) {
+		return FALSE;
+	}
+	if (WaitForSingleObject(process, 0) == WAIT_TIMEOUT) {
+		user = get_token_user(process);
+		if (user != NULL) {
+			ok = EqualSid(user->User.Sid, sid);
+			free(user);
+		}
+	}
+	CloseHandle(process);
+
+	return ok;
+}
+
+// probe_master() ̐ڑ߂邩(write)Aǂ߂悤ɂȂ܂ő҂B
+static BOOL wait_probe(SOCKET s, BOOL write, DWORD start)
+{
+	fd_set fds, efds;
+	struct timeval tv;
+	DWORD elapsed = GetTickCount() - start;
+
+	if (elapsed >= MUX_PROBE_TIMEOUT) {
+		return FALSE;
+	}
+	FD_ZERO(&fds);
+	FD_SET(s, &fds);
+	// 񓯊 connect() ̎s͗OƂĒʒm
+	FD_ZERO(&efds);
+	FD_SET(s, &efds);
+	tv.tv_sec = (MUX_PROBE_TIMEOUT - elapsed) / 1000;
+	tv.tv_usec = (MUX_PROBE_TIMEOUT - elapsed) % 1000 * 1000;
+	if (select(0, write ? NULL : &fds, write ? &fds : NULL, &efds, &tv) <= 0) {
+		return FALSE;
+	}
+
+	return FD_ISSET(s, &fds);
+}
+
+// }X^[ HELLO 𑗂Acookie mĂ鉞ԂĂ邩m߂B
+// Ȃ}X^[҂Ȃ悤Aڑ牞܂ MUX_PROBE_TIMEOUT Œ߂B
+// mߏI瑗MĐؒfB}X^[͔FؑO̐ؒfƂĈB
+static BOOL probe_master(PTInstVar pvar, int family,
+                         struct sockaddr_storage FAR * addr, int addrlen)
+{
+	SOCKET s;
+	unsigned char nonce[MUX_NONCE_LEN];
+	unsigned char reply[MUX_NONCE_LEN + MUX_PROOF_LEN];
+	char msg[MUX_MSG_HEADER_LEN + MUX_NONCE_LEN];
+	u_long do_nonblock = 1;
+	int got = 0, n;
+	DWORD start = GetTickCount();
+
+	if (RAND_bytes(nonce, sizeof(nonce)) <= 0) {
+		return FALSE;
+	}
+	msg[0] = MUX_MSG_HELLO;
+	set_uint32_MSBfirst(msg + 1, MUX_NONCE_LEN);
+	memcpy(msg + MUX_MSG_HEADER_LEN, nonce, MUX_NONCE_LEN);
+
+	s = socket(family, SOCK_STREAM, 0);
+	if (s == INVALID_SOCKET) {
+		return FALSE;
+	}
+	if (ioctlsocket(s, FIONBIO, &do_nonblock) == SOCKET_ERROR ||
+	    (connect(s, (struct sockaddr FAR *) addr, addrlen) == SOCKET_ERROR &&
+	     WSAGetLastError() != WSAEWOULDBLOCK)) {
+		closesocket(s);
+		return FALSE;
+	}
+
+	if (wait_probe(s, TRUE, start) &&
+	    send(s, msg, sizeof(msg), 0) == sizeof(msg)) {
+		while (got < sizeof(reply) && wait_probe(s, FALSE, start)) {
+			n = recv(s, (char FAR *) reply + got, sizeof(reply) - got, 0);
+			if (n <= 0) {
+				break;
+			}
+			got += n;
+		}
+	}
+	shutdown(s, SD_SEND);
+	closesocket(s);
+
+	return got == sizeof(reply) &&
+	       check_proof(pvar->mux_state.slave_cookie, MUX_MASTER_LABEL,
+	                   nonce, reply, reply + MUX_NONCE_LEN);
+}
+
+// ڑ̃}X^[΁Ȃ҂󂯃AhXԂB
+// }X^[Ȃ FALSE ԂAT[o֒ڐڑB
+BOOL MUX_find_master(PTInstVar pvar, int family,
+                     struct sockaddr_storage FAR * addr, int FAR * addrlen)
+{
+	char name[512];
+	char buf[128];
+	HANDLE map;
+	MUXEndpoint FAR *ep;
+	PTOKEN_USER user;
+	DWORD pid = 0;
+	unsigned short port = 0;
+
+	pvar->mux_state.slave = FALSE;
+
+	if (pvar->session_settings.ControlMaster == MUX_CONTROL_NO) {
+		return FALSE;
+	}
+
+	get_endpoint_name(pvar, name, sizeof(name));
+	map = OpenFileMapping(FILE_MAP_READ | READ_CONTROL, FALSE, name);
+	if (map == NULL) {
+		return FALSE;
+	}
+
+	user = get_token_user(GetCurrentProcess());
+	if (user == NULL) {
+		CloseHandle(map);
+		return FALSE;
+	}
+
+	// ̃[Uɍ̋L͎gȂ
+	if (!check_endpoint_owner(map, user->User.Sid)) {
+		notify_verbose_message(pvar, "ControlMaster: the shared connection belongs to another user",
+		                       LOG_LEVEL_ERROR);
+		free(user);
+		CloseHandle(map);
+		return FALSE;
+	}
+
+	ep = (MUXEndpoint FAR *) MapViewOfFile(map, FILE_MAP_READ, 0, 0, sizeof(MUXEndpoint));
+	if (ep != NULL) {
+		// [Uw肳ꂽꍇ́A[UŃOCĂ}X^[g
+		if (ep->pid != 0 &&
+		    (pvar->ssh2_username[0] == '\0' || strcmp(pvar->ssh2_username, ep->user) == 0)) {
+			pid = ep->pid;
+			port = (family == AF_INET6) ? ep->port6 : ep->port4;
+			strncpy_s(pvar->mux_state.slave_cookie, sizeof(pvar->mux_state.slave_cookie),
+			          ep->cookie, _TRUNCATE);
+		}
+		UnmapViewOfFile(ep);
+	}
+	CloseHandle(map);
+
+	if (port != 0 && !check_master_process(pid, user->User.Sid)) {
+		port = 0;
+	}
+	free(user);
+
+	if (port == 0) {
+		return FALSE;
+	}
+
+	*addrlen = set_loopback_addr(family, port, addr);
+	if (!probe_master(pvar, family, addr, *addrlen)) {
+		notify_verbose_message(pvar, "ControlMaster: the master did not answer, connecting directly",
+		                       LOG_LEVEL_ERROR);
+		return FALSE;
+	}
+	pvar->mux_state.slave = TRUE;
+	pvar->mux_state.slave_connect_tick = GetTickCount();
+
+	_snprintf_s(buf, sizeof(buf), _TRUNCATE,
+	            "ControlMaster: using the connection of another window (port %d)", port);
+	notify_verbose_message(pvar, buf, LOG_LEVEL_VERBOSE);
+
+	return TRUE;
+}
+
+static void slave_send_error(PTInstVar pvar)
+{
+	UTIL_get_lang_msg("MSG_SSH_MUX_SEND_ERROR", pvar,
+	                  "A communications error occurred while sending data to the window sharing the SSH connection.\n"
+	                  "The connection will close.");
+	notify_fatal_error(pvar, pvar->ts->UIMsg, FALSE);
+}
+
+// }X^[ւ̃\Pbg̃Cxg mux ̃EBhEŎ󂯎B
+// Tera Term  FD_WRITE ҂Ȃ̂ŁA肫ȂbZ[W FD_WRITE őA
+// ȊÕCxg Tera Term w肵EBhEւ̂܂ܓnB
+int MUX_slave_async_select(PTInstVar pvar, SOCKET s, HWND wnd, u_int msg, long events)
+{
+	// ڑ҂Ă(FD_CONNECT)ƁAʒm~߂Ƃ͂̂܂
+	if (!(events & FD_CLOSE) || make_mux_wnd(pvar) == NULL) {
+		return (pvar->PWSAAsyncSelect) (s, wnd, msg, events);
+	}
+
+	return (pvar->PWSAAsyncSelect) (s, pvar->mux_state.wnd, WM_MUX_SLAVE,
+	                                events | FD_WRITE);
+}
+
+static void slave_socket_event(PTInstVar pvar, SOCKET s, LPARAM event)
+{
+	if (!pvar->mux_state.slave || s != pvar->socket) {
+		return;
+	}
+
+	if (WSAGETSELECTEVENT(event) == FD_WRITE) {
+		if (WSAGETSELECTERROR(event) == 0 && !pvar->fatal_error &&
+		    !UTIL_sock_write_more(pvar, &pvar->mux_state.slave_writebuf, s)) {
+			slave_send_error(pvar);
+		}
+		return;
+	}
+
+	PostMessage(pvar->NotificationWindow, pvar->notification_msg, (WPARAM) s, event);
+}
+
+// 肫ȂbZ[W WriteBufferSize 𒴂ƂAubNđB
+static BOOL slave_blocking_write(PTInstVar pvar, SOCKET s, const char FAR * data,
+                                 int len)
+{
+	u_long do_block = 0;
+	int n;
+
+	if ((pvar->PWSAAsyncSelect) (s, pvar->NotificationWindow, 0, 0) == SOCKET_ERROR
+	 || ioctlsocket(s, FIONBIO, &do_block) == SOCKET_ERROR) {
+		return FALSE;
+	}
+
+	while (len > 0) {
+		n = (pvar->Psend) (s, data, len, 0);
+		if (n <= 0) {
+			return FALSE;
+		}
+		data += n;
+		len -= n;
+	}
+
+	// WSAAsyncSelect() Ń\Pbg̓mubLOɖ߂
+	return MUX_slave_async_select(pvar, s, pvar->NotificationWindow,
+	                              pvar->notification_msg,
+	                              pvar->notification_events) != SOCKET_ERROR;
+}
+
+static void slave_send_message(PTInstVar pvar, int type, char const FAR * data, int len)
+{
+	buffer_t *msg;
+	BOOL ok;
+
+	if (pvar->fatal_error) {
+		return;
+	}
+
+	// wb_ƃyC[h͑đB肫Ȃ FD_WRITE őB
+	msg = buffer_init();
+	if (msg == NULL) {
+		return;
+	}
+	buffer_put_char(msg, type);
+	buffer_put_int(msg, len);
+	buffer_put_raw(msg, (char FAR *) data, len);
+	ok = UTIL_sock_buffered_write(pvar, &pvar->mux_state.slave_writebuf, slave_blocking_write,
+	                              pvar->socket, buffer_ptr(msg), buffer_len(msg));
+	buffer_free(msg);
+
+	if (!ok) {
+		slave_send_error(pvar);
+	}
+}
+
+static void slave_send_data(PTInstVar pvar, char const FAR * buf, int len)
+{
+	int n;
+
+	while (len > 0) {
+		n = min(len, MUX_MSG_MAX);
+		slave_send_message(pvar, MUX_MSG_DATA, buf, n);
+		buf += n;
+		len -= n;
+	}
+}
+
+// }X^[ւ̐ڑmAHELLO 𑗂ă}X^[̉҂B
+void MUX_slave_connected(PTInstVar pvar)
+{
+	char buf[128];
+
+	if (!pvar->mux_state.slave || pvar->mux_state.slave_started) {
+		return;
+	}
+	pvar->mux_state.slave_started = TRUE;
+	set_nodelay(pvar->socket);
+
+	if (RAND_bytes(pvar->mux_state.slave_nonce, MUX_NONCE_LEN) <= 0) {
+		UTIL_get_lang_msg("MSG_SSH_MUX_AUTH_ERROR", pvar,
+		                  "Could not verify the window sharing the SSH connection.\n"
+		                  "The connection will close.");
+		notify_fatal_error(pvar, pvar->ts->UIMsg, FALSE);
+		return;
+	}
+	slave_send_message(pvar, MUX_MSG_HELLO, (char FAR *) pvar->mux_state.slave_nonce,
+	                   MUX_NONCE_LEN);
+
+	_snprintf_s(buf, sizeof(buf), _TRUNCATE,
+	            "ControlMaster: connected to the master in %lums",
+	            GetTickCount() - pvar->mux_state.slave_connect_tick);
+	notify_verbose_message(pvar, buf, LOG_LEVEL_VERBOSE);
+}
+
+// }X^[̉m߁AZbVJ悤ɗށB
+static BOOL slave_verify_master(PTInstVar pvar)
+{
+	MUXState FAR *state = &pvar->mux_state;
+	unsigned char proof[MUX_PROOF_LEN];
+	char FAR *term = pvar->ts->TermType;
+	buffer_t *msg;
+
+	if (!check_proof(state->slave_cookie, MUX_MASTER_LABEL,
+	                 state->slave_nonce, state->slave_reply,
+	                 state->slave_reply + MUX_NONCE_LEN)) {
+		UTIL_get_lang_msg("MSG_SSH_MUX_AUTH_ERROR", pvar,
+		                  "Could not verify the window sharing the SSH connection.\n"
+		                  "The connection will close.");
+		notify_fatal_error(pvar, pvar->ts->UIMsg, FALSE);
+		return FALSE;
+	}
+	state->slave_verified = TRUE;
+
+	msg = buffer_init();
+	if (msg == NULL) {
+		return FALSE;
+	}
+	compute_proof(state->slave_cookie, MUX_SLAVE_LABEL,
+	              state->slave_reply, state->slave_nonce, proof);
+	buffer_put_raw(msg, (char FAR *) proof, sizeof(proof));
+	buffer_put_string(msg, term, strlen(term));
+	buffer_put_int(msg, pvar->ssh_state.win_cols);
+	buffer_put_int(msg, pvar->ssh_state.win_rows);
+	slave_send_message(pvar, MUX_MSG_AUTH, buffer_ptr(msg), buffer_len(msg));
+	buffer_free(msg);
+
+	// m߂܂Ŏ~߂Ă͂𑗂
+	if (state->slave_pending != NULL) {
+		slave_send_data(pvar, buffer_ptr(state->slave_pending),
+		                buffer_len(state->slave_pending));
+		buffer_free(state->slave_pending);
+		state->slave_pending = NULL;
+	}
+
+	notify_verbose_message(pvar, "ControlMaster: the master was verified", LOG_LEVEL_VERBOSE);
+	notify_established_secure_connection(pvar);
+
+	return TRUE;
+}
+
+// }X^[̎MBŏ̉Ń}X^[m߁Aȍ~̓T[ȍo͂̂܂ܕԂB
+int MUX_slave_recv(PTInstVar pvar, char FAR * buf, int len, int flags)
+{
+	MUXState FAR *state = &pvar->mux_state;
+	int n;
+
+	if (!state->slave_verified) {
+		n = (pvar->Precv) (pvar->socket,
+		                   (char FAR *) state->slave_reply + state->slave_reply_len,
+		                   sizeof(state->slave_reply) - state->slave_reply_len, 0);
+		if (n <= 0) {
+			return n;
+		}
+		state->slave_reply_len += n;
+		if (state->slave_reply_len < sizeof(state->slave_reply) ||
+		    !slave_verify_master(pvar)) {
+			WSASetLastError(WSAEWOULDBLOCK);
+			return SOCKET_ERROR;
+		}
+	}
+
+	return (pvar->Precv) (pvar->socket, buf, len, flags);
+}
+
+void MUX_slave_send(PTInstVar pvar, char const FAR * buf, int len)
+{
+	MUX_slave_connected(pvar);
+
+	// }X^[m߂܂ł͑炸ɗ߂Ă
+	if (!pvar->mux_state.slave_verified) {
+		if (pvar->mux_state.slave_pending == NULL) {
+			pvar->mux_state.slave_pending = buffer_init();
+		}
+		if (pvar->mux_state.slave_pending != NULL) {
+			buffer_put_raw(pvar->mux_state.slave_pending, (char FAR *) buf, len);
+		}
+		return;
+	}
+
+	slave_send_data(pvar, buf, len);
+}
+
+void MUX_slave_notify_win_size(PTInstVar pvar, int cols, int rows)
+{
+	char msg[8];
+
+	pvar->ssh_state.win_cols = cols;
+	pvar->ssh_state.win_rows = rows;
+
+	// }X^[m߂OȂAAUTH ő
+	if (pvar->mux_state.slave_verified) {
+		set_uint32_MSBfirst(msg, cols);
+		set_uint32_MSBfirst(msg + 4, rows);
+		slave_send_message(pvar, MUX_MSG_WINSIZE, msg, sizeof(msg));
+	}
+}
+
+
+void MUX_init(PTInstVar pvar)
+{
+	memset(&pvar->mux_state, 0, sizeof(pvar->mux_state));
+	pvar->mux_state.listening_sockets[0] = INVALID_SOCKET;
+	pvar->mux_state.listening_sockets[1] = INVALID_SOCKET;
+	UTIL_init_sock_write_buf(&pvar->mux_state.slave_writebuf);
+}
+
+void MUX_end(PTInstVar pvar)
+{
+	int i;
+
+	// }X^[ؒfƁA肵ĂEBhEؒf
+	stop_master(pvar);
+
+	if (pvar->mux_state.clients != NULL) {
+		for (i = 0; i < pvar->mux_state.num_clients; i++) {
+			close_client(pvar, i);
+		}
+		free(pvar->mux_state.clients);
+	}
+
+	if (pvar->mux_state.wnd != NULL) {
+		DestroyWindow(pvar->mux_state.wnd);
+	}
+
+	if (pvar->mux_state.slave_pending != NULL) {
+		buffer_free(pvar->mux_state.slave_pending);
+	}
+	UTIL_destroy_sock_write_buf(&pvar->mux_state.slave_writebuf);
+
+	MUX_init(pvar);
+}
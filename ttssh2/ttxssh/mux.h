@@ -0,0 +1,113 @@
+/*
+Copyright (c) TeraTerm Project.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+  3. The name of the author may not be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+OF SUCH DAMAGE.
+*/
+
+#ifndef __TTSSH_MUX_H
+#define __TTSSH_MUX_H
+
+/*
+ * SSHڑ̋L (ControlMaster)
+ *
+ * ŏɐڑEBhE(}X^[)AF؍ς݂SSH2ڑ[vobN
+ * |[gŌJBڑ֌ォڑEBhE(X[u)́AT[o
+ * ڑɃ}X^[֐ڑA}X^[X[uƂɃZbV`lJB
+ * X[u͌ƔF؂sȂB
+ *
+ * ҂󂯃|[gƔ閧 cookie ́A[UJ閼OtL
+ * JB}X^[ƃX[u cookie g`W/X|XŌ݂
+ * m߁AX[u̓}X^[m߂܂Œ[̓͂𑗂ȂB
+ */
+
+/* ControlMaster ̐ݒl */
+#define MUX_CONTROL_NO    0  // gȂ
+#define MUX_CONTROL_AUTO  1  // }X^[Α肵AȂΎ}X^[ɂȂ
+
+#define MUX_COOKIE_LEN 32
+#define MUX_NONCE_LEN  16
+#define MUX_PROOF_LEN  32  // HMAC-SHA256
+
+typedef struct {
+	int status;
+	SOCKET s;
+	int channel_id;            // SSH2̃`lԍBJO -1
+	buffer_t *inbuf;           // X[uM̃bZ[W
+	UTILSockWriteBuf writebuf;
+	DWORD accept_tick;         // ڑ󂯕t
+	unsigned char client_nonce[MUX_NONCE_LEN];
+	unsigned char master_nonce[MUX_NONCE_LEN];
+
+	char term[64];
+	int cols;
+	int rows;
+	BOOL winsize_pending;      // Ɏ󂯎EBhETCY܂ĂȂ
+} MUXClient;
+
+typedef struct {
+	/* }X^[ */
+	HWND wnd;
+	WNDPROC old_wnd_proc;
+	HANDLE endpoint;           // ڑJ閼OtL
+	SOCKET listening_sockets[2];
+	char cookie[MUX_COOKIE_LEN + 1];
+	int num_clients;
+	MUXClient FAR * clients;
+
+	/* X[u */
+	BOOL slave;                // ̃EBhESSHڑɑ肵Ă
+	BOOL slave_started;
+	BOOL slave_verified;       // }X^[ cookie mĂ邱Ƃm߂
+	char slave_cookie[MUX_COOKIE_LEN + 1];
+	unsigned char slave_nonce[MUX_NONCE_LEN];
+	unsigned char slave_reply[MUX_NONCE_LEN + MUX_PROOF_LEN];  // }X^[̉
+	int slave_reply_len;
+	buffer_t *slave_pending;   // }X^[m߂OɎ󂯕t
+	UTILSockWriteBuf slave_writebuf;  // }X^[֑肫ȂbZ[W
+	DWORD slave_connect_tick;
+} MUXState;
+
+void MUX_init(PTInstVar pvar);
+void MUX_end(PTInstVar pvar);
+
+/* }X^[ */
+void MUX_start_master(PTInstVar pvar);
+void MUX_confirmed_open(PTInstVar pvar, int client_num);
+void MUX_failed_open(PTInstVar pvar, int client_num);
+void MUX_received_data(PTInstVar pvar, int client_num,
+                       unsigned char FAR * data, int length);
+void MUX_channel_closed(PTInstVar pvar, int client_num);
+void MUX_resume_read(PTInstVar pvar, int client_num);
+BOOL MUX_is_congested(PTInstVar pvar, int client_num);
+void MUX_rekey_finished(PTInstVar pvar);
+
+/* X[u */
+BOOL MUX_find_master(PTInstVar pvar, int family,
+                     struct sockaddr_storage FAR * addr, int FAR * addrlen);
+void MUX_slave_connected(PTInstVar pvar);
+int MUX_slave_async_select(PTInstVar pvar, SOCKET s, HWND wnd, u_int msg, long events);
+int MUX_slave_recv(PTInstVar pvar, char FAR * buf, int len, int flags);
+void MUX_slave_send(PTInstVar pvar, char const FAR * buf, int len);
+void MUX_slave_notify_win_size(PTInstVar pvar, int cols, int rows);
+
+#endif
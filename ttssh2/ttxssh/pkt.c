@@ -50,6 +50,9 @@ void PKT_init(PTInstVar pvar)
 	pvar->pkt_state.seen_server_ID = FALSE;
 	pvar->pkt_state.seen_newline = FALSE;
 	pvar->pkt_state.predecrypted_packet = FALSE;
+	pvar->pkt_state.recv_calls = 0;
+	pvar->pkt_state.recv_packets = 0;
+	pvar->pkt_state.recv_bytes_moved = 0;
 }
 
 /* Read some data, leave no more than up_to_amount bytes in the buffer,
@@ -57,23 +60,31 @@ void PKT_init(PTInstVar pvar)
 static int recv_data(PTInstVar pvar, unsigned long up_to_amount)
 {
 	int amount_read;
+	char FAR *tail;
 
 	/* Shuffle data to the start of the buffer */
-	if (pvar->pkt_state.datastart != 0) {
+	// 擪֋l߂̂ł͂ȂAobt@ up_to_amount ̋󂫂
+	// ȂƂl߂Bobt@͗vʂ2{mۂ̂ŁA
+	// l߂񐔂͏ȂÂƂcĂ̂Mr̃pPbgɂȂB
+	if (pvar->pkt_state.datalen == 0) {
+		pvar->pkt_state.datastart = 0;
+	} else if (pvar->pkt_state.datastart != 0 &&
+	           pvar->pkt_state.datastart + up_to_amount > pvar->pkt_state.buflen) {
 		memmove(pvar->pkt_state.buf,
 		        pvar->pkt_state.buf + pvar->pkt_state.datastart,
 		        pvar->pkt_state.datalen);
 		pvar->pkt_state.datastart = 0;
+		pvar->pkt_state.recv_bytes_moved += pvar->pkt_state.datalen;
 	}
 
-	buf_ensure_size(&pvar->pkt_state.buf, &pvar->pkt_state.buflen,
-	                up_to_amount);
+	buf_ensure_size_growing(&pvar->pkt_state.buf, &pvar->pkt_state.buflen,
+	                        pvar->pkt_state.datastart + up_to_amount);
 
 	_ASSERT(pvar->pkt_state.buf != NULL);
 
+	tail = pvar->pkt_state.buf + pvar->pkt_state.datastart + pvar->pkt_state.datalen;
 	amount_read = (pvar->Precv) (pvar->socket,
-	                             pvar->pkt_state.buf +
-	                             pvar->pkt_state.datalen,
+	                             tail,
 	                             up_to_amount - pvar->pkt_state.datalen,
 	                             0);
 
@@ -84,14 +95,14 @@ static int recv_data(PTInstVar pvar, unsigned long up_to_amount)
 			int i;
 
 			for (i = 0; i < amount_read; i++) {
-				if (pvar->pkt_state.buf[pvar->pkt_state.datalen + i] ==
-				    '\n') {
+				if (tail[i] == '\n') {
 					pvar->pkt_state.seen_newline = 1;
 				}
 			}
 		}
 
 		pvar->pkt_state.datalen += amount_read;
+		pvar->pkt_state.recv_calls++;
 	}
 
 	return amount_read;
@@ -164,18 +175,20 @@ int PKT_recv(PTInstVar pvar, char FAR * buf, int buflen)
 			/* We're looking for the initial ID string and either we've seen the
 			   terminating newline, or we've exceeded the limit at which we should see
 			   a newline. */
+			char FAR *data =
+				pvar->pkt_state.buf + pvar->pkt_state.datastart;
 			unsigned int i;
 
 			for (i = 0;
-			     pvar->pkt_state.buf[i] != '\n'
+			     data[i] != '\n'
 			     && i < pvar->pkt_state.datalen; i++) {
 			}
-			if (pvar->pkt_state.buf[i] == '\n') {
+			if (data[i] == '\n') {
 				i++;
 			}
 
 			// SSHT[õo[W`FbNs
-			if (SSH_handle_server_ID(pvar, pvar->pkt_state.buf, i)) {
+			if (SSH_handle_server_ID(pvar, data, i)) {
 				pvar->pkt_state.seen_server_ID = 1;
 
 				if (SSHv1(pvar)) {
@@ -197,12 +210,23 @@ int PKT_recv(PTInstVar pvar, char FAR * buf, int buflen)
 		} else if (pvar->pkt_state.seen_server_ID
 		           && pvar->pkt_state.datalen >=
 		           (unsigned int) SSH_get_min_packet_size(pvar)) {
-			char FAR *data =
-				pvar->pkt_state.buf + pvar->pkt_state.datastart;
+			char FAR *data;
 			uint32 padding;
 			uint32 pktsize;
 			uint32 total_packet_size;
 
+			// pPbg4oCgEn߂(SSH_handle_packet() ̑O)B
+			// pPbg͂ǂ̕ł4̔{Ȃ̂ŁAÊ
+			// T[oID̍s̒ゾŁÂƂ擪֋l߂B
+			if (pvar->pkt_state.datastart % 4 != 0) {
+				memmove(pvar->pkt_state.buf,
+				        pvar->pkt_state.buf + pvar->pkt_state.datastart,
+				        pvar->pkt_state.datalen);
+				pvar->pkt_state.datastart = 0;
+				pvar->pkt_state.recv_bytes_moved += pvar->pkt_state.datalen;
+			}
+			data = pvar->pkt_state.buf + pvar->pkt_state.datastart;
+
 			//debug_print(10, data, pvar->pkt_state.datalen);
 
 			// SSH2ȂÍpPbg̈ꕔ𕜍B
@@ -225,7 +249,7 @@ int PKT_recv(PTInstVar pvar, char FAR * buf, int buflen)
 				pktsize = realpktsize + padding;
 			} else {
 				// SSH2̃pPbg͐擪 packet-size(4)+padding(1)+type(1) B
-				pktsize = get_uint32_MSBfirst(data);
+				pktsize = SSH_get_packet_length(pvar, data);
 				padding = (unsigned char) data[4];
 			}
 
@@ -237,6 +261,7 @@ int PKT_recv(PTInstVar pvar, char FAR * buf, int buflen)
 				/* the data must be 4 byte aligned. */
 				SSH_handle_packet(pvar, data, pktsize, padding);
 				pvar->pkt_state.predecrypted_packet = FALSE;
+				pvar->pkt_state.recv_packets++;
 
 				pvar->pkt_state.datastart += total_packet_size;
 				pvar->pkt_state.datalen -= total_packet_size;
@@ -304,5 +329,16 @@ int PKT_recv(PTInstVar pvar, char FAR * buf, int buflen)
 
 void PKT_end(PTInstVar pvar)
 {
+	if (pvar->pkt_state.recv_calls > 0) {
+		char buf[128];
+
+		_snprintf_s(buf, sizeof(buf), _TRUNCATE,
+		            "receive statistics: %lu packets in %lu recv() calls (%.1f packets/recv), %lu bytes moved",
+		            pvar->pkt_state.recv_packets, pvar->pkt_state.recv_calls,
+		            (double)pvar->pkt_state.recv_packets / pvar->pkt_state.recv_calls,
+		            pvar->pkt_state.recv_bytes_moved);
+		notify_verbose_message(pvar, buf, LOG_LEVEL_VERBOSE);
+	}
+
 	buf_destroy(&pvar->pkt_state.buf, &pvar->pkt_state.buflen);
 }
@@ -46,6 +46,10 @@ typedef struct {
   BOOL seen_server_ID;
   BOOL seen_newline;
   BOOL predecrypted_packet;
+  // M̓v (LogLevel  VERBOSE ȏ̂ƂؒfɃO֏o͂)
+  unsigned long recv_calls;
+  unsigned long recv_packets;
+  unsigned long recv_bytes_moved;
 } PKTState;
 
 void PKT_init(PTInstVar pvar);
@@ -50,6 +50,7 @@ OF SUCH DAMAGE.
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <assert.h>
+#include <direct.h>
 
 
 #define WM_USER_CONSOLE (WM_USER + 1)
@@ -59,19 +60,12 @@ OF SUCH DAMAGE.
 
 /* Commands for interactive mode */
 #define I_CHDIR     1
-#define I_CHGRP     2
-#define I_CHMOD     3
-#define I_CHOWN     4
-#define I_DF        24
 #define I_GET       5
 #define I_HELP      6
 #define I_LCHDIR    7
-#define I_LINK      25
-#define I_LLS       8
 #define I_LMKDIR    9
 #define I_LPWD      10
 #define I_LS        11
-#define I_LUMASK    12
 #define I_MKDIR     13
 #define I_PUT       14
 #define I_PWD       15
@@ -79,10 +73,7 @@ OF SUCH DAMAGE.
 #define I_RENAME    17
 #define I_RM        18
 #define I_RMDIR     19
-#define I_SHELL     20
-#define I_SYMLINK   21
 #define I_VERSION   22
-#define I_PROGRESS  23
 
 /* Type of completion */
 #define NOARGS  0
@@ -99,35 +90,25 @@ static const struct CMD cmds[] = {
     { "bye",    I_QUIT,     NOARGS  },
     { "cd",     I_CHDIR,    REMOTE  },
     { "chdir",  I_CHDIR,    REMOTE  },
-    { "chgrp",  I_CHGRP,    REMOTE  },
-    { "chmod",  I_CHMOD,    REMOTE  },
-    { "chown",  I_CHOWN,    REMOTE  },
-    { "df",     I_DF,       REMOTE  },
     { "dir",    I_LS,       REMOTE  },
     { "exit",   I_QUIT,     NOARGS  },
     { "get",    I_GET,      REMOTE  },
     { "help",   I_HELP,     NOARGS  },
     { "lcd",    I_LCHDIR,   LOCAL   },
     { "lchdir", I_LCHDIR,   LOCAL   },
-    { "lls",    I_LLS,      LOCAL   },
     { "lmkdir", I_LMKDIR,   LOCAL   },
-    { "ln",     I_LINK,     REMOTE  },
     { "lpwd",   I_LPWD,     LOCAL   },
     { "ls",     I_LS,       REMOTE  },
-    { "lumask", I_LUMASK,   NOARGS  },
     { "mkdir",  I_MKDIR,    REMOTE  },
     { "mget",   I_GET,      REMOTE  },
     { "mput",   I_PUT,      LOCAL   },
-    { "progress",   I_PROGRESS, NOARGS  },
     { "put",    I_PUT,      LOCAL   },
     { "pwd",    I_PWD,      REMOTE  },
     { "quit",   I_QUIT,     NOARGS  },
     { "rename", I_RENAME,   REMOTE  },
     { "rm",     I_RM,       REMOTE  },
     { "rmdir",  I_RMDIR,    REMOTE  },
-    { "symlink",    I_SYMLINK,  REMOTE  },
     { "version",    I_VERSION,  NOARGS  },
-    { "!",      I_SHELL,    NOARGS  },
     { "?",      I_HELP,     NOARGS  },
     { NULL,     -1,     -1  }
 };
@@ -219,34 +200,6 @@ static void sftp_send_msg(PTInstVar pvar, Channel_t *c, buffer_t *msg)
 	SSH2_send_channel_data(pvar, c, p, len, 0);
 }
 
-// T[oMSFTPpPbgobt@Ɋi[B
-static void sftp_get_msg(PTInstVar pvar, Channel_t *c, unsigned char *data, unsigned int buflen, buffer_t **message)
-{
-	buffer_t *msg = *message;
-	int msg_len;
-
-	// obt@mۂAf[^ׂĕ荞ށBȍ~ buffer_t ^ʂđ삷B
-	// ق OpenSSH ̃R[hƂ̐eaǂȂ邽߁B
-	buffer_clear(msg);
-	buffer_append(msg, data, buflen);
-	buffer_rewind(msg);
-
-	msg_len = buffer_get_int(msg);
-	if (msg_len > SFTP_MAX_MSG_LENGTH) {
-		// TODO:
-		sftp_syslog(pvar, "Received message too long %u", msg_len);
-		goto error;
-	}
-	if (msg_len + 4 != buflen) {
-		// TODO:
-		sftp_syslog(pvar, "Buffer length %u is invalid", buflen);
-		goto error;
-	}
-
-error:
-	return;
-}
-
 static void sftp_send_string_request(PTInstVar pvar, Channel_t *c, unsigned int id, unsigned int code,
 									 char *s, unsigned int len)
 {
@@ -440,33 +393,21 @@ help(void)
 		"Available commands:\r\n"
 	    "bye                                Quit sftp\r\n"
 	    "cd path                            Change remote directory to 'path'\r\n"
-	    "chgrp grp path                     Change group of file 'path' to 'grp'\r\n"
-	    "chmod mode path                    Change permissions of file 'path' to 'mode'\r\n"
-	    "chown own path                     Change owner of file 'path' to 'own'\r\n"
-	    "df [-hi] [path]                    Display statistics for current directory or\r\n"
-	    "                                   filesystem containing 'path'\r\n"
 	    "exit                               Quit sftp\r\n"
-	    "get [-Ppr] remote [local]          Download file\r\n"
+	    "get remote [local]                 Download file\r\n"
 	    "help                               Display this help text\r\n"
 	    "lcd path                           Change local directory to 'path'\r\n"
-	    "lls [ls-options [path]]            Display local directory listing\r\n"
 	    "lmkdir path                        Create local directory\r\n"
-	    "ln [-s] oldpath newpath            Link remote file (-s for symlink)\r\n"
 	    "lpwd                               Print local working directory\r\n"
-	    "ls [-1afhlnrSt] [path]             Display remote directory listing\r\n"
-	    "lumask umask                       Set local umask to 'umask'\r\n"
+	    "ls [path]                          Display remote directory listing\r\n"
 	    "mkdir path                         Create remote directory\r\n"
-	    "progress                           Toggle display of progress meter\r\n"
-	    "put [-Ppr] local [remote]          Upload file\r\n"
+	    "put local [remote]                 Upload file\r\n"
 	    "pwd                                Display remote working directory\r\n"
 	    "quit                               Quit sftp\r\n"
 	    "rename oldpath newpath             Rename remote file\r\n"
 	    "rm path                            Delete remote file\r\n"
 	    "rmdir path                         Remove remote directory\r\n"
-	    "symlink oldpath newpath            Symlink remote file\r\n"
 	    "version                            Show SFTP version\r\n"
-	    "!command                           Execute 'command' in local shell\r\n"
-	    "!                                  Escape to local shell\r\n"
 	    "?                                  Synonym for help\r\n");
 }
 
@@ -635,9 +576,7 @@ static int parse_args(const char **cpp, int *pflag, int *rflag, int *lflag, int
     int *hflag, int *sflag, unsigned long *n_arg, char **path1, char **path2)
 {
     const char *cmd, *cp = *cpp;
-    char *cp2 = NULL, **argv;
-    int base = 0;
-    long l = 0;
+    char **argv;
     int i, cmdnum, optidx, argc;
 
     /* Skip leading whitespace */
@@ -666,12 +605,8 @@ static int parse_args(const char **cpp, int *pflag, int *rflag, int *lflag, int
 	cmdnum = cmds[i].n;
 	cmd = cmds[i].c;
 
-	/* Special case */
-	if (*cp == '!') {
-		cp++;
-		cmdnum = I_SHELL;
-	} else if (cmdnum == -1) {
-		sftp_syslog(g_pvar, "Invalid command.");
+	if (cmdnum == -1) {
+		sftp_console_message(g_pvar, g_channel, "Invalid command.");
 		return -1;
 	}
 
@@ -679,42 +614,41 @@ static int parse_args(const char **cpp, int *pflag, int *rflag, int *lflag, int
 	*lflag = *pflag = *rflag = *hflag = *n_arg = 0;
 	*path1 = *path2 = NULL;
 	optidx = 1;
+
+	// get/put/ls ̃IvVɂ͖ΉȂ̂ŁAw肳ꂽG[ɂB
+	// "-" Ŏn܂pX "--" ̌ɏB
+	if (cmdnum == I_GET || cmdnum == I_PUT || cmdnum == I_LS) {
+		if (optidx < argc && strcmp(argv[optidx], "--") == 0) {
+			optidx++;
+		} else if (optidx < argc && argv[optidx][0] == '-' && argv[optidx][1] != '\0') {
+			sftp_console_message(g_pvar, g_channel,
+				"%s: unsupported option \"%s\".", cmd, argv[optidx]);
+			return -1;
+		}
+	}
+
 	switch (cmdnum) {
-#if 0
 	case I_GET:
 	case I_PUT:
-		if ((optidx = parse_getput_flags(cmd, argv, argc,
-		    pflag, rflag)) == -1)
-			return -1;
 		/* Get first pathname (mandatory) */
 		if (argc - optidx < 1) {
-			error("You must specify at least one path after a "
-			    "%s command.", cmd);
+			sftp_console_message(g_pvar, g_channel,
+				"You must specify at least one path after a %s command.", cmd);
 			return -1;
 		}
-		*path1 = xstrdup(argv[optidx]);
+		*path1 = argv[optidx];
 		/* Get second pathname (optional) */
-		if (argc - optidx > 1) {
-			*path2 = xstrdup(argv[optidx + 1]);
-			/* Destination is not globbed */
-			undo_glob_escape(*path2);
-		}
+		if (argc - optidx > 1)
+			*path2 = argv[optidx + 1];
 		break;
-	case I_LINK:
-		if ((optidx = parse_link_flags(cmd, argv, argc, sflag)) == -1)
-			return -1;
-	case I_SYMLINK:
 	case I_RENAME:
 		if (argc - optidx < 2) {
-			error("You must specify two paths after a %s "
-			    "command.", cmd);
+			sftp_console_message(g_pvar, g_channel,
+				"You must specify two paths after a %s command.", cmd);
 			return -1;
 		}
-		*path1 = xstrdup(argv[optidx]);
-		*path2 = xstrdup(argv[optidx + 1]);
-		/* Paths are not globbed */
-		undo_glob_escape(*path1);
-		undo_glob_escape(*path2);
+		*path1 = argv[optidx];
+		*path2 = argv[optidx + 1];
 		break;
 	case I_RM:
 	case I_MKDIR:
@@ -724,79 +658,25 @@ static int parse_args(const char **cpp, int *pflag, int *rflag, int *lflag, int
 	case I_LMKDIR:
 		/* Get pathname (mandatory) */
 		if (argc - optidx < 1) {
-			error("You must specify a path after a %s command.",
-			    cmd);
-			return -1;
-		}
-		*path1 = xstrdup(argv[optidx]);
-		/* Only "rm" globs */
-		if (cmdnum != I_RM)
-			undo_glob_escape(*path1);
-		break;
-	case I_DF:
-		if ((optidx = parse_df_flags(cmd, argv, argc, hflag,
-		    iflag)) == -1)
+			sftp_console_message(g_pvar, g_channel,
+				"You must specify a path after a %s command.", cmd);
 			return -1;
-		/* Default to current directory if no path specified */
-		if (argc - optidx < 1)
-			*path1 = NULL;
-		else {
-			*path1 = xstrdup(argv[optidx]);
-			undo_glob_escape(*path1);
 		}
+		*path1 = argv[optidx];
 		break;
 	case I_LS:
-		if ((optidx = parse_ls_flags(argv, argc, lflag)) == -1)
-			return(-1);
 		/* Path is optional */
 		if (argc - optidx > 0)
-			*path1 = xstrdup(argv[optidx]);
+			*path1 = argv[optidx];
 		break;
-	case I_LLS:
-		/* Skip ls command and following whitespace */
-		cp = cp + strlen(cmd) + strspn(cp, WHITESPACE);
-	case I_SHELL:
-		/* Uses the rest of the line */
-		break;
-	case I_LUMASK:
-	case I_CHMOD:
-		base = 8;
-	case I_CHOWN:
-	case I_CHGRP:
-		/* Get numeric arg (mandatory) */
-		if (argc - optidx < 1)
-			goto need_num_arg;
-		errno = 0;
-		l = strtol(argv[optidx], &cp2, base);
-		if (cp2 == argv[optidx] || *cp2 != '\0' ||
-		    ((l == LONG_MIN || l == LONG_MAX) && errno == ERANGE) ||
-		    l < 0) {
- need_num_arg:
-			error("You must supply a numeric argument "
-			    "to the %s command.", cmd);
-			return -1;
-		}
-		*n_arg = l;
-		if (cmdnum == I_LUMASK)
-			break;
-		/* Get pathname (mandatory) */
-		if (argc - optidx < 2) {
-			error("You must specify a path after a %s command.",
-			    cmd);
-			return -1;
-		}
-		*path1 = xstrdup(argv[optidx + 1]);
-		break;
-#endif
 	case I_QUIT:
 	case I_PWD:
 	case I_LPWD:
 	case I_HELP:
 	case I_VERSION:
-	case I_PROGRESS:
 		break;
 	default:
-		//fatal("Command not implemented");
+		sftp_console_message(g_pvar, g_channel, "%s is not implemented.", cmd);
 		return -1;
 	}
 
@@ -806,54 +686,663 @@ static int parse_args(const char **cpp, int *pflag, int *rflag, int *lflag, int
 
 
 /*
- * SFTP R}hCR\[
+ * SFTP ]GW
+ *
+ * R}h1ɎsBget/put ł READ/WRITE v҂
+ * num_requests ܂őĂ(read-ahead/write-behind)ARTTɗȂ
+ * 悤ɂB͗vIDŏƍ̂ŁAǂ̏ŕԂĂĂ悢B
  */
-static WNDPROC hEditProc;
 
-static LRESULT CALLBACK EditProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+// ҂̗v
+typedef struct sftp_request {
+	unsigned int id;
+	unsigned int type;              // v (SSH2_FXP_*)
+	unsigned long long offset;      // READ/WRITE ̈ʒu
+	unsigned int len;               // READ/WRITE ̒
+	struct sftp_request *next;
+} sftp_request_t;
+
+typedef struct sftp_attrib {
+	unsigned int flags;
+	unsigned long long size;
+	unsigned int uid, gid;
+	unsigned int perm;
+	unsigned int atime, mtime;
+} sftp_attrib_t;
+
+enum sftp_xfer_state {
+	SFTP_XFER_OPEN,      // OPEN/OPENDIR ̉҂
+	SFTP_XFER_FSTAT,     // FSTAT ̉҂
+	SFTP_XFER_DATA,      // READ/WRITE/READDIR ̉҂
+	SFTP_XFER_CLOSE,     // CLOSE ̉҂
+	SFTP_XFER_REALPATH,  // REALPATH ̉҂(cd)
+	SFTP_XFER_STAT,      // STAT ̉҂(cd)
+	SFTP_XFER_STATUS,    // mkdir, rm Ȃǂ̉҂
+	SFTP_XFER_DONE,
+};
+
+typedef struct sftp_xfer {
+	int cmd;                        // I_GET, I_PUT, ...
+	enum sftp_xfer_state state;
+	char remote[1024];
+	char remote2[1024];             // rename ̕ύX̖O
+	char local[MAX_PATH];
+	char *handle;
+	int handle_len;
+	FILE *fp;
+	char *buf;                      // put ̓ǂݍ݃obt@
+	unsigned long long size;        // t@CTCY
+	unsigned long long offset;      // ɗvʒu
+	unsigned long long done;        // ]ς݂̃oCg
+	int eof;
+	int error;
+	DWORD start_tick;
+	sftp_request_t *requests;
+	unsigned int outstanding;       // ҂̗v
+	sftp_notify_t notify;           // R}h̏Im点 (}N)
+} sftp_xfer_t;
+
+// ZbVmOÕR}h̎sɎ󂯕tR}h
+typedef struct sftp_cmdline {
+	char line[512];
+	sftp_notify_t notify;
+	struct sftp_cmdline *next;
+} sftp_cmdline_t;
+
+static sftp_cmdline_t *sftp_cmd_head, *sftp_cmd_tail;
+static int sftp_opening;
+static char sftp_lpwd[MAX_PATH];  // local working directory
+
+static void sftp_queue_command(char *line, sftp_notify_t notify)
 {
-	char buf[512];
-	char *cmd;
-    char *path1, *path2, *tmp = NULL;
-    int pflag = 0, rflag = 0, lflag = 0, iflag = 0, hflag = 0, sflag = 0;
-    int cmdnum, i = 0;
-    unsigned long n_arg = 0;
-	//Attrib a, *aa;
-	char path_buf[1024] = {0};
-	int err = 0;
-	//glob_t g;
-	int err_abort;
+	sftp_cmdline_t *cmd;
 
-	switch (uMsg) {
-		case WM_KEYDOWN:
-		if ((int)wParam == VK_RETURN) {
-			GetWindowText(hwnd, buf, sizeof(buf));
-			SetWindowText(hwnd, "");
-			if (buf[0] != '\0') {
-				SendDlgItemMessage(GetParent(hwnd), IDC_SFTP_CONSOLE, EM_REPLACESEL, 0, (LPARAM) buf);
-				SendDlgItemMessage(GetParent(hwnd), IDC_SFTP_CONSOLE, EM_REPLACESEL, 0,
-								   (LPARAM) (char FAR *) "\r\n");
-				goto cmd_parsed;
+	cmd = malloc(sizeof(sftp_cmdline_t));
+	if (cmd == NULL) {
+		if (notify != NULL)
+			notify(0);
+		return;
+	}
+	strncpy_s(cmd->line, sizeof(cmd->line), line, _TRUNCATE);
+	cmd->notify = notify;
+	cmd->next = NULL;
+	if (sftp_cmd_tail != NULL)
+		sftp_cmd_tail->next = cmd;
+	else
+		sftp_cmd_head = cmd;
+	sftp_cmd_tail = cmd;
+}
+
+// sꂸɏIR}h͎sƂĒm点
+static void sftp_clear_commands(void)
+{
+	sftp_cmdline_t *cmd;
+
+	while (sftp_cmd_head != NULL) {
+		cmd = sftp_cmd_head;
+		sftp_cmd_head = cmd->next;
+		if (cmd->notify != NULL)
+			cmd->notify(0);
+		free(cmd);
+	}
+	sftp_cmd_tail = NULL;
+}
+
+static void decode_attrib(buffer_t *msg, sftp_attrib_t *a)
+{
+	unsigned int i, count;
+
+	memset(a, 0, sizeof(sftp_attrib_t));
+	a->flags = buffer_get_int(msg);
+	if (a->flags & SSH2_FILEXFER_ATTR_SIZE)
+		a->size = buffer_get_int64(msg);
+	if (a->flags & SSH2_FILEXFER_ATTR_UIDGID) {
+		a->uid = buffer_get_int(msg);
+		a->gid = buffer_get_int(msg);
+	}
+	if (a->flags & SSH2_FILEXFER_ATTR_PERMISSIONS)
+		a->perm = buffer_get_int(msg);
+	if (a->flags & SSH2_FILEXFER_ATTR_ACMODTIME) {
+		a->atime = buffer_get_int(msg);
+		a->mtime = buffer_get_int(msg);
+	}
+	if (a->flags & SSH2_FILEXFER_ATTR_EXTENDED) {
+		count = buffer_get_int(msg);
+		for (i = 0; i < count && buffer_remain_len(msg) > 0; i++) {
+			free(buffer_get_string_msg(msg, NULL));
+			free(buffer_get_string_msg(msg, NULL));
+		}
+	}
+}
+
+static void sftp_make_absolute(Channel_t *c, char *path, char *dst, size_t dstlen)
+{
+	if (path[0] == '/' || c->sftp.pwd[0] == '\0') {
+		strncpy_s(dst, dstlen, path, _TRUNCATE);
+	} else if (strcmp(c->sftp.pwd, "/") == 0) {
+		_snprintf_s(dst, dstlen, _TRUNCATE, "/%s", path);
+	} else {
+		_snprintf_s(dst, dstlen, _TRUNCATE, "%s/%s", c->sftp.pwd, path);
+	}
+}
+
+static void sftp_make_local_absolute(char *path, char *dst, size_t dstlen)
+{
+	if (path[0] == '\\' || path[0] == '/' || (path[0] != '\0' && path[1] == ':') ||
+	    sftp_lpwd[0] == '\0') {
+		strncpy_s(dst, dstlen, path, _TRUNCATE);
+	} else {
+		_snprintf_s(dst, dstlen, _TRUNCATE, "%s\\%s", sftp_lpwd, path);
+	}
+}
+
+static void sftp_request_add(sftp_xfer_t *x, unsigned int id, unsigned int type,
+                             unsigned long long offset, unsigned int len)
+{
+	sftp_request_t *req;
+
+	req = malloc(sizeof(sftp_request_t));
+	if (req == NULL) {
+		x->error = 1;
+		return;
+	}
+	req->id = id;
+	req->type = type;
+	req->offset = offset;
+	req->len = len;
+	req->next = x->requests;
+	x->requests = req;
+	x->outstanding++;
+}
+
+// ɑΉvXgOĕԂ
+static sftp_request_t *sftp_request_lookup(sftp_xfer_t *x, unsigned int id)
+{
+	sftp_request_t **p, *req;
+
+	for (p = &x->requests; *p != NULL; p = &(*p)->next) {
+		if ((*p)->id == id) {
+			req = *p;
+			*p = req->next;
+			x->outstanding--;
+			return req;
+		}
+	}
+	return NULL;
+}
+
+static void sftp_xfer_free(sftp_xfer_t *x)
+{
+	sftp_request_t *req;
+
+	while (x->requests != NULL) {
+		req = x->requests;
+		x->requests = req->next;
+		free(req);
+	}
+	if (x->fp != NULL)
+		fclose(x->fp);
+	free(x->handle);
+	free(x->buf);
+	free(x);
+}
+
+static void sftp_xfer_send_string(PTInstVar pvar, Channel_t *c, sftp_xfer_t *x, unsigned int code,
+                                  char *s, unsigned int len)
+{
+	unsigned int id = c->sftp.msg_id++;
+
+	sftp_send_string_request(pvar, c, id, code, s, len);
+	sftp_request_add(x, id, code, 0, 0);
+}
+
+static void sftp_xfer_send_open(PTInstVar pvar, Channel_t *c, sftp_xfer_t *x, unsigned int mode, int perm)
+{
+	buffer_t *msg;
+	unsigned int id = c->sftp.msg_id++;
+
+	sftp_buffer_alloc(&msg);
+	buffer_put_char(msg, SSH2_FXP_OPEN);
+	buffer_put_int(msg, id);
+	buffer_put_string(msg, x->remote, strlen(x->remote));
+	buffer_put_int(msg, mode);
+	if (perm >= 0) {
+		buffer_put_int(msg, SSH2_FILEXFER_ATTR_PERMISSIONS);
+		buffer_put_int(msg, perm);
+	} else {
+		buffer_put_int(msg, 0);
+	}
+	sftp_send_msg(pvar, c, msg);
+	sftp_buffer_free(msg);
+
+	sftp_request_add(x, id, SSH2_FXP_OPEN, 0, 0);
+}
+
+static void sftp_xfer_send_mkdir(PTInstVar pvar, Channel_t *c, sftp_xfer_t *x)
+{
+	buffer_t *msg;
+	unsigned int id = c->sftp.msg_id++;
+
+	sftp_buffer_alloc(&msg);
+	buffer_put_char(msg, SSH2_FXP_MKDIR);
+	buffer_put_int(msg, id);
+	buffer_put_string(msg, x->remote, strlen(x->remote));
+	buffer_put_int(msg, SSH2_FILEXFER_ATTR_PERMISSIONS);
+	buffer_put_int(msg, 0777);
+	sftp_send_msg(pvar, c, msg);
+	sftp_buffer_free(msg);
+
+	sftp_request_add(x, id, SSH2_FXP_MKDIR, 0, 0);
+}
+
+static void sftp_xfer_send_rename(PTInstVar pvar, Channel_t *c, sftp_xfer_t *x)
+{
+	buffer_t *msg;
+	unsigned int id = c->sftp.msg_id++;
+
+	sftp_buffer_alloc(&msg);
+	buffer_put_char(msg, SSH2_FXP_RENAME);
+	buffer_put_int(msg, id);
+	buffer_put_string(msg, x->remote, strlen(x->remote));
+	buffer_put_string(msg, x->remote2, strlen(x->remote2));
+	sftp_send_msg(pvar, c, msg);
+	sftp_buffer_free(msg);
+
+	sftp_request_add(x, id, SSH2_FXP_RENAME, 0, 0);
+}
+
+static void sftp_xfer_send_read(PTInstVar pvar, Channel_t *c, sftp_xfer_t *x,
+                                unsigned long long offset, unsigned int len)
+{
+	buffer_t *msg;
+	unsigned int id = c->sftp.msg_id++;
+
+	sftp_buffer_alloc(&msg);
+	buffer_put_char(msg, SSH2_FXP_READ);
+	buffer_put_int(msg, id);
+	buffer_put_string(msg, x->handle, x->handle_len);
+	buffer_put_int64(msg, offset);
+	buffer_put_int(msg, len);
+	sftp_send_msg(pvar, c, msg);
+	sftp_buffer_free(msg);
+
+	sftp_request_add(x, id, SSH2_FXP_READ, offset, len);
+}
+
+static void sftp_xfer_send_write(PTInstVar pvar, Channel_t *c, sftp_xfer_t *x,
+                                 unsigned long long offset, char *data, unsigned int len)
+{
+	buffer_t *msg;
+	unsigned int id = c->sftp.msg_id++;
+
+	sftp_buffer_alloc(&msg);
+	buffer_put_char(msg, SSH2_FXP_WRITE);
+	buffer_put_int(msg, id);
+	buffer_put_string(msg, x->handle, x->handle_len);
+	buffer_put_int64(msg, offset);
+	buffer_put_string(msg, data, len);
+	sftp_send_msg(pvar, c, msg);
+	sftp_buffer_free(msg);
+
+	sftp_request_add(x, id, SSH2_FXP_WRITE, offset, len);
+}
+
+// get: ҂ READ  num_requests ɂȂ܂ŗv𑗂
+static void sftp_get_fill(PTInstVar pvar, Channel_t *c, sftp_xfer_t *x)
+{
+	unsigned int limit;
+
+	while (!x->eof && !x->error) {
+		// t@CTCYɒB́AEOFm߂v1
+		limit = (x->offset < x->size) ? c->sftp.num_requests : 1;
+		if (x->outstanding >= limit)
+			break;
+		sftp_xfer_send_read(pvar, c, x, x->offset, c->sftp.transfer_buflen);
+		x->offset += c->sftp.transfer_buflen;
+	}
+}
+
+// put: ҂ WRITE  num_requests ɂȂ܂Ńt@Cǂő
+static void sftp_put_fill(PTInstVar pvar, Channel_t *c, sftp_xfer_t *x)
+{
+	size_t n;
+
+	while (!x->eof && !x->error && x->outstanding < c->sftp.num_requests) {
+		// `l̑M҂L[ĂƂ́AWRITE ̉҂Ă瑱
+		if (c->bufchain_amount >= CHAN_BUFCHAIN_MAX)
+			break;
+
+		n = fread(x->buf, 1, c->sftp.transfer_buflen, x->fp);
+		if (n == 0) {
+			if (ferror(x->fp)) {
+				sftp_console_message(pvar, c, "Couldn't read from local file \"%s\"", x->local);
+				x->error = 1;
+			}
+			x->eof = 1;
+			break;
+		}
+		sftp_xfer_send_write(pvar, c, x, x->offset, x->buf, (unsigned int)n);
+		x->offset += n;
+	}
+}
+
+static void sftp_run_queued(PTInstVar pvar, Channel_t *c);
+
+// G[ɂȂR}hI点BnhJĂΕĂIB
+static void sftp_xfer_fail(sftp_xfer_t *x)
+{
+	x->error = 1;
+	if (x->handle != NULL && x->state != SFTP_XFER_CLOSE)
+		x->state = SFTP_XFER_DATA;
+	else
+		x->state = SFTP_XFER_DONE;
+}
+
+static void sftp_xfer_finish(PTInstVar pvar, Channel_t *c)
+{
+	sftp_xfer_t *x = c->sftp.xfer;
+	DWORD elapsed;
+
+	// [g̃t@CJȂƂ́A[Jt@C
+	if (x->cmd == I_GET && x->error && x->handle == NULL && x->fp != NULL) {
+		fclose(x->fp);
+		x->fp = NULL;
+		remove(x->local);
+	}
+
+	if ((x->cmd == I_GET || x->cmd == I_PUT) && !x->error) {
+		elapsed = GetTickCount() - x->start_tick;
+		sftp_console_message(pvar, c, "%s %s (%llu bytes, %lu.%03lu sec, %llu KB/s)",
+		                     x->cmd == I_GET ? "Fetched" : "Uploaded",
+		                     x->cmd == I_GET ? x->remote : x->local,
+		                     x->done, elapsed / 1000, elapsed % 1000,
+		                     elapsed > 0 ? x->done / elapsed : x->done / 1000);
+	}
+
+	if (x->notify != NULL)
+		x->notify(!x->error);
+
+	sftp_xfer_free(x);
+	c->sftp.xfer = NULL;
+
+	sftp_run_queued(pvar, c);
+}
+
+// A̗v𑗂邩AR}hI
+static void sftp_xfer_step(PTInstVar pvar, Channel_t *c, sftp_xfer_t *x)
+{
+	if (x->state == SFTP_XFER_DATA) {
+		if (!x->eof && !x->error) {
+			if (x->cmd == I_GET) {
+				sftp_get_fill(pvar, c, x);
+			} else if (x->cmd == I_PUT) {
+				sftp_put_fill(pvar, c, x);
+			} else if (x->cmd == I_LS && x->outstanding == 0) {
+				sftp_xfer_send_string(pvar, c, x, SSH2_FXP_READDIR, x->handle, x->handle_len);
 			}
 		}
+		if ((x->eof || x->error) && x->outstanding == 0) {
+			x->state = SFTP_XFER_CLOSE;
+			sftp_xfer_send_string(pvar, c, x, SSH2_FXP_CLOSE, x->handle, x->handle_len);
+		}
+	}
+
+	if (x->state == SFTP_XFER_DONE && x->outstanding == 0) {
+		sftp_xfer_finish(pvar, c);
+	}
+}
+
+static void sftp_xfer_response(PTInstVar pvar, Channel_t *c, buffer_t *msg)
+{
+	sftp_xfer_t *x = c->sftp.xfer;
+	sftp_request_t *req;
+	sftp_attrib_t a;
+	unsigned int type, id, status, count, i;
+	char *data, *filename, *longname;
+	int len;
+
+	type = buffer_get_char(msg);
+	id = buffer_get_int(msg);
+
+	if (x == NULL || (req = sftp_request_lookup(x, id)) == NULL) {
+		sftp_syslog(pvar, "Unexpected SFTP reply (type %u, id %u)", type, id);
+		return;
+	}
+
+	switch (type) {
+	case SSH2_FXP_STATUS:
+		status = buffer_get_int(msg);
+		if (status == SSH2_FX_EOF &&
+		    (req->type == SSH2_FXP_READ || req->type == SSH2_FXP_READDIR)) {
+			x->eof = 1;
+		} else if (status != SSH2_FX_OK) {
+			sftp_console_message(pvar, c, "\"%s\": %s", x->remote, fx2txt(status));
+			sftp_xfer_fail(x);
+		} else if (req->type == SSH2_FXP_WRITE) {
+			x->done += req->len;
+		} else if (x->state == SFTP_XFER_STATUS || x->state == SFTP_XFER_CLOSE) {
+			x->state = SFTP_XFER_DONE;
+		}
 		break;
+
+	case SSH2_FXP_HANDLE:
+		if (x->state != SFTP_XFER_OPEN)
+			goto unexpected;
+		x->handle = buffer_get_string_msg(msg, &len);
+		x->handle_len = len;
+		if (x->cmd == I_GET) {
+			x->state = SFTP_XFER_FSTAT;
+			sftp_xfer_send_string(pvar, c, x, SSH2_FXP_FSTAT, x->handle, x->handle_len);
+		} else {
+			x->state = SFTP_XFER_DATA;
+		}
+		break;
+
+	case SSH2_FXP_ATTRS:
+		decode_attrib(msg, &a);
+		if (x->state == SFTP_XFER_FSTAT) {
+			x->size = (a.flags & SSH2_FILEXFER_ATTR_SIZE) ? a.size : 0;
+			x->state = SFTP_XFER_DATA;
+		} else if (x->state == SFTP_XFER_STAT) {
+			// S_IFMT/S_IFDIR POSIX̒lŔr
+			if (!(a.flags & SSH2_FILEXFER_ATTR_PERMISSIONS)) {
+				sftp_console_message(pvar, c, "Can't change directory: Can't check target");
+				sftp_xfer_fail(x);
+			} else if ((a.perm & 0170000) != 0040000) {
+				sftp_console_message(pvar, c, "Can't change directory: \"%s\" is not a directory", x->remote);
+				sftp_xfer_fail(x);
+			} else {
+				strncpy_s(c->sftp.pwd, sizeof(c->sftp.pwd), x->remote, _TRUNCATE);
+				x->state = SFTP_XFER_DONE;
+			}
+		} else {
+			goto unexpected;
+		}
+		break;
+
+	case SSH2_FXP_DATA:
+		if (req->type != SSH2_FXP_READ)
+			goto unexpected;
+		data = buffer_get_string_msg(msg, &len);
+		if (data == NULL || (unsigned int)len > req->len) {
+			sftp_console_message(pvar, c, "Received more data than asked for %u > %u", len, req->len);
+			sftp_xfer_fail(x);
+		} else {
+			// ͏sœ͂̂ŁAvʒuɏ
+			if (_fseeki64(x->fp, req->offset, SEEK_SET) != 0 ||
+			    fwrite(data, 1, len, x->fp) < (size_t)len) {
+				sftp_console_message(pvar, c, "Couldn't write to local file \"%s\"", x->local);
+				sftp_xfer_fail(x);
+			} else {
+				x->done += len;
+				if ((unsigned int)len < req->len) {
+					// vẐŁAcv
+					sftp_xfer_send_read(pvar, c, x, req->offset + len, req->len - len);
+				}
+			}
+		}
+		free(data);
+		break;
+
+	case SSH2_FXP_NAME:
+		count = buffer_get_int(msg);
+		if (x->state == SFTP_XFER_REALPATH) {
+			if (count != 1) {
+				sftp_console_message(pvar, c, "Got multiple names (%d) from SSH_FXP_REALPATH", count);
+				sftp_xfer_fail(x);
+				break;
+			}
+			filename = buffer_get_string_msg(msg, NULL);
+			longname = buffer_get_string_msg(msg, NULL);
+			strncpy_s(x->remote, sizeof(x->remote), filename, _TRUNCATE);
+			free(filename);
+			free(longname);
+			x->state = SFTP_XFER_STAT;
+			sftp_xfer_send_string(pvar, c, x, SSH2_FXP_STAT, x->remote, strlen(x->remote));
+		} else if (x->cmd == I_LS && x->state == SFTP_XFER_DATA) {
+			for (i = 0; i < count && buffer_remain_len(msg) > 0; i++) {
+				filename = buffer_get_string_msg(msg, NULL);
+				longname = buffer_get_string_msg(msg, NULL);
+				decode_attrib(msg, &a);
+				if (strcmp(filename, ".") != 0 && strcmp(filename, "..") != 0) {
+					sftp_console_message(pvar, c, "%s", longname);
+				}
+				free(filename);
+				free(longname);
+			}
+		} else {
+			goto unexpected;
+		}
+		break;
+
 	default:
-		return (CallWindowProc(hEditProc, hwnd, uMsg, wParam, lParam));
+		goto unexpected;
 	}
-	return 0L;
 
-cmd_parsed:
-	// R}hC
+	free(req);
+	sftp_xfer_step(pvar, c, x);
+	return;
+
+unexpected:
+	sftp_console_message(pvar, c, "Unexpected SFTP reply type %u", type);
+	free(req);
+	sftp_xfer_fail(x);
+	sftp_xfer_step(pvar, c, x);
+}
+
+// [gւ̗v𔺂R}hJn
+static void sftp_xfer_start(PTInstVar pvar, Channel_t *c, int cmdnum, char *path1, char *path2)
+{
+	sftp_xfer_t *x;
+	struct __stat64 st;
+	char *p;
+
+	x = calloc(1, sizeof(sftp_xfer_t));
+	if (x == NULL)
+		return;
+	x->cmd = cmdnum;
+	x->start_tick = GetTickCount();
+
+	switch (cmdnum) {
+	case I_GET:
+		sftp_make_absolute(c, path1, x->remote, sizeof(x->remote));
+		if (path2 == NULL) {
+			p = strrchr(path1, '/');
+			path2 = p ? p + 1 : path1;
+		}
+		sftp_make_local_absolute(path2, x->local, sizeof(x->local));
+		x->fp = fopen(x->local, "wb");
+		if (x->fp == NULL) {
+			sftp_console_message(pvar, c, "Couldn't open local file \"%s\" for writing", x->local);
+			goto error;
+		}
+		x->state = SFTP_XFER_OPEN;
+		sftp_xfer_send_open(pvar, c, x, SSH2_FXF_READ, -1);
+		break;
+
+	case I_PUT:
+		sftp_make_local_absolute(path1, x->local, sizeof(x->local));
+		if (path2 == NULL) {
+			p = strrchr(path1, '\\');
+			if (p == NULL)
+				p = strrchr(path1, '/');
+			path2 = p ? p + 1 : path1;
+		}
+		sftp_make_absolute(c, path2, x->remote, sizeof(x->remote));
+		x->fp = fopen(x->local, "rb");
+		if (x->fp == NULL || _stat64(x->local, &st) != 0) {
+			sftp_console_message(pvar, c, "Couldn't open local file \"%s\" for reading", x->local);
+			goto error;
+		}
+		x->size = st.st_size;
+		x->buf = malloc(c->sftp.transfer_buflen);
+		if (x->buf == NULL)
+			goto error;
+		x->state = SFTP_XFER_OPEN;
+		sftp_xfer_send_open(pvar, c, x, SSH2_FXF_WRITE | SSH2_FXF_CREAT | SSH2_FXF_TRUNC, 0644);
+		break;
+
+	case I_LS:
+		sftp_make_absolute(c, path1 ? path1 : ".", x->remote, sizeof(x->remote));
+		x->state = SFTP_XFER_OPEN;
+		sftp_xfer_send_string(pvar, c, x, SSH2_FXP_OPENDIR, x->remote, strlen(x->remote));
+		break;
+
+	case I_MKDIR:
+		sftp_make_absolute(c, path1, x->remote, sizeof(x->remote));
+		x->state = SFTP_XFER_STATUS;
+		sftp_xfer_send_mkdir(pvar, c, x);
+		break;
+
+	case I_RMDIR:
+	case I_RM:
+		sftp_make_absolute(c, path1, x->remote, sizeof(x->remote));
+		x->state = SFTP_XFER_STATUS;
+		sftp_xfer_send_string(pvar, c, x, cmdnum == I_RM ? SSH2_FXP_REMOVE : SSH2_FXP_RMDIR,
+		                      x->remote, strlen(x->remote));
+		break;
+
+	case I_RENAME:
+		sftp_make_absolute(c, path1, x->remote, sizeof(x->remote));
+		sftp_make_absolute(c, path2, x->remote2, sizeof(x->remote2));
+		x->state = SFTP_XFER_STATUS;
+		sftp_xfer_send_rename(pvar, c, x);
+		break;
+
+	case I_CHDIR:
+		sftp_make_absolute(c, path1, x->remote, sizeof(x->remote));
+		x->state = SFTP_XFER_REALPATH;
+		sftp_xfer_send_string(pvar, c, x, SSH2_FXP_REALPATH, x->remote, strlen(x->remote));
+		break;
+
+	default:
+		goto error;
+	}
+
+	c->sftp.xfer = x;
+	return;
+
+error:
+	sftp_xfer_free(x);
+}
+
+// R}hC߂ĎsB
+// R}hI notify Ɍ(Ȃ1)nB]Ȃǂ͉󂯂ĂIB
+static void sftp_execute(PTInstVar pvar, Channel_t *c, char *line, sftp_notify_t notify)
+{
+	char *cmd;
+	char *path1, *path2;
+	int pflag = 0, rflag = 0, lflag = 0, iflag = 0, hflag = 0, sflag = 0;
+	int cmdnum;
+	int result = 1;
+	unsigned long n_arg = 0;
+	char path_buf[MAX_PATH];
+
 	path1 = path2 = NULL;
-	cmd = buf;
+	cmd = line;
 	cmdnum = parse_args(&cmd, &pflag, &rflag, &lflag, &iflag, &hflag,
 		&sflag, &n_arg, &path1, &path2);
 
-	if (iflag != 0)
-		err_abort = 0;
-
-	//memset(&g, 0, sizeof(g));
-
 	/* Perform command */
 	switch (cmdnum) {
 	case 0:
@@ -861,216 +1350,122 @@ cmd_parsed:
 		break;
 	case -1:
 		/* Unrecognized command */
-		err = -1;
+		result = 0;
 		break;
-#if 0
 	case I_GET:
-		err = process_get(conn, path1, path2, *pwd, pflag, rflag);
-		break;
 	case I_PUT:
-		err = process_put(conn, path1, path2, *pwd, pflag, rflag);
-		break;
 	case I_RENAME:
-		path1 = make_absolute(path1, *pwd);
-		path2 = make_absolute(path2, *pwd);
-		err = do_rename(conn, path1, path2);
-		break;
-	case I_SYMLINK:
-		sflag = 1;
-	case I_LINK:
-		path1 = make_absolute(path1, *pwd);
-		path2 = make_absolute(path2, *pwd);
-		err = (sflag ? do_symlink : do_hardlink)(conn, path1, path2);
-		break;
 	case I_RM:
-		path1 = make_absolute(path1, *pwd);
-		remote_glob(conn, path1, GLOB_NOCHECK, NULL, &g);
-		for (i = 0; g.gl_pathv[i] && !interrupted; i++) {
-			printf("Removing %s\n", g.gl_pathv[i]);
-			err = do_rm(conn, g.gl_pathv[i]);
-			if (err != 0 && err_abort)
-				break;
-		}
-		break;
 	case I_MKDIR:
-		path1 = make_absolute(path1, *pwd);
-		attrib_clear(&a);
-		a.flags |= SSH2_FILEXFER_ATTR_PERMISSIONS;
-		a.perm = 0777;
-		err = do_mkdir(conn, path1, &a, 1);
-		break;
 	case I_RMDIR:
-		path1 = make_absolute(path1, *pwd);
-		err = do_rmdir(conn, path1);
-		break;
 	case I_CHDIR:
-		path1 = make_absolute(path1, *pwd);
-		if ((tmp = do_realpath(conn, path1)) == NULL) {
-			err = 1;
-			break;
-		}
-		if ((aa = do_stat(conn, tmp, 0)) == NULL) {
-			xfree(tmp);
-			err = 1;
-			break;
-		}
-		if (!(aa->flags & SSH2_FILEXFER_ATTR_PERMISSIONS)) {
-			error("Can't change directory: Can't check target");
-			xfree(tmp);
-			err = 1;
-			break;
-		}
-		if (!S_ISDIR(aa->perm)) {
-			error("Can't change directory: \"%s\" is not "
-			    "a directory", tmp);
-			xfree(tmp);
-			err = 1;
-			break;
-		}
-		xfree(*pwd);
-		*pwd = tmp;
-		break;
 	case I_LS:
-		if (!path1) {
-			do_ls_dir(conn, *pwd, *pwd, lflag);
-			break;
+		sftp_xfer_start(pvar, c, cmdnum, path1, path2);
+		if (c->sftp.xfer != NULL) {
+			c->sftp.xfer->notify = notify;
+			return;
 		}
-
-		/* Strip pwd off beginning of non-absolute paths */
-		tmp = NULL;
-		if (*path1 != '/')
-			tmp = *pwd;
-
-		path1 = make_absolute(path1, *pwd);
-		err = do_globbed_ls(conn, path1, tmp, lflag);
-		break;
-	case I_DF:
-		/* Default to current directory if no path specified */
-		if (path1 == NULL)
-			path1 = xstrdup(*pwd);
-		path1 = make_absolute(path1, *pwd);
-		err = do_df(conn, path1, hflag, iflag);
+		result = 0;
 		break;
 	case I_LCHDIR:
-		if (chdir(path1) == -1) {
-			error("Couldn't change local directory to "
-			    "\"%s\": %s", path1, strerror(errno));
-			err = 1;
+		sftp_make_local_absolute(path1, path_buf, sizeof(path_buf));
+		if (GetFileAttributes(path_buf) == INVALID_FILE_ATTRIBUTES ||
+		    !(GetFileAttributes(path_buf) & FILE_ATTRIBUTE_DIRECTORY)) {
+			sftp_console_message(pvar, c, "Couldn't change local directory to \"%s\"", path1);
+			result = 0;
+			break;
 		}
+		strncpy_s(sftp_lpwd, sizeof(sftp_lpwd), path_buf, _TRUNCATE);
 		break;
 	case I_LMKDIR:
-		if (mkdir(path1, 0777) == -1) {
-			error("Couldn't create local directory "
-			    "\"%s\": %s", path1, strerror(errno));
-			err = 1;
-		}
-		break;
-	case I_LLS:
-		local_do_ls(cmd);
-		break;
-	case I_SHELL:
-		local_do_shell(cmd);
-		break;
-	case I_LUMASK:
-		umask(n_arg);
-		printf("Local umask: %03lo\n", n_arg);
-		break;
-	case I_CHMOD:
-		path1 = make_absolute(path1, *pwd);
-		attrib_clear(&a);
-		a.flags |= SSH2_FILEXFER_ATTR_PERMISSIONS;
-		a.perm = n_arg;
-		remote_glob(conn, path1, GLOB_NOCHECK, NULL, &g);
-		for (i = 0; g.gl_pathv[i] && !interrupted; i++) {
-			printf("Changing mode on %s\n", g.gl_pathv[i]);
-			err = do_setstat(conn, g.gl_pathv[i], &a);
-			if (err != 0 && err_abort)
-				break;
-		}
-		break;
-	case I_CHOWN:
-	case I_CHGRP:
-		path1 = make_absolute(path1, *pwd);
-		remote_glob(conn, path1, GLOB_NOCHECK, NULL, &g);
-		for (i = 0; g.gl_pathv[i] && !interrupted; i++) {
-			if (!(aa = do_stat(conn, g.gl_pathv[i], 0))) {
-				if (err_abort) {
-					err = -1;
-					break;
-				} else
-					continue;
-			}
-			if (!(aa->flags & SSH2_FILEXFER_ATTR_UIDGID)) {
-				error("Can't get current ownership of "
-				    "remote file \"%s\"", g.gl_pathv[i]);
-				if (err_abort) {
-					err = -1;
-					break;
-				} else
-					continue;
-			}
-			aa->flags &= SSH2_FILEXFER_ATTR_UIDGID;
-			if (cmdnum == I_CHOWN) {
-				printf("Changing owner on %s\n", g.gl_pathv[i]);
-				aa->uid = n_arg;
-			} else {
-				printf("Changing group on %s\n", g.gl_pathv[i]);
-				aa->gid = n_arg;
-			}
-			err = do_setstat(conn, g.gl_pathv[i], aa);
-			if (err != 0 && err_abort)
-				break;
+		sftp_make_local_absolute(path1, path_buf, sizeof(path_buf));
+		if (_mkdir(path_buf) == -1) {
+			sftp_console_message(pvar, c, "Couldn't create local directory \"%s\"", path1);
+			result = 0;
 		}
 		break;
 	case I_PWD:
-		printf("Remote working directory: %s\n", *pwd);
+		sftp_console_message(pvar, c, "Remote working directory: %s", c->sftp.pwd);
 		break;
 	case I_LPWD:
-		if (!getcwd(path_buf, sizeof(path_buf))) {
-			error("Couldn't get local cwd: %s", strerror(errno));
-			err = -1;
-			break;
-		}
-		printf("Local working directory: %s\n", path_buf);
+		sftp_console_message(pvar, c, "Local working directory: %s", sftp_lpwd);
 		break;
-#endif
 	case I_QUIT:
-		/* Processed below */
+		ssh2_channel_send_close(pvar, c);
 		break;
 	case I_HELP:
 		help();
 		break;
 	case I_VERSION:
-		printf("SFTP protocol version %u\n", sftp_proto_version(&g_channel->sftp));
+		sftp_console_message(pvar, c, "SFTP protocol version %u", sftp_proto_version(&c->sftp));
 		break;
-#if 0
-	case I_PROGRESS:
-		showprogress = !showprogress;
-		if (showprogress)
-			printf("Progress meter enabled\n");
-		else
-			printf("Progress meter disabled\n");
+	default:
+		break;
+	}
+
+	if (notify != NULL)
+		notify(result);
+}
+
+// R}hsBZbV̊mOÕR}h̎sȂA҂sɓB
+static void sftp_run_command(PTInstVar pvar, Channel_t *c, char *line, sftp_notify_t notify)
+{
+	if (c->sftp.state != SFTP_REALPATH || c->sftp.xfer != NULL || sftp_cmd_head != NULL) {
+		sftp_queue_command(line, notify);
+		return;
+	}
+	sftp_execute(pvar, c, line, notify);
+}
+
+static void sftp_run_queued(PTInstVar pvar, Channel_t *c)
+{
+	sftp_cmdline_t *cmd;
+
+	while (sftp_cmd_head != NULL && c->sftp.xfer == NULL && c->used) {
+		cmd = sftp_cmd_head;
+		sftp_cmd_head = cmd->next;
+		if (sftp_cmd_head == NULL)
+			sftp_cmd_tail = NULL;
+		sftp_execute(pvar, c, cmd->line, cmd->notify);
+		free(cmd);
+	}
+}
+
+
+/*
+ * SFTP R}hCR\[
+ */
+static WNDPROC hEditProc;
+
+static LRESULT CALLBACK EditProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+	char buf[512];
+
+	switch (uMsg) {
+		case WM_KEYDOWN:
+		if ((int)wParam == VK_RETURN) {
+			GetWindowText(hwnd, buf, sizeof(buf));
+			SetWindowText(hwnd, "");
+			if (buf[0] != '\0') {
+				SendDlgItemMessage(GetParent(hwnd), IDC_SFTP_CONSOLE, EM_REPLACESEL, 0, (LPARAM) buf);
+				SendDlgItemMessage(GetParent(hwnd), IDC_SFTP_CONSOLE, EM_REPLACESEL, 0,
+								   (LPARAM) (char FAR *) "\r\n");
+				goto cmd_parsed;
+			}
+		}
 		break;
-#endif
 	default:
-		//fatal("%d is not implemented", cmdnum);
-		err = -1;
+		return (CallWindowProc(hEditProc, hwnd, uMsg, wParam, lParam));
 	}
+	return 0L;
 
-#if 0
-	if (g.gl_pathc)
-		globfree(&g);
-	if (path1)
-		xfree(path1);
-	if (path2)
-		xfree(path2);
-
-	/* If an unignored error occurs in batch mode we should abort. */
-	if (err_abort && err != 0)
-		return (-1);
-	else if (cmdnum == I_QUIT)
-		return (1);
-#endif
+cmd_parsed:
+	if (g_channel == NULL) {
+		SendDlgItemMessage(GetParent(hwnd), IDC_SFTP_CONSOLE, EM_REPLACESEL, 0,
+						   (LPARAM) (char FAR *) "Not connected.\r\n");
+		return 0L;
+	}
+	sftp_run_command(g_pvar, g_channel, buf, NULL);
 
 	return 0L;
 }
@@ -1152,22 +1547,17 @@ static LRESULT CALLBACK OnSftpConsoleDlgProc(HWND hDlgWnd, UINT msg, WPARAM wp,
 	return TRUE;
 }
 
-// SFTPM -Xe[g}V[-
-void sftp_response(PTInstVar pvar, Channel_t *c, unsigned char *data, unsigned int buflen)
+// MSFTPbZ[W -Xe[g}V[-
+static void sftp_dispatch(PTInstVar pvar, Channel_t *c, buffer_t *msg)
 {
-	buffer_t *msg;
 	HWND hDlgWnd;
 
-	/*
-	 * Allocate buffer
-	 */
-	sftp_buffer_alloc(&msg);
-	sftp_get_msg(pvar, c, data, buflen, &msg);
-
 	if (c->sftp.state == SFTP_INIT) {
 		// O[oϐɕۑB
 		g_pvar = pvar;
 		g_channel = c;
+		sftp_opening = 0;
+		strncpy_s(sftp_lpwd, sizeof(sftp_lpwd), pvar->ts->FileDir, _TRUNCATE);
 
 		sftp_do_init_recv(pvar, c, msg);
 
@@ -1185,9 +1575,98 @@ void sftp_response(PTInstVar pvar, Channel_t *c, unsigned char *data, unsigned i
 	} else if (c->sftp.state == SFTP_CONNECTED) {
 		char *remote_path;
 		remote_path = sftp_do_realpath_recv(pvar, c, msg);
+		if (remote_path != NULL) {
+			strncpy_s(c->sftp.pwd, sizeof(c->sftp.pwd), remote_path, _TRUNCATE);
+			free(remote_path);
+		}
 
 		c->sftp.state = SFTP_REALPATH;
 
+		// ڑOɎ󂯕tR}hsB
+		sftp_run_queued(pvar, c);
+
+	} else {
+		sftp_xfer_response(pvar, c, msg);
+
+	}
+}
+
+// SFTPM
+// bZ[W̋؂肪ȂȂƂ́Aȏ㑱Ȃ̂ŁA
+// sƑ҂s̃R}hׂĎsă`lB
+static void sftp_abort(PTInstVar pvar, Channel_t *c)
+{
+	if (c->sftp.xfer != NULL) {
+		if (c->sftp.xfer->notify != NULL)
+			c->sftp.xfer->notify(0);
+		sftp_xfer_free(c->sftp.xfer);
+		c->sftp.xfer = NULL;
+	}
+	if (g_channel == NULL || g_channel == c)
+		sftp_clear_commands();
+	buffer_clear(c->sftp.recvbuf);
+	ssh2_channel_send_close(pvar, c);
+}
+
+// SFTPbZ[W͕CHANNEL_DATAɕē͂A1CHANNEL_DATA
+// Ă肷̂ŁAbZ[Wŋ؂蒼Ă珈B
+void sftp_response(PTInstVar pvar, Channel_t *c, unsigned char *data, unsigned int buflen)
+{
+	buffer_t *msg;
+	char *p, *rest;
+	unsigned int len, pos, msg_len;
+
+	// ƌ߂`lɎc̃f[^͂Ăǂ܂Ȃ
+	if (c->state & (SSH_CHANNEL_STATE_CLOSE_SENT | SSH_CHANNEL_STATE_CLOSE_PENDING))
+		return;
+
+	if (c->sftp.recvbuf == NULL) {
+		c->sftp.recvbuf = buffer_init();
+		if (c->sftp.recvbuf == NULL)
+			return;
+	}
+	buffer_append(c->sftp.recvbuf, data, buflen);
+
+	/*
+	 * Allocate buffer
+	 */
+	sftp_buffer_alloc(&msg);
+
+	p = buffer_ptr(c->sftp.recvbuf);
+	len = buffer_len(c->sftp.recvbuf);
+	pos = 0;
+	while (len - pos >= 4) {
+		msg_len = get_uint32_MSBfirst(p + pos);
+		if (msg_len > SFTP_MAX_MSG_LENGTH) {
+			sftp_syslog(pvar, "Received message too long %u", msg_len);
+			sftp_console_message(pvar, c, "Received message too long %u, closing the SFTP session", msg_len);
+			sftp_abort(pvar, c);
+			sftp_buffer_free(msg);
+			return;
+		}
+		if (len - pos - 4 < msg_len)
+			break;
+
+		buffer_clear(msg);
+		buffer_append(msg, p + pos, msg_len + 4);
+		buffer_rewind(msg);
+		buffer_get_int(msg);
+		pos += msg_len + 4;
+
+		sftp_dispatch(pvar, c, msg);
+	}
+
+	// Ȃcobt@̐擪֋l߂
+	if (pos == len) {
+		buffer_clear(c->sftp.recvbuf);
+	} else if (pos > 0) {
+		rest = malloc(len - pos);
+		if (rest != NULL) {
+			memcpy(rest, p + pos, len - pos);
+			buffer_clear(c->sftp.recvbuf);
+			buffer_append(c->sftp.recvbuf, rest, len - pos);
+			free(rest);
+		}
 	}
 
 	/*
@@ -1195,3 +1674,44 @@ void sftp_response(PTInstVar pvar, Channel_t *c, unsigned char *data, unsigned i
 	 */
 	sftp_buffer_free(msg);
 }
+
+// SFTP`l̍폜ɌĂ΂
+void sftp_channel_free(Channel_t *c)
+{
+	if (c->sftp.xfer != NULL) {
+		if (c->sftp.xfer->notify != NULL)
+			c->sftp.xfer->notify(0);
+		sftp_xfer_free(c->sftp.xfer);
+		c->sftp.xfer = NULL;
+	}
+	if (c->sftp.recvbuf != NULL) {
+		buffer_free(c->sftp.recvbuf);
+		c->sftp.recvbuf = NULL;
+	}
+	if (g_channel == NULL || g_channel == c) {
+		g_channel = NULL;
+		sftp_opening = 0;
+		sftp_clear_commands();
+	}
+}
+
+// SFTPR}hsB}NĂ΂B
+// SFTPZbVȂΊJnAR}h̓ZbV̊mɎsB
+// R}hI notify Ă΂B
+int sftp_command(PTInstVar pvar, char *cmdline, sftp_notify_t notify)
+{
+	if (g_channel != NULL) {
+		sftp_run_command(pvar, g_channel, cmdline, notify);
+		return TRUE;
+	}
+
+	sftp_queue_command(cmdline, notify);
+	if (!sftp_opening) {
+		if (!SSH_sftp_transaction(pvar)) {
+			sftp_clear_commands();
+			return FALSE;
+		}
+		sftp_opening = 1;
+	}
+	return TRUE;
+}
@@ -105,7 +105,12 @@ OF SUCH DAMAGE.
 #define DEFAULT_COPY_BUFLEN 32768   /* Size of buffer for up/download */
 #define DEFAULT_NUM_REQUESTS    64  /* # concurrent outstanding requests */
 
+// R}h̏IʒmBresult ͐Ȃ1AsȂ0B
+typedef void (CALLBACK *sftp_notify_t)(int result);
+
 void sftp_do_init(PTInstVar pvar, Channel_t *c);
 void sftp_response(PTInstVar pvar, Channel_t *c, unsigned char *data, unsigned int buflen);
+void sftp_channel_free(Channel_t *c);
+int sftp_command(PTInstVar pvar, char *cmdline, sftp_notify_t notify);
 
 #endif
@@ -42,6 +42,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <openssl/md5.h>
 #include <limits.h>
 #include <malloc.h>
+#include <errno.h>
 #include <string.h>
 #include <stdlib.h>
 #include <process.h>
@@ -75,12 +76,22 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 
 // channel data structure
-#define CHANNEL_MAX 100
+// `l\͕KvɉĔ{XŊgA󂢂ԍ̓X^bNōėpB
+// SCPXbhȂǂ Channel_t ւ̃|C^ێĂ̂ŁAChannel_t 
+// 1mۂA\gĂړȂB
+#define CHANNEL_MAX 65536
+#define CHANNEL_TABLE_INITIAL 16
 
 
 static struct global_confirm global_confirms;
 
-static Channel_t channels[CHANNEL_MAX];
+static Channel_t **channels;       // self_id -> Channel_t
+static int channels_size;          // channels[] ̗vf
+static int channels_count;         // 蓖ĂƂ̂ self_id ̐
+static int *channel_free_ids;      // 󂢂Ă self_id ̃X^bN
+static int channel_free_count;
+static Channel_t **local_channels; // local_num(|[gtH[fBO) -> Channel_t
+static int local_channels_size;
 
 static char ssh_ttymodes[] = "\x01\x03\x02\x1c\x03\x08\x04\x15\x05\x04";
 
@@ -93,6 +104,8 @@ static BOOL handle_SSH2_kexinit(PTInstVar pvar);
 static void SSH2_dh_kex_init(PTInstVar pvar);
 static void SSH2_dh_gex_kex_init(PTInstVar pvar);
 static void SSH2_ecdh_kex_init(PTInstVar pvar);
+static void SSH2_curve25519_kex_init(PTInstVar pvar);
+static void take_prefetched_kex_key(PTInstVar pvar, DH **dh, EC_KEY **ecdh);
 static BOOL handle_SSH2_dh_common_reply(PTInstVar pvar);
 static BOOL handle_SSH2_dh_gex_reply(PTInstVar pvar);
 static BOOL handle_SSH2_newkeys(PTInstVar pvar);
@@ -121,7 +134,16 @@ void SSH2_dispatch_add_range_message(unsigned char begin, unsigned char end);
 int dh_pub_is_valid(DH *dh, BIGNUM *dh_pub);
 static void start_ssh_heartbeat_thread(PTInstVar pvar);
 void ssh2_channel_send_close(PTInstVar pvar, Channel_t *c);
+static void ssh2_channel_send_eof(PTInstVar pvar, Channel_t *c);
+static void ssh2_channel_delete(Channel_t *c);
+static void ssh2_channel_free_bufchain(Channel_t *c);
+static void ssh2_channel_delete_after_close(Channel_t *c);
+static void do_SSH2_adjust_window_size(PTInstVar pvar, Channel_t *c);
 static BOOL SSH_agent_response(PTInstVar pvar, Channel_t *c, int local_channel_num, unsigned char *data, unsigned int buflen);
+static void ssh2_scp_job_start(PTInstVar pvar);
+static void ssh2_scp_job_done(PTInstVar pvar);
+static void ssh2_scp_write_free(Channel_t *c);
+static void ssh2_scp_job_clear(PTInstVar pvar);
 
 //
 // Global request confirm
@@ -159,42 +181,100 @@ static int client_global_request_reply(PTInstVar pvar, int type, unsigned int se
 //
 // channel function
 //
+static BOOL ssh2_channel_grow_table(void)
+{
+	int newsize = channels_size ? channels_size * 2 : CHANNEL_TABLE_INITIAL;
+	Channel_t **newchannels;
+	int *newfree;
+
+	newchannels = realloc(channels, sizeof(Channel_t *) * newsize);
+	if (newchannels == NULL)
+		return FALSE;
+	memset(newchannels + channels_size, 0, sizeof(Channel_t *) * (newsize - channels_size));
+	channels = newchannels;
+
+	newfree = realloc(channel_free_ids, sizeof(int) * newsize);
+	if (newfree == NULL)
+		return FALSE;
+	channel_free_ids = newfree;
+
+	channels_size = newsize;
+	return TRUE;
+}
+
+static BOOL ssh2_local_channel_set(int local_num, Channel_t *c)
+{
+	if (local_num < 0)
+		return TRUE;
+
+	if (local_num >= local_channels_size) {
+		int newsize = max(local_num + 1, local_channels_size * 2);
+		Channel_t **newlocal = realloc(local_channels, sizeof(Channel_t *) * newsize);
+
+		if (newlocal == NULL)
+			return FALSE;
+		memset(newlocal + local_channels_size, 0, sizeof(Channel_t *) * (newsize - local_channels_size));
+		local_channels = newlocal;
+		local_channels_size = newsize;
+	}
+	local_channels[local_num] = c;
+	return TRUE;
+}
+
 static Channel_t *ssh2_channel_new(unsigned int window, unsigned int maxpack,
                                    enum confirm_type type, int local_num)
 {
-	int i, found;
+	int id;
 	Channel_t *c;
 
-	found = -1;
-	for (i = 0 ; i < CHANNEL_MAX ; i++) {
-		if (channels[i].used == 0) { // free channel
-			found = i;
-			break;
+	if (channel_free_count > 0) {
+		id = channel_free_ids[--channel_free_count];
+	} else {
+		if (channels_count >= CHANNEL_MAX) { // not free channel
+			return (NULL);
+		}
+		if (channels_count >= channels_size && !ssh2_channel_grow_table()) {
+			return (NULL);
+		}
+		id = channels_count;
+		if (channels[id] == NULL) {
+			channels[id] = malloc(sizeof(Channel_t));
+			if (channels[id] == NULL) {
+				return (NULL);
+			}
 		}
+		channels_count++;
 	}
-	if (found == -1) { // not free channel
+
+	c = channels[id];
+	if (!ssh2_local_channel_set(local_num, c)) {
+		channel_free_ids[channel_free_count++] = id;
 		return (NULL);
 	}
 
 	// setup
-	c = &channels[found];
 	memset(c, 0, sizeof(Channel_t));
 	c->used = 1;
-	c->self_id = i;
+	c->self_id = id;
 	c->remote_id = -1;
 	c->local_window = window;
 	c->local_window_max = window;
 	c->local_consumed = 0;
+	c->open_tick = GetTickCount();
+	c->window_adjust_tick = c->open_tick;
+	c->recv_rate = 0;
 	c->local_maxpacket = maxpack;
 	c->remote_window = 0;
 	c->remote_maxpacket = 0;
 	c->type = type;
 	c->local_num = local_num;  // alloc_channel()̕ԒlۑĂ
+	c->mux_num = -1;
 	c->bufchain = NULL;
 	if (type == TYPE_SCP) {
 		c->scp.state = SCP_INIT;
 		c->scp.progress_window = NULL;
 		c->scp.thread = (HANDLE)-1;
+		c->scp.window_event = CreateEvent(NULL, FALSE, FALSE, NULL);
 		c->scp.localfp = NULL;
 		c->scp.filemtime = 0;
 		c->scp.fileatime = 0;
@@ -208,64 +288,168 @@ static Channel_t *ssh2_channel_new(unsigned int window, unsigned int maxpack,
 	return (c);
 }
 
+// window JA܂͑M҂L[󂢂ƂAMXbh֒m点B
+static void ssh2_channel_notify_window(Channel_t *c)
+{
+	if (c->type == TYPE_SCP && c->scp.window_event != NULL) {
+		SetEvent(c->scp.window_event);
+	}
+}
+
 // remote_window̋󂫂ȂꍇɁAȂobt@Xgi͏jւȂłB
+//  bufchain_tail ŊoĂAXgH炸ɒǉB
 static void ssh2_channel_add_bufchain(Channel_t *c, unsigned char *buf, unsigned int buflen)
 {
-	bufchain_t *p, *old;
+	bufchain_t *p;
 
 	// allocate new buffer
 	p = malloc(sizeof(bufchain_t));
 	if (p == NULL)
 		return;
 	p->msg = buffer_init();
-	if (p == NULL) {
+	if (p->msg == NULL) {
 		free(p);
 		return;
 	}
 	buffer_put_raw(p->msg, buf, buflen);
 	p->next = NULL;
+	c->bufchain_amount += buflen;
 
 	if (c->bufchain == NULL) {
 		c->bufchain = p;
 	} else {
-		old = c->bufchain;
-		while (old->next)
-			old = old->next;
-		old->next = p;
+		c->bufchain_tail->next = p;
 	}
+	c->bufchain_tail = p;
 }
 
+// remote_window  remote_maxpacket Ɏ܂镪 SSH2_MSG_CHANNEL_DATA ƂđA
+// oCgԂB
+static unsigned int ssh2_channel_send_window(PTInstVar pvar, Channel_t *c, unsigned char FAR * buf, unsigned int buflen)
+{
+	unsigned char *outmsg;
+	unsigned int len, sent = 0;
+	char log[128];
+
+	while (sent < buflen) {
+		len = min(buflen - sent, c->remote_window);
+		if (c->remote_maxpacket > 0 && len > c->remote_maxpacket)
+			len = c->remote_maxpacket;
+		if (len == 0)
+			break;
+
+		// `lwb_ƃf[^𑗐MpPbgobt@֒ڑgݗĂB
+		// ÍMACvZ finish_send_packet() ̃obt@ōsB
+		outmsg = begin_send_packet(pvar, SSH2_MSG_CHANNEL_DATA, 4 + 4 + len);
+		set_uint32(outmsg, c->remote_id);
+		set_uint32(outmsg + 4, len);
+		memcpy(outmsg + 8, buf + sent, len);
+		finish_send_packet(pvar);
+
+		if (LOG_LEVEL_SSHDUMP <= pvar->session_settings.LogLevel) {
+			_snprintf_s(log, sizeof(log), _TRUNCATE, "SSH2_MSG_CHANNEL_DATA was sent at SSH2_send_channel_data(). local:%d remote:%d len:%u", c->self_id, c->remote_id, len);
+			notify_verbose_message(pvar, log, LOG_LEVEL_SSHDUMP);
+		}
+
+		// remote window size̒
+		c->remote_window -= len;
+		sent += len;
+	}
+
+	return sent;
+}
 
 static void ssh2_channel_retry_send_bufchain(PTInstVar pvar, Channel_t *c)
 {
 	bufchain_t *ch;
-	unsigned int size;
+	unsigned int size, sent;
+	BOOL congested;
+	char log[128];
+
+	// ͑Ȃ̂ŁAɌĂ΂܂ő҂B
+	if (pvar->rekeying)
+		return;
+
+	congested = (c->bufchain_amount >= CHAN_BUFCHAIN_MAX);
 
 	while (c->bufchain) {
-		// 擪ɑ
+		// 擪ɑBwindow Ɏ܂Ȃ̓`NɎcĂA񑱂瑗B
 		ch = c->bufchain;
-		size = buffer_len(ch->msg);
-		if (size >= c->remote_window)
+		size = buffer_remain_len(ch->msg);
+		sent = ssh2_channel_send_window(pvar, c, buffer_tail_ptr(ch->msg), size);
+		buffer_consume(ch->msg, sent);
+		c->bufchain_amount -= sent;
+		if (sent < size) {
+			if (c->window_stall_start == 0) {
+				c->window_stall_start = GetTickCount();
+				c->window_stall_count++;
+			}
 			break;
-
-		if (c->local_num == -1) { // shell or SCP
-			SSH2_send_channel_data(pvar, c, buffer_ptr(ch->msg), size, TRUE);
-		} else { // port-forwarding
-			SSH_channel_send(pvar, c->local_num, -1, buffer_ptr(ch->msg), size, TRUE);
 		}
 
 		c->bufchain = ch->next;
+		if (c->bufchain == NULL)
+			c->bufchain_tail = NULL;
 
 		buffer_free(ch->msg);
 		free(ch);
 	}
+
+	// cȂȂAwindow ҂̎ԂL^B
+	if (c->bufchain == NULL && c->window_stall_start != 0) {
+		DWORD stall = GetTickCount() - c->window_stall_start;
+
+		c->window_stall_total += stall;
+		c->window_stall_start = 0;
+		if (LOG_LEVEL_SSHDUMP <= pvar->session_settings.LogLevel) {
+			_snprintf_s(log, sizeof(log), _TRUNCATE, "channel window stall ended. local:%d remote:%d stall:%lums", c->self_id, c->remote_id, stall);
+			notify_verbose_message(pvar, log, LOG_LEVEL_SSHDUMP);
+		}
+	}
+
+	// L[󂢂̂ŁA~߂Ă[J\Pbg̓ǂݍ݂ĊJB
+	if (congested && c->bufchain_amount < CHAN_BUFCHAIN_MAX) {
+		if (c->type == TYPE_MUX) {
+			MUX_resume_read(pvar, c->mux_num);
+		} else if (c->local_num != -1) {
+			FWD_resume_local_read(pvar, c->local_num);
+		}
+	}
+
+	ssh2_channel_notify_window(c);
+
+	// f[^𑗂؂̂ŁA񂵂ɂĂ EOF/CLOSE 𑗂B
+	if (c->bufchain == NULL) {
+		if (c->state & SSH_CHANNEL_STATE_EOF_PENDING) {
+			ssh2_channel_send_eof(pvar, c);
+		}
+		if (c->state & SSH_CHANNEL_STATE_CLOSE_PENDING) {
+			ssh2_channel_send_close(pvar, c);
+		}
+		if ((c->state & SSH_CHANNEL_STATE_DELETE_PENDING) &&
+		    (c->state & SSH_CHANNEL_STATE_CLOSE_SENT)) {
+			ssh2_channel_delete(c);
+		}
+	}
 }
 
+// ɗ߂Ăf[^ÅɑS`lB
+static void ssh2_channel_retry_send_all_bufchain(PTInstVar pvar)
+{
+	int i;
 
+	for (i = 0 ; i < channels_count ; i++) {
+		if (channels[i]->used &&
+		    (channels[i]->bufchain ||
+		     (channels[i]->state & (SSH_CHANNEL_STATE_EOF_PENDING | SSH_CHANNEL_STATE_CLOSE_PENDING))))
+			ssh2_channel_retry_send_bufchain(pvar, channels[i]);
+	}
+}
 
-// channel closeɃ`l\̂Xg֕ԋp
-// (2007.4.26 yutaka)
-static void ssh2_channel_delete(Channel_t *c)
+
+
+// M҂L[̂Ă
+static void ssh2_channel_free_bufchain(Channel_t *c)
 {
 	bufchain_t *ch, *ptr;
 
@@ -277,9 +461,73 @@ static void ssh2_channel_delete(Channel_t *c)
 		ch = ch->next;
 		free(ptr);
 	}
+	c->bufchain = NULL;
+	c->bufchain_tail = NULL;
+	c->bufchain_amount = 0;
+}
+
+// CLOSE 𑗂`lB CLOSE ܂ĂȂ΁A
+// [J؂藣ĂACLOSE 𑗂ŉB
+static void ssh2_channel_delete_after_close(Channel_t *c)
+{
+	if (c->state & SSH_CHANNEL_STATE_CLOSE_SENT) {
+		ssh2_channel_delete(c);
+		return;
+	}
+
+	if (c->local_num >= 0 && c->local_num < local_channels_size &&
+	    local_channels[c->local_num] == c) {
+		local_channels[c->local_num] = NULL;
+	}
+	c->local_num = -1;
+	c->mux_num = -1;
+	c->state |= SSH_CHANNEL_STATE_DELETE_PENDING;
+}
+
+// channel closeɃ`l\̂Xg֕ԋp
+// (2007.4.26 yutaka)
+static void ssh2_channel_delete(Channel_t *c)
+{
+	PTInstVar scp_pvar = NULL;
+
+	// ]L[JnSCPIÃt@C̓]n߂
+	if (c->used && c->type == TYPE_SCP && c->scp.job) {
+		scp_pvar = c->scp.pvar;
+	}
+
+	// `lԍ󂫃X^bN֕Ԃ
+	if (c->used) {
+		if (c->local_num >= 0 && c->local_num < local_channels_size &&
+		    local_channels[c->local_num] == c) {
+			local_channels[c->local_num] = NULL;
+		}
+		channel_free_ids[channel_free_count++] = c->self_id;
+	}
+
+	ssh2_channel_free_bufchain(c);
 
 	if (c->type == TYPE_SCP) {
 		c->scp.state = SCP_CLOSING;
+		if (c->scp.progress_window != NULL) {
+			DestroyWindow(c->scp.progress_window);
+			c->scp.progress_window = NULL;
+		}
+		// window ҂̑MXbhAMf[^҂̏݃XbhNāAI
+		ssh2_channel_notify_window(c);
+		if (c->scp.write_event != NULL) {
+			SetEvent(c->scp.write_event);
+		}
+		if (c->scp.thread != (HANDLE)-1L) {
+			WaitForSingleObject(c->scp.thread, INFINITE);
+			CloseHandle(c->scp.thread);
+			c->scp.thread = (HANDLE)-1L;
+		}
+		if (c->scp.window_event != NULL) {
+			CloseHandle(c->scp.window_event);
+			c->scp.window_event = NULL;
+		}
+		ssh2_scp_write_free(c);
+		// XbhIĂ
 		if (c->scp.localfp != NULL) {
 			fclose(c->scp.localfp);
 			if (c->scp.dir == FROMREMOTE) {
@@ -291,46 +539,53 @@ static void ssh2_channel_delete(Channel_t *c)
 				}
 			}
 		}
-		if (c->scp.progress_window != NULL) {
-			DestroyWindow(c->scp.progress_window);
-			c->scp.progress_window = NULL;
-		}
-		if (c->scp.thread != (HANDLE)-1L) {
-			WaitForSingleObject(c->scp.thread, INFINITE);
-			CloseHandle(c->scp.thread);
-			c->scp.thread = (HANDLE)-1L;
-		}
 	}
 	if (c->type == TYPE_AGENT) {
 		buffer_free(c->agent_msg);
 	}
+	if (c->type == TYPE_SFTP) {
+		sftp_channel_free(c);
+	}
 
 	memset(c, 0, sizeof(Channel_t));
 	c->used = 0;
+
+	if (scp_pvar != NULL) {
+		ssh2_scp_job_done(scp_pvar);
+	}
 }
 
 
 // connection closeɌĂ΂
-void ssh2_channel_free(void)
+// Channel_t ͎̐ڑōėp邽߁AɎcĂB
+void ssh2_channel_free(PTInstVar pvar)
 {
 	int i;
 	Channel_t *c;
 
-	for (i = 0 ; i < CHANNEL_MAX ; i++) {
-		c = &channels[i];
+	// ؒfɑ҂sSCPJnȂ悤AɎ̂ĂĂ
+	ssh2_scp_job_clear(pvar);
+
+	for (i = 0 ; i < channels_count ; i++) {
+		c = channels[i];
 		ssh2_channel_delete(c);
 	}
 
+	channels_count = 0;
+	channel_free_count = 0;
+	if (local_channels != NULL) {
+		memset(local_channels, 0, sizeof(Channel_t *) * local_channels_size);
+	}
 }
 
 static Channel_t *ssh2_channel_lookup(int id)
 {
 	Channel_t *c;
 
-	if (id < 0 || id >= CHANNEL_MAX) {
+	if (id < 0 || id >= channels_count) {
 		return (NULL);
 	}
-	c = &channels[id];
+	c = channels[id];
 	if (c->used == 0) { // already freed
 		return (NULL);
 	}
@@ -342,15 +597,10 @@ static Channel_t *ssh2_channel_lookup(int id)
 // (2005.6.12 yutaka)
 static Channel_t *ssh2_local_channel_lookup(int local_num)
 {
-	int i;
-	Channel_t *c;
-
-	for (i = 0 ; i < CHANNEL_MAX ; i++) {
-		c = &channels[i];
-		if (c->local_num == local_num)
-			return (c);
+	if (local_num < 0 || local_num >= local_channels_size) {
+		return (NULL);
 	}
-	return (NULL);
+	return (local_channels[local_num]);
 }
 
 
@@ -747,6 +997,38 @@ static int prep_packet(PTInstVar pvar, char FAR * data, int len,
 
 		pvar->ssh_state.payload += padding;
 		pvar->ssh_state.payloadlen -= padding + 4;
+	} else if (CRYPT_is_receiver_aead(pvar)) {
+		// AEADÍł͔F؃^Ǒ؂ƕ𓯎ɍsB
+		// O͂ĂȂ̂ŁApfBO͕Ɏ蒼B
+		if (!CRYPT_decrypt_aead(pvar, pvar->ssh_state.receiver_sequence_number,
+		                        data, len)) {
+			UTIL_get_lang_msg("MSG_SSH_CORRUPTDATA_ERROR", pvar,
+			                  "Detected corrupted data; connection terminating.");
+			notify_fatal_error(pvar, pvar->ts->UIMsg, TRUE);
+			return SSH_MSG_NONE;
+		}
+		padding = (unsigned char) data[4];
+
+		pvar->ssh_state.payload++;
+		pvar->ssh_state.payloadlen -= padding + 1;
+	} else if (CRYPT_is_receiver_etm(pvar)) {
+		// Encrypt-then-MAC ł͈Íɑ΂ MAC ؂AȂΕB
+		// 񂳂ꂽpPbg͕ɔjłB
+		if (len % CRYPT_get_decryption_block_size(pvar) != 0 ||
+		    !CRYPT_verify_receiver_MAC
+			(pvar, pvar->ssh_state.receiver_sequence_number, data, len + 4,
+			 data + len + 4)) {
+			UTIL_get_lang_msg("MSG_SSH_CORRUPTDATA_ERROR", pvar,
+			                  "Detected corrupted data; connection terminating.");
+			notify_fatal_error(pvar, pvar->ts->UIMsg, TRUE);
+			return SSH_MSG_NONE;
+		}
+
+		CRYPT_decrypt(pvar, data + 4, len);
+		padding = (unsigned char) data[4];
+
+		pvar->ssh_state.payload++;
+		pvar->ssh_state.payloadlen -= padding + 1;
 	} else {
 		int already_decrypted = get_predecryption_amount(pvar);
 
@@ -800,8 +1082,10 @@ static int prep_packet(PTInstVar pvar, char FAR * data, int len,
 	} else {
 		// support of SSH2 packet compression (2005.7.9 yutaka)
 		// support of "Compression delayed" (2006.6.23 maya)
+		// support of "zstd@ttssh2.osdn.jp"
 		if ((pvar->stoc_compression == COMP_ZLIB ||
-		     pvar->stoc_compression == COMP_DELAYED && pvar->userauth_success) &&
+		     (pvar->stoc_compression == COMP_DELAYED || pvar->stoc_compression == COMP_ZSTD) &&
+		     pvar->userauth_success) &&
 		    pvar->ssh2_keys[MODE_IN].comp.enabled) { // compression enabled
 			int ret;
 
@@ -814,10 +1098,26 @@ static int prep_packet(PTInstVar pvar, char FAR * data, int len,
 			buffer_clear(pvar->decomp_buffer);
 
 			// packet sizepadding菜yC[ĥ݂WJB
-			ret = buffer_decompress(&pvar->ssh_state.decompress_stream,
-			                        pvar->ssh_state.payload,
-			                        pvar->ssh_state.payloadlen,
-			                        pvar->decomp_buffer);
+			if (pvar->stoc_compression == COMP_ZSTD) {
+				ret = buffer_decompress_zstd(pvar->ssh_state.zstd_decompress_stream,
+				                             pvar->ssh_state.payload,
+				                             pvar->ssh_state.payloadlen,
+				                             PACKET_MAX_SIZE,
+				                             pvar->decomp_buffer);
+				if (ret == -1) {
+					UTIL_get_lang_msg("MSG_SSH_INVALID_COMPDATA_ERROR", pvar,
+					                  "Invalid compressed data in received packet");
+					notify_fatal_error(pvar, pvar->ts->UIMsg, TRUE);
+					return SSH_MSG_NONE;
+				}
+				pvar->ssh_state.zstd_decompress_in += pvar->ssh_state.payloadlen;
+				pvar->ssh_state.zstd_decompress_out += buffer_len(pvar->decomp_buffer);
+			} else {
+				ret = buffer_decompress(&pvar->ssh_state.decompress_stream,
+				                        pvar->ssh_state.payload,
+				                        pvar->ssh_state.payloadlen,
+				                        pvar->decomp_buffer);
+			}
 
 			// |C^̍XVB
 			pvar->ssh_state.payload = buffer_ptr(pvar->decomp_buffer);
@@ -969,6 +1269,120 @@ error:
 #endif
 }
 
+// Kk̔Ԋu (kÕoCg)
+#define ADAPTIVE_COMP_WINDOW (256 * 1024)
+// oCpXɁȂƂɈkčĕ]
+#define ADAPTIVE_COMP_PROBE  16
+
+static LONGLONG adaptive_comp_clock(void)
+{
+	LARGE_INTEGER t;
+
+	QueryPerformanceCounter(&t);
+	return t.QuadPart;
+}
+
+static void adaptive_comp_init(PTInstVar pvar)
+{
+	SSHAdaptiveComp *ac = &pvar->ssh_state.adaptive_comp;
+
+	memset(ac, 0, sizeof(*ac));
+	ac->level = ac->deflate_level = pvar->ssh_state.compression_level;
+}
+
+// Kk: ς݂̃x𔽉fĂ爳kAkƈk̎ԂώZB
+static int adaptive_compress(PTInstVar pvar, char *payload, int len, buffer_t *msg)
+{
+	SSHAdaptiveComp *ac = &pvar->ssh_state.adaptive_comp;
+	int before = buffer_len(msg);
+	LONGLONG start = adaptive_comp_clock();
+	int ret;
+
+	if (pvar->ctos_compression == COMP_ZSTD) {
+		if (ac->level != ac->deflate_level) {
+			if (buffer_compress_zstd_level(pvar->ssh_state.zstd_compress_stream,
+			                               ac->level > 0 ? ac->level : ZSTD_minCLevel(), msg) == -1) {
+				return -1;
+			}
+			ac->deflate_level = ac->level;
+		}
+		ret = buffer_compress_zstd(pvar->ssh_state.zstd_compress_stream, payload, len, msg);
+		pvar->ssh_state.zstd_compress_in += len;
+		pvar->ssh_state.zstd_compress_out += buffer_len(msg) - before;
+	} else {
+		if (ac->level != ac->deflate_level) {
+			if (buffer_compress_level(&pvar->ssh_state.compress_stream, ac->level, msg) == -1) {
+				return -1;
+			}
+			ac->deflate_level = ac->level;
+		}
+		ret = buffer_compress(&pvar->ssh_state.compress_stream, payload, len, msg);
+	}
+
+	ac->comp_time += adaptive_comp_clock() - start;
+	ac->in += len;
+	ac->out += buffer_len(msg) - before;
+
+	return ret;
+}
+
+// Kk: MɊ|ԂώZAtɂȂ玟̃x߂B
+// ubLOMȂ̂ŁA\Pbgl܂(Nx)قǑMԂȂB
+static void adaptive_comp_update(PTInstVar pvar, LONGLONG send_time)
+{
+	SSHAdaptiveComp *ac = &pvar->ssh_state.adaptive_comp;
+	int level = ac->level;
+	double ratio, rate;
+	char buf[128];
+
+	ac->send_time += send_time;
+	if (ac->in < ADAPTIVE_COMP_WINDOW) {
+		return;
+	}
+
+	ratio = (double)ac->out / ac->in;
+	rate = (double)ac->in / max(ac->send_time, 1);
+
+	if (level == 0) {
+		// oCpX͈k𑪂Ȃ̂ŁAM[gƂ(NxȂ)A
+		// ̊ԊuňkĊJđ蒼B
+		ac->bypass_windows++;
+		if (rate < ac->bypass_rate / 2 || ac->bypass_windows >= ADAPTIVE_COMP_PROBE) {
+			level = 1;
+		}
+	} else if (ratio > 0.9) {
+		// قƂǏk܂Ȃf[^ (kς݂̃t@CȂ)
+		level = 0;
+	} else if (ac->comp_time > ac->send_time) {
+		// MkɎԂ|Ă (N)
+		if (level > 1) {
+			level--;
+		} else if (ratio > 0.5) {
+			level = 0;
+		}
+	} else if (ac->send_time > ac->comp_time * 4 &&
+	           level < pvar->ssh_state.compression_level) {
+		// MȂ̂ŁAkグ]n
+		level++;
+	}
+
+	if (level != ac->level) {
+		_snprintf_s(buf, sizeof(buf), _TRUNCATE,
+		            "adaptive compression: level %d -> %d (ratio %.2f)",
+		            ac->level, level, ratio);
+		notify_verbose_message(pvar, buf, LOG_LEVEL_VERBOSE);
+
+		if (level == 0) {
+			ac->bypass_rate = rate;
+			ac->bypass_windows = 0;
+		}
+		ac->level = level;
+	}
+
+	ac->in = ac->out = 0;
+	ac->comp_time = ac->send_time = 0;
+}
+
 /* if skip_compress is true, then the data has already been compressed
    into outbuf + 12 */
 void finish_send_packet_special(PTInstVar pvar, int skip_compress)
@@ -977,6 +1391,8 @@ void finish_send_packet_special(PTInstVar pvar, int skip_compress)
 	unsigned char FAR *data;
 	unsigned int data_length;
 	buffer_t *msg = NULL; // for SSH2 packet compression
+	BOOL adaptive = FALSE;
+	LONGLONG send_start;
 
 	if (pvar->ssh_state.compressing) {
 		if (!skip_compress) {
@@ -1025,6 +1441,7 @@ void finish_send_packet_special(PTInstVar pvar, int skip_compress)
 		int block_size = CRYPT_get_encryption_block_size(pvar);
 		unsigned int encryption_size;
 		unsigned int padding;
+		unsigned int aadlen;
 		BOOL ret;
 
 		/*
@@ -1045,8 +1462,10 @@ void finish_send_packet_special(PTInstVar pvar, int skip_compress)
 		 */
 		// pPbgkL̏ꍇApPbgkĂ瑗MpPbg\zB(2005.7.9 yutaka)
 		// support of "Compression delayed" (2006.6.23 maya)
+		// support of "zstd@ttssh2.osdn.jp"
 		if ((pvar->ctos_compression == COMP_ZLIB ||
-		     pvar->ctos_compression == COMP_DELAYED && pvar->userauth_success) &&
+		     (pvar->ctos_compression == COMP_DELAYED || pvar->ctos_compression == COMP_ZSTD) &&
+		     pvar->userauth_success) &&
 		    pvar->ssh2_keys[MODE_OUT].comp.enabled) {
 			// ̃obt@ packet-length(4) + padding(1) + payload(any) B
 			msg = buffer_init();
@@ -1057,7 +1476,18 @@ void finish_send_packet_special(PTInstVar pvar, int skip_compress)
 
 			// kΏۂ̓wb_yC[ĥ݁B
 			buffer_append(msg, "\0\0\0\0\0", 5);  // 5 = packet-length(4) + padding(1)
-			if (buffer_compress(&pvar->ssh_state.compress_stream, pvar->ssh_state.outbuf + 12, len, msg) == -1) {
+			if (pvar->session_settings.AdaptiveCompression) {
+				// kɍȂ΃xA܂͖kőB
+				adaptive = TRUE;
+				ret = adaptive_compress(pvar, pvar->ssh_state.outbuf + 12, len, msg);
+			} else if (pvar->ctos_compression == COMP_ZSTD) {
+				ret = buffer_compress_zstd(pvar->ssh_state.zstd_compress_stream, pvar->ssh_state.outbuf + 12, len, msg);
+				pvar->ssh_state.zstd_compress_in += len;
+				pvar->ssh_state.zstd_compress_out += buffer_len(msg) - 5;
+			} else {
+				ret = buffer_compress(&pvar->ssh_state.compress_stream, pvar->ssh_state.outbuf + 12, len, msg);
+			}
+			if (ret == -1) {
 				UTIL_get_lang_msg("MSG_SSH_COMP_ERROR", pvar,
 				                  "An error occurred while compressing packet data.\n"
 				                  "The connection will close.");
@@ -1087,8 +1517,11 @@ void finish_send_packet_special(PTInstVar pvar, int skip_compress)
 #else
 		// łpPbg𑗂낤ƂƁAT[o"Bad packet length"ɂȂĂ܂ւ̑ΏB
 		// (2007.10.29 yutaka)
+		// AEADÍ Encrypt-then-MAC ł packet-length(4) ͈ÍΏۊOȂ̂ŁA
+		// padding-length ȍ~ubNTCY̔{ɂȂ悤ɂB
 		encryption_size = 4 + 1 + len;
-		padding = block_size - (encryption_size % block_size);
+		aadlen = (CRYPT_is_sender_aead(pvar) || CRYPT_is_sender_etm(pvar)) ? 4 : 0;
+		padding = block_size - ((encryption_size - aadlen) % block_size);
 		if (padding < 4)
 			padding += block_size;
 		encryption_size += padding;
@@ -1104,19 +1537,42 @@ void finish_send_packet_special(PTInstVar pvar, int skip_compress)
 #endif
 		//if (pvar->ssh_state.outbuflen <= 7 + data_length) *(int *)0 = 0;
 		CRYPT_set_random_data(pvar, data + 5 + len, padding);
-		ret = CRYPT_build_sender_MAC(pvar,
-		                             pvar->ssh_state.sender_sequence_number,
-		                             data, encryption_size,
-		                             data + encryption_size);
-		if (ret == FALSE) { // MAC܂ݒ肳ĂȂꍇ
-			data_length = encryption_size;
-		}
+		if (CRYPT_is_sender_aead(pvar)) {
+			// ÍƓɔF؃^O data + encryption_size ɏށB
+			if (!CRYPT_encrypt_aead(pvar, pvar->ssh_state.sender_sequence_number,
+			                        data, encryption_size - 4)) {
+				buffer_free(msg);
+				return;
+			}
+		} else if (CRYPT_is_sender_etm(pvar)) {
+			// packet-length ȊOÍĂAÍɑ΂ MAC vZB
+			CRYPT_encrypt(pvar, data + 4, encryption_size - 4);
+			ret = CRYPT_build_sender_MAC(pvar,
+			                             pvar->ssh_state.sender_sequence_number,
+			                             data, encryption_size,
+			                             data + encryption_size);
+			if (ret == FALSE) { // MAC܂ݒ肳ĂȂꍇ
+				data_length = encryption_size;
+			}
+		} else {
+			ret = CRYPT_build_sender_MAC(pvar,
+			                             pvar->ssh_state.sender_sequence_number,
+			                             data, encryption_size,
+			                             data + encryption_size);
+			if (ret == FALSE) { // MAC܂ݒ肳ĂȂꍇ
+				data_length = encryption_size;
+			}
 
-		// pPbgÍBMACȍ~͈ÍΏۊOB
-		CRYPT_encrypt(pvar, data, encryption_size);
+			// pPbgÍBMACȍ~͈ÍΏۊOB
+			CRYPT_encrypt(pvar, data, encryption_size);
+		}
 	}
 
+	send_start = adaptive_comp_clock();
 	send_packet_blocking(pvar, data, data_length);
+	if (adaptive) {
+		adaptive_comp_update(pvar, adaptive_comp_clock() - send_start);
+	}
 
 	buffer_free(msg);
 
@@ -2288,6 +2744,27 @@ static void enable_send_compression(PTInstVar pvar)
 		} else {
 			pvar->ssh_state.compressing = TRUE;
 		}
+		adaptive_comp_init(pvar);
+	}
+
+	// zstd@ttssh2.osdn.jp ł zlib Ɠkx(1-9)̂܂ zstd ̃xƂĎgB
+	// zstd  1-9  zlib ̓x\ɍłB
+	if (SSHv2(pvar) && pvar->ctos_compression == COMP_ZSTD) {
+		if (pvar->ssh_state.zstd_compress_stream == NULL) {
+			pvar->ssh_state.zstd_compress_stream = ZSTD_createCStream();
+		} else {
+			ZSTD_CCtx_reset(pvar->ssh_state.zstd_compress_stream, ZSTD_reset_session_only);
+		}
+		if (pvar->ssh_state.zstd_compress_stream == NULL ||
+		    ZSTD_isError(ZSTD_CCtx_setParameter(pvar->ssh_state.zstd_compress_stream,
+		                                        ZSTD_c_compressionLevel,
+		                                        pvar->ssh_state.compression_level))) {
+			UTIL_get_lang_msg("MSG_SSH_SETUP_COMP_ERROR", pvar,
+			                  "An error occurred while setting up compression.\n"
+			                  "The connection will close.");
+			notify_fatal_error(pvar, pvar->ts->UIMsg, TRUE);
+			return;
+		}
 	}
 }
 
@@ -2321,6 +2798,25 @@ static void enable_recv_compression(PTInstVar pvar)
 		buf_ensure_size(&pvar->ssh_state.postdecompress_inbuf,
 		                &pvar->ssh_state.postdecompress_inbuflen, 1000);
 	}
+
+	if (SSHv2(pvar) && pvar->stoc_compression == COMP_ZSTD) {
+		if (pvar->ssh_state.zstd_decompress_stream == NULL) {
+			pvar->ssh_state.zstd_decompress_stream = ZSTD_createDStream();
+		} else {
+			ZSTD_DCtx_reset(pvar->ssh_state.zstd_decompress_stream, ZSTD_reset_session_only);
+		}
+		// 肪傫 window w肵ĂAWJɎg 8MB ܂łɗ}B
+		// kx 1-9  window  4MB ȉłB
+		if (pvar->ssh_state.zstd_decompress_stream == NULL ||
+		    ZSTD_isError(ZSTD_DCtx_setParameter(pvar->ssh_state.zstd_decompress_stream,
+		                                        ZSTD_d_windowLogMax, 23))) {
+			UTIL_get_lang_msg("MSG_SSH_SETUP_COMP_ERROR", pvar,
+			                  "An error occurred while setting up compression.\n"
+			                  "The connection will close.");
+			notify_fatal_error(pvar, pvar->ts->UIMsg, TRUE);
+			return;
+		}
+	}
 }
 
 static void enable_compression(PTInstVar pvar)
@@ -2731,6 +3227,8 @@ void SSH_init(PTInstVar pvar)
 	int i;
 
 	buf_create(&pvar->ssh_state.outbuf, &pvar->ssh_state.outbuflen);
+	buf_ensure_size(&pvar->ssh_state.outbuf, &pvar->ssh_state.outbuflen,
+	                SSH_OUTBUF_INITIAL_SIZE);
 	buf_create(&pvar->ssh_state.precompress_outbuf,
 	           &pvar->ssh_state.precompress_outbuflen);
 	buf_create(&pvar->ssh_state.postdecompress_inbuf,
@@ -2738,6 +3236,14 @@ void SSH_init(PTInstVar pvar)
 	pvar->ssh_state.payload = NULL;
 	pvar->ssh_state.compressing = FALSE;
 	pvar->ssh_state.decompressing = FALSE;
+	pvar->ssh_state.zstd_compress_stream = NULL;
+	pvar->ssh_state.zstd_decompress_stream = NULL;
+	pvar->ssh_state.zstd_compress_in = 0;
+	pvar->ssh_state.zstd_compress_out = 0;
+	pvar->ssh_state.zstd_decompress_in = 0;
+	pvar->ssh_state.zstd_decompress_out = 0;
+	memset(&pvar->ssh_state.kex_prefetch, 0, sizeof(pvar->ssh_state.kex_prefetch));
+	memset(&pvar->ssh_state.scp_queue, 0, sizeof(pvar->ssh_state.scp_queue));
 	pvar->ssh_state.status_flags =
 		STATUS_DONT_SEND_USER_NAME | STATUS_DONT_SEND_CREDENTIALS;
 	pvar->ssh_state.payload_datalen = 0;
@@ -2756,6 +3262,7 @@ void SSH_init(PTInstVar pvar)
 	pvar->settings.ssh_protocol_version = 2;  // SSH2(default)
 	pvar->rekeying = 0;
 	pvar->key_done = 0;
+	pvar->ssh2_rtt = 0;
 	pvar->ssh2_autologin = 0;  // autologin disabled(default)
 	pvar->ask4passwd = 0; // disabled(default) (2006.9.18 maya)
 	pvar->userauth_retry_count = 0;
@@ -2838,6 +3345,33 @@ void get_window_pixel_size(PTInstVar pvar, int *x, int *y)
 	return;
 }
 
+static void ssh2_send_window_change(PTInstVar pvar, Channel_t *c, int cols, int rows, int x, int y)
+{
+	buffer_t *msg;
+	char *s;
+	unsigned char *outmsg;
+	int len;
+
+	msg = buffer_init();
+	if (msg == NULL) {
+		// TODO: error check
+		return;
+	}
+	buffer_put_int(msg, c->remote_id);
+	s = "window-change";
+	buffer_put_string(msg, s, strlen(s));
+	buffer_put_char(msg, 0);  // wantconfirm
+	buffer_put_int(msg, cols);  // columns
+	buffer_put_int(msg, rows);  // lines
+	buffer_put_int(msg, x);  // window width (pixel):
+	buffer_put_int(msg, y);  // window height (pixel):
+	len = buffer_len(msg);
+	outmsg = begin_send_packet(pvar, SSH2_MSG_CHANNEL_REQUEST, len);
+	memcpy(outmsg, buffer_ptr(msg), len);
+	finish_send_packet(pvar);
+	buffer_free(msg);
+}
+
 void SSH_notify_win_size(PTInstVar pvar, int cols, int rows)
 {
 	int x, y;
@@ -2859,35 +3393,14 @@ void SSH_notify_win_size(PTInstVar pvar, int cols, int rows)
 
 	} else if (SSHv2(pvar)) { // ^[~iTCYύXʒm̒ǉ (2005.1.4 yutaka)
 		                      // SSH2ǂ̃`FbNsB(2005.1.5 yutaka)
-		buffer_t *msg;
-		char *s;
-		unsigned char *outmsg;
-		int len;
 		Channel_t *c;
 
 		c = ssh2_channel_lookup(pvar->shell_id);
 		if (c == NULL)
 			return;
 
-		msg = buffer_init();
-		if (msg == NULL) {
-			// TODO: error check
-			return;
-		}
-		buffer_put_int(msg, c->remote_id);
-		s = "window-change";
-		buffer_put_string(msg, s, strlen(s));
-		buffer_put_char(msg, 0);  // wantconfirm
-		buffer_put_int(msg, pvar->ssh_state.win_cols);  // columns
-		buffer_put_int(msg, pvar->ssh_state.win_rows);  // lines
 		get_window_pixel_size(pvar, &x, &y);
-		buffer_put_int(msg, x);  // window width (pixel):
-		buffer_put_int(msg, y);  // window height (pixel):
-		len = buffer_len(msg);
-		outmsg = begin_send_packet(pvar, SSH2_MSG_CHANNEL_REQUEST, len);
-		memcpy(outmsg, buffer_ptr(msg), len);
-		finish_send_packet(pvar);
-		buffer_free(msg);
+		ssh2_send_window_change(pvar, c, pvar->ssh_state.win_cols, pvar->ssh_state.win_rows, x, y);
 
 		notify_verbose_message(pvar, "SSH2_MSG_CHANNEL_REQUEST was sent at SSH_notify_win_size().", LOG_LEVEL_VERBOSE);
 
@@ -2962,15 +3475,28 @@ int SSH_get_min_packet_size(PTInstVar pvar)
    at least 5 bytes must be decrypted */
 void SSH_predecrpyt_packet(PTInstVar pvar, char FAR * data)
 {
-	if (SSHv2(pvar)) {
+	// AEADÍł̓pPbgŜMĂF؃^O؂̂ŁAO͂ȂB
+	// Encrypt-then-MAC ł packet-length Ȃ̂ŁAO͂ȂB
+	if (SSHv2(pvar) && !CRYPT_is_receiver_aead(pvar) && !CRYPT_is_receiver_etm(pvar)) {
 		CRYPT_decrypt(pvar, data, get_predecryption_amount(pvar));
 	}
 }
 
-int SSH_get_clear_MAC_size(PTInstVar pvar)
+// MpPbg̐擪ɂ packet-length Ԃ (SSH2)
+uint32 SSH_get_packet_length(PTInstVar pvar, char FAR * data)
 {
-	if (SSHv1(pvar)) {
-		return 0;
+	if (SSHv2(pvar) && CRYPT_is_receiver_aead(pvar)) {
+		return CRYPT_get_aead_packet_length(pvar,
+		                                    pvar->ssh_state.receiver_sequence_number,
+		                                    data);
+	}
+	return get_uint32_MSBfirst(data);
+}
+
+int SSH_get_clear_MAC_size(PTInstVar pvar)
+{
+	if (SSHv1(pvar)) {
+		return 0;
 	} else {
 		return CRYPT_get_receiver_MAC_size(pvar);
 	}
@@ -3093,11 +3619,17 @@ void SSH_get_compression_info(PTInstVar pvar, char FAR * dest, int len)
 	// support of "Compression delayed" (2006.6.23 maya)
 	if (pvar->ssh_state.compressing ||
 		pvar->ctos_compression == COMP_ZLIB ||
-		pvar->ctos_compression == COMP_DELAYED && pvar->userauth_success) {
+		(pvar->ctos_compression == COMP_DELAYED || pvar->ctos_compression == COMP_ZSTD) &&
+		pvar->userauth_success) {
 		unsigned long total_in = pvar->ssh_state.compress_stream.total_in;
 		unsigned long total_out =
 			pvar->ssh_state.compress_stream.total_out;
 
+		if (pvar->ctos_compression == COMP_ZSTD) {
+			total_in = pvar->ssh_state.zstd_compress_in;
+			total_out = pvar->ssh_state.zstd_compress_out;
+		}
+
 		if (total_out > 0) {
 			UTIL_get_lang_msg("DLG_ABOUT_COMP_INFO", pvar,
 			                  "level %d; ratio %.1f (%ld:%ld)");
@@ -3110,6 +3642,20 @@ void SSH_get_compression_info(PTInstVar pvar, char FAR * dest, int len)
 			_snprintf_s(buf, sizeof(buf), _TRUNCATE, pvar->ts->UIMsg,
 			            pvar->ssh_state.compression_level);
 		}
+
+		// Kǩ݂̏
+		if (SSHv2(pvar) && pvar->session_settings.AdaptiveCompression) {
+			if (pvar->ssh_state.adaptive_comp.level > 0) {
+				UTIL_get_lang_msg("DLG_ABOUT_COMP_ADAPTIVE", pvar, "adaptive, currently level %d");
+				_snprintf_s(buf2, sizeof(buf2), _TRUNCATE, pvar->ts->UIMsg,
+				            pvar->ssh_state.adaptive_comp.level);
+			} else {
+				UTIL_get_lang_msg("DLG_ABOUT_COMP_BYPASS", pvar, "adaptive, currently bypassed");
+				strncpy_s(buf2, sizeof(buf2), pvar->ts->UIMsg, _TRUNCATE);
+			}
+			strncat_s(buf, sizeof(buf), "; ", _TRUNCATE);
+			strncat_s(buf, sizeof(buf), buf2, _TRUNCATE);
+		}
 	} else {
 		UTIL_get_lang_msg("DLG_ABOUT_COMP_NONE", pvar, "none");
 		strncpy_s(buf, sizeof(buf), pvar->ts->UIMsg, _TRUNCATE);
@@ -3118,12 +3664,18 @@ void SSH_get_compression_info(PTInstVar pvar, char FAR * dest, int len)
 	// support of "Compression delayed" (2006.6.23 maya)
 	if (pvar->ssh_state.decompressing ||
 		pvar->stoc_compression == COMP_ZLIB ||
-		pvar->stoc_compression == COMP_DELAYED && pvar->userauth_success) {
+		(pvar->stoc_compression == COMP_DELAYED || pvar->stoc_compression == COMP_ZSTD) &&
+		pvar->userauth_success) {
 		unsigned long total_in =
 			pvar->ssh_state.decompress_stream.total_in;
 		unsigned long total_out =
 			pvar->ssh_state.decompress_stream.total_out;
 
+		if (pvar->stoc_compression == COMP_ZSTD) {
+			total_in = pvar->ssh_state.zstd_decompress_in;
+			total_out = pvar->ssh_state.zstd_decompress_out;
+		}
+
 		if (total_in > 0) {
 			UTIL_get_lang_msg("DLG_ABOUT_COMP_INFO", pvar,
 			                  "level %d; ratio %.1f (%ld:%ld)");
@@ -3146,6 +3698,41 @@ void SSH_get_compression_info(PTInstVar pvar, char FAR * dest, int len)
 	_snprintf_s(dest, len, _TRUNCATE, pvar->ts->UIMsg, buf, buf2);
 }
 
+// e`l̎Mwindow ƒ߂̎M[g (About _CAOp)
+void SSH_get_channel_info(PTInstVar pvar, char FAR * dest, int len)
+{
+	static const char *type_names[] = {
+		"session", "forward", "scp", "sftp", "agent", "mux",
+	};
+	char buf[128];
+	int i, shown = 0, rest = 0;
+	Channel_t *c;
+
+	dest[0] = '\0';
+	for (i = 0 ; i < channels_count ; i++) {
+		c = channels[i];
+		if (!c->used)
+			continue;
+		if (shown >= 16) {
+			rest++;
+			continue;
+		}
+		UTIL_get_lang_msg("DLG_ABOUT_CHANNEL_INFO", pvar, "#%d %s: window %u KB, %u KB/s");
+		_snprintf_s(buf, sizeof(buf), _TRUNCATE, pvar->ts->UIMsg,
+		            c->self_id, type_names[c->type],
+		            c->local_window_max / 1024, c->recv_rate / 1024);
+		strncat_s(dest, len, "\r\n    ", _TRUNCATE);
+		strncat_s(dest, len, buf, _TRUNCATE);
+		shown++;
+	}
+	if (rest > 0) {
+		UTIL_get_lang_msg("DLG_ABOUT_CHANNEL_MORE", pvar, "(%d more)");
+		_snprintf_s(buf, sizeof(buf), _TRUNCATE, pvar->ts->UIMsg, rest);
+		strncat_s(dest, len, "\r\n    ", _TRUNCATE);
+		strncat_s(dest, len, buf, _TRUNCATE);
+	}
+}
+
 void SSH_get_server_ID_info(PTInstVar pvar, char FAR * dest, int len)
 {
 	strncpy_s(dest, len,
@@ -3212,6 +3799,22 @@ void SSH_end(PTInstVar pvar)
 		inflateEnd(&pvar->ssh_state.decompress_stream);
 		pvar->ssh_state.decompressing = FALSE;
 	}
+	// support of "zstd@ttssh2.osdn.jp"
+	if (pvar->ssh_state.zstd_compress_stream != NULL) {
+		ZSTD_freeCStream(pvar->ssh_state.zstd_compress_stream);
+		pvar->ssh_state.zstd_compress_stream = NULL;
+	}
+	if (pvar->ssh_state.zstd_decompress_stream != NULL) {
+		ZSTD_freeDStream(pvar->ssh_state.zstd_decompress_stream);
+		pvar->ssh_state.zstd_decompress_stream = NULL;
+	}
+	pvar->ssh_state.zstd_compress_in = 0;
+	pvar->ssh_state.zstd_compress_out = 0;
+	pvar->ssh_state.zstd_decompress_in = 0;
+	pvar->ssh_state.zstd_decompress_out = 0;
+
+	// gȂš̂Ă
+	take_prefetched_kex_key(pvar, NULL, NULL);
 
 #if 1
 	// SSH2̃f[^ (2004.12.27 yutaka)
@@ -3224,6 +3827,7 @@ void SSH_end(PTInstVar pvar)
 			EC_KEY_free(pvar->ecdh_client_key);
 			pvar->ecdh_client_key = NULL;
 		}
+		SecureZeroMemory(pvar->curve25519_client_key, sizeof(pvar->curve25519_client_key));
 		memset(pvar->server_version_string, 0, sizeof(pvar->server_version_string));
 		memset(pvar->client_version_string, 0, sizeof(pvar->client_version_string));
 
@@ -3287,22 +3891,19 @@ void SSH_end(PTInstVar pvar)
 
 void SSH2_send_channel_data(PTInstVar pvar, Channel_t *c, unsigned char FAR * buf, unsigned int buflen, int retry)
 {
-	buffer_t *msg;
-	unsigned char *outmsg;
-	unsigned int len;
-	char log[128];
-
-	// SSH2̏ꍇApPbĝĂB(2005.6.19 yutaka)
-	if (pvar->rekeying) {
-		// TODO: zƂĂ̓pPbgjł͂ȂApPbgǂݎxɂƂ낾A
-		// ƂɂB
-		c = NULL;
+	unsigned int sent;
 
+	if (c == NULL)
 		return;
-	}
 
-	if (c == NULL)
+	// SSH2̓pPbg𑗂Ȃ̂ŁAf[^̂ĂɃL[֐ςłB
+	// ̊ handle_SSH2_newkeys() 珇ɑB
+	if (pvar->rekeying) {
+		if (retry == 0) {
+			ssh2_channel_add_bufchain(c, buf, buflen);
+		}
 		return;
+	}
 
 	// gCł͂ȂAʏ̃pPbgM̍ہAȑOȂf[^
 	// NhXgɎcĂ悤ł΁AXg̖ɌqB
@@ -3313,39 +3914,14 @@ void SSH2_send_channel_data(PTInstVar pvar, Channel_t *c, unsigned char FAR * bu
 		return;
 	}
 
-	if ((unsigned int)buflen > c->remote_window) {
-		unsigned int offset = 0;
-		// Ȃf[^͂ۑĂ
-		ssh2_channel_add_bufchain(c, buf + offset, buflen - offset);
-		buflen = offset;
-		return;
-	}
-	if (buflen > 0) {
-		msg = buffer_init();
-		if (msg == NULL) {
-			// TODO: error check
-			return;
-		}
-		buffer_put_int(msg, c->remote_id);
-		buffer_put_string(msg, (char *)buf, buflen);
-
-		len = buffer_len(msg);
-		outmsg = begin_send_packet(pvar, SSH2_MSG_CHANNEL_DATA, len);
-		//if (len + 12 >= pvar->ssh_state.outbuflen) *(int *)0 = 0;
-		memcpy(outmsg, buffer_ptr(msg), len);
-		finish_send_packet(pvar);
-		buffer_free(msg);
-		//debug_print(1, pvar->ssh_state.outbuf, 7 + 4 + 1 + 1 + len);
-
-		_snprintf_s(log, sizeof(log), _TRUNCATE, "SSH2_MSG_CHANNEL_DATA was sent at SSH2_send_channel_data(). local:%d remote:%d", c->self_id, c->remote_id);
-		notify_verbose_message(pvar, log, LOG_LEVEL_SSHDUMP);
-
-		// remote window size̒
-		if (buflen <= c->remote_window) {
-			c->remote_window -= buflen;
-		}
-		else {
-			c->remote_window = 0;
+	// window  maxpacket ɍ킹ĕđAȂ
+	// window J܂ŃL[֐ςłB
+	sent = ssh2_channel_send_window(pvar, c, buf, buflen);
+	if (sent < buflen) {
+		ssh2_channel_add_bufchain(c, buf + sent, buflen - sent);
+		if (c->window_stall_start == 0) {
+			c->window_stall_start = GetTickCount();
+			c->window_stall_count++;
 		}
 	}
 }
@@ -3405,6 +3981,17 @@ void SSH_channel_send(PTInstVar pvar, int channel_num,
 
 }
 
+BOOL SSH_channel_is_congested(PTInstVar pvar, int channel_num)
+{
+	Channel_t *c;
+
+	if (SSHv1(pvar))
+		return FALSE;
+
+	c = ssh2_local_channel_lookup(channel_num);
+	return (c != NULL && c->bufchain_amount >= CHAN_BUFCHAIN_MAX);
+}
+
 void SSH_fail_channel_open(PTInstVar pvar, uint32 remote_channel_num)
 {
 	if (SSHv1(pvar)) {
@@ -3509,25 +4096,37 @@ void SSH_channel_output_eof(PTInstVar pvar, uint32 remote_channel_num)
 	}
 }
 
+// EOF ͑M҂L[̃f[^ɓ͂Ȃ΂ȂȂBL[
+// f[^cĂԂ́AL[󂢂Ƃ ssh2_channel_retry_send_bufchain() 瑗B
 void SSH2_channel_input_eof(PTInstVar pvar, Channel_t *c)
 {
-	buffer_t *msg;
-	unsigned char *outmsg;
-	int len;
 	char log[128];
 
 	if (c == NULL)
 		return;
 
-	// SSH2̏ꍇApPbĝĂB(2005.6.21 yutaka)
-	if (pvar->rekeying) {
-		// TODO: zƂĂ̓pPbgjł͂ȂApPbgǂݎxɂƂ낾A
-		// ƂɂB
-		c = NULL;
+	if (c->state & (SSH_CHANNEL_STATE_EOF_PENDING | SSH_CHANNEL_STATE_CLOSE_SENT))
+		return;
 
+	if (pvar->rekeying || c->bufchain) {
+		c->state |= SSH_CHANNEL_STATE_EOF_PENDING;
+		_snprintf_s(log, sizeof(log), _TRUNCATE, "SSH2_MSG_CHANNEL_EOF is deferred until queued data is sent. local:%d remote:%d", c->self_id, c->remote_id);
+		notify_verbose_message(pvar, log, LOG_LEVEL_VERBOSE);
 		return;
 	}
 
+	ssh2_channel_send_eof(pvar, c);
+}
+
+static void ssh2_channel_send_eof(PTInstVar pvar, Channel_t *c)
+{
+	buffer_t *msg;
+	unsigned char *outmsg;
+	int len;
+	char log[128];
+
+	c->state &= ~SSH_CHANNEL_STATE_EOF_PENDING;
+
 	msg = buffer_init();
 	if (msg == NULL) {
 		// TODO: error check
@@ -3840,7 +4439,7 @@ void SSH_open_channel(PTInstVar pvar, uint32 local_channel_num,
 //
 // (2007.12.21 yutaka)
 //
-int SSH_scp_transaction(PTInstVar pvar, char *sendfile, char *dstfile, enum scp_dir direction)
+static Channel_t *ssh2_scp_open(PTInstVar pvar, char *sendfile, char *dstfile, enum scp_dir direction)
 {
 	buffer_t *msg;
 	char *s;
@@ -3958,7 +4557,7 @@ int SSH_scp_transaction(PTInstVar pvar, char *sendfile, char *dstfile, enum scp_
 
 	notify_verbose_message(pvar, "SSH2_MSG_CHANNEL_OPEN was sent at SSH_scp_transaction().", LOG_LEVEL_VERBOSE);
 
-	return TRUE;
+	return c;
 
 error:
 	if (c != NULL)
@@ -3966,7 +4565,169 @@ error:
 	if (fp != NULL)
 		fclose(fp);
 
-	return FALSE;
+	return NULL;
+}
+
+//
+// SCP]L[ (pvar->ssh_state.scp_queue)
+//
+// `lƂ́Ȁł͎̃t@CJnAn[gr[gp
+// _CAOփbZ[W𑗂ĊJn˗Bssh2_channel_delete() 
+// `l\𑖍ĂŒɂĂ΂̂ŁAŐV`l
+// JƁÃXbgėpĂ܂߁B
+//
+#define WM_SCP_JOB_NEXT (WM_USER + 2)
+
+static void ssh2_scp_job_begin(Channel_t *c, PTInstVar pvar)
+{
+	SSHScpQueue *q = &pvar->ssh_state.scp_queue;
+
+	c->scp.pvar = pvar;
+	c->scp.job = 1;
+	q->running++;
+	if (c->scp.dir == TOREMOTE) {
+		q->batch_size += c->scp.filestat.st_size;
+	}
+}
+
+// 󂢂ĂXg[̐A҂s񂩂t@C̓]JnB
+static void ssh2_scp_job_start(PTInstVar pvar)
+{
+	SSHScpQueue *q = &pvar->ssh_state.scp_queue;
+	scp_job_t *job;
+	Channel_t *c;
+
+	q->start_posted = FALSE;
+	while (q->head != NULL && q->running < max(1, pvar->settings.ScpParallel)) {
+		job = q->head;
+		q->head = job->next;
+		if (q->head == NULL)
+			q->tail = NULL;
+
+		c = ssh2_scp_open(pvar, job->src, job->dst, job->dir);
+		if (c != NULL) {
+			ssh2_scp_job_begin(c, pvar);
+		} else {
+			q->batch_done++;
+		}
+		free(job);
+	}
+}
+
+// SCP`lꂽƂɌĂ΂
+static void ssh2_scp_job_done(PTInstVar pvar)
+{
+	SSHScpQueue *q = &pvar->ssh_state.scp_queue;
+
+	if (q->running > 0)
+		q->running--;
+	q->batch_done++;
+
+	if (q->head != NULL && !q->start_posted) {
+		if (PostMessage(pvar->ssh_hearbeat_dialog, WM_SCP_JOB_NEXT, (WPARAM)pvar, 0)) {
+			q->start_posted = TRUE;
+		}
+	}
+}
+
+static void ssh2_scp_job_clear(PTInstVar pvar)
+{
+	SSHScpQueue *q = &pvar->ssh_state.scp_queue;
+	scp_job_t *job;
+
+	while (q->head != NULL) {
+		job = q->head;
+		q->head = job->next;
+		free(job);
+	}
+	q->tail = NULL;
+	q->running = 0;
+	q->start_posted = FALSE;
+}
+
+// ]f[^ʂvɉAt@C̓]͍v̐i
+// iEBhẼ^Cgɕ\BCXbhĂԂƁB
+static void ssh2_scp_job_progress(Channel_t *c, unsigned int len)
+{
+	SSHScpQueue *q;
+	char title[128];
+	int rate;
+
+	if (!c->scp.job)
+		return;
+
+	q = &c->scp.pvar->ssh_state.scp_queue;
+	q->batch_xfer += len;
+	if (q->batch_files <= 1 || c->scp.progress_window == NULL)
+		return;
+
+	if (q->batch_size > 0) {
+		rate = (int)(100 * min(q->batch_xfer, q->batch_size) / q->batch_size);
+	} else {
+		rate = 0;
+	}
+	if (rate == q->batch_rate)
+		return;
+	q->batch_rate = rate;
+
+	_snprintf_s(title, sizeof(title), _TRUNCATE, "TTSSH: SCP %s file (%d/%d files done, total %d%%)",
+	            c->scp.dir == TOREMOTE ? "sending" : "receiving",
+	            q->batch_done, q->batch_files, rate);
+	SetWindowText(c->scp.progress_window, title);
+}
+
+int SSH_scp_transaction(PTInstVar pvar, char *sendfile, char *dstfile, enum scp_dir direction)
+{
+	SSHScpQueue *q = &pvar->ssh_state.scp_queue;
+	scp_job_t *job;
+	Channel_t *c;
+
+	// \PbgN[YĂꍇ͉ȂB
+	if (pvar->socket == INVALID_SOCKET)
+		return FALSE;
+
+	if (SSHv1(pvar))      // SSH1T|[gTBD
+		return FALSE;
+
+	// O̓]SIĂ΁Av̐i𐔂
+	if (q->running == 0 && q->head == NULL) {
+		q->batch_files = 0;
+		q->batch_done = 0;
+		q->batch_size = 0;
+		q->batch_xfer = 0;
+		q->batch_rate = -1;
+	}
+
+	// 󂢂ĂXg[΁AɊJn
+	if (q->head == NULL && q->running < max(1, pvar->settings.ScpParallel)) {
+		c = ssh2_scp_open(pvar, sendfile, dstfile, direction);
+		if (c == NULL)
+			return FALSE;
+		ssh2_scp_job_begin(c, pvar);
+		q->batch_files++;
+		return TRUE;
+	}
+
+	job = malloc(sizeof(scp_job_t));
+	if (job == NULL)
+		return FALSE;
+	job->dir = direction;
+	strncpy_s(job->src, sizeof(job->src), sendfile, _TRUNCATE);
+	if (dstfile != NULL) {
+		strncpy_s(job->dst, sizeof(job->dst), dstfile, _TRUNCATE);
+	} else {
+		job->dst[0] = '\0';
+	}
+	job->next = NULL;
+	if (q->tail != NULL) {
+		q->tail->next = job;
+	} else {
+		q->head = job;
+	}
+	q->tail = job;
+	q->batch_files++;
+
+	return TRUE;
 }
 
 int SSH_start_scp(PTInstVar pvar, char *sendfile, char *dstfile)
@@ -3998,7 +4759,8 @@ int SSH_sftp_transaction(PTInstVar pvar)
 		goto error;
 
 	// `lݒ
-	c = ssh2_channel_new(CHAN_SES_WINDOW_DEFAULT, CHAN_SES_PACKET_DEFAULT, TYPE_SFTP, -1);
+	// READvsđ̂ŁẢׂĎ܂邾 window pӂB
+	c = ssh2_channel_new(DEFAULT_NUM_REQUESTS * DEFAULT_COPY_BUFLEN, CHAN_SES_PACKET_DEFAULT, TYPE_SFTP, -1);
 	if (c == NULL) {
 		UTIL_get_lang_msg("MSG_SSH_NO_FREE_CHANNEL", pvar,
 		                  "Could not open new channel. TTSSH is already opening too many channels.");
@@ -4113,6 +4875,22 @@ int get_cipher_discard_len(SSHCipher cipher)
 	return (val);
 }
 
+// AEADÍ(AES-GCM, ChaCha20-Poly1305)̔F؃^OԂBAEADłȂ 0B
+int get_cipher_auth_len(SSHCipher cipher)
+{
+	ssh2_cipher_t *ptr = ssh2_ciphers;
+	int val = 0;
+
+	while (ptr->name != NULL) {
+		if (cipher == ptr->cipher) {
+			val = ptr->auth_len;
+			break;
+		}
+		ptr++;
+	}
+	return (val);
+}
+
 // ÍASY猟B
 SSHCipher get_cipher_by_name(char *name)
 {
@@ -4240,6 +5018,21 @@ int get_ssh2_mac_truncatebits(hmac_type type)
 	return bits;
 }
 
+int get_ssh2_mac_etm(hmac_type type)
+{
+	ssh2_mac_t *ptr = ssh2_macs;
+	int etm = 0;
+
+	while (ptr->name != NULL) {
+		if (type == ptr->type) {
+			etm = ptr->etm;
+			break;
+		}
+		ptr++;
+	}
+	return etm;
+}
+
 char* get_ssh2_comp_name(compression_type type)
 {
 	ssh2_comp_t *ptr = ssh2_comps;
@@ -4404,6 +5197,15 @@ void SSH2_update_cipher_myproposal(PTInstVar pvar)
 			case SSH2_CIPHER_CAMELLIA256_CTR:
 				c_str = "camellia256-ctr,";
 				break;
+			case SSH2_CIPHER_AES128_GCM:
+				c_str = "aes128-gcm@openssh.com,";
+				break;
+			case SSH2_CIPHER_AES256_GCM:
+				c_str = "aes256-gcm@openssh.com,";
+				break;
+			case SSH2_CIPHER_CHACHAPOLY:
+				c_str = "chacha20-poly1305@openssh.com,";
+				break;
 			default:
 				continue;
 		}
@@ -4747,6 +5549,7 @@ static void choose_SSH2_key_maxlength(PTInstVar pvar)
 {
 	int mode, need, val, ctos;
 	const EVP_MD *md;
+	SSHCipher cipher;
 
 	for (mode = 0; mode < MODE_MAX; mode++) {
 		if (mode == MODE_OUT)
@@ -4756,26 +5559,34 @@ static void choose_SSH2_key_maxlength(PTInstVar pvar)
 
 		if (ctos == 1) {
 			val = pvar->ctos_hmac;
+			cipher = pvar->ctos_cipher;
 		} else {
 			val = pvar->stoc_hmac;
+			cipher = pvar->stoc_cipher;
 		}
 
 		// current_keys[]ɐݒ肵ĂāAƂ pvar->ssh2_keys[] փRs[B
-		md = get_ssh2_mac_EVP_MD(val);
-		current_keys[mode].mac.md = md;
-		current_keys[mode].mac.key_len = current_keys[mode].mac.mac_len = EVP_MD_size(md);
-		if (get_ssh2_mac_truncatebits(val) != 0) {
-			current_keys[mode].mac.mac_len = get_ssh2_mac_truncatebits(val) / 8;
+		current_keys[mode].enc.auth_len = get_cipher_auth_len(cipher);
+		if (current_keys[mode].enc.auth_len > 0) {
+			// AEADÍł͈ÍƓɔF؃^OvẐŁAMAC͎gȂB
+			// MACTCYɂ͔F؃^Oݒ肵ĂB
+			current_keys[mode].mac.md = NULL;
+			current_keys[mode].mac.key_len = 0;
+			current_keys[mode].mac.mac_len = current_keys[mode].enc.auth_len;
+			current_keys[mode].mac.etm = 0;
+		} else {
+			md = get_ssh2_mac_EVP_MD(val);
+			current_keys[mode].mac.md = md;
+			current_keys[mode].mac.key_len = current_keys[mode].mac.mac_len = EVP_MD_size(md);
+			if (get_ssh2_mac_truncatebits(val) != 0) {
+				current_keys[mode].mac.mac_len = get_ssh2_mac_truncatebits(val) / 8;
+			}
+			current_keys[mode].mac.etm = get_ssh2_mac_etm(val);
 		}
 
 		// L[TCYƃubNTCYŐݒ肵Ă (2004.11.7 yutaka)
-		if (ctos == 1) {
-			current_keys[mode].enc.key_len = get_cipher_key_len(pvar->ctos_cipher);
-			current_keys[mode].enc.block_size = get_cipher_block_size(pvar->ctos_cipher);
-		} else {
-			current_keys[mode].enc.key_len = get_cipher_key_len(pvar->stoc_cipher);
-			current_keys[mode].enc.block_size = get_cipher_block_size(pvar->stoc_cipher);
-		}
+		current_keys[mode].enc.key_len = get_cipher_key_len(cipher);
+		current_keys[mode].enc.block_size = get_cipher_block_size(cipher);
 		current_keys[mode].mac.enabled = 0;
 		current_keys[mode].comp.enabled = 0; // (2005.7.9 yutaka)
 
@@ -4806,6 +5617,118 @@ static void choose_SSH2_key_maxlength(PTInstVar pvar)
 
 }
 
+// ̑OɁANCAg̗D揇ʂŐ擪̈ÍEMAC we_need ςB
+// choose_SSH2_key_maxlength() ƓvZŁAƂI΂̂ƂB
+static int estimate_SSH2_key_maxlength(void)
+{
+	SSHCipher cipher;
+	hmac_type hmac;
+	int need;
+
+	cipher = choose_SSH2_cipher_algorithm(myproposal[PROPOSAL_ENC_ALGS_CTOS],
+	                                      myproposal[PROPOSAL_ENC_ALGS_CTOS]);
+	hmac = choose_SSH2_hmac_algorithm(myproposal[PROPOSAL_MAC_ALGS_CTOS],
+	                                  myproposal[PROPOSAL_MAC_ALGS_CTOS]);
+
+	need = max(get_cipher_key_len(cipher), get_cipher_block_size(cipher));
+	if (get_cipher_auth_len(cipher) == 0 && hmac != HMAC_UNKNOWN) {
+		need = max(need, EVP_MD_size(get_ssh2_mac_EVP_MD(hmac)));
+	}
+	return need;
+}
+
+//
+// T[oւ TCP ڑ҂ԂɁAŎgĂB
+// ̓NCAg̗D揇ʂ̐擪̂̂z肷BT[o
+// Iׂ΁ASSH2_MSG_KEXINIT 󂯎Ă献鎞ԂȂB
+// DH group exchange ̓T[oO[v󂯎܂ŌȂ̂őΏۊOB
+//
+void SSH2_prefetch_kex_key(PTInstVar pvar)
+{
+	SSHKexPrefetch *prefetch = &pvar->ssh_state.kex_prefetch;
+	kex_algorithm kex_type;
+	DWORD start = GetTickCount();
+	char buf[128];
+
+	if (pvar->settings.ssh_protocol_version == 1 || pvar->mux_state.slave) {
+		return;
+	}
+	if (prefetch->dh != NULL || prefetch->ecdh != NULL) {
+		return;
+	}
+
+	kex_type = choose_SSH2_kex_algorithm(myproposal[PROPOSAL_KEX_ALGS],
+	                                     myproposal[PROPOSAL_KEX_ALGS]);
+	switch (kex_type) {
+		case KEX_DH_GRP1_SHA1:
+		case KEX_DH_GRP14_SHA1:
+			if (kex_type == KEX_DH_GRP1_SHA1) {
+				prefetch->dh = dh_new_group1();
+			} else {
+				prefetch->dh = dh_new_group14();
+			}
+			if (prefetch->dh == NULL) {
+				return;
+			}
+			prefetch->we_need = estimate_SSH2_key_maxlength();
+			dh_gen_key(pvar, prefetch->dh, prefetch->we_need);
+			break;
+		case KEX_ECDH_SHA2_256:
+		case KEX_ECDH_SHA2_384:
+		case KEX_ECDH_SHA2_521:
+			prefetch->ecdh = EC_KEY_new_by_curve_name(kextype_to_cipher_nid(kex_type));
+			if (prefetch->ecdh == NULL) {
+				return;
+			}
+			if (EC_KEY_generate_key(prefetch->ecdh) != 1) {
+				EC_KEY_free(prefetch->ecdh);
+				prefetch->ecdh = NULL;
+				return;
+			}
+			break;
+		default:
+			return;
+	}
+	prefetch->kex_type = kex_type;
+
+	_snprintf_s(buf, sizeof(buf), _TRUNCATE,
+	            "Key for %s was generated while connecting (%lums).",
+	            get_kex_algorithm_name(kex_type), GetTickCount() - start);
+	notify_verbose_message(pvar, buf, LOG_LEVEL_VERBOSE);
+}
+
+//
+// ɍĂA܂ŎĝȂoB
+// gȂ͎̂ĂB(ɍ͍ŏ̌ɂg)
+// dh, ecdh Ƃ NULL Ȃ̂Ă邾B
+//
+static void take_prefetched_kex_key(PTInstVar pvar, DH **dh, EC_KEY **ecdh)
+{
+	SSHKexPrefetch *prefetch = &pvar->ssh_state.kex_prefetch;
+	BOOL match = (prefetch->kex_type == pvar->kex_type);
+
+	if (dh != NULL && match && prefetch->dh != NULL &&
+	    prefetch->we_need == pvar->we_need) {
+		*dh = prefetch->dh;
+		prefetch->dh = NULL;
+		notify_verbose_message(pvar, "Using the key generated while connecting.", LOG_LEVEL_VERBOSE);
+	}
+	if (ecdh != NULL && match && prefetch->ecdh != NULL) {
+		*ecdh = prefetch->ecdh;
+		prefetch->ecdh = NULL;
+		notify_verbose_message(pvar, "Using the key generated while connecting.", LOG_LEVEL_VERBOSE);
+	}
+
+	if (prefetch->dh != NULL) {
+		DH_free(prefetch->dh);
+		prefetch->dh = NULL;
+	}
+	if (prefetch->ecdh != NULL) {
+		EC_KEY_free(prefetch->ecdh);
+		prefetch->ecdh = NULL;
+	}
+}
+
 
 // L[JnÕ`FbN (SSH2_MSG_KEXINIT)
 // Y֐̓f[^ʐMɂĂ΂Ă\
@@ -4980,7 +5903,8 @@ static BOOL handle_SSH2_kexinit(PTInstVar pvar)
 	notify_verbose_message(pvar, tmp, LOG_LEVEL_VERBOSE);
 
 	pvar->ctos_hmac = choose_SSH2_hmac_algorithm(buf, myproposal[PROPOSAL_MAC_ALGS_CTOS]);
-	if (pvar->ctos_hmac == HMAC_UNKNOWN) { // not match
+	// AEADÍI΂ꂽꍇMACgȂ̂ŁAvȂĂ悢B
+	if (pvar->ctos_hmac == HMAC_UNKNOWN && get_cipher_auth_len(pvar->ctos_cipher) == 0) { // not match
 		strncpy_s(tmp, sizeof(tmp), "unknown MAC algorithm: ", _TRUNCATE);
 		strncat_s(tmp, sizeof(tmp), buf, _TRUNCATE);
 		msg = tmp;
@@ -5000,7 +5924,7 @@ static BOOL handle_SSH2_kexinit(PTInstVar pvar)
 	notify_verbose_message(pvar, tmp, LOG_LEVEL_VERBOSE);
 
 	pvar->stoc_hmac = choose_SSH2_hmac_algorithm(buf, myproposal[PROPOSAL_MAC_ALGS_STOC]);
-	if (pvar->stoc_hmac == HMAC_UNKNOWN) { // not match
+	if (pvar->stoc_hmac == HMAC_UNKNOWN && get_cipher_auth_len(pvar->stoc_cipher) == 0) { // not match
 		strncpy_s(tmp, sizeof(tmp), "unknown MAC algorithm: ", _TRUNCATE);
 		strncat_s(tmp, sizeof(tmp), buf, _TRUNCATE);
 		msg = tmp;
@@ -5073,12 +5997,12 @@ static BOOL handle_SSH2_kexinit(PTInstVar pvar)
 
 	_snprintf_s(buf, sizeof(buf), _TRUNCATE,
 	            "MAC algorithm client to server: %s",
-	            get_ssh2_mac_name(pvar->ctos_hmac));
+	            get_cipher_auth_len(pvar->ctos_cipher) ? "<implicit>" : get_ssh2_mac_name(pvar->ctos_hmac));
 	notify_verbose_message(pvar, buf, LOG_LEVEL_VERBOSE);
 
 	_snprintf_s(buf, sizeof(buf), _TRUNCATE,
 	            "MAC algorithm server to client: %s",
-	            get_ssh2_mac_name(pvar->stoc_hmac));
+	            get_cipher_auth_len(pvar->stoc_cipher) ? "<implicit>" : get_ssh2_mac_name(pvar->stoc_hmac));
 	notify_verbose_message(pvar, buf, LOG_LEVEL_VERBOSE);
 
 	_snprintf_s(buf, sizeof(buf), _TRUNCATE,
@@ -5113,6 +6037,10 @@ static BOOL handle_SSH2_kexinit(PTInstVar pvar)
 		case KEX_ECDH_SHA2_521:
 			SSH2_ecdh_kex_init(pvar);
 			break;
+		case KEX_CURVE25519_SHA256:
+		case KEX_CURVE25519_SHA256_LIBSSH:
+			SSH2_curve25519_kex_init(pvar);
+			break;
 		default:
 			// TODO
 			break;
@@ -5140,17 +6068,21 @@ static void SSH2_dh_kex_init(PTInstVar pvar)
 	unsigned char *outmsg;
 	int len;
 
-	// Diffie-Hellman key agreement
-	if (pvar->kex_type == KEX_DH_GRP1_SHA1) {
-		dh = dh_new_group1();
-	} else if (pvar->kex_type == KEX_DH_GRP14_SHA1) {
-		dh = dh_new_group14();
-	} else {
-		goto error;
-	}
+	// ڑ҂ԂɍĂ΁Ag
+	take_prefetched_kex_key(pvar, &dh, NULL);
+	if (dh == NULL) {
+		// Diffie-Hellman key agreement
+		if (pvar->kex_type == KEX_DH_GRP1_SHA1) {
+			dh = dh_new_group1();
+		} else if (pvar->kex_type == KEX_DH_GRP14_SHA1) {
+			dh = dh_new_group14();
+		} else {
+			goto error;
+		}
 
-	// 閧ɂׂ(X)𐶐
-	dh_gen_key(pvar, dh, pvar->we_need);
+		// 閧ɂׂ(X)𐶐
+		dh_gen_key(pvar, dh, pvar->we_need);
+	}
 
 	msg = buffer_init();
 	if (msg == NULL) {
@@ -5432,24 +6364,27 @@ static void SSH2_ecdh_kex_init(PTInstVar pvar)
 	unsigned char *outmsg;
 	int len;
 
-	client_key = EC_KEY_new();
-	if (client_key == NULL) {
-		goto error;
-	}
-	client_key = EC_KEY_new_by_curve_name(kextype_to_cipher_nid(pvar->kex_type));
+	// ڑ҂ԂɍĂ΁Ag
+	take_prefetched_kex_key(pvar, NULL, &client_key);
 	if (client_key == NULL) {
-		goto error;
-	}
-	if (EC_KEY_generate_key(client_key) != 1) {
-		goto error;
+		client_key = EC_KEY_new();
+		if (client_key == NULL) {
+			goto error;
+		}
+		client_key = EC_KEY_new_by_curve_name(kextype_to_cipher_nid(pvar->kex_type));
+		if (client_key == NULL) {
+			goto error;
+		}
+		if (EC_KEY_generate_key(client_key) != 1) {
+			goto error;
+		}
 	}
 	group = EC_KEY_get0_group(client_key);
 
 
 	msg = buffer_init();
 	if (msg == NULL) {
-		// TODO: error check
-		return;
+		goto error;
 	}
 
 	buffer_put_ecpoint(msg, group, EC_KEY_get0_public_key(client_key));
@@ -5484,6 +6419,48 @@ error:;
 }
 
 
+//
+// KEX_CURVE25519_SHA256 or KEX_CURVE25519_SHA256_LIBSSH
+//
+static void SSH2_curve25519_kex_init(PTInstVar pvar)
+{
+	static const unsigned char basepoint[CURVE25519_SIZE] = {9};
+	buffer_t *msg = NULL;
+	unsigned char *outmsg;
+	int len;
+
+	// ̐̓XJ[{Z 1 ōςނ̂Ős͂ĂȂB]̂Ă邾B
+	take_prefetched_kex_key(pvar, NULL, NULL);
+
+	msg = buffer_init();
+	if (msg == NULL) {
+		notify_fatal_error(pvar, "Out of memory @ SSH2_curve25519_kex_init()", TRUE);
+		return;
+	}
+
+	// ō쐬́AƂŋL閧ƃnbV̌vZɎgߎĂB
+	arc4random_buf(pvar->curve25519_client_key, CURVE25519_SIZE);
+	crypto_scalarmult_curve25519(pvar->curve25519_client_pubkey,
+	                             pvar->curve25519_client_key, basepoint);
+
+	buffer_put_string(msg, pvar->curve25519_client_pubkey, CURVE25519_SIZE);
+
+	len = buffer_len(msg);
+	outmsg = begin_send_packet(pvar, SSH2_MSG_KEX_ECDH_INIT, len);
+	memcpy(outmsg, buffer_ptr(msg), len);
+	finish_send_packet(pvar);
+
+	SSH2_dispatch_init(2);
+	SSH2_dispatch_add_message(SSH2_MSG_KEX_ECDH_REPLY);
+	SSH2_dispatch_add_message(SSH2_MSG_IGNORE); // XXX: Tru64 UNIX workaround   (2005.3.5 yutaka)
+	SSH2_dispatch_add_message(SSH2_MSG_DEBUG);
+
+	buffer_free(msg);
+
+	notify_verbose_message(pvar, "SSH2_MSG_KEX_ECDH_INIT was sent at SSH2_curve25519_kex_init().", LOG_LEVEL_VERBOSE);
+}
+
+
 static void ssh2_set_newkeys(PTInstVar pvar, int mode)
 {
 #if 1
@@ -5500,6 +6477,40 @@ static void ssh2_set_newkeys(PTInstVar pvar, int mode)
 #endif
 
 	pvar->ssh2_keys[mode] = current_keys[mode];
+
+	// MACς̂ŁAHMAC̎OvZ蒼B
+	CRYPT_set_MAC_key(pvar, mode);
+}
+
+
+//
+// ̍쐬E؂ɂԂOɎcBstart ͊JñptH[}XJE^lB
+//
+static void log_signature_time(PTInstVar pvar, Key *key, char *what, LARGE_INTEGER *start)
+{
+	LARGE_INTEGER now, freq;
+	char buf[128];
+
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+	_snprintf_s(buf, sizeof(buf), _TRUNCATE, "%s signature %s took %.3f ms.",
+	            get_ssh_keytype_name(key->type), what,
+	            (double)(now.QuadPart - start->QuadPart) * 1000.0 / freq.QuadPart);
+	notify_verbose_message(pvar, buf, LOG_LEVEL_VERBOSE);
+}
+
+// ̃nbVɑ΂zXg̏؂
+static int verify_kex_signature(PTInstVar pvar, Key *hostkey, char *signature, int siglen,
+                                char *hash, int hashlen)
+{
+	LARGE_INTEGER start;
+	int ret;
+
+	QueryPerformanceCounter(&start);
+	ret = key_verify(hostkey, signature, siglen, hash, hashlen);
+	log_signature_time(pvar, hostkey, "verification", &start);
+
+	return ret;
 }
 
 
@@ -5640,7 +6651,7 @@ static BOOL handle_SSH2_dh_kex_reply(PTInstVar pvar)
 		}
 	}
 
-	if ((ret = key_verify(hostkey, signature, siglen, hash, hashlen)) != 1) {
+	if ((ret = verify_kex_signature(pvar, hostkey, signature, siglen, hash, hashlen)) != 1) {
 		if (ret == -3 && hostkey->type == KEY_RSA) {
 			if (!pvar->settings.EnableRsaShortKeyServer) {
 				_snprintf_s(emsg_tmp, sizeof(emsg_tmp), _TRUNCATE,
@@ -5875,7 +6886,7 @@ static BOOL handle_SSH2_dh_gex_reply(PTInstVar pvar)
 		}
 	}
 
-	if ((ret = key_verify(hostkey, signature, siglen, hash, hashlen)) != 1) {
+	if ((ret = verify_kex_signature(pvar, hostkey, signature, siglen, hash, hashlen)) != 1) {
 		if (ret == -3 && hostkey->type == KEY_RSA) {
 			if (!pvar->settings.EnableRsaShortKeyServer) {
 				_snprintf_s(emsg_tmp, sizeof(emsg_tmp), _TRUNCATE,
@@ -5961,6 +6972,96 @@ error:
 }
 
 
+//
+// ECDH  curve25519 ̌ŋʂ̌㔼
+// ZbVIDۑAzXg̏m߂Ă献𓱏o SSH2_MSG_NEWKEYS 𑗂B
+// s emsg ɃbZ[W FALSE ԂBfuncname ̓bZ[WɓĂяo̖OB
+//
+static BOOL ssh2_kex_finish_reply(PTInstVar pvar, Key *hostkey, char *signature, int siglen,
+                                  char *hash, int hashlen, BIGNUM *share_key,
+                                  const char *funcname, char *emsg, int emsg_len)
+{
+	char buf[128];
+	int ret;
+
+	// session id̕ۑiڑ̂݁j
+	if (pvar->session_id == NULL) {
+		pvar->session_id_len = hashlen;
+		pvar->session_id = malloc(pvar->session_id_len);
+		if (pvar->session_id == NULL) {
+			_snprintf_s(emsg, emsg_len, _TRUNCATE, "Out of memory @ %s()", funcname);
+			return FALSE;
+		}
+		memcpy(pvar->session_id, hash, pvar->session_id_len);
+	}
+
+	if ((ret = verify_kex_signature(pvar, hostkey, signature, siglen, hash, hashlen)) != 1) {
+		if (ret == -3 && hostkey->type == KEY_RSA) {
+			if (!pvar->settings.EnableRsaShortKeyServer) {
+				_snprintf_s(emsg, emsg_len, _TRUNCATE,
+				            "key verify error(remote rsa key length is too short %d-bit) "
+				            "@ %s()", BN_num_bits(hostkey->rsa->n), funcname);
+				save_memdump(LOGDUMP);
+				return FALSE;
+			}
+		}
+		else {
+			_snprintf_s(emsg, emsg_len, _TRUNCATE,
+			            "key verify error(%d) @ %s()\r\n%s", ret, funcname, SENDTOME);
+			save_memdump(LOGDUMP);
+			return FALSE;
+		}
+	}
+
+	kex_derive_keys(pvar, pvar->we_need, hash, share_key, pvar->session_id, pvar->session_id_len);
+
+	// KEX finish
+	begin_send_packet(pvar, SSH2_MSG_NEWKEYS, 0);
+	finish_send_packet(pvar);
+
+	_snprintf_s(buf, sizeof(buf), _TRUNCATE, "SSH2_MSG_NEWKEYS was sent at %s().", funcname);
+	notify_verbose_message(pvar, buf, LOG_LEVEL_VERBOSE);
+
+	// SSH2_MSG_NEWKEYS𑗂IƂɃL[̐ݒ肨эĐݒs
+	// Mp̈Í SSH2_MSG_NEWKEYS ̑MɁAMp̂ SSH2_MSG_NEWKEYS 
+	// MɍĐݒsB
+	if (pvar->rekeying == 1) { // L[̍Đݒ
+		// ܂AMpݒ肷B
+		ssh2_set_newkeys(pvar, MODE_OUT);
+		pvar->ssh2_keys[MODE_OUT].mac.enabled = 1;
+		pvar->ssh2_keys[MODE_OUT].comp.enabled = 1;
+		enable_send_compression(pvar);
+		if (!CRYPT_start_encryption(pvar, 1, 0)) {
+			_snprintf_s(emsg, emsg_len, _TRUNCATE,
+			            "could not start encryption with the new keys @ %s()", funcname);
+			return FALSE;
+		}
+
+	} else {
+		// ڑ̏ꍇ͎ۂɈÍ[`ݒ肳̂́AƂɂȂĂ
+		// Ȃ̂ŁiCRYPT_start_encryption֐jAŌ̐ݒĂ܂Ă悢B
+		ssh2_set_newkeys(pvar, MODE_IN);
+		ssh2_set_newkeys(pvar, MODE_OUT);
+
+		// SSH2_MSG_NEWKEYS𑗐M_ŁAMACLɂB(2006.10.30 yutaka)
+		pvar->ssh2_keys[MODE_OUT].mac.enabled = 1;
+		pvar->ssh2_keys[MODE_OUT].comp.enabled = 1;
+
+		// pPbgkLȂ珉B(2005.7.9 yutaka)
+		// SSH2_MSG_NEWKEYS̎MOȂ̂łł悢B(2006.10.30 maya)
+		prep_compression(pvar);
+		enable_compression(pvar);
+	}
+
+	SSH2_dispatch_init(3);
+	SSH2_dispatch_add_message(SSH2_MSG_NEWKEYS);
+	SSH2_dispatch_add_message(SSH2_MSG_IGNORE); // XXX: Tru64 UNIX workaround   (2005.3.5 yutaka)
+	SSH2_dispatch_add_message(SSH2_MSG_DEBUG);
+
+	return TRUE;
+}
+
+
 //
 // Elliptic Curv Diffie-Hellman Key Exchange Reply(SSH2_MSG_KEX_ECDH_REPLY:31)
 //
@@ -5979,7 +7080,7 @@ static BOOL handle_SSH2_ecdh_kex_reply(PTInstVar pvar)
 	BIGNUM *share_key = NULL;
 	char *hash;
 	char *emsg, emsg_tmp[1024];  // error message
-	int ret, hashlen;
+	int hashlen;
 	Key *hostkey = NULL;  // hostkey
 
 	notify_verbose_message(pvar, "SSH2_MSG_KEX_ECDH_REPLY was received.", LOG_LEVEL_VERBOSE);
@@ -6096,75 +7197,12 @@ static BOOL handle_SSH2_ecdh_kex_reply(PTInstVar pvar)
 	//debug_print(34, buffer_ptr(pvar->peer_kex), buffer_len(pvar->peer_kex));
 	//debug_print(35, server_host_key_blob, bloblen);
 
-	// session id̕ۑiڑ̂݁j
-	if (pvar->session_id == NULL) {
-		pvar->session_id_len = hashlen;
-		pvar->session_id = malloc(pvar->session_id_len);
-		if (pvar->session_id != NULL) {
-			memcpy(pvar->session_id, hash, pvar->session_id_len);
-		} else {
-			// TODO:
-		}
-	}
-
-	if ((ret = key_verify(hostkey, signature, siglen, hash, hashlen)) != 1) {
-		if (ret == -3 && hostkey->type == KEY_RSA) {
-			if (!pvar->settings.EnableRsaShortKeyServer) {
-				_snprintf_s(emsg_tmp, sizeof(emsg_tmp), _TRUNCATE,
-				            "key verify error(remote rsa key length is too short %d-bit) "
-				            "@ handle_SSH2_ecdh_kex_reply()", BN_num_bits(hostkey->rsa->n));
-			}
-			else {
-				goto cont;
-			}
-		}
-		else {
-			_snprintf_s(emsg_tmp, sizeof(emsg_tmp), _TRUNCATE,
-			            "key verify error(%d) @ handle_SSH2_ecdh_kex_reply()\r\n%s", ret, SENDTOME);
-		}
+	if (!ssh2_kex_finish_reply(pvar, hostkey, signature, siglen, hash, hashlen, share_key,
+	                           __FUNCTION__, emsg_tmp, sizeof(emsg_tmp))) {
 		emsg = emsg_tmp;
-		save_memdump(LOGDUMP);
 		goto error;
 	}
 
-cont:
-	kex_derive_keys(pvar, pvar->we_need, hash, share_key, pvar->session_id, pvar->session_id_len);
-
-	// KEX finish
-	begin_send_packet(pvar, SSH2_MSG_NEWKEYS, 0);
-	finish_send_packet(pvar);
-
-	notify_verbose_message(pvar, "SSH2_MSG_NEWKEYS was sent at handle_SSH2_ecdh_kex_reply().", LOG_LEVEL_VERBOSE);
-
-	// SSH2_MSG_NEWKEYS𑗂IƂɃL[̐ݒ肨эĐݒs
-	// Mp̈Í SSH2_MSG_NEWKEYS ̑MɁAMp̂ SSH2_MSG_NEWKEYS 
-	// MɍĐݒsB
-	if (pvar->rekeying == 1) { // L[̍Đݒ
-		// ܂AMpݒ肷B
-		ssh2_set_newkeys(pvar, MODE_OUT);
-		pvar->ssh2_keys[MODE_OUT].mac.enabled = 1;
-		pvar->ssh2_keys[MODE_OUT].comp.enabled = 1;
-		enable_send_compression(pvar);
-		if (!CRYPT_start_encryption(pvar, 1, 0)) {
-			// TODO: error
-		}
-
-	} else {
-		// ڑ̏ꍇ͎ۂɈÍ[`ݒ肳̂́AƂɂȂĂ
-		// Ȃ̂ŁiCRYPT_start_encryption֐jAŌ̐ݒĂ܂Ă悢B
-		ssh2_set_newkeys(pvar, MODE_IN);
-		ssh2_set_newkeys(pvar, MODE_OUT);
-
-		// SSH2_MSG_NEWKEYS𑗐M_ŁAMACLɂB(2006.10.30 yutaka)
-		pvar->ssh2_keys[MODE_OUT].mac.enabled = 1;
-		pvar->ssh2_keys[MODE_OUT].comp.enabled = 1;
-
-		// pPbgkLȂ珉B(2005.7.9 yutaka)
-		// SSH2_MSG_NEWKEYS̎MOȂ̂łł悢B(2006.10.30 maya)
-		prep_compression(pvar);
-		enable_compression(pvar);
-	}
-
 	// TTSSHo[Wɕ\L[rbg߂Ă
 	switch (pvar->kex_type) {
 		case KEX_ECDH_SHA2_256:
@@ -6184,11 +7222,6 @@ cont:
 			break;
 	}
 
-	SSH2_dispatch_init(3);
-	SSH2_dispatch_add_message(SSH2_MSG_NEWKEYS);
-	SSH2_dispatch_add_message(SSH2_MSG_IGNORE); // XXX: Tru64 UNIX workaround   (2005.3.5 yutaka)
-	SSH2_dispatch_add_message(SSH2_MSG_DEBUG);
-
 	EC_KEY_free(pvar->ecdh_client_key); pvar->ecdh_client_key = NULL;
 	EC_POINT_clear_free(server_public);
 	key_free(hostkey);
@@ -6208,6 +7241,146 @@ error:
 }
 
 
+//
+// curve25519-sha256 Key Exchange Reply(SSH2_MSG_KEX_ECDH_REPLY:31)
+//
+static BOOL handle_SSH2_curve25519_kex_reply(PTInstVar pvar)
+{
+	char *data;
+	int len;
+	char *server_host_key_blob;
+	int bloblen, siglen, keylen;
+	unsigned char *server_public;
+	char *signature;
+	unsigned char shared[CURVE25519_SIZE];
+	unsigned char nonzero;
+	BIGNUM *share_key = NULL;
+	char *hash;
+	char *emsg, emsg_tmp[1024];  // error message
+	int hashlen, i;
+	Key *hostkey = NULL;  // hostkey
+
+	notify_verbose_message(pvar, "SSH2_MSG_KEX_ECDH_REPLY was received.", LOG_LEVEL_VERBOSE);
+
+	// 6byteiTCY{pfBO{^Cvj菜ȍ~̃yC[h
+	data = pvar->ssh_state.payload;
+	// pPbgTCY - (pfBOTCY+1)G^̃pPbgTCY
+	len = pvar->ssh_state.payloadlen;
+
+	// for debug
+	push_memdump("KEX_ECDH_REPLY", "key exchange: receiving", data, len);
+
+	bloblen = get_uint32_MSBfirst(data);
+	data += 4;
+	server_host_key_blob = data; // for hash
+
+	push_memdump("KEX_ECDH_REPLY", "server_host_key_blob", server_host_key_blob, bloblen);
+
+	hostkey = key_from_blob(data, bloblen);
+	if (hostkey == NULL) {
+		emsg = "key_from_blob error @ handle_SSH2_curve25519_kex_reply()";
+		goto error;
+	}
+	data += bloblen;
+
+	if (hostkey->type != pvar->hostkey_type) {  // zXgL[̎ʔr
+		_snprintf_s(emsg_tmp, sizeof(emsg_tmp), _TRUNCATE,
+		            "type mismatch for decoded server_host_key_blob (kex:%s blob:%s) @ %s",
+		            get_ssh_keytype_name(pvar->hostkey_type), get_ssh_keytype_name(hostkey->type), __FUNCTION__);
+		emsg = emsg_tmp;
+		goto error;
+	}
+	HOSTS_check_host_key(pvar, pvar->ssh_state.hostname, pvar->ssh_state.tcpport, hostkey);
+	if (pvar->socket == INVALID_SOCKET) {
+		emsg = "Server disconnected @ handle_SSH2_curve25519_kex_reply()";
+		goto error;
+	}
+
+	/* Q_S, server public key */
+	keylen = get_uint32_MSBfirst(data);
+	data += 4;
+	if (keylen != CURVE25519_SIZE) {
+		emsg = "curve25519 invalid server public key length @ handle_SSH2_curve25519_kex_reply()";
+		goto error;
+	}
+	server_public = data;
+	data += keylen;
+
+	siglen = get_uint32_MSBfirst(data);
+	data += 4;
+	signature = data;
+	data += siglen;
+
+	push_memdump("KEX_ECDH_REPLY", "signature", signature, siglen);
+
+	// ʌ̐Bʐ̓_𑗂ĂT[o͋L閧 0 ɂȂ̂ŋۂB
+	crypto_scalarmult_curve25519(shared, pvar->curve25519_client_key, server_public);
+	nonzero = 0;
+	for (i = 0; i < CURVE25519_SIZE; i++) {
+		nonzero |= shared[i];
+	}
+	if (nonzero == 0) {
+		emsg = "curve25519 shared secret is zero @ handle_SSH2_curve25519_kex_reply()";
+		goto error;
+	}
+	share_key = BN_new();
+	if (share_key == NULL) {
+		emsg = "Out of memory @ handle_SSH2_curve25519_kex_reply()";
+		goto error;
+	}
+	// L閧 32 oCĝ܂܃rbOGfBA̐Ƃ݂Ȃ (RFC8731)
+	BN_bin2bn(shared, CURVE25519_SIZE, share_key);
+	SecureZeroMemory(shared, sizeof(shared));
+
+	// nbV̌vZ
+	/* calc and verify H */
+	hash = kex_c25519_hash(get_kex_algorithm_EVP_MD(pvar->kex_type),
+	                       pvar->client_version_string,
+	                       pvar->server_version_string,
+	                       buffer_ptr(pvar->my_kex), buffer_len(pvar->my_kex),
+	                       buffer_ptr(pvar->peer_kex), buffer_len(pvar->peer_kex),
+	                       server_host_key_blob, bloblen,
+	                       pvar->curve25519_client_pubkey,
+	                       server_public,
+	                       share_key,
+	                       &hashlen);
+
+	{
+		push_memdump("KEX_ECDH_REPLY curve25519_kex_reply", "my_kex", buffer_ptr(pvar->my_kex), buffer_len(pvar->my_kex));
+		push_memdump("KEX_ECDH_REPLY curve25519_kex_reply", "peer_kex", buffer_ptr(pvar->peer_kex), buffer_len(pvar->peer_kex));
+
+		push_bignum_memdump("KEX_ECDH_REPLY curve25519_kex_reply", "share_key", share_key);
+
+		push_memdump("KEX_ECDH_REPLY curve25519_kex_reply", "hash", hash, hashlen);
+	}
+
+	if (!ssh2_kex_finish_reply(pvar, hostkey, signature, siglen, hash, hashlen, share_key,
+	                           __FUNCTION__, emsg_tmp, sizeof(emsg_tmp))) {
+		emsg = emsg_tmp;
+		goto error;
+	}
+
+	// TTSSHo[Wɕ\L[rbg߂Ă
+	pvar->client_key_bits = 256;
+	pvar->server_key_bits = 256;
+
+	SecureZeroMemory(pvar->curve25519_client_key, sizeof(pvar->curve25519_client_key));
+	BN_clear_free(share_key);
+	key_free(hostkey);
+	return TRUE;
+
+error:
+	SecureZeroMemory(shared, sizeof(shared));
+	SecureZeroMemory(pvar->curve25519_client_key, sizeof(pvar->curve25519_client_key));
+	key_free(hostkey);
+	BN_clear_free(share_key);
+
+	notify_fatal_error(pvar, emsg, TRUE);
+
+	return FALSE;
+}
+
+
 // KEXɂăT[oԂĂ 31 ԃbZ[Wɑ΂nh
 static BOOL handle_SSH2_dh_common_reply(PTInstVar pvar)
 {
@@ -6225,6 +7398,10 @@ static BOOL handle_SSH2_dh_common_reply(PTInstVar pvar)
 		case KEX_ECDH_SHA2_521:
 			handle_SSH2_ecdh_kex_reply(pvar);
 			break;
+		case KEX_CURVE25519_SHA256:
+		case KEX_CURVE25519_SHA256_LIBSSH:
+			handle_SSH2_curve25519_kex_reply(pvar);
+			break;
 		default:
 			// TODO
 			break;
@@ -6274,6 +7451,9 @@ static BOOL handle_SSH2_newkeys(PTInstVar pvar)
 	                       | 1 << SSH2_CIPHER_CAMELLIA128_CTR
 	                       | 1 << SSH2_CIPHER_CAMELLIA192_CTR
 	                       | 1 << SSH2_CIPHER_CAMELLIA256_CTR
+	                       | 1 << SSH2_CIPHER_AES128_GCM
+	                       | 1 << SSH2_CIPHER_AES256_GCM
+	                       | 1 << SSH2_CIPHER_CHACHAPOLY
 	);
 	int type = (1 << SSH_AUTH_PASSWORD) | (1 << SSH_AUTH_RSA) |
 	           (1 << SSH_AUTH_TIS) | (1 << SSH_AUTH_PAGEANT);
@@ -6300,6 +7480,10 @@ static BOOL handle_SSH2_newkeys(PTInstVar pvar)
 			// TODO: error
 		}
 		do_SSH2_dispatch_setup_for_transfer(pvar);
+
+		// ɗ߂Ă`lf[^𑗂B
+		ssh2_channel_retry_send_all_bufchain(pvar);
+		MUX_rekey_finished(pvar);
 		return TRUE;
 
 	} else {
@@ -6482,6 +7666,7 @@ BOOL do_SSH2_authrequest(PTInstVar pvar)
 		char *signature = NULL;
 		int siglen;
 		Key *keypair = pvar->auth_state.cur_cred.key_pair;
+		LARGE_INTEGER sign_start;
 
 		if (get_SSH2_publickey_blob(pvar, &blob, &bloblen) == FALSE) {
 			goto error;
@@ -6509,11 +7694,13 @@ BOOL do_SSH2_authrequest(PTInstVar pvar)
 		buffer_append_length(signbuf, s, bloblen);
 
 		// ̍쐬
+		QueryPerformanceCounter(&sign_start);
 		if ( generate_SSH2_keysign(keypair, &signature, &siglen, buffer_ptr(signbuf), buffer_len(signbuf)) == FALSE) {
 			buffer_free(blob);
 			buffer_free(signbuf);
 			goto error;
 		}
+		log_signature_time(pvar, keypair, "generation", &sign_start);
 
 		// step3
 		s = connect_id;
@@ -6648,6 +7835,10 @@ static LRESULT CALLBACK ssh_heartbeat_dlg_proc(HWND hWnd, UINT msg, WPARAM wp, L
 			return TRUE;
 			break;
 
+		case WM_SCP_JOB_NEXT:
+			ssh2_scp_job_start((PTInstVar)wp);
+			return TRUE;
+
 		case WM_COMMAND:
 			switch (wp) {
 			}
@@ -6721,6 +7912,7 @@ static void start_ssh_heartbeat_thread(PTInstVar pvar)
 
 	// [hX_CAO쐬Bn[gr[gpȂ̂Ń_CAO͔\̂܂܂
 	// ̂ŁA\[XID͂Ȃł悢B
+	// SCP]L[̎̃t@C̊Jn (WM_SCP_JOB_NEXT) ̃_CAOŎ󂯂B
 	hDlgWnd = CreateDialog(hInst, MAKEINTRESOURCE(IDD_SSHSCP_PROGRESS),
                pvar->cv->HWin, (DLGPROC)ssh_heartbeat_dlg_proc);
 	pvar->ssh_hearbeat_dialog = hDlgWnd;
@@ -6805,6 +7997,9 @@ static BOOL handle_SSH2_userauth_success(PTInstVar pvar)
 
 	notify_verbose_message(pvar, "User authentication is successful and SSH heartbeat thread is starting.", LOG_LEVEL_VERBOSE);
 
+	// ڑւ̃EBhEA̐ڑɑł悤ɂ
+	MUX_start_master(pvar);
+
 	return TRUE;
 }
 
@@ -7258,93 +8453,257 @@ BOOL handle_SSH2_userauth_passwd_changereq(PTInstVar pvar)
 	finish_send_packet(pvar);
 	buffer_free(msg);
 
-	return TRUE;
+	return TRUE;
+}
+
+// pty-req œn[[h
+static void ssh2_put_tty_modes(PTInstVar pvar, buffer_t *ttymsg)
+{
+	// TTY mode͂œn (2005.7.17 yutaka)
+	buffer_put_char(ttymsg, SSH2_TTY_OP_OSPEED);
+	buffer_put_int(ttymsg, 9600);  // baud rate
+	buffer_put_char(ttymsg, SSH2_TTY_OP_ISPEED);
+	buffer_put_int(ttymsg, 9600);  // baud rate
+
+	// VERASE
+	buffer_put_char(ttymsg, SSH2_TTY_KEY_VERASE);
+	if (pvar->ts->BSKey == IdBS) {
+		buffer_put_int(ttymsg, 0x08); // BS key
+	} else {
+		buffer_put_int(ttymsg, 0x7F); // DEL key
+	}
+
+	switch (pvar->ts->CRReceive) {
+	  case IdLF:
+		buffer_put_char(ttymsg, SSH2_TTY_OP_ONLCR);
+		buffer_put_int(ttymsg, 0);
+		break;
+	  case IdCR:
+		buffer_put_char(ttymsg, SSH2_TTY_OP_ONLCR);
+		buffer_put_int(ttymsg, 1);
+		break;
+	  default:
+		break;
+	}
+
+	buffer_put_char(ttymsg, SSH2_TTY_OP_END); // End of terminal modes
+}
+
+BOOL send_pty_request(PTInstVar pvar, Channel_t *c)
+{
+	buffer_t *msg, *ttymsg;
+	char *s = "pty-req";  // pseudo terminal̃NGXg
+	unsigned char *outmsg;
+	int len, x, y;
+#ifdef DONT_WANTCONFIRM
+	int wantconfirm = 0; // false
+#else
+	int wantconfirm = 1; // true
+#endif
+
+	// pty open
+	msg = buffer_init();
+	if (msg == NULL) {
+		// TODO: error check
+		return FALSE;
+	}
+	ttymsg = buffer_init();
+	if (ttymsg == NULL) {
+		// TODO: error check
+		buffer_free(msg);
+		return FALSE;
+	}
+
+	buffer_put_int(msg, c->remote_id);
+	buffer_put_string(msg, s, strlen(s));
+	buffer_put_char(msg, wantconfirm);  // wantconfirm (disableɕύX 2005/3/28 yutaka)
+
+	s = pvar->ts->TermType; // TERM
+	buffer_put_string(msg, s, strlen(s));
+	buffer_put_int(msg, pvar->ssh_state.win_cols);  // columns
+	buffer_put_int(msg, pvar->ssh_state.win_rows);  // lines
+	get_window_pixel_size(pvar, &x, &y);
+	buffer_put_int(msg, x);  // window width (pixel):
+	buffer_put_int(msg, y);  // window height (pixel):
+
+	ssh2_put_tty_modes(pvar, ttymsg);
+
+	// SSH2ł͕ƂďށB
+	buffer_put_string(msg, buffer_ptr(ttymsg), buffer_len(ttymsg));
+
+	len = buffer_len(msg);
+	outmsg = begin_send_packet(pvar, SSH2_MSG_CHANNEL_REQUEST, len);
+	memcpy(outmsg, buffer_ptr(msg), len);
+	finish_send_packet(pvar);
+	buffer_free(msg);
+	buffer_free(ttymsg);
+
+	notify_verbose_message(pvar, "SSH2_MSG_CHANNEL_REQUEST was sent at send_pty_request().", LOG_LEVEL_VERBOSE);
+	pvar->session_nego_status = 2;
+
+	if (wantconfirm == 0) {
+		handle_SSH2_channel_success(pvar);
+	}
+
+	return TRUE;
+}
+
+//
+// ControlMaster: 肵ĂEBhẼZbV`l
+//
+
+// ZbV`lJA`lԍԂBJȂ -1 ԂB
+int SSH2_mux_open_channel(PTInstVar pvar, int client_num)
+{
+	buffer_t *msg;
+	char *s;
+	unsigned char *outmsg;
+	int len;
+	Channel_t *c;
+
+	if (!SSHv2(pvar) || !pvar->userauth_success || pvar->rekeying) {
+		return -1;
+	}
+
+	c = ssh2_channel_new(CHAN_SES_WINDOW_DEFAULT, CHAN_SES_PACKET_DEFAULT, TYPE_MUX, -1);
+	if (c == NULL) {
+		return -1;
+	}
+	c->mux_num = client_num;
+
+	msg = buffer_init();
+	if (msg == NULL) {
+		ssh2_channel_delete(c);
+		return -1;
+	}
+	s = "session";
+	buffer_put_string(msg, s, strlen(s));  // ctype
+	buffer_put_int(msg, c->self_id);  // self(channel number)
+	buffer_put_int(msg, c->local_window);  // local_window
+	buffer_put_int(msg, c->local_maxpacket);  // local_maxpacket
+	len = buffer_len(msg);
+	outmsg = begin_send_packet(pvar, SSH2_MSG_CHANNEL_OPEN, len);
+	memcpy(outmsg, buffer_ptr(msg), len);
+	finish_send_packet(pvar);
+	buffer_free(msg);
+
+	notify_verbose_message(pvar, "SSH2_MSG_CHANNEL_OPEN was sent at SSH2_mux_open_channel().", LOG_LEVEL_VERBOSE);
+
+	return c->self_id;
 }
 
-BOOL send_pty_request(PTInstVar pvar, Channel_t *c)
+// pty-req  shell 𑱂đB
+// ͋߂Ȃ̂ŁAŏ̃`l̂悤 session_nego_status i߂Kv͂ȂB
+void SSH2_mux_start_session(PTInstVar pvar, int channel_id, char FAR * term, int cols, int rows)
 {
 	buffer_t *msg, *ttymsg;
-	char *s = "pty-req";  // pseudo terminal̃NGXg
+	char *s;
 	unsigned char *outmsg;
-	int len, x, y;
-#ifdef DONT_WANTCONFIRM
-	int wantconfirm = 0; // false
-#else
-	int wantconfirm = 1; // true
-#endif
+	int len;
+	Channel_t *c;
+
+	c = ssh2_channel_lookup(channel_id);
+	if (c == NULL || c->type != TYPE_MUX) {
+		return;
+	}
 
-	// pty open
 	msg = buffer_init();
 	if (msg == NULL) {
-		// TODO: error check
-		return FALSE;
+		return;
 	}
 	ttymsg = buffer_init();
 	if (ttymsg == NULL) {
-		// TODO: error check
 		buffer_free(msg);
-		return FALSE;
+		return;
 	}
 
 	buffer_put_int(msg, c->remote_id);
+	s = "pty-req";
 	buffer_put_string(msg, s, strlen(s));
-	buffer_put_char(msg, wantconfirm);  // wantconfirm (disableɕύX 2005/3/28 yutaka)
+	buffer_put_char(msg, 0);  // wantconfirm
+	buffer_put_string(msg, term, strlen(term));  // TERM
+	buffer_put_int(msg, cols);  // columns
+	buffer_put_int(msg, rows);  // lines
+	buffer_put_int(msg, 0);  // window width (pixel): s
+	buffer_put_int(msg, 0);  // window height (pixel): s
+	ssh2_put_tty_modes(pvar, ttymsg);
+	buffer_put_string(msg, buffer_ptr(ttymsg), buffer_len(ttymsg));
+	len = buffer_len(msg);
+	outmsg = begin_send_packet(pvar, SSH2_MSG_CHANNEL_REQUEST, len);
+	memcpy(outmsg, buffer_ptr(msg), len);
+	finish_send_packet(pvar);
 
-	s = pvar->ts->TermType; // TERM
+	buffer_clear(msg);
+	buffer_put_int(msg, c->remote_id);
+	s = "shell";
 	buffer_put_string(msg, s, strlen(s));
-	buffer_put_int(msg, pvar->ssh_state.win_cols);  // columns
-	buffer_put_int(msg, pvar->ssh_state.win_rows);  // lines
-	get_window_pixel_size(pvar, &x, &y);
-	buffer_put_int(msg, x);  // window width (pixel):
-	buffer_put_int(msg, y);  // window height (pixel):
+	buffer_put_char(msg, 0);  // wantconfirm
+	len = buffer_len(msg);
+	outmsg = begin_send_packet(pvar, SSH2_MSG_CHANNEL_REQUEST, len);
+	memcpy(outmsg, buffer_ptr(msg), len);
+	finish_send_packet(pvar);
 
-	// TTY mode͂œn (2005.7.17 yutaka)
-	buffer_put_char(ttymsg, SSH2_TTY_OP_OSPEED);
-	buffer_put_int(ttymsg, 9600);  // baud rate
-	buffer_put_char(ttymsg, SSH2_TTY_OP_ISPEED);
-	buffer_put_int(ttymsg, 9600);  // baud rate
+	buffer_free(msg);
+	buffer_free(ttymsg);
 
-	// VERASE
-	buffer_put_char(ttymsg, SSH2_TTY_KEY_VERASE);
-	if (pvar->ts->BSKey == IdBS) {
-		buffer_put_int(ttymsg, 0x08); // BS key
-	} else {
-		buffer_put_int(ttymsg, 0x7F); // DEL key
+	notify_verbose_message(pvar, "SSH2_MSG_CHANNEL_REQUEST was sent at SSH2_mux_start_session().", LOG_LEVEL_VERBOSE);
+}
+
+void SSH2_mux_send(PTInstVar pvar, int channel_id, unsigned char FAR * buf, int len)
+{
+	Channel_t *c = ssh2_channel_lookup(channel_id);
+
+	if (c == NULL || c->type != TYPE_MUX) {
+		return;
 	}
+	SSH2_send_channel_data(pvar, c, buf, len, 0);
+}
 
-	switch (pvar->ts->CRReceive) {
-	  case IdLF:
-		buffer_put_char(ttymsg, SSH2_TTY_OP_ONLCR);
-		buffer_put_int(ttymsg, 0);
-		break;
-	  case IdCR:
-		buffer_put_char(ttymsg, SSH2_TTY_OP_ONLCR);
-		buffer_put_int(ttymsg, 1);
-		break;
-	  default:
-		break;
+void SSH2_mux_notify_win_size(PTInstVar pvar, int channel_id, int cols, int rows)
+{
+	Channel_t *c = ssh2_channel_lookup(channel_id);
+
+	// ͑ȂBĂяǒɑ蒼B
+	if (c == NULL || c->type != TYPE_MUX || pvar->rekeying) {
+		return;
 	}
+	ssh2_send_window_change(pvar, c, cols, rows, 0, 0);
+}
 
-	buffer_put_char(ttymsg, SSH2_TTY_OP_END); // End of terminal modes
+BOOL SSH2_mux_is_congested(PTInstVar pvar, int channel_id)
+{
+	Channel_t *c = ssh2_channel_lookup(channel_id);
 
-	// SSH2ł͕ƂďށB
-	buffer_put_string(msg, buffer_ptr(ttymsg), buffer_len(ttymsg));
+	return c != NULL && c->bufchain_amount >= CHAN_BUFCHAIN_MAX;
+}
 
-	len = buffer_len(msg);
-	outmsg = begin_send_packet(pvar, SSH2_MSG_CHANNEL_REQUEST, len);
-	memcpy(outmsg, buffer_ptr(msg), len);
-	finish_send_packet(pvar);
-	buffer_free(msg);
-	buffer_free(ttymsg);
+// X[uւ݂̏i񂾂̂ŁA~߂Ă window JB
+void SSH2_mux_resume_window(PTInstVar pvar, int channel_id)
+{
+	Channel_t *c = ssh2_channel_lookup(channel_id);
 
-	notify_verbose_message(pvar, "SSH2_MSG_CHANNEL_REQUEST was sent at send_pty_request().", LOG_LEVEL_VERBOSE);
-	pvar->session_nego_status = 2;
+	if (c == NULL || c->type != TYPE_MUX || c->remote_id == -1 || pvar->rekeying) {
+		return;
+	}
+	do_SSH2_adjust_window_size(pvar, c);
+}
 
-	if (wantconfirm == 0) {
-		handle_SSH2_channel_success(pvar);
+// X[uؒf̂ŁA`lB
+// CHANNEL_CLOSE MB
+void SSH2_mux_close(PTInstVar pvar, int channel_id)
+{
+	Channel_t *c = ssh2_channel_lookup(channel_id);
+
+	if (c == NULL || c->type != TYPE_MUX) {
+		return;
 	}
+	c->mux_num = -1;
 
-	return TRUE;
+	// ܂ OPEN_CONFIRMATION 󂯎ĂȂ΁A󂯎ĂB
+	// ȂAssh2_channel_send_close() ̌܂ő̂΂B
+	if (c->remote_id != -1) {
+		ssh2_channel_send_close(pvar, c);
+	}
 }
 
 static BOOL handle_SSH2_open_confirm(PTInstVar pvar)
@@ -7388,6 +8747,17 @@ static BOOL handle_SSH2_open_confirm(PTInstVar pvar)
 		pvar->session_nego_status = 1;
 	}
 
+	// OPEN  CONFIRMATION ܂ł̎Ԃ RTT ƂċL^B
+	// T[ȍԂ܂܂̂ŁAŏlgB
+	{
+		DWORD rtt = GetTickCount() - c->open_tick;
+
+		if (rtt == 0)
+			rtt = 1;
+		if (pvar->ssh2_rtt == 0 || rtt < pvar->ssh2_rtt)
+			pvar->ssh2_rtt = rtt;
+	}
+
 	// remote window size
 	c->remote_window = get_uint32_MSBfirst(data);
 	data += 4;
@@ -7400,6 +8770,16 @@ static BOOL handle_SSH2_open_confirm(PTInstVar pvar)
 		return TRUE;
 	}
 
+	if (c->type == TYPE_MUX) {
+		if (c->mux_num == -1) {
+			// JĂԂɃX[uؒf
+			ssh2_channel_send_close(pvar, c);
+		} else {
+			MUX_confirmed_open(pvar, c->mux_num);
+		}
+		return TRUE;
+	}
+
 	if (c->type == TYPE_SHELL) {
 		// |[gtH[fBȌ (2005.2.26, 2005.6.21 yutaka)
 		// VFI[vƂ X11 ̗voȂĂ͂ȂȂB(2005.7.3 yutaka)
@@ -7556,6 +8936,8 @@ static BOOL handle_SSH2_open_failure(PTInstVar pvar)
 	// ]`lɂ\Pbg̉RC (2007.7.26 maya)
 	if (c->type == TYPE_PORTFWD) {
 		FWD_free_channel(pvar, c->local_num);
+	} else if (c->type == TYPE_MUX) {
+		MUX_failed_open(pvar, c->mux_num);
 	}
 
 	// `l̉RC (2007.5.1 maya)
@@ -7754,6 +9136,47 @@ static BOOL handle_SSH2_channel_failure(PTInstVar pvar)
 
 
 
+// M[g RTT ш敝x(BDP)ςAwindow  BDP 2{ɖȂ
+// local_window_max  ChannelWindowMax ܂Ŕ{XōLB
+static void ssh2_channel_tune_window(PTInstVar pvar, Channel_t *c)
+{
+	unsigned int consumed, ceiling, newmax;
+	DWORD now, elapsed;
+	double bdp;
+	char log[160];
+
+	now = GetTickCount();
+	elapsed = now - c->window_adjust_tick;
+	if (elapsed == 0)
+		elapsed = 1;
+	consumed = c->local_window_max - c->local_window;
+	c->recv_rate = (unsigned int)min((double)consumed * 1000 / elapsed, UINT_MAX);
+	c->window_adjust_tick = now;
+
+	if (pvar->settings.ChannelWindowMax <= 0 || pvar->ssh2_rtt == 0)
+		return;
+	// ControlMaster ̃`ĺAX[uւ̏݃obt@Ɏ܂傫̂܂܂ɂB
+	if (c->type == TYPE_MUX)
+		return;
+	ceiling = (unsigned int)min(pvar->settings.ChannelWindowMax, INT_MAX / 1024) * 1024;
+	if (c->local_window_max >= ceiling)
+		return;
+
+	bdp = (double)c->recv_rate * pvar->ssh2_rtt / 1000;
+	if (bdp * 2 <= c->local_window_max)
+		return;
+
+	newmax = c->local_window_max * 2;
+	if (newmax > ceiling || newmax < c->local_window_max)
+		newmax = ceiling;
+	c->local_window_max = newmax;
+
+	_snprintf_s(log, sizeof(log), _TRUNCATE,
+	            "channel receive window grown to %u. local:%d remote:%d rate:%u bytes/s rtt:%lu ms",
+	            c->local_window_max, c->self_id, c->remote_id, c->recv_rate, pvar->ssh2_rtt);
+	notify_verbose_message(pvar, log, LOG_LEVEL_VERBOSE);
+}
+
 // NCAgwindow sizeT[o֒m点
 static void do_SSH2_adjust_window_size(PTInstVar pvar, Channel_t *c)
 {
@@ -7763,11 +9186,29 @@ static void do_SSH2_adjust_window_size(PTInstVar pvar, Channel_t *c)
 	unsigned char *outmsg;
 	int len;
 
+	// SCPMŁAfBXNւ݂̏ǂɃL[֗܂ĂԂ window JȂB
+	// ݃XbhL[炵AWM_SCP_WRITTEN ŉ߂ČĂ΂B
+	if (c->type == TYPE_SCP && c->scp.dir == FROMREMOTE &&
+	    c->scp.write_queued >= SCP_WRITE_QUEUE_MAX)
+		return;
+
+	// ControlMaster ŁAX[uւ݂̏ǂɗ܂ĂԂB
+	// ݂i񂾂ASSH2_mux_resume_window() ŉ߂ČĂ΂B
+	if (c->type == TYPE_MUX && c->mux_num != -1 && MUX_is_congested(pvar, c->mux_num))
+		return;
+
 	// [Jwindow sizeɂ܂]TȂAȂB
 	// added /2 (2006.3.6 yutaka)
-	if (c->local_window > c->local_window_max/2)
+	// Lȏꍇ́AM window g؂Ȃ悤 1/4 _őB
+	if (pvar->settings.ChannelWindowMax > 0) {
+		if (c->local_window > c->local_window_max/4*3)
+			return;
+	}
+	else if (c->local_window > c->local_window_max/2)
 		return;
 
+	ssh2_channel_tune_window(pvar, c);
+
 	{
 		// pty open
 		msg = buffer_init();
@@ -7805,6 +9246,17 @@ void ssh2_channel_send_close(PTInstVar pvar, Channel_t *c)
 			return;
 		}
 
+		// ⑗M҂̃f[^Ԃ́AL[󂢂Ă瑗B
+		if (pvar->rekeying || c->bufchain) {
+			if (!(c->state & SSH_CHANNEL_STATE_CLOSE_PENDING)) {
+				c->state |= SSH_CHANNEL_STATE_CLOSE_PENDING;
+				_snprintf_s(log, sizeof(log), _TRUNCATE, "SSH2_MSG_CHANNEL_CLOSE is deferred until queued data is sent. local:%d remote:%d", c->self_id, c->remote_id);
+				notify_verbose_message(pvar, log, LOG_LEVEL_VERBOSE);
+			}
+			return;
+		}
+		c->state &= ~SSH_CHANNEL_STATE_CLOSE_PENDING;
+
 		// SSH2 serverchannel close`
 		msg = buffer_init();
 		if (msg == NULL) {
@@ -7830,6 +9282,7 @@ void ssh2_channel_send_close(PTInstVar pvar, Channel_t *c)
 #define WM_SENDING_FILE (WM_USER + 1)
 #define WM_CHANNEL_CLOSE (WM_USER + 2)
 #define WM_GET_CLOSED_STATUS (WM_USER + 3)
+#define WM_SCP_WRITTEN (WM_USER + 4)
 
 typedef struct scp_dlg_parm {
 	Channel_t *c;
@@ -7838,6 +9291,54 @@ typedef struct scp_dlg_parm {
 	size_t buflen;
 } scp_dlg_parm_t;
 
+// SCPt@C]̐i\BCXbhĂԂƁB
+// ]Xbh~߂Ȃ悤A\̍XV͈ԊuƂɂ܂Ƃ߂čsB
+static void ssh2_scp_show_progress(Channel_t *c, long long done, long long total)
+{
+	HWND hWnd = c->scp.progress_window;
+	char s[80];
+	int rate, elapsed;
+	DWORD now;
+
+	if (hWnd == NULL)
+		return;
+
+	now = GetTickCount();
+	if (done < total && now - c->scp.progress_tick < 100)
+		return;
+	c->scp.progress_tick = now;
+
+	if (total > 0) {
+		rate = (int)(100 * done / total);
+	} else {
+		rate = 100;
+	}
+	_snprintf_s(s, sizeof(s), _TRUNCATE, "%lld / %lld (%d%%)", done, total, rate);
+	SendDlgItemMessage(hWnd, IDC_PROGRESS, WM_SETTEXT, 0, (LPARAM)s);
+	if (c->scp.progress_rate != rate) {
+		c->scp.progress_rate = rate;
+		SendDlgItemMessage(hWnd, IDC_PROGBAR, PBM_SETPOS, (WPARAM)rate, 0);
+	}
+
+	elapsed = (now - c->scp.progress_start) / 1000;
+	if (elapsed > 2) {
+		rate = (int)(done / elapsed);
+		if (rate < 1200) {
+			_snprintf_s(s, sizeof(s), _TRUNCATE, "%d:%02d (%d %s)", elapsed / 60, elapsed % 60, rate, "Bytes/s");
+		}
+		else if (rate < 1200000) {
+			_snprintf_s(s, sizeof(s), _TRUNCATE, "%d:%02d (%d.%02d %s)", elapsed / 60, elapsed % 60, rate / 1000, rate / 10 % 100, "KBytes/s");
+		}
+		else {
+			_snprintf_s(s, sizeof(s), _TRUNCATE, "%d:%02d (%d.%02d %s)", elapsed / 60, elapsed % 60, rate / (1000 * 1000), rate / 10000 % 100, "MBytes/s");
+		}
+	}
+	else {
+		_snprintf_s(s, sizeof(s), _TRUNCATE, "%d:%02d", elapsed / 60, elapsed % 60);
+	}
+	SendDlgItemMessage(hWnd, IDC_PROGTIME, WM_SETTEXT, 0, (LPARAM)s);
+}
+
 static LRESULT CALLBACK ssh_scp_dlg_proc(HWND hWnd, UINT msg, WPARAM wp, LPARAM lp)
 {
 	static int closed = 0;
@@ -7851,8 +9352,23 @@ static LRESULT CALLBACK ssh_scp_dlg_proc(HWND hWnd, UINT msg, WPARAM wp, LPARAM
 		case WM_CHANNEL_CLOSE:
 			{
 			scp_dlg_parm_t *parm = (scp_dlg_parm_t *)wp;
+			PTInstVar pvar = parm->pvar;
+			int err = parm->c->scp.write_error;
+			char msg[MAX_PATH + 256];
+
+			// ݃Xbht@Cւ݂̏ɎsĎ~܂
+			if (err != 0) {
+				UTIL_get_lang_msg("MSG_SSH_SCP_WRITE_ERROR", pvar,
+				                  "Failed to write the received file.\n%s: %s");
+				_snprintf_s(msg, sizeof(msg), _TRUNCATE, pvar->ts->UIMsg,
+				            parm->c->scp.localfilefull, strerror(err));
+			}
 
-			ssh2_channel_send_close(parm->pvar, parm->c);
+			ssh2_channel_send_close(pvar, parm->c);
+
+			if (err != 0) {
+				notify_nonfatal_error(pvar, msg);
+			}
 			}
 			return TRUE;
 			break;
@@ -7862,6 +9378,24 @@ static LRESULT CALLBACK ssh_scp_dlg_proc(HWND hWnd, UINT msg, WPARAM wp, LPARAM
 			scp_dlg_parm_t *parm = (scp_dlg_parm_t *)wp;
 
 			SSH2_send_channel_data(parm->pvar, parm->c, parm->buf, parm->buflen, 0);
+			// EOF  1byte ͓]ʂɊ܂߂Ȃ
+			if (parm->c->scp.state != SCP_DATA) {
+				parm->c->scp.filesendsize += parm->buflen;
+				ssh2_scp_show_progress(parm->c, parm->c->scp.filesendsize, parm->c->scp.filestat.st_size);
+				ssh2_scp_job_progress(parm->c, parm->buflen);
+			}
+			}
+			return TRUE;
+			break;
+
+		// SCPt@CM(remote-to-local)A݃L[~߂Ă window JB
+		case WM_SCP_WRITTEN:
+			{
+			Channel_t *c = (Channel_t *)wp;
+
+			if (c->used && c->type == TYPE_SCP && !(c->state & SSH_CHANNEL_STATE_CLOSE_SENT)) {
+				do_SSH2_adjust_window_size(c->scp.pvar, c);
+			}
 			}
 			return TRUE;
 			break;
@@ -7941,16 +9475,12 @@ static unsigned __stdcall ssh_scp_thread(void FAR * p)
 {
 	Channel_t *c = (Channel_t *)p;
 	PTInstVar pvar = c->scp.pvar;
-	long long total_size = 0;
 	char *buf = NULL;
 	size_t buflen;
-	char s[80];
 	size_t ret;
 	HWND hWnd = c->scp.progress_window;
 	scp_dlg_parm_t parm;
-	int rate, ProgStat;
-	DWORD stime;
-	int elapsed, prev_elapsed;
+	int ProgStat;
 
 	buflen = min(c->remote_window, 8192*4); // max 32KB
 	buf = malloc(buflen);
@@ -7960,11 +9490,14 @@ static unsigned __stdcall ssh_scp_thread(void FAR * p)
 
 	InitDlgProgress(hWnd, IDC_PROGBAR, &ProgStat);
 
-	stime = GetTickCount();
-	prev_elapsed = 0;
+	// i̕\ WM_SENDING_FILE 郁CXbhōs
+	c->scp.filesendsize = 0;
+	c->scp.progress_start = GetTickCount();
+	c->scp.progress_tick = c->scp.progress_start;
+	c->scp.progress_rate = ProgStat;
 
 	do {
-		int readlen, count=0;
+		int readlen;
 
 		// Cancel{^ꂽEBhEB
 		if (is_canceled_window(hWnd))
@@ -7976,23 +9509,24 @@ static unsigned __stdcall ssh_scp_thread(void FAR * p)
 		if (ret == 0)
 			break;
 
-		// remote_window 񕜂܂ő҂
-		do {
+		// remote_window JAM҂L[󂭂܂ő҂B
+		// window Ɏ܂Ȃ SSH2_send_channel_data() L[֐ςނ̂ŁA
+		// window ł󂢂ĂΑĂ悢B
+		while (c->remote_window == 0 || c->bufchain_amount >= CHAN_BUFCHAIN_MAX) {
 			// socket or channelN[YꂽXbhI
 			if (pvar->socket == INVALID_SOCKET || c->scp.state == SCP_CLOSING || c->used == 0)
 				goto abort;
 
-			if (ret > c->remote_window) {
-				Sleep(100);
-			}
+			if (is_canceled_window(hWnd))
+				goto cancel_abort;
 
-			// 100񔲂Ȃ甲Ă܂
-			count++;
-			if (count > 100) {
-				break;
-			}
+			// WINDOW_ADJUST ̎MŋNBCancel{^̊mF̂߁A莞ԂłNB
+			WaitForSingleObject(c->scp.window_event, 500);
+		}
 
-		} while (ret > c->remote_window);
+		// socket or channelN[YꂽXbhI
+		if (pvar->socket == INVALID_SOCKET || c->scp.state == SCP_CLOSING || c->used == 0)
+			goto abort;
 
 		// sending data
 		parm.buf = buf;
@@ -8001,37 +9535,6 @@ static unsigned __stdcall ssh_scp_thread(void FAR * p)
 		parm.pvar = pvar;
 		SendMessage(hWnd, WM_SENDING_FILE, (WPARAM)&parm, 0);
 
-		total_size += ret;
-
-		rate = (int)(100 * total_size / c->scp.filestat.st_size);
-		_snprintf_s(s, sizeof(s), _TRUNCATE, "%lld / %lld (%d%%)", total_size, c->scp.filestat.st_size, rate);
-		SendMessage(GetDlgItem(hWnd, IDC_PROGRESS), WM_SETTEXT, 0, (LPARAM)s);
-		if (ProgStat != rate) {
-			ProgStat = rate;
-			SendDlgItemMessage(hWnd, IDC_PROGBAR, PBM_SETPOS, (WPARAM)ProgStat, 0);
-		}
-
-		elapsed = (GetTickCount() - stime) / 1000;
-		if (elapsed > prev_elapsed) {
-			if (elapsed > 2) {
-				rate = (int)(total_size / elapsed);
-				if (rate < 1200) {
-					_snprintf_s(s, sizeof(s), _TRUNCATE, "%d:%02d (%d %s)", elapsed / 60, elapsed % 60, rate, "Bytes/s");
-				}
-				else if (rate < 1200000) {
-					_snprintf_s(s, sizeof(s), _TRUNCATE, "%d:%02d (%d.%02d %s)", elapsed / 60, elapsed % 60, rate / 1000, rate / 10 % 100, "KBytes/s");
-				}
-				else {
-					_snprintf_s(s, sizeof(s), _TRUNCATE, "%d:%02d (%d.%02d %s)", elapsed / 60, elapsed % 60, rate / (1000 * 1000), rate / 10000 % 100, "MBytes/s");
-				}
-			}
-			else {
-				_snprintf_s(s, sizeof(s), _TRUNCATE, "%d:%02d", elapsed / 60, elapsed % 60);
-			}
-			SendDlgItemMessage(hWnd, IDC_PROGTIME, WM_SETTEXT, 0, (LPARAM)s);
-			prev_elapsed = elapsed;
-		}
-
 	} while (ret <= buflen);
 
 	// eof
@@ -8117,99 +9620,153 @@ static void SSH2_scp_toremote(PTInstVar pvar, Channel_t *c, unsigned char *data,
 }
 
 
-#define WM_RECEIVING_FILE (WM_USER + 2)
+// SCPMf[^̏݃L[BCXbh̃ubN֎Mf[^l߁A
+// ݃XbhlߏIubN擪oāA܂Ƃ߂ăfBXN֏B
+typedef struct scp_write_block {
+	struct scp_write_block *next;
+	unsigned int len;
+	unsigned char data[SCP_WRITE_BLOCK];
+} scp_write_block_t;
+
+// Mf[^݃L[֐ςށBCXbhĂԂƁB
+static BOOL ssh2_scp_write_enqueue(Channel_t *c, unsigned char *data, unsigned int buflen, int eof)
+{
+	scp_write_block_t *blk;
+	unsigned int n;
+	BOOL ready;
+
+	EnterCriticalSection(&c->scp.write_lock);
+	while (buflen > 0) {
+		blk = c->scp.write_tail;
+		if (blk == NULL || blk->len == SCP_WRITE_BLOCK) {
+			blk = malloc(sizeof(scp_write_block_t));
+			if (blk == NULL) {
+				LeaveCriticalSection(&c->scp.write_lock);
+				return FALSE;
+			}
+			blk->next = NULL;
+			blk->len = 0;
+			if (c->scp.write_tail != NULL) {
+				c->scp.write_tail->next = blk;
+			} else {
+				c->scp.write_head = blk;
+			}
+			c->scp.write_tail = blk;
+		}
+
+		n = min(buflen, SCP_WRITE_BLOCK - blk->len);
+		memcpy(blk->data + blk->len, data, n);
+		blk->len += n;
+		c->scp.write_queued += n;
+		data += n;
+		buflen -= n;
+	}
+	if (eof)
+		c->scp.write_eof = 1;
+	// lߏIubNłƂ݃XbhN
+	ready = (c->scp.write_eof ||
+	         (c->scp.write_head != NULL && c->scp.write_head->len == SCP_WRITE_BLOCK));
+	LeaveCriticalSection(&c->scp.write_lock);
+
+	if (ready)
+		SetEvent(c->scp.write_event);
+
+	return TRUE;
+}
+
+// ݃XbhIɁAcubN̂ĂB
+static void ssh2_scp_write_free(Channel_t *c)
+{
+	scp_write_block_t *blk;
+
+	if (c->scp.write_event == NULL)
+		return;
+
+	while (c->scp.write_head != NULL) {
+		blk = c->scp.write_head;
+		c->scp.write_head = blk->next;
+		free(blk);
+	}
+	c->scp.write_tail = NULL;
+	c->scp.write_queued = 0;
+
+	DeleteCriticalSection(&c->scp.write_lock);
+	CloseHandle(c->scp.write_event);
+	c->scp.write_event = NULL;
+}
+
+static void ssh2_scp_fsync(FILE *fp)
+{
+	fflush(fp);
+	_commit(_fileno(fp));
+}
 
+// SCPM̏݃XbhBM(CXbh)̓L[֐ςނŁA
+// fBXNxĂlbg[N̎M͎~߂ȂB
 static unsigned __stdcall ssh_scp_receive_thread(void FAR * p)
 {
 	Channel_t *c = (Channel_t *)p;
 	PTInstVar pvar = c->scp.pvar;
-	long long total_size = 0;
-	char s[80];
 	HWND hWnd = c->scp.progress_window;
-	MSG msg;
-	unsigned char *data;
-	unsigned int buflen;
-	int eof;
-	int rate, ProgStat;
-	DWORD stime;
-	int elapsed, prev_elapsed;
 	scp_dlg_parm_t parm;
-
-	InitDlgProgress(hWnd, IDC_PROGBAR, &ProgStat);
-
-	stime = GetTickCount();
-	prev_elapsed = 0;
+	scp_write_block_t *blk;
+	BOOL eof, congested;
 
 	for (;;) {
 		// Cancel{^ꂽEBhEB
 		if (is_canceled_window(hWnd))
 			goto cancel_abort;
 
-		if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE) != 0) {
-			switch (msg.message) {
-			case WM_RECEIVING_FILE:
-				data = (unsigned char *)msg.wParam;
-				buflen = (unsigned int)msg.lParam;
-				eof = 0;
-
-				if (c->scp.filercvsize >= c->scp.filetotalsize) { // EOF
-					free(data);  // free!
-					goto done;
-				}
-
-				if (c->scp.filercvsize + buflen > c->scp.filetotalsize) { // overflow (include EOF)
-					buflen = (unsigned int)(c->scp.filetotalsize - c->scp.filercvsize);
-					eof = 1;
-				}
-
-				c->scp.filercvsize += buflen;
-
-				if (fwrite(data, 1, buflen, c->scp.localfp) < buflen) { // error
-					// TODO:
-				}
-
-				free(data);  // free!
-
-				rate =(int)(100 * c->scp.filercvsize / c->scp.filetotalsize);
-				_snprintf_s(s, sizeof(s), _TRUNCATE, "%lld / %lld (%d%%)", c->scp.filercvsize, c->scp.filetotalsize, rate);
-				SendMessage(GetDlgItem(c->scp.progress_window, IDC_PROGRESS), WM_SETTEXT, 0, (LPARAM)s);
+		// `l폜Ƃ́AĉĂďI
+		if (c->scp.state == SCP_CLOSING)
+			goto abort;
+
+		EnterCriticalSection(&c->scp.write_lock);
+		blk = c->scp.write_head;
+		eof = c->scp.write_eof;
+		if (blk != NULL && (blk->len == SCP_WRITE_BLOCK || eof)) {
+			c->scp.write_head = blk->next;
+			if (c->scp.write_head == NULL)
+				c->scp.write_tail = NULL;
+		} else {
+			blk = NULL;
+		}
+		LeaveCriticalSection(&c->scp.write_lock);
 
-				if (ProgStat != rate) {
-					ProgStat = rate;
-					SendDlgItemMessage(c->scp.progress_window, IDC_PROGBAR, PBM_SETPOS, (WPARAM)ProgStat, 0);
-				}
+		if (blk == NULL) {
+			if (eof)
+				goto done;
+			// Mf[^܂ƋNBCancel{^̊mF̂߁A莞ԂłNB
+			WaitForSingleObject(c->scp.write_event, 500);
+			continue;
+		}
 
-				elapsed = (GetTickCount() - stime) / 1000;
-				if (elapsed > prev_elapsed) {
-					if (elapsed > 2) {
-						rate = (int)(c->scp.filercvsize / elapsed);
-						if (rate < 1200) {
-							_snprintf_s(s, sizeof(s), _TRUNCATE, "%d:%02d (%d %s)", elapsed / 60, elapsed % 60, rate, "Bytes/s");
-						}
-						else if (rate < 1200000) {
-							_snprintf_s(s, sizeof(s), _TRUNCATE, "%d:%02d (%d.%02d %s)", elapsed / 60, elapsed % 60, rate / 1000, rate / 10 % 100, "KBytes/s");
-						}
-						else {
-							_snprintf_s(s, sizeof(s), _TRUNCATE, "%d:%02d (%d.%02d %s)", elapsed / 60, elapsed % 60, rate / (1000 * 1000), rate / 10000 % 100, "MBytes/s");
-						}
-					}
-					else {
-						_snprintf_s(s, sizeof(s), _TRUNCATE, "%d:%02d", elapsed / 60, elapsed % 60);
-					}
-					SendDlgItemMessage(hWnd, IDC_PROGTIME, WM_SETTEXT, 0, (LPARAM)s);
-					prev_elapsed = elapsed;
-				}
+		if (fwrite(blk->data, 1, blk->len, c->scp.localfp) < blk->len) {
+			// G[̕\́A`lƂɃCXbhōs
+			c->scp.write_error = (errno != 0) ? errno : EIO;
+			free(blk);
+			goto cancel_abort;
+		}
+		if (pvar->settings.ScpFsync == 2) {
+			ssh2_scp_fsync(c->scp.localfp);
+		}
 
-				if (eof)
-					goto done;
+		EnterCriticalSection(&c->scp.write_lock);
+		congested = (c->scp.write_queued >= SCP_WRITE_QUEUE_MAX);
+		c->scp.write_queued -= blk->len;
+		congested = congested && (c->scp.write_queued < SCP_WRITE_QUEUE_MAX);
+		LeaveCriticalSection(&c->scp.write_lock);
+		free(blk);
 
-				break;
-			}
-		}
-		Sleep(0);
+		// ~߂Ă window ACXbhŊJĂ炤
+		if (congested)
+			PostMessage(hWnd, WM_SCP_WRITTEN, (WPARAM)c, 0);
 	}
 
 done:
+	if (pvar->settings.ScpFsync == 1) {
+		ssh2_scp_fsync(c->scp.localfp);
+	}
 	c->scp.state = SCP_CLOSING;
 	ShowWindow(c->scp.progress_window, SW_HIDE);
 
@@ -8221,6 +9778,7 @@ cancel_abort:
 	parm.pvar = pvar;
 	SendMessage(hWnd, WM_CHANNEL_CLOSE, (WPARAM)&parm, 0);
 
+abort:
 	return 0;
 }
 
@@ -8263,6 +9821,8 @@ static BOOL SSH2_scp_fromremote(PTInstVar pvar, Channel_t *c, unsigned char *dat
 			// WindowsȂ̂Ńp[~bV͖BTCŶ݋L^B
 			c->scp.filetotalsize = size;
 			c->scp.filercvsize = 0;
+			if (c->scp.job)
+				c->scp.pvar->ssh_state.scp_queue.batch_size += size;
 
 			c->scp.state = SCP_DATA;
 
@@ -8274,8 +9834,19 @@ static BOOL SSH2_scp_fromremote(PTInstVar pvar, Channel_t *c, unsigned char *dat
 				c->scp.progress_window = hDlgWnd;
 				SetWindowText(hDlgWnd, "TTSSH: SCP receiving file");
 				SendMessage(GetDlgItem(hDlgWnd, IDC_FILENAME), WM_SETTEXT, 0, (LPARAM)c->scp.localfilefull);
+				InitDlgProgress(hDlgWnd, IDC_PROGBAR, &c->scp.progress_rate);
 				ShowWindow(hDlgWnd, SW_SHOW);
 			}
+			c->scp.progress_start = GetTickCount();
+			c->scp.progress_tick = c->scp.progress_start;
+
+			// ݃L[
+			InitializeCriticalSection(&c->scp.write_lock);
+			c->scp.write_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+			c->scp.write_head = NULL;
+			c->scp.write_tail = NULL;
+			c->scp.write_queued = 0;
+			c->scp.write_eof = 0;
 
 			thread = (HANDLE)_beginthreadex(NULL, 0, ssh_scp_receive_thread, c, 0, &tid);
 			if (thread == (HANDLE)-1) {
@@ -8297,27 +9868,20 @@ static BOOL SSH2_scp_fromremote(PTInstVar pvar, Channel_t *c, unsigned char *dat
 		}
 
 	} else if (c->scp.state == SCP_DATA) {  // payload̎M
-		unsigned char *newdata = malloc(buflen);
-		BOOL ret;
-		DWORD texit;
-		if (newdata != NULL) {
-			memcpy(newdata, data, buflen);
-			do {
-				// SCPt@CMɁAt@CM𒆒fƁA[vɊׂ邱Ƃ邽߁A
-				// XbhIĂ邩ǂ𔻕ʂB
-				// (2014.7.6 yutaka)
-				texit = STILL_ACTIVE;
-				GetExitCodeThread(c->scp.thread, &texit);
-				if (texit != STILL_ACTIVE) {
-					texit = texit;
-					break;
-				}
+		int eof = 0;
+
+		// t@CTCY𒴂(̃Xe[^X)͏܂Ȃ
+		if (c->scp.filercvsize + buflen >= c->scp.filetotalsize) {
+			buflen = (unsigned int)(c->scp.filetotalsize - c->scp.filercvsize);
+			eof = 1;
+		}
+		c->scp.filercvsize += buflen;
+		ssh2_scp_job_progress(c, buflen);
+		ssh2_scp_show_progress(c, c->scp.filercvsize, c->scp.filetotalsize);
 
-				// XbhL[ĂȂꍇAbZ[W|Xgs邱Ƃ̂ŁA
-				// gCBMSDNɂƏĂB
-				// (2011.6.15 yutaka)
-				ret = PostThreadMessage(c->scp.thread_id, WM_RECEIVING_FILE, (WPARAM)newdata, (LPARAM)buflen);
-			} while (ret == FALSE);
+		// fBXNւ݂̏͏݃XbhɔC
+		if (!ssh2_scp_write_enqueue(c, data, buflen, eof)) {
+			return FALSE;
 		}
 
 	} else if (c->scp.state == SCP_CLOSING) {  // EOF̎M
@@ -8454,6 +10018,9 @@ static BOOL handle_SSH2_channel_data(PTInstVar pvar)
 	} else if (c->type == TYPE_SFTP) {  // SFTP
 		sftp_response(pvar, c, data, str_len);
 
+	} else if (c->type == TYPE_MUX) {  // ControlMaster
+		MUX_received_data(pvar, c->mux_num, data, str_len);
+
 	} else if (c->type == TYPE_AGENT) {  // agent forward
 		if (!SSH_agent_response(pvar, c, 0, data, str_len)) {
 			return FALSE;
@@ -8534,6 +10101,9 @@ static BOOL handle_SSH2_channel_extended_data(PTInstVar pvar)
 
 	} else if (c->type == TYPE_SFTP) {  // SFTP
 
+	} else if (c->type == TYPE_MUX) {  // ControlMaster
+		MUX_received_data(pvar, c->mux_num, data, strlen);
+
 	} else if (c->type == TYPE_AGENT) {  // agent forward
 		if (!SSH_agent_response(pvar, c, 0, data, strlen)) {
 			return FALSE;
@@ -8766,6 +10336,20 @@ static BOOL handle_SSH2_channel_close(PTInstVar pvar)
 	_snprintf_s(log, sizeof(log), _TRUNCATE, "SSH2_MSG_CHANNEL_CLOSE was received. local:%d remote:%d", c->self_id, c->remote_id);
 	notify_verbose_message(pvar, log, LOG_LEVEL_VERBOSE);
 
+	if (c->window_stall_count > 0) {
+		_snprintf_s(log, sizeof(log), _TRUNCATE, "channel window stalled %u times, %lums in total. local:%d remote:%d",
+		            c->window_stall_count, c->window_stall_total, c->self_id, c->remote_id);
+		notify_verbose_message(pvar, log, LOG_LEVEL_VERBOSE);
+	}
+	_snprintf_s(log, sizeof(log), _TRUNCATE, "channel receive window %u, last receive rate %u bytes/s. local:%d remote:%d",
+	            c->local_window_max, c->recv_rate, c->self_id, c->remote_id);
+	notify_verbose_message(pvar, log, LOG_LEVEL_VERBOSE);
+
+	// ͂f[^󂯎Ȃ̂ŁAM҂̃f[^͎̂ĂB
+	// ł΁ACLOSE ̑Ԃ NEWKEYS ̌ɉ񂳂B
+	ssh2_channel_free_bufchain(c);
+	c->state &= ~SSH_CHANNEL_STATE_EOF_PENDING;
+
 	if (c->type == TYPE_SHELL) {
 		ssh2_channel_send_close(pvar, c);
 
@@ -8781,11 +10365,16 @@ static BOOL handle_SSH2_channel_close(PTInstVar pvar)
 		FWD_free_channel(pvar, c->local_num);
 
 		// `l̉RC (2007.4.26 yutaka)
-		ssh2_channel_delete(c);
+		ssh2_channel_delete_after_close(c);
 
 	} else if (c->type == TYPE_SCP) {
 		ssh2_channel_delete(c);
 
+	} else if (c->type == TYPE_MUX) {
+		ssh2_channel_send_close(pvar, c);
+		MUX_channel_closed(pvar, c->mux_num);
+		ssh2_channel_delete_after_close(c);
+
 	} else if (c->type == TYPE_AGENT) {
 		ssh2_channel_delete(c);
 
@@ -8918,6 +10507,9 @@ static BOOL handle_SSH2_window_adjust(PTInstVar pvar)
 	// c
 	ssh2_channel_retry_send_bufchain(pvar, c);
 
+	// ͑c𑗂ȂAwindow ͊ĴőMXbh֒m点
+	ssh2_channel_notify_window(c);
+
 	return TRUE;
 }
 
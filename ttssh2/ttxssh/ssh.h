@@ -35,6 +35,7 @@ See LICENSE.TXT for the license.
 #define __SSH_H
 
 #include "zlib.h"
+#include <zstd.h>
 #include <openssl/evp.h>
 
 #include "buffer.h"
@@ -49,7 +50,6 @@ See LICENSE.TXT for the license.
 }
 
 // from OpenSSH
-extern const EVP_CIPHER *evp_aes_128_ctr(void);
 extern const EVP_CIPHER *evp_des3_ctr(void);
 extern const EVP_CIPHER *evp_bf_ctr(void);
 extern const EVP_CIPHER *evp_cast5_ctr(void);
@@ -93,7 +93,8 @@ typedef enum {
 	SSH2_CIPHER_3DES_CTR, SSH2_CIPHER_BLOWFISH_CTR, SSH2_CIPHER_CAST128_CTR,
 	SSH2_CIPHER_CAMELLIA128_CBC, SSH2_CIPHER_CAMELLIA192_CBC, SSH2_CIPHER_CAMELLIA256_CBC,
 	SSH2_CIPHER_CAMELLIA128_CTR, SSH2_CIPHER_CAMELLIA192_CTR, SSH2_CIPHER_CAMELLIA256_CTR,
-	SSH_CIPHER_MAX = SSH2_CIPHER_CAMELLIA256_CTR,
+	SSH2_CIPHER_AES128_GCM, SSH2_CIPHER_AES256_GCM, SSH2_CIPHER_CHACHAPOLY,
+	SSH_CIPHER_MAX = SSH2_CIPHER_CHACHAPOLY,
 } SSHCipher;
 
 typedef enum {
@@ -111,7 +112,7 @@ typedef enum {
 #define SSH_PROTOFLAG_HOST_IN_FWD_OPEN 2
 
 enum channel_type {
-	TYPE_SHELL, TYPE_PORTFWD, TYPE_SCP, TYPE_SFTP, TYPE_AGENT,
+	TYPE_SHELL, TYPE_PORTFWD, TYPE_SCP, TYPE_SFTP, TYPE_AGENT, TYPE_MUX,
 };
 
 // for SSH1
@@ -124,6 +125,19 @@ enum channel_type {
 #define CHAN_SES_WINDOW_DEFAULT (4*CHAN_SES_PACKET_DEFAULT)
 #define CHAN_TCP_PACKET_DEFAULT (32*1024)
 #define CHAN_TCP_WINDOW_DEFAULT (4*CHAN_TCP_PACKET_DEFAULT)
+
+// MpPbgobt@̏TCYBCHANNEL_DATA 1pPbg(wb_ApfBOAMAC)
+// ŏmۂĂAM̂т realloc Ȃ悤ɂB
+#define SSH_OUTBUF_INITIAL_SIZE (CHAN_SES_PACKET_DEFAULT + 256)
+
+// `l̑M҂L[(bufchain)̗ʂ𒴂A|[gtH[fBO
+// [J\Pbg̓ǂݍ݂SCPM~߂āAL[󂭂̂҂B
+#define CHAN_BUFCHAIN_MAX CHAN_TCP_WINDOW_DEFAULT
+
+// SCPMf[^́Ȃ傫̃ubNɂ܂Ƃ߂Ă珑݃XbhŃfBXN֏B
+// ݑ҂̃f[^SCP_WRITE_QUEUE_MAX𒴂AI܂ window JȂB
+#define SCP_WRITE_BLOCK (256*1024)
+#define SCP_WRITE_QUEUE_MAX (16*SCP_WRITE_BLOCK)
 #if 0 // unused
 #define CHAN_X11_PACKET_DEFAULT (16*1024)
 #define CHAN_X11_WINDOW_DEFAULT (4*CHAN_X11_PACKET_DEFAULT)
@@ -344,40 +358,44 @@ typedef struct ssh2_cipher {
 	int block_size;
 	int key_len;
 	int discard_len;
+	int auth_len;
 	const EVP_CIPHER *(*func)(void);
 } ssh2_cipher_t;
 
 static ssh2_cipher_t ssh2_ciphers[] = {
-	{SSH2_CIPHER_3DES_CBC,        "3des-cbc",         8, 24,    0, EVP_des_ede3_cbc},     // RFC4253
-	{SSH2_CIPHER_AES128_CBC,      "aes128-cbc",      16, 16,    0, EVP_aes_128_cbc},      // RFC4253
-	{SSH2_CIPHER_AES192_CBC,      "aes192-cbc",      16, 24,    0, EVP_aes_192_cbc},      // RFC4253
-	{SSH2_CIPHER_AES256_CBC,      "aes256-cbc",      16, 32,    0, EVP_aes_256_cbc},      // RFC4253
-	{SSH2_CIPHER_BLOWFISH_CBC,    "blowfish-cbc",     8, 16,    0, EVP_bf_cbc},           // RFC4253
-	{SSH2_CIPHER_AES128_CTR,      "aes128-ctr",      16, 16,    0, evp_aes_128_ctr},      // RFC4344
-	{SSH2_CIPHER_AES192_CTR,      "aes192-ctr",      16, 24,    0, evp_aes_128_ctr},      // RFC4344
-	{SSH2_CIPHER_AES256_CTR,      "aes256-ctr",      16, 32,    0, evp_aes_128_ctr},      // RFC4344
-	{SSH2_CIPHER_ARCFOUR,         "arcfour",          8, 16,    0, EVP_rc4},              // RFC4253
-	{SSH2_CIPHER_ARCFOUR128,      "arcfour128",       8, 16, 1536, EVP_rc4},              // RFC4345
-	{SSH2_CIPHER_ARCFOUR256,      "arcfour256",       8, 32, 1536, EVP_rc4},              // RFC4345
-	{SSH2_CIPHER_CAST128_CBC,     "cast128-cbc",      8, 16,    0, EVP_cast5_cbc},        // RFC4253
-	{SSH2_CIPHER_3DES_CTR,        "3des-ctr",         8, 24,    0, evp_des3_ctr},         // RFC4344
-	{SSH2_CIPHER_BLOWFISH_CTR,    "blowfish-ctr",     8, 16,    0, evp_bf_ctr},           // RFC4344
-	{SSH2_CIPHER_CAST128_CTR,     "cast128-ctr",      8, 16,    0, evp_cast5_ctr},        // RFC4344
-	{SSH2_CIPHER_CAMELLIA128_CBC, "camellia128-cbc", 16, 16,    0, EVP_camellia_128_cbc}, // draft-kanno-secsh-camellia-02
-	{SSH2_CIPHER_CAMELLIA192_CBC, "camellia192-cbc", 16, 24,    0, EVP_camellia_192_cbc}, // draft-kanno-secsh-camellia-02
-	{SSH2_CIPHER_CAMELLIA256_CBC, "camellia256-cbc", 16, 32,    0, EVP_camellia_256_cbc}, // draft-kanno-secsh-camellia-02
-	{SSH2_CIPHER_CAMELLIA128_CTR, "camellia128-ctr", 16, 16,    0, evp_camellia_128_ctr}, // draft-kanno-secsh-camellia-02
-	{SSH2_CIPHER_CAMELLIA192_CTR, "camellia192-ctr", 16, 24,    0, evp_camellia_128_ctr}, // draft-kanno-secsh-camellia-02
-	{SSH2_CIPHER_CAMELLIA256_CTR, "camellia256-ctr", 16, 32,    0, evp_camellia_128_ctr}, // draft-kanno-secsh-camellia-02
+	{SSH2_CIPHER_3DES_CBC,        "3des-cbc",         8, 24,    0, 0, EVP_des_ede3_cbc},     // RFC4253
+	{SSH2_CIPHER_AES128_CBC,      "aes128-cbc",      16, 16,    0, 0, EVP_aes_128_cbc},      // RFC4253
+	{SSH2_CIPHER_AES192_CBC,      "aes192-cbc",      16, 24,    0, 0, EVP_aes_192_cbc},      // RFC4253
+	{SSH2_CIPHER_AES256_CBC,      "aes256-cbc",      16, 32,    0, 0, EVP_aes_256_cbc},      // RFC4253
+	{SSH2_CIPHER_BLOWFISH_CBC,    "blowfish-cbc",     8, 16,    0, 0, EVP_bf_cbc},           // RFC4253
+	{SSH2_CIPHER_AES128_CTR,      "aes128-ctr",      16, 16,    0, 0, EVP_aes_128_ctr},      // RFC4344
+	{SSH2_CIPHER_AES192_CTR,      "aes192-ctr",      16, 24,    0, 0, EVP_aes_192_ctr},      // RFC4344
+	{SSH2_CIPHER_AES256_CTR,      "aes256-ctr",      16, 32,    0, 0, EVP_aes_256_ctr},      // RFC4344
+	{SSH2_CIPHER_ARCFOUR,         "arcfour",          8, 16,    0, 0, EVP_rc4},              // RFC4253
+	{SSH2_CIPHER_ARCFOUR128,      "arcfour128",       8, 16, 1536, 0, EVP_rc4},              // RFC4345
+	{SSH2_CIPHER_ARCFOUR256,      "arcfour256",       8, 32, 1536, 0, EVP_rc4},              // RFC4345
+	{SSH2_CIPHER_CAST128_CBC,     "cast128-cbc",      8, 16,    0, 0, EVP_cast5_cbc},        // RFC4253
+	{SSH2_CIPHER_3DES_CTR,        "3des-ctr",         8, 24,    0, 0, evp_des3_ctr},         // RFC4344
+	{SSH2_CIPHER_BLOWFISH_CTR,    "blowfish-ctr",     8, 16,    0, 0, evp_bf_ctr},           // RFC4344
+	{SSH2_CIPHER_CAST128_CTR,     "cast128-ctr",      8, 16,    0, 0, evp_cast5_ctr},        // RFC4344
+	{SSH2_CIPHER_CAMELLIA128_CBC, "camellia128-cbc", 16, 16,    0, 0, EVP_camellia_128_cbc}, // draft-kanno-secsh-camellia-02
+	{SSH2_CIPHER_CAMELLIA192_CBC, "camellia192-cbc", 16, 24,    0, 0, EVP_camellia_192_cbc}, // draft-kanno-secsh-camellia-02
+	{SSH2_CIPHER_CAMELLIA256_CBC, "camellia256-cbc", 16, 32,    0, 0, EVP_camellia_256_cbc}, // draft-kanno-secsh-camellia-02
+	{SSH2_CIPHER_CAMELLIA128_CTR, "camellia128-ctr", 16, 16,    0, 0, evp_camellia_128_ctr}, // draft-kanno-secsh-camellia-02
+	{SSH2_CIPHER_CAMELLIA192_CTR, "camellia192-ctr", 16, 24,    0, 0, evp_camellia_128_ctr}, // draft-kanno-secsh-camellia-02
+	{SSH2_CIPHER_CAMELLIA256_CTR, "camellia256-ctr", 16, 32,    0, 0, evp_camellia_128_ctr}, // draft-kanno-secsh-camellia-02
+	{SSH2_CIPHER_AES128_GCM,      "aes128-gcm@openssh.com",        16, 16, 0, 16, EVP_aes_128_gcm}, // RFC5647
+	{SSH2_CIPHER_AES256_GCM,      "aes256-gcm@openssh.com",        16, 32, 0, 16, EVP_aes_256_gcm}, // RFC5647
+	{SSH2_CIPHER_CHACHAPOLY,      "chacha20-poly1305@openssh.com",  8, 64, 0, 16, EVP_enc_null},
 #ifdef WITH_CAMELLIA_PRIVATE
-	{SSH2_CIPHER_CAMELLIA128_CBC, "camellia128-cbc@openssh.org", 16, 16, 0, EVP_camellia_128_cbc},
-	{SSH2_CIPHER_CAMELLIA192_CBC, "camellia192-cbc@openssh.org", 16, 24, 0, EVP_camellia_192_cbc},
-	{SSH2_CIPHER_CAMELLIA256_CBC, "camellia256-cbc@openssh.org", 16, 32, 0, EVP_camellia_256_cbc},
-	{SSH2_CIPHER_CAMELLIA128_CTR, "camellia128-ctr@openssh.org", 16, 16, 0, evp_camellia_128_ctr},
-	{SSH2_CIPHER_CAMELLIA192_CTR, "camellia192-ctr@openssh.org", 16, 24, 0, evp_camellia_128_ctr},
-	{SSH2_CIPHER_CAMELLIA256_CTR, "camellia256-ctr@openssh.org", 16, 32, 0, evp_camellia_128_ctr},
+	{SSH2_CIPHER_CAMELLIA128_CBC, "camellia128-cbc@openssh.org", 16, 16, 0, 0, EVP_camellia_128_cbc},
+	{SSH2_CIPHER_CAMELLIA192_CBC, "camellia192-cbc@openssh.org", 16, 24, 0, 0, EVP_camellia_192_cbc},
+	{SSH2_CIPHER_CAMELLIA256_CBC, "camellia256-cbc@openssh.org", 16, 32, 0, 0, EVP_camellia_256_cbc},
+	{SSH2_CIPHER_CAMELLIA128_CTR, "camellia128-ctr@openssh.org", 16, 16, 0, 0, evp_camellia_128_ctr},
+	{SSH2_CIPHER_CAMELLIA192_CTR, "camellia192-ctr@openssh.org", 16, 24, 0, 0, evp_camellia_128_ctr},
+	{SSH2_CIPHER_CAMELLIA256_CTR, "camellia256-ctr@openssh.org", 16, 32, 0, 0, evp_camellia_128_ctr},
 #endif // WITH_CAMELLIA_PRIVATE
-	{SSH_CIPHER_NONE,          NULL,            0,  0, 0,    NULL},
+	{SSH_CIPHER_NONE,          NULL,            0,  0, 0, 0, NULL},
 };
 
 
@@ -390,6 +408,8 @@ typedef enum {
 	KEX_ECDH_SHA2_256,
 	KEX_ECDH_SHA2_384,
 	KEX_ECDH_SHA2_521,
+	KEX_CURVE25519_SHA256,
+	KEX_CURVE25519_SHA256_LIBSSH,
 	KEX_DH_UNKNOWN,
 	KEX_DH_MAX = KEX_DH_UNKNOWN,
 } kex_algorithm;
@@ -408,9 +428,14 @@ static ssh2_kex_algorithm_t ssh2_kex_algorithms[] = {
 	{KEX_ECDH_SHA2_256, "ecdh-sha2-nistp256",                   EVP_sha256}, // RFC5656
 	{KEX_ECDH_SHA2_384, "ecdh-sha2-nistp384",                   EVP_sha384}, // RFC5656
 	{KEX_ECDH_SHA2_521, "ecdh-sha2-nistp521",                   EVP_sha512}, // RFC5656
+	{KEX_CURVE25519_SHA256, "curve25519-sha256",                EVP_sha256}, // RFC8731
+	{KEX_CURVE25519_SHA256_LIBSSH, "curve25519-sha256@libssh.org", EVP_sha256},
 	{KEX_DH_NONE      , NULL,                                   NULL},
 };
 
+// curve25519-sha256 ̌ƋL閧̒
+#define CURVE25519_SIZE 32
+
 
 typedef enum {
 	HMAC_NONE,      /* disabled line */
@@ -423,6 +448,8 @@ typedef enum {
 	HMAC_SHA2_256_96,
 	HMAC_SHA2_512,
 	HMAC_SHA2_512_96,
+	HMAC_SHA2_256_EtM,
+	HMAC_SHA2_512_EtM,
 	HMAC_UNKNOWN,
 	HMAC_MAX = HMAC_UNKNOWN,
 } hmac_type;
@@ -432,19 +459,22 @@ typedef struct ssh2_mac {
 	char *name;
 	const EVP_MD *(*evp_md)(void);
 	int truncatebits;
+	int etm;
 } ssh2_mac_t;
 
 static ssh2_mac_t ssh2_macs[] = {
-	{HMAC_SHA1,        "hmac-sha1",                  EVP_sha1,      0},  // RFC4253
-	{HMAC_MD5,         "hmac-md5",                   EVP_md5,       0},  // RFC4253
-	{HMAC_SHA1_96,     "hmac-sha1-96",               EVP_sha1,      96}, // RFC4253
-	{HMAC_MD5_96,      "hmac-md5-96",                EVP_md5,       96}, // RFC4253
-	{HMAC_RIPEMD160,   "hmac-ripemd160@openssh.com", EVP_ripemd160, 0},
-	{HMAC_SHA2_256,    "hmac-sha2-256",              EVP_sha256,    0},  // RFC6668
-//	{HMAC_SHA2_256_96, "hmac-sha2-256-96",           EVP_sha256,    96}, // draft-dbider-sha2-mac-for-ssh-05, deleted at 06
-	{HMAC_SHA2_512,    "hmac-sha2-512",              EVP_sha512,    0},  // RFC6668
-//	{HMAC_SHA2_512_96, "hmac-sha2-512-96",           EVP_sha512,    96}, // draft-dbider-sha2-mac-for-ssh-05, deleted at 06
-	{HMAC_NONE,        NULL,                         NULL,          0},
+	{HMAC_SHA1,         "hmac-sha1",                     EVP_sha1,      0,  0}, // RFC4253
+	{HMAC_MD5,          "hmac-md5",                      EVP_md5,       0,  0}, // RFC4253
+	{HMAC_SHA1_96,      "hmac-sha1-96",                  EVP_sha1,      96, 0}, // RFC4253
+	{HMAC_MD5_96,       "hmac-md5-96",                   EVP_md5,       96, 0}, // RFC4253
+	{HMAC_RIPEMD160,    "hmac-ripemd160@openssh.com",    EVP_ripemd160, 0,  0},
+	{HMAC_SHA2_256,     "hmac-sha2-256",                 EVP_sha256,    0,  0}, // RFC6668
+//	{HMAC_SHA2_256_96,  "hmac-sha2-256-96",              EVP_sha256,    96, 0}, // draft-dbider-sha2-mac-for-ssh-05, deleted at 06
+	{HMAC_SHA2_512,     "hmac-sha2-512",                 EVP_sha512,    0,  0}, // RFC6668
+//	{HMAC_SHA2_512_96,  "hmac-sha2-512-96",              EVP_sha512,    96, 0}, // draft-dbider-sha2-mac-for-ssh-05, deleted at 06
+	{HMAC_SHA2_256_EtM, "hmac-sha2-256-etm@openssh.com", EVP_sha256,    0,  1},
+	{HMAC_SHA2_512_EtM, "hmac-sha2-512-etm@openssh.com", EVP_sha512,    0,  1},
+	{HMAC_NONE,         NULL,                            NULL,          0,  0},
 };
 
 
@@ -453,6 +483,7 @@ typedef enum {
 	COMP_NOCOMP,
 	COMP_ZLIB,
 	COMP_DELAYED,
+	COMP_ZSTD,
 	COMP_UNKNOWN,
 	COMP_MAX = COMP_UNKNOWN,
 } compression_type;
@@ -466,6 +497,7 @@ static ssh2_comp_t ssh2_comps[] = {
 	{COMP_NOCOMP,  "none"},             // RFC4253
 	{COMP_ZLIB,    "zlib"},             // RFC4253
 	{COMP_DELAYED, "zlib@openssh.com"},
+	{COMP_ZSTD,    "zstd@ttssh2.osdn.jp"}, // xpPbgk (zlib@openssh.com ƓF،ɊJn)
 	{COMP_NONE,    NULL},
 };
 
@@ -475,6 +507,7 @@ struct Enc {
 	u_char          *iv;
 	unsigned int    key_len;
 	unsigned int    block_size;
+	unsigned int    auth_len;
 };
 
 struct Mac {
@@ -484,6 +517,7 @@ struct Mac {
 	int             mac_len; 
 	u_char          *key;
 	int             key_len;
+	int             etm;
 };
 
 struct Comp {
@@ -544,6 +578,30 @@ enum scp_dir {
 	TOREMOTE, FROMREMOTE,
 };
 
+// SCP]L[
+// t@CSCP]́At@CƂɃ`lJ1SSHڑ
+// ɍsBɓ]̂ ScpParallel {܂łƂAc͑҂s
+// ĂāA`l邽тɎ̃t@CJnB
+typedef struct scp_job {
+	enum scp_dir dir;
+	char src[MAX_PATH];
+	char dst[MAX_PATH];
+	struct scp_job *next;
+} scp_job_t;
+
+typedef struct {
+	scp_job_t *head;
+	scp_job_t *tail;
+	int running;            // ]̃`l
+	BOOL start_posted;      // ̃t@C̊JnbZ[Wň˗ς
+	// SXg[킹i
+	int batch_files;        // ]t@C
+	int batch_done;         // It@C
+	long long batch_size;   // Ă͈͂̍vTCY
+	long long batch_xfer;   // ]ς݂̃TCY
+	int batch_rate;
+} SSHScpQueue;
+
 /* The packet handler returns TRUE to keep the handler in place,
    FALSE to remove the handler. */
 typedef BOOL (* SSHPacketHandler)(PTInstVar pvar);
@@ -559,6 +617,31 @@ struct _SSHPacketHandlerItem {
 	int active_for_message;
 };
 
+// Kk̏ (SSH2  zlib  zstd ̈k)
+// ʂ𑗐M邲ƂɈkEk̎ԁEMɊ|ԂׁA
+// kɍȂƂ̓x邩AXgAhubNő(oCpX)B
+// zstd ̃oCpX́Ał()xőB
+typedef struct {
+	int level;             // Ɏgkx (0 ȂoCpX)
+	int deflate_level;     // kXg[ɐݒς݂̃x
+	unsigned long in;      // v̑ł̈kOoCg
+	unsigned long out;     // AkoCg
+	LONGLONG comp_time;    // AkɊ| (ptH[}XJE^l)
+	LONGLONG send_time;    // A\PbgMɊ|
+	double bypass_rate;    // oCpXJnȎM[g (oCg/JE^l)
+	int bypass_windows;    // oCpX𑱂̐
+} SSHAdaptiveComp;
+
+// ̌̐s
+// T[oւ TCP ڑ҂ԂɁANCAg̗D揇ʂōŏ̌z肵
+// ĂBۂɌ܂ƈvƂAŏ̌ŎgB
+typedef struct {
+	kex_algorithm kex_type;
+	int we_need;           // DH ̔閧̒߂̂Ɏgl
+	DH *dh;
+	EC_KEY *ecdh;
+} SSHKexPrefetch;
+
 typedef struct {
 	char FAR * hostname;
 
@@ -594,9 +677,18 @@ typedef struct {
 
 	z_stream compress_stream;
 	z_stream decompress_stream;
+	ZSTD_CStream *zstd_compress_stream;
+	ZSTD_DStream *zstd_decompress_stream;
+	unsigned long zstd_compress_in;
+	unsigned long zstd_compress_out;
+	unsigned long zstd_decompress_in;
+	unsigned long zstd_decompress_out;
 	BOOL compressing;
 	BOOL decompressing;
 	int compression_level;
+	SSHAdaptiveComp adaptive_comp;
+	SSHKexPrefetch kex_prefetch;
+	SSHScpQueue scp_queue;
 
 	SSHPacketHandlerItem FAR * packet_handlers[256];
 	int status_flags;
@@ -639,11 +731,14 @@ void SSH_end(PTInstVar pvar);
 void SSH_get_server_ID_info(PTInstVar pvar, char FAR * dest, int len);
 void SSH_get_protocol_version_info(PTInstVar pvar, char FAR * dest, int len);
 void SSH_get_compression_info(PTInstVar pvar, char FAR * dest, int len);
+void SSH_get_channel_info(PTInstVar pvar, char FAR * dest, int len);
 
 /* len must be <= SSH_MAX_SEND_PACKET_SIZE */
 void SSH_channel_send(PTInstVar pvar, int channel_num,
                       uint32 remote_channel_num,
                       unsigned char FAR * buf, int len, int retry);
+/* TRUE if data written to the channel is being queued and the caller should stop reading */
+BOOL SSH_channel_is_congested(PTInstVar pvar, int channel_num);
 void SSH_fail_channel_open(PTInstVar pvar, uint32 remote_channel_num);
 void SSH_confirm_channel_open(PTInstVar pvar, uint32 remote_channel_num, uint32 local_channel_num);
 void SSH_channel_output_eof(PTInstVar pvar, uint32 remote_channel_num);
@@ -667,6 +762,7 @@ int SSH_get_min_packet_size(PTInstVar pvar);
 /* data is guaranteed to be at least SSH_get_min_packet_size bytes long
    at least 5 bytes must be decrypted */
 void SSH_predecrpyt_packet(PTInstVar pvar, char FAR * data);
+uint32 SSH_get_packet_length(PTInstVar pvar, char FAR * data);
 int SSH_get_clear_MAC_size(PTInstVar pvar);
 
 #define SSH_is_any_payload(pvar) ((pvar)->ssh_state.payload_datalen > 0)
@@ -686,15 +782,17 @@ const EVP_MD* get_kex_algorithm_EVP_MD(kex_algorithm kextype);
 char* get_ssh2_mac_name(hmac_type type);
 const EVP_MD* get_ssh2_mac_EVP_MD(hmac_type type);
 int get_ssh2_mac_truncatebits(hmac_type type);
+int get_ssh2_mac_etm(hmac_type type);
 char* get_ssh2_comp_name(compression_type type);
 char* get_ssh_keytype_name(ssh_keytype type);
 int get_cipher_discard_len(SSHCipher cipher);
+int get_cipher_auth_len(SSHCipher cipher);
 void ssh_heartbeat_lock_initialize(void);
 void ssh_heartbeat_lock_finalize(void);
 void ssh_heartbeat_lock(void);
 void ssh_heartbeat_unlock(void);
 void halt_ssh_heartbeat_thread(PTInstVar pvar);
-void ssh2_channel_free(void);
+void ssh2_channel_free(PTInstVar pvar);
 BOOL handle_SSH2_userauth_inforeq(PTInstVar pvar);
 BOOL handle_SSH2_userauth_passwd_changereq(PTInstVar pvar);
 void SSH2_update_compression_myproposal(PTInstVar pvar);
@@ -702,6 +800,7 @@ void SSH2_update_cipher_myproposal(PTInstVar pvar);
 void SSH2_update_kex_myproposal(PTInstVar pvar);
 void SSH2_update_host_key_myproposal(PTInstVar pvar);
 void SSH2_update_hmac_myproposal(PTInstVar pvar);
+void SSH2_prefetch_kex_key(PTInstVar pvar);
 int SSH_notify_break_signal(PTInstVar pvar);
 
 ///
@@ -726,11 +825,26 @@ typedef struct scp {
 	HANDLE thread;
 	unsigned int thread_id;
 	PTInstVar pvar;
+	int job;                       // ]L[Jn]
+	HANDLE window_event;           // M\ɂȂ(WINDOW_ADJUSTMȂ)VOiԂɂȂ
+	// for sending file
+	long long filesendsize;
+	// for progress window
+	DWORD progress_start;
+	DWORD progress_tick;
+	int progress_rate;
 	// for receiving file
 	long long filetotalsize;
 	long long filercvsize;
 	DWORD filemtime;
 	DWORD fileatime;
+	CRITICAL_SECTION write_lock;   // ݃L[̔r
+	HANDLE write_event;            // ރubNłVOiԂɂȂ
+	struct scp_write_block *write_head;
+	struct scp_write_block *write_tail;
+	unsigned int write_queued;     // ܂fBXN֏ĂȂf[^
+	int write_eof;                 // t@C̍Ō܂ŃL[ɐς
+	int write_error;               // fBXNւ݂̏ɎsƂ errno
 } scp_t;
 
 enum sftp_state {
@@ -752,6 +866,9 @@ typedef struct sftp {
 	unsigned long long limit_kbps;
 	//struct bwlimit bwlimit_in, bwlimit_out;
 	char path[1024];
+	char pwd[1024];               // remote working directory
+	buffer_t *recvbuf;            // CHANNEL_DATAɂ܂郁bZ[W̑gݗėp
+	struct sftp_xfer *xfer;       // s̃R}h
 } sftp_t;
 
 typedef struct channel {
@@ -761,23 +878,47 @@ typedef struct channel {
 	unsigned int local_window;
 	unsigned int local_window_max;
 	unsigned int local_consumed;
+	// Mwindowp
+	DWORD open_tick;            // CHANNEL_OPEN 𑗂
+	DWORD window_adjust_tick;   // O WINDOW_ADJUST 𑗂
+	unsigned int recv_rate;     // ߂̎M[g(bytes/s)
 	unsigned int local_maxpacket;
 	unsigned int remote_window;
 	unsigned int remote_maxpacket;
 	enum channel_type type;
 	int local_num;
 	bufchain_t *bufchain;
+	bufchain_t *bufchain_tail;
+	unsigned int bufchain_amount;
+	// remote_window 肸ɑM҂ɂȂ񐔂Ǝ(ms)
+	DWORD window_stall_start;
+	DWORD window_stall_total;
+	unsigned int window_stall_count;
 	scp_t scp;
 	buffer_t *agent_msg;
 	int agent_request_len;
 	sftp_t sftp;
+	int mux_num;                // ControlMaster: 肵ĂEBhE̔ԍB-1 Ȃ؂藣ς
 #define SSH_CHANNEL_STATE_CLOSE_SENT 0x00000001
+#define SSH_CHANNEL_STATE_EOF_PENDING    0x00000002  // M҂L[󂢂 EOF 𑗂
+#define SSH_CHANNEL_STATE_CLOSE_PENDING  0x00000004  // M҂L[󂢂 CLOSE 𑗂
+#define SSH_CHANNEL_STATE_DELETE_PENDING 0x00000008  // CLOSE 𑗂`l
 	unsigned int state;
 } Channel_t;
 
 unsigned char FAR *begin_send_packet(PTInstVar pvar, int type, int len);
 void finish_send_packet_special(PTInstVar pvar, int skip_compress);
 void SSH2_send_channel_data(PTInstVar pvar, Channel_t *c, unsigned char FAR * buf, unsigned int buflen, int retry);
+void ssh2_channel_send_close(PTInstVar pvar, Channel_t *c);
+
+/* ControlMaster: 肵ĂEBhẼZbV`l */
+int SSH2_mux_open_channel(PTInstVar pvar, int client_num);
+void SSH2_mux_start_session(PTInstVar pvar, int channel_id, char FAR * term, int cols, int rows);
+void SSH2_mux_send(PTInstVar pvar, int channel_id, unsigned char FAR * buf, int len);
+void SSH2_mux_notify_win_size(PTInstVar pvar, int channel_id, int cols, int rows);
+BOOL SSH2_mux_is_congested(PTInstVar pvar, int channel_id);
+void SSH2_mux_resume_window(PTInstVar pvar, int channel_id);
+void SSH2_mux_close(PTInstVar pvar, int channel_id);
 
 #define finish_send_packet(pvar) finish_send_packet_special((pvar), 0)
 #define get_payload_uint32(pvar, offset) get_uint32_MSBfirst((pvar)->ssh_state.payload + (offset))
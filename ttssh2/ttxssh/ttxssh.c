@@ -47,6 +47,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <time.h>
+#include <limits.h>
 #include <mbstring.h>
 
 #include "resource.h"
@@ -137,6 +138,7 @@ static void init_TTSSH(PTInstVar pvar)
 	HOSTS_init(pvar);
 	FWD_init(pvar);
 	FWDUI_init(pvar);
+	MUX_init(pvar);
 
 	ssh_heartbeat_lock_initialize();
 }
@@ -145,7 +147,7 @@ static void uninit_TTSSH(PTInstVar pvar)
 {
 	halt_ssh_heartbeat_thread(pvar);
 
-	ssh2_channel_free();
+	ssh2_channel_free(pvar);
 
 	SSH_end(pvar);
 	PKT_end(pvar);
@@ -154,6 +156,7 @@ static void uninit_TTSSH(PTInstVar pvar)
 	HOSTS_end(pvar);
 	FWD_end(pvar);
 	FWDUI_end(pvar);
+	MUX_end(pvar);
 
 	if (pvar->OldLargeIcon != NULL) {
 		PostMessage(pvar->NotificationWindow, WM_SETICON, ICON_BIG,
@@ -266,6 +269,9 @@ static void normalize_cipher_order(char FAR * buf)
 #else
 	// for SSH2(yutaka)
 	static char default_strings[] = {
+		SSH2_CIPHER_AES256_GCM,
+		SSH2_CIPHER_AES128_GCM,
+		SSH2_CIPHER_CHACHAPOLY,
 		SSH2_CIPHER_CAMELLIA256_CTR,
 		SSH2_CIPHER_AES256_CTR,
 		SSH2_CIPHER_CAMELLIA256_CBC,
@@ -301,6 +307,8 @@ static void normalize_cipher_order(char FAR * buf)
 static void normalize_kex_order(char FAR * buf)
 {
 	static char default_strings[] = {
+		KEX_CURVE25519_SHA256,
+		KEX_CURVE25519_SHA256_LIBSSH,
 		KEX_ECDH_SHA2_256,
 		KEX_ECDH_SHA2_384,
 		KEX_ECDH_SHA2_521,
@@ -332,6 +340,8 @@ static void normalize_host_key_order(char FAR * buf)
 static void normalize_mac_order(char FAR * buf)
 {
 	static char default_strings[] = {
+		HMAC_SHA2_512_EtM,
+		HMAC_SHA2_256_EtM,
 		HMAC_SHA2_512,
 		HMAC_SHA2_256,
 		HMAC_SHA1,
@@ -350,6 +360,7 @@ static void normalize_mac_order(char FAR * buf)
 static void normalize_comp_order(char FAR * buf)
 {
 	static char default_strings[] = {
+		COMP_ZSTD,
 		COMP_DELAYED,
 		COMP_ZLIB,
 		COMP_NOCOMP,
@@ -510,6 +521,34 @@ static void read_ssh_options(PTInstVar pvar, PCHAR fileName)
 
 	settings->GexMinimalGroupSize = GetPrivateProfileInt("TTSSH", "GexMinimalGroupSize", 0, fileName);
 
+	settings->ChannelWindowMax = GetPrivateProfileInt("TTSSH", "ChannelWindowMax", 16384, fileName);
+	if (settings->ChannelWindowMax < 0)
+		settings->ChannelWindowMax = 0;
+
+	settings->ScpParallel = GetPrivateProfileInt("TTSSH", "ScpParallel", 4, fileName);
+	if (settings->ScpParallel < 1)
+		settings->ScpParallel = 1;
+
+	settings->ScpFsync = GetPrivateProfileInt("TTSSH", "ScpFsync", 0, fileName);
+	if (settings->ScpFsync < 0 || settings->ScpFsync > 2)
+		settings->ScpFsync = 0;
+
+	settings->AdaptiveCompression = GetPrivateProfileInt("TTSSH", "AdaptiveCompression", 1, fileName);
+
+	settings->ControlMaster = GetPrivateProfileInt("TTSSH", "ControlMaster", MUX_CONTROL_NO, fileName);
+	if (settings->ControlMaster != MUX_CONTROL_AUTO)
+		settings->ControlMaster = MUX_CONTROL_NO;
+
+	settings->HostKeyCacheLifetime = GetPrivateProfileInt("TTSSH", "HostKeyCacheLifetime", 300, fileName);
+	if (settings->HostKeyCacheLifetime < 0)
+		settings->HostKeyCacheLifetime = 0;
+
+	settings->PrivateKeyCacheLifetime = GetPrivateProfileInt("TTSSH", "PrivateKeyCacheLifetime", 0, fileName);
+	// -1 菬lA~bɂ int Ɏ܂Ȃl͖Ƃ
+	if (settings->PrivateKeyCacheLifetime < -1 ||
+	    settings->PrivateKeyCacheLifetime > INT_MAX / 1000)
+		settings->PrivateKeyCacheLifetime = 0;
+
 	clear_local_settings(pvar);
 }
 
@@ -622,6 +661,28 @@ static void write_ssh_options(PTInstVar pvar, PCHAR fileName,
 
 	_itoa_s(settings->GexMinimalGroupSize, buf, sizeof(buf), 10);
 	WritePrivateProfileString("TTSSH", "GexMinimalGroupSize", buf, fileName);
+
+	_itoa_s(settings->ChannelWindowMax, buf, sizeof(buf), 10);
+	WritePrivateProfileString("TTSSH", "ChannelWindowMax", buf, fileName);
+
+	_itoa_s(settings->ScpParallel, buf, sizeof(buf), 10);
+	WritePrivateProfileString("TTSSH", "ScpParallel", buf, fileName);
+
+	_itoa_s(settings->ScpFsync, buf, sizeof(buf), 10);
+	WritePrivateProfileString("TTSSH", "ScpFsync", buf, fileName);
+
+	WritePrivateProfileString("TTSSH", "AdaptiveCompression",
+	    settings->AdaptiveCompression ? "1" : "0",
+	    fileName);
+
+	_itoa_s(settings->ControlMaster, buf, sizeof(buf), 10);
+	WritePrivateProfileString("TTSSH", "ControlMaster", buf, fileName);
+
+	_itoa_s(settings->HostKeyCacheLifetime, buf, sizeof(buf), 10);
+	WritePrivateProfileString("TTSSH", "HostKeyCacheLifetime", buf, fileName);
+
+	_itoa_s(settings->PrivateKeyCacheLifetime, buf, sizeof(buf), 10);
+	WritePrivateProfileString("TTSSH", "PrivateKeyCacheLifetime", buf, fileName);
 }
 
 
@@ -724,6 +785,8 @@ static int PASCAL FAR TTXconnect(SOCKET s,
                                  const struct sockaddr FAR * name,
                                  int namelen)
 {
+	int result;
+
 #ifndef NO_INET6
 	if (pvar->socket == INVALID_SOCKET || pvar->socket != s) {
 		struct sockaddr_storage ss;
@@ -731,6 +794,11 @@ static int PASCAL FAR TTXconnect(SOCKET s,
 
 		pvar->socket = s;
 
+		// ڑւSSHڑ̃EBhEɂ΁AT[oł͂Ȃ֐ڑ
+		if (MUX_find_master(pvar, name->sa_family, &ss, &len)) {
+			return (pvar->Pconnect) (s, (struct sockaddr FAR *) &ss, len);
+		}
+
 		memset(&ss, 0, sizeof(ss));
 		switch (pvar->ts->ProtocolFamily) {
 		case AF_INET:
@@ -775,7 +843,12 @@ static int PASCAL FAR TTXconnect(SOCKET s,
 	}
 #endif							/* NO_INET6 */
 
-	return (pvar->Pconnect) (s, name, namelen);
+	result = (pvar->Pconnect) (s, name, namelen);
+
+	// TCP̐ڑm̂҂ԂɁAŎgĂ
+	SSH2_prefetch_kex_key(pvar);
+
+	return result;
 }
 
 static int PASCAL FAR TTXWSAAsyncSelect(SOCKET s, HWND hWnd, u_int wMsg,
@@ -785,6 +858,19 @@ static int PASCAL FAR TTXWSAAsyncSelect(SOCKET s, HWND hWnd, u_int wMsg,
 		pvar->notification_events = lEvent;
 		pvar->notification_msg = wMsg;
 
+		// 肵Ăꍇ́AF؂Ȃ
+		if (pvar->mux_state.slave) {
+			int ret;
+
+			pvar->NotificationWindow = hWnd;
+			ret = MUX_slave_async_select(pvar, s, hWnd, wMsg, lEvent);
+			// ڑmĎMn߂A}X^[ɃZbVJĂ炤
+			if (ret != SOCKET_ERROR && (lEvent & FD_READ)) {
+				MUX_slave_connected(pvar);
+			}
+			return ret;
+		}
+
 		if (pvar->NotificationWindow == NULL) {
 			pvar->NotificationWindow = hWnd;
 			AUTH_advance_to_next_cred(pvar);
@@ -799,6 +885,11 @@ static int PASCAL FAR TTXrecv(SOCKET s, char FAR * buf, int len, int flags)
 	if (s == pvar->socket) {
 		int ret;
 
+		// 肵Ăꍇ́A}X^[T[ȍo͂̂܂ܗĂ
+		if (pvar->mux_state.slave) {
+			return MUX_slave_recv(pvar, buf, len, flags);
+		}
+
 		ssh_heartbeat_lock();
 		ret = PKT_recv(pvar, buf, len);
 		ssh_heartbeat_unlock();
@@ -813,6 +904,11 @@ static int PASCAL FAR TTXsend(SOCKET s, char const FAR * buf, int len,
                               int flags)
 {
 	if (s == pvar->socket) {
+		if (pvar->mux_state.slave) {
+			MUX_slave_send(pvar, buf, len);
+			return len;
+		}
+
 		ssh_heartbeat_lock();
 		SSH_send(pvar, buf, len);
 		ssh_heartbeat_unlock();
@@ -2470,7 +2566,11 @@ static void PASCAL FAR TTXGetSetupHooks(TTXSetupHooks FAR * hooks)
 
 static void PASCAL FAR TTXSetWinSize(int rows, int cols)
 {
-	SSH_notify_win_size(pvar, cols, rows);
+	if (pvar->mux_state.slave) {
+		MUX_slave_notify_win_size(pvar, cols, rows);
+	} else {
+		SSH_notify_win_size(pvar, cols, rows);
+	}
 }
 
 static void insertMenuBeforeItem(HMENU menu, WORD beforeItemID, WORD flags,
@@ -2535,6 +2635,11 @@ static void PASCAL FAR TTXModifyMenu(HMENU menu)
 	insertMenuBeforeItem(menu, 50360, MF_ENABLED, ID_SSHFWDSETUPMENU, pvar->ts->UIMsg);
 	UTIL_get_lang_msg("MENU_SSH_KEYGEN", pvar, "SSH KeyGe&nerator...");
 	insertMenuBeforeItem(menu, 50360, MF_ENABLED, ID_SSHKEYGENMENU, pvar->ts->UIMsg);
+	/* 閧oݒ̂Ƃ */
+	if (pvar->settings.PrivateKeyCacheLifetime != 0) {
+		UTIL_get_lang_msg("MENU_SSH_FORGETKEYS", pvar, "Forget Cached SSH Private &Keys");
+		insertMenuBeforeItem(menu, 50360, MF_ENABLED, ID_SSHFORGETKEYSMENU, pvar->ts->UIMsg);
+	}
 
 	/* inserts before ID_FILE_CHANGEDIR */
 	UTIL_get_lang_msg("MENU_SSH_SCP", pvar, "SS&H SCP...");
@@ -2721,13 +2826,18 @@ static void init_about_dlg(PTInstVar pvar, HWND dlg)
 			append_about_text(dlg, pvar->ts->UIMsg, buf);
 
 			SSH_get_compression_info(pvar, buf, sizeof(buf));
-			if (pvar->ctos_compression == COMP_DELAYED) { // xpPbgk̏ꍇ (2006.6.23 yutaka)
+			if (pvar->ctos_compression == COMP_DELAYED ||
+			    pvar->ctos_compression == COMP_ZSTD) { // xpPbgk̏ꍇ (2006.6.23 yutaka)
 				UTIL_get_lang_msg("DLG_ABOUT_COMPDELAY", pvar, "Delayed Compression:");
 				append_about_text(dlg, pvar->ts->UIMsg, buf);
 			} else {
 				UTIL_get_lang_msg("DLG_ABOUT_COMP", pvar, "Compression:");
 				append_about_text(dlg, pvar->ts->UIMsg, buf);
 			}
+
+			SSH_get_channel_info(pvar, buf, sizeof(buf));
+			UTIL_get_lang_msg("DLG_ABOUT_CHANNELS", pvar, "Channels:");
+			append_about_text(dlg, pvar->ts->UIMsg, buf);
 		}
 
 		// zXgJfingerprint\B
@@ -2951,6 +3061,12 @@ static char FAR *get_cipher_name(int cipher)
 		return "Camellia192-CTR(SSH2)";
 	case SSH2_CIPHER_CAMELLIA256_CTR:
 		return "Camellia256-CTR(SSH2)";
+	case SSH2_CIPHER_AES128_GCM:
+		return "AES128-GCM(SSH2)";
+	case SSH2_CIPHER_AES256_GCM:
+		return "AES256-GCM(SSH2)";
+	case SSH2_CIPHER_CHACHAPOLY:
+		return "ChaCha20-Poly1305(SSH2)";
 
 	default:
 		return NULL;
@@ -4275,10 +4391,53 @@ int uuencode(unsigned char *src, int srclen, unsigned char *target, int targsize
 //
 // SCP dialog
 //
+
+// Mt@Cɕ̃t@Cw肷Ƃ́A"file1" "file2" ̂悤
+// _uNH[gň͂ŕׂB(t@C " ͎gȂ)
+static void scp_append_sendfile(char *list, size_t listlen, char *file, int multi)
+{
+	if (!multi) {
+		strncpy_s(list, listlen, file, _TRUNCATE);
+		return;
+	}
+	if (list[0] != '\0') {
+		strncat_s(list, listlen, " ", _TRUNCATE);
+	}
+	strncat_s(list, listlen, "\"", _TRUNCATE);
+	strncat_s(list, listlen, file, _TRUNCATE);
+	strncat_s(list, listlen, "\"", _TRUNCATE);
+}
+
+// Mt@C̃t@CׂSCP]L[֓
+static void scp_start_sendfiles(PTInstVar pvar, char *list, char *dstdir)
+{
+	char file[MAX_PATH];
+	char *p = list, *q;
+	size_t len;
+
+	if (strchr(list, '"') == NULL) {
+		SSH_start_scp(pvar, list, dstdir);
+		return;
+	}
+
+	while ((p = strchr(p, '"')) != NULL) {
+		p++;
+		q = strchr(p, '"');
+		len = (q != NULL) ? (size_t)(q - p) : strlen(p);
+		if (len > 0) {
+			strncpy_s(file, sizeof(file), p, min(len, sizeof(file) - 1));
+			SSH_start_scp(pvar, file, dstdir);
+		}
+		if (q == NULL)
+			break;
+		p = q + 1;
+	}
+}
+
 static BOOL CALLBACK TTXScpDialog(HWND dlg, UINT msg, WPARAM wParam,
                                      LPARAM lParam)
 {
-	static char sendfile[MAX_PATH] = "";
+	static char sendfile[MAX_PATH * 16] = "";
 	static char sendfiledir[MAX_PATH] = "";
 	static char recvdir[MAX_PATH] = "";
 	HWND hWnd;
@@ -4313,14 +4472,16 @@ static BOOL CALLBACK TTXScpDialog(HWND dlg, UINT msg, WPARAM wParam,
 		{
 		hDrop = (HDROP)wParam;
 		uFileNo = DragQueryFile((HDROP)wParam, 0xFFFFFFFF, NULL, 0);
+		sendfile[0] = '\0';
 		for(i = 0; i < (int)uFileNo; i++) {
 			DragQueryFile(hDrop, i, szFileName, sizeof(szFileName));
-
-			// update edit box
-			hWnd = GetDlgItem(dlg, IDC_SENDFILE_EDIT);
-			SendMessage(hWnd, WM_SETTEXT , 0, (LPARAM)szFileName);
+			scp_append_sendfile(sendfile, sizeof(sendfile), szFileName, uFileNo > 1);
 		}
 		DragFinish(hDrop);
+
+		// update edit box
+		hWnd = GetDlgItem(dlg, IDC_SENDFILE_EDIT);
+		SendMessage(hWnd, WM_SETTEXT , 0, (LPARAM)sendfile);
 		}
 		return TRUE;
 
@@ -4329,6 +4490,9 @@ static BOOL CALLBACK TTXScpDialog(HWND dlg, UINT msg, WPARAM wParam,
 		case IDC_SENDFILE_SELECT | (BN_CLICKED << 16):
 			{
 			OPENFILENAME ofn;
+			char files[MAX_PATH * 16] = "";
+			char path[MAX_PATH];
+			char *p;
 
 			ZeroMemory(&ofn, sizeof(ofn));
 			ofn.lStructSize = sizeof(OPENFILENAME);
@@ -4338,8 +4502,8 @@ static BOOL CALLBACK TTXScpDialog(HWND dlg, UINT msg, WPARAM wParam,
 			             "exe(*.exe)\\0*.exe\\0all(*.*)\\0*.*\\0\\0", ts.UILanguageFile);
 #endif
 			ofn.lpstrFilter = "all(*.*)\0*.*\0\0";
-			ofn.lpstrFile = sendfile;
-			ofn.nMaxFile = sizeof(sendfile);
+			ofn.lpstrFile = files;
+			ofn.nMaxFile = sizeof(files);
 #if 0
 			get_lang_msg("FILEDLG_SELECT_LOGVIEW_APP_TITLE", uimsg, sizeof(uimsg),
 			             "Choose a executing file with launching logging file", ts.UILanguageFile);
@@ -4351,8 +4515,19 @@ static BOOL CALLBACK TTXScpDialog(HWND dlg, UINT msg, WPARAM wParam,
 /* from commdlg.h */
 #define OFN_FORCESHOWHIDDEN          0x10000000
 #endif
-			ofn.Flags = OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST | OFN_FORCESHOWHIDDEN | OFN_HIDEREADONLY;
+			ofn.Flags = OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST | OFN_FORCESHOWHIDDEN | OFN_HIDEREADONLY |
+			            OFN_ALLOWMULTISELECT | OFN_EXPLORER;
 			if (GetOpenFileName(&ofn) != 0) {
+				if (ofn.nFileOffset > 0 && files[ofn.nFileOffset - 1] == '\0') {
+					// I "fBNg\0t@C1\0t@C2\0\0" ̌`ŕԂ
+					sendfile[0] = '\0';
+					for (p = files + ofn.nFileOffset; *p != '\0'; p += strlen(p) + 1) {
+						_snprintf_s(path, sizeof(path), _TRUNCATE, "%s\\%s", files, p);
+						scp_append_sendfile(sendfile, sizeof(sendfile), path, 1);
+					}
+				} else {
+					strncpy_s(sendfile, sizeof(sendfile), files, _TRUNCATE);
+				}
 				hWnd = GetDlgItem(dlg, IDC_SENDFILE_EDIT);
 				SendMessage(hWnd, WM_SETTEXT , 0, (LPARAM)sendfile);
 			}
@@ -4381,7 +4556,7 @@ static BOOL CALLBACK TTXScpDialog(HWND dlg, UINT msg, WPARAM wParam,
 				SendMessage(hWnd, WM_GETTEXT , sizeof(sendfiledir), (LPARAM)sendfiledir);
 				strncpy_s(pvar->ts->ScpSendDir, sizeof(pvar->ts->ScpSendDir), sendfiledir, _TRUNCATE);
 
-				SSH_start_scp(pvar, sendfile, sendfiledir);
+				scp_start_sendfiles(pvar, sendfile, sendfiledir);
 				//SSH_scp_transaction(pvar, "bigfile30.bin", "", FROMREMOTE);
 				EndDialog(dlg, 1); // dialog close
 				return TRUE;
@@ -4440,6 +4615,13 @@ __declspec(dllexport) int CALLBACK TTXScpReceivefile(char *remotefile, char *loc
 	return SSH_scp_transaction(pvar, remotefile, localfile, FROMREMOTE);
 }
 
+// }NR}h"sftpcmd"ĂяoBSFTPZbVȂΊJnB
+// R}hI notify ɌʂnB
+__declspec(dllexport) int CALLBACK TTXSftpCommand(char *cmdline, sftp_notify_t notify)
+{
+	return sftp_command(pvar, cmdline, notify);
+}
+
 
 // TTSSH̐ݒe(known hosts file)ԂB
 //
@@ -5524,6 +5706,11 @@ static int PASCAL FAR TTXProcessCommand(HWND hWin, WORD cmd)
 		}
 		return 1;
 
+	case ID_SSHFORGETKEYSMENU:
+		KEYFILES_forget_cached_keys();
+		notify_verbose_message(pvar, "Cached private keys were forgotten.", LOG_LEVEL_VERBOSE);
+		return 1;
+
 	case ID_ABOUTMENU:
 		if (DialogBoxParam(hInst, MAKEINTRESOURCE(IDD_ABOUTDIALOG),
 		                   hWin, TTXAboutDlg, (LPARAM) pvar) == -1) {
@@ -5795,6 +5982,9 @@ static void PASCAL FAR TTXEnd(void)
 {
 	uninit_TTSSH(pvar);
 
+	// oĂ閧
+	KEYFILES_forget_cached_keys();
+
 	if (pvar->err_msg != NULL) {
 		/* Could there be a buffer overrun bug anywhere in Win32
 		   MessageBox? Who knows? I'm paranoid. */
@@ -69,6 +69,7 @@ typedef struct _TInstVar FAR * PTInstVar;
 #include <openssl/ec.h>
 #include <openssl/evp.h>
 #include "buffer.h"
+#include "mux.h"
 
 /* tttypes.h Œ`Ă EM }N openssl/rsa.h (OpenSSL 0.9.8)̊֐vg^Cv錾
  * ƏdĂ܂̂ŁArhG[ƂȂBL3wb_includeʒuLɈړB
@@ -85,6 +86,7 @@ HANDLE hInst; /* Instance handle of TTXSSH.DLL */
 #define ID_SSHAUTHSETUPMENU 52320
 #define ID_SSHFWDSETUPMENU  52330
 #define ID_SSHKEYGENMENU    52340
+#define ID_SSHFORGETKEYSMENU 52350
 #define ID_ABOUTMENU        52910
 
 #define ID_SSHAUTH            62501
@@ -178,6 +180,20 @@ typedef struct _TS_SSH {
 	int UpdateHostkeys;
 
 	int GexMinimalGroupSize;
+
+	int ChannelWindowMax; // Mwindow̏(KB)B0Ȃ玩ȂB
+
+	int ScpParallel; // SCPœɓ]t@C
+
+	int ScpFsync; // SCPMt@CfBXN֏o_@ (0:Ȃ 1:t@CM 2:݂)
+
+	int AdaptiveCompression; // kɍȂƂɈkx/~߂
+
+	int ControlMaster; // ڑ̃EBhESSHڑL (MUX_CONTROL_*)
+
+	int HostKeyCacheLifetime; // known_hostsŊmFzXgJoĂ(b)B0ȂoȂB
+
+	int PrivateKeyCacheLifetime; // ǂݍ񂾔閧oĂ(b)B0ȂoȂB-1ȂI܂ŁB
 } TS_SSH;
 
 typedef struct _TInstVar {
@@ -223,6 +239,7 @@ typedef struct _TInstVar {
 	CRYPTState crypt_state;
 	HOSTSState hosts_state;
 	FWDState fwd_state;
+	MUXState mux_state;
 
 /* The settings applied to the current session. The user may change
    the settings but usually we don't want that to affect the session
@@ -280,6 +297,7 @@ typedef struct _TInstVar {
 	char ssh2_password[MAX_PATH];
 	char ssh2_keyfile[MAX_PATH];
 	time_t ssh_heartbeat_tick;
+	DWORD ssh2_rtt; // CHANNEL_OPEN  CONFIRMATION ܂ł̍ŏ(ms)B0͖B
 	HANDLE ssh_heartbeat_thread;
 	int keyboard_interactive_password_input;
 	int userauth_retry_count;
@@ -304,6 +322,8 @@ typedef struct _TInstVar {
 	BOOL nocheck_known_hosts;
 
 	EC_KEY *ecdh_client_key;
+	unsigned char curve25519_client_key[CURVE25519_SIZE];     // curve25519-sha256 ̔閧
+	unsigned char curve25519_client_pubkey[CURVE25519_SIZE];  // AJ
 
 	int dns_key_check;
 